@@ -47,6 +47,7 @@
 
 #include "mon_acpi.h"
 #include "mon_callback.h"
+#include "hw_pcpu.h"
 
 #define MON_DEADLOOP()          MON_DEADLOOP_LOG(MON_ACPI_PM_C)
 #define MON_ASSERT(__condition) MON_ASSERT_LOG(MON_ACPI_PM_C, __condition)
@@ -860,6 +861,9 @@ void CDECL mon_acpi_resume_after_s3_c_main(uint32_t cpu_id,
 	ept_guest_cpu_state_t *ept_guest_cpu = NULL;
 	const virtual_cpu_id_t *vcpu_id = NULL;
 
+	/* hw_cpu_id() is used by locks below, restore GS base first */
+	hw_pcpu_load((cpu_id_t)cpu_id);
+
 	g_s3_resume_flag = 1;
 	mon_debug_port_clear();
 	mon_io_init();
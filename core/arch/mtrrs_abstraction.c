@@ -19,6 +19,7 @@
 #include <common_libc.h>
 #include "mon_dbg.h"
 #include "address.h"
+#include "lock.h"
 #include "file_codes.h"
 
 #define MON_DEADLOOP()          MON_DEADLOOP_LOG(MTRRS_ABSTRACTION_C)
@@ -30,6 +31,13 @@
 #define MTRRS_ABS_NUM_OF_VAR_RANGE_MTRRS 10
 #define MTRRS_ABS_HIGH_ADDR_SHIFT 32
 #define MTRRS_ABS_ADDR_BASE_SHIFT 12
+#define MTRRS_ABS_FIXED_RANGES_END 0x100000
+
+/* every fixed sub-range, start and end of every variable range, 0 and
+ * the end of the fixed ranges */
+#define MTRRS_ABS_MAX_MAP_BOUNDS                                        \
+	(MTRRS_ABS_NUM_OF_FIXED_RANGE_MTRRS * MTRRS_ABS_NUM_OF_SUB_RANGES + \
+	 2 * MTRRS_ABS_NUM_OF_VAR_RANGE_MTRRS + 2)
 
 typedef union {
 	struct {
@@ -118,8 +126,28 @@ typedef struct {
 } mtrrs_abstraction_cached_info_t;
 
 static mtrrs_abstraction_cached_info_t mtrrs_cached_info;
-uint64_t remsize = 0;
-uint64_t mtrr_msbs = 0;
+static uint64_t mtrr_msbs = 0;
+
+/* Effective memory types precomputed from the cached MTRRs. Entry i covers
+ * [map[i].base, map[i + 1].base), the last entry extends to the end of the
+ * physical address space. map[0].base is always 0 and adjacent entries always have
+ * different types, so an entry is a maximal same-type extent.
+ * The map is not built when a variable MTRR uses a non-contiguous mask,
+ * lookups then evaluate the MTRRs per address. */
+typedef struct {
+	uint64_t		base;
+	mon_phys_mem_type_t	type;
+	uint32_t		padding; /* not used */
+} mtrrs_abs_map_entry_t;
+
+static mtrrs_abs_map_entry_t mtrrs_map[MTRRS_ABS_MAX_MAP_BOUNDS];
+static uint32_t mtrrs_map_count = 0;
+static boolean_t mtrrs_map_valid = FALSE;
+static uint64_t mtrrs_map_bounds[MTRRS_ABS_MAX_MAP_BOUNDS];
+static mon_read_write_lock_t mtrrs_map_lock;
+
+static
+void mtrrs_abstraction_build_memory_type_map(void);
 /*---------------------------------------------------*/
 
 uint32_t mtrrs_abstraction_get_num_of_variable_range_regs(void)
@@ -189,7 +217,8 @@ INLINE uint64_t mtrrs_abstraction_get_mask_from_reg(uint32_t reg_index)
 
 INLINE
 boolean_t mtrrs_abstraction_is_addr_covered_by_var_reg(hpa_t address,
-						       uint32_t reg_index)
+						       uint32_t reg_index,
+						       OUT uint64_t *remsize)
 {
 	uint64_t phys_base = mtrrs_abstraction_get_address_from_reg(reg_index);
 	uint64_t phys_mask = mtrrs_abstraction_get_mask_from_reg(reg_index);
@@ -197,7 +226,7 @@ boolean_t mtrrs_abstraction_is_addr_covered_by_var_reg(hpa_t address,
 	uint64_t mask_target = phys_mask & address;
 
 	if (mask_base == mask_target) {
-		remsize =
+		*remsize =
 			(phys_base &
 			 phys_mask) + (~(phys_mask | mtrr_msbs)) + 1 - address;
 	}
@@ -385,6 +414,11 @@ boolean_t mtrrs_abstraction_bsp_initialize(void)
 		~((uint64_t)(((uint64_t)1 <<
 		addr_get_physical_address_size()) - 1));
 
+	lock_initialize_read_write_lock(&mtrrs_map_lock);
+	lock_acquire_writelock(&mtrrs_map_lock);
+	mtrrs_abstraction_build_memory_type_map();
+	lock_release_writelock(&mtrrs_map_lock);
+
 	mtrrs_cached_info.is_initialized = TRUE;
 	return TRUE;
 }
@@ -479,7 +513,17 @@ failed:
 	return FALSE;
 }
 
-mon_phys_mem_type_t mtrrs_abstraction_get_memory_type(hpa_t address)
+/*------------------------------------------------------------------------
+ * Function: mtrrs_abstraction_compute_memory_type
+ *  Description: Evaluates the cached MTRRs for given HPA. remsize receives
+ *               a size from address over which the type is known not to
+ *               change (0 if unknown).
+ *  Return Value: Memory type, MON_PHYS_MEM_UNDEFINED in case overlapping
+ *                variable MTRRs have conflicting types.
+ *------------------------------------------------------------------------*/
+static
+mon_phys_mem_type_t mtrrs_abstraction_compute_memory_type(hpa_t address,
+							  OUT uint64_t *remsize)
 {
 	uint32_t index;
 	uint32_t var_mtrr_match_bitmap;
@@ -487,8 +531,8 @@ mon_phys_mem_type_t mtrrs_abstraction_get_memory_type(hpa_t address)
 	uint64_t remsize_back = 0, range_base = 0;
 	mon_phys_mem_type_t type_back = MON_PHYS_MEM_UNDEFINED;
 
-	remsize = 0;
-	MON_ASSERT(mtrrs_cached_info.is_initialized);
+	*remsize = 0;
+
 
 	if (!mtrrs_abstraction_are_mtrrs_enabled()) {
 		return MON_PHYS_MEM_UNCACHABLE;
@@ -519,7 +563,7 @@ mon_phys_mem_type_t mtrrs_abstraction_get_memory_type(hpa_t address)
 							  MTRRS_ABS_NUM_OF_SUB_RANGES;
 				uint64_t sub_range_index = offset /
 							   sub_range_size;
-				remsize =
+				*remsize =
 					(sub_range_index +
 					 1) * sub_range_size - offset;
 				MON_ASSERT(
@@ -548,7 +592,7 @@ mon_phys_mem_type_t mtrrs_abstraction_get_memory_type(hpa_t address)
 		}
 
 		if (mtrrs_abstraction_is_addr_covered_by_var_reg(address,
-			    index)) {
+			    index, remsize)) {
 			type = (mon_phys_mem_type_t)
 			       mtrrs_cached_info.ia32_mtrr_var_phys_base[index].
 			       bits.type;
@@ -559,34 +603,34 @@ mon_phys_mem_type_t mtrrs_abstraction_get_memory_type(hpa_t address)
 				    || type_back == MON_PHYS_MEM_UNCACHABLE) {
 					if (type_back !=
 					    MON_PHYS_MEM_UNCACHABLE) {
-						remsize_back = remsize;
+						remsize_back = *remsize;
 					}
 					if (type != MON_PHYS_MEM_UNCACHABLE) {
-						remsize = 0;
+						*remsize = 0;
 					}
 					if (type == MON_PHYS_MEM_UNCACHABLE
 					    && type_back ==
 					    MON_PHYS_MEM_UNCACHABLE) {
 						remsize_back =
 							(remsize_back >
-							 remsize) ? remsize_back
+							 *remsize) ? remsize_back
 							:
-							remsize;
+							*remsize;
 					}
 
 					type_back = MON_PHYS_MEM_UNCACHABLE;
-					remsize = 0;
+					*remsize = 0;
 				} else {
 					remsize_back =
 						(remsize_back >
-						 remsize) ? remsize :
+						 *remsize) ? *remsize :
 						remsize_back;
 					type_back = type;
-					remsize = 0;
+					*remsize = 0;
 				}
 			} else {
-				remsize_back = remsize;
-				remsize = 0;
+				remsize_back = *remsize;
+				*remsize = 0;
 				type_back = type;
 			}
 		} else {
@@ -599,7 +643,7 @@ mon_phys_mem_type_t mtrrs_abstraction_get_memory_type(hpa_t address)
 			}
 		}
 	}
-	remsize = remsize_back;
+	*remsize = remsize_back;
 
 	if (0 == var_mtrr_match_bitmap) {
 		/* not described by any MTRR, return default memory type */
@@ -618,12 +662,189 @@ mon_phys_mem_type_t mtrrs_abstraction_get_memory_type(hpa_t address)
 		return MON_PHYS_MEM_WRITE_THROUGH;
 	}
 
+	/* improper MTRR setting, reported on lookup */
+	return MON_PHYS_MEM_UNDEFINED;
+}
+
+/*------------------------------------------------------------------------
+ * Function: mtrrs_abstraction_build_memory_type_map
+ *  Description: Rebuilds mtrrs_map from the cached MTRRs. Every point where
+ *               the memory type may change is a start or end of a fixed
+ *               sub-range or of a variable range, so the type is evaluated
+ *               once at each such bound and equal neighbours are merged.
+ *               Must be called with mtrrs_map_lock write-locked.
+ *------------------------------------------------------------------------*/
+static
+void mtrrs_abstraction_build_memory_type_map(void)
+{
+	uint32_t num_of_bounds = 0;
+	uint32_t index, sub_index, i;
+	uint64_t bound, remsize;
+	mon_phys_mem_type_t type;
+
+	mtrrs_map_valid = FALSE;
+	mtrrs_map_count = 0;
+
+	mtrrs_map_bounds[num_of_bounds++] = 0;
+
+	if (mtrrs_abstraction_are_fixed_regs_supported()) {
+		for (index = 0; index < MTRRS_ABS_NUM_OF_FIXED_RANGE_MTRRS;
+		     index++) {
+			uint32_t sub_range_size =
+				(mtrrs_cached_info.ia32_mtrr_fix_range[index].
+				 end_addr + 1 -
+				 mtrrs_cached_info.ia32_mtrr_fix_range[index].
+				 start_addr) / MTRRS_ABS_NUM_OF_SUB_RANGES;
+
+			for (sub_index = 0;
+			     sub_index < MTRRS_ABS_NUM_OF_SUB_RANGES;
+			     sub_index++) {
+				mtrrs_map_bounds[num_of_bounds++] =
+					mtrrs_cached_info.ia32_mtrr_fix_range[
+						index].start_addr +
+					sub_index * sub_range_size;
+			}
+		}
+		mtrrs_map_bounds[num_of_bounds++] = MTRRS_ABS_FIXED_RANGES_END;
+	}
+
+	for (index = 0;
+	     index < mtrrs_abstraction_get_num_of_variable_range_regs();
+	     index++) {
+		uint64_t phys_mask, range_base, range_size;
+
+		if (index >= MTRRS_ABS_NUM_OF_VAR_RANGE_MTRRS) {
+			break;
+		}
+
+		if (!mtrrs_abstraction_is_var_reg_valid(index)) {
+			continue;
+		}
+
+		phys_mask = mtrrs_abstraction_get_mask_from_reg(index);
+		range_base = mtrrs_abstraction_get_address_from_reg(index) &
+			     phys_mask;
+		range_size = ~(phys_mask | mtrr_msbs) + 1;
+
+		if ((phys_mask | mtrr_msbs) != ~(range_size - 1)) {
+			/* non-contiguous mask covers many disjoint areas */
+			MON_LOG(mask_anonymous, level_warning,
+				"WARN: MTRRs Abstraction: Variable MTRR %d has"
+				" non-contiguous mask\n", index);
+			return;
+		}
+
+		mtrrs_map_bounds[num_of_bounds++] = range_base;
+		if (range_size != 0) {
+			mtrrs_map_bounds[num_of_bounds++] =
+				range_base + range_size;
+		}
+	}
+
+	MON_ASSERT(num_of_bounds <= MTRRS_ABS_MAX_MAP_BOUNDS);
+
+	/* sort the bounds */
+	for (index = 1; index < num_of_bounds; index++) {
+		bound = mtrrs_map_bounds[index];
+		for (i = index; (i > 0) && (mtrrs_map_bounds[i - 1] > bound);
+		     i--)
+			mtrrs_map_bounds[i] = mtrrs_map_bounds[i - 1];
+		mtrrs_map_bounds[i] = bound;
+	}
+
+	for (index = 0; index < num_of_bounds; index++) {
+		bound = mtrrs_map_bounds[index];
+
+		if ((index > 0) && (bound == mtrrs_map_bounds[index - 1])) {
+			continue;
+		}
+		if ((bound & mtrr_msbs) != 0) {
+			/* end of a range reaching the top of the address space */
+			break;
+		}
+
+		type = mtrrs_abstraction_compute_memory_type(bound, &remsize);
+
+		if ((mtrrs_map_count > 0) &&
+		    (mtrrs_map[mtrrs_map_count - 1].type == type)) {
+			continue;
+		}
+		mtrrs_map[mtrrs_map_count].base = bound;
+		mtrrs_map[mtrrs_map_count].type = type;
+		mtrrs_map_count++;
+	}
+
+	mtrrs_map_valid = TRUE;
+}
+
+/*------------------------------------------------------------------------
+ * Function: mtrrs_abstraction_lookup_memory_type
+ *  Description: Finds the memory type of given HPA and the size from the
+ *               address to the end of its same-type extent.
+ *               Must be called with mtrrs_map_lock read-locked.
+ *------------------------------------------------------------------------*/
+static
+mon_phys_mem_type_t mtrrs_abstraction_lookup_memory_type(hpa_t address,
+							 OUT uint64_t *size)
+{
+	uint32_t low = 0, high, middle;
+	mon_phys_mem_type_t type;
+
+	if (!mtrrs_map_valid) {
+		type = mtrrs_abstraction_compute_memory_type(address, size);
+		if (*size == 0) {
+			*size = 4 KILOBYTES;
+		}
+		return type;
+	}
+
+	/* the last entry with base <= address, mtrrs_map[0].base is 0 */
+	high = mtrrs_map_count - 1;
+	while (low < high) {
+		middle = (low + high + 1) / 2;
+		if (mtrrs_map[middle].base <= address) {
+			low = middle;
+		} else {
+			high = middle - 1;
+		}
+	}
+
+	if (low + 1 < mtrrs_map_count) {
+		*size = mtrrs_map[low + 1].base - address;
+	} else if ((address & mtrr_msbs) == 0) {
+		*size = (~mtrr_msbs + 1) - address;
+	} else {
+		/* beyond the physical address space */
+		*size = 4 KILOBYTES;
+	}
+	return mtrrs_map[low].type;
+}
+
+static
+void mtrrs_abstraction_report_conflicting_types(void)
+{
 	/* improper MTRR setting */
 	MON_LOG(mask_anonymous, level_error,
 		"FATAL: MTRRs Abstraction: Overlapping variable MTRRs"
 		" have confilting types\n");
 	MON_DEADLOOP();
-	return MON_PHYS_MEM_UNDEFINED;
+}
+
+mon_phys_mem_type_t mtrrs_abstraction_get_memory_type(hpa_t address)
+{
+	mon_phys_mem_type_t type;
+	uint64_t size;
+
+	MON_ASSERT(mtrrs_cached_info.is_initialized);
+
+	lock_acquire_readlock(&mtrrs_map_lock);
+	type = mtrrs_abstraction_lookup_memory_type(address, &size);
+	lock_release_readlock(&mtrrs_map_lock);
+
+	if (MON_PHYS_MEM_UNDEFINED == type) {
+		mtrrs_abstraction_report_conflicting_types();
+	}
+	return type;
 }
 
 mon_phys_mem_type_t mtrrs_abstraction_get_range_memory_type(hpa_t address,
@@ -631,21 +852,26 @@ mon_phys_mem_type_t mtrrs_abstraction_get_range_memory_type(hpa_t address,
 							    uint64_t totalsize)
 {
 	mon_phys_mem_type_t first_page_mem_type, mem_type;
-	uint64_t range_size = 0;
+	uint64_t range_size = 0, extent_size = 0;
 
-	remsize = 0;
+	MON_ASSERT(mtrrs_cached_info.is_initialized);
 
-	first_page_mem_type = mtrrs_abstraction_get_memory_type(address);
+	lock_acquire_readlock(&mtrrs_map_lock);
 
+	/* with a valid map the first extent is already maximal, the loop only
+	 * iterates when the MTRRs are evaluated per address */
+	first_page_mem_type = mtrrs_abstraction_lookup_memory_type(address,
+		&extent_size);
 	for (mem_type = first_page_mem_type;
 	     (mem_type == first_page_mem_type) && (range_size < totalsize);
-	     mem_type =
-		     mtrrs_abstraction_get_memory_type(address + range_size)) {
-		if (remsize != 0) {
-			range_size += remsize;
-		} else {
-			range_size += 4 KILOBYTES;
-		}
+	     mem_type = mtrrs_abstraction_lookup_memory_type(
+		     address + range_size, &extent_size))
+		range_size += extent_size;
+
+	lock_release_readlock(&mtrrs_map_lock);
+
+	if (MON_PHYS_MEM_UNDEFINED == first_page_mem_type) {
+		mtrrs_abstraction_report_conflicting_types();
 	}
 	if (size != NULL) {
 		*size = range_size;
@@ -653,8 +879,9 @@ mon_phys_mem_type_t mtrrs_abstraction_get_range_memory_type(hpa_t address,
 	return first_page_mem_type;
 }
 
-boolean_t mtrrs_abstraction_track_mtrr_update(uint32_t mtrr_index,
-					      uint64_t value)
+static
+boolean_t mtrrs_abstraction_update_cached_mtrr(uint32_t mtrr_index,
+					       uint64_t value)
 {
 	if (mtrr_index == IA32_MTRR_DEF_TYPE_ADDR) {
 		if (!mtrrs_abstraction_is_IA32_MTRR_DEF_TYPE_valid(value)) {
@@ -741,3 +968,18 @@ boolean_t mtrrs_abstraction_track_mtrr_update(uint32_t mtrr_index,
 
 	return FALSE;
 }
+
+boolean_t mtrrs_abstraction_track_mtrr_update(uint32_t mtrr_index,
+					      uint64_t value)
+{
+	boolean_t result;
+
+	lock_acquire_writelock(&mtrrs_map_lock);
+	result = mtrrs_abstraction_update_cached_mtrr(mtrr_index, value);
+	if (result && mtrrs_cached_info.is_initialized) {
+		mtrrs_abstraction_build_memory_type_map();
+	}
+	lock_release_writelock(&mtrrs_map_lock);
+
+	return result;
+}
@@ -126,6 +126,7 @@ typedef struct {
 #define CR4_OSXMMEXCPT  0x00000400
 #define CR4_VMXE        0x00002000
 #define CR4_SMXE        0x00004000
+#define CR4_PCIDE       0x00020000
 #define CR4_OSXSAVE     0x00040000
 
 typedef union {
@@ -32,8 +32,12 @@ char *CDECL mon_strcpy_s(char *dst, size_t dst_length, const char *src);
 uint32_t CDECL mon_strcmp(const char *string1, const char *string2);
 void CDECL mon_memcpy_assuming_mmio(uint8_t *dst, uint8_t *src, int32_t count);
 int CDECL mon_memcmp(const void *mem1, const void *mem2, size_t count);
+void CDECL mon_memset64(void *dest, uint64_t value, size_t count);
+void mon_memops_init(void);
 
 #define mon_zeromem(dest_, count_) mon_memset(dest_, 0, count_);
+#define mon_zero_pages(dest_, num_) \
+	mon_memset64(dest_, 0, (num_) * (PAGE_4KB_SIZE / sizeof(uint64_t)))
 
 /* sprintf_s() - secure sprintf. Includes size of input buffer */
 
@@ -132,6 +132,10 @@ boolean_t event_gcpu_register(mon_event_t e,                    /* in: event */
 			      guest_cpu_handle_t gcpu,          /* in: guest cpu */
 			      event_callback_t call);           /* in: callback to register on event e */
 
+boolean_t event_guest_register(mon_event_t e,                   /* in: event */
+			       guest_handle_t guest,            /* in: guest handle */
+			       event_callback_t call);          /* in: callback to register on event e */
+
 boolean_t event_global_unregister(mon_event_t e,                /* in: event */
 				  event_callback_t call);       /* in: callback to unregister from event e */
 
@@ -224,6 +224,10 @@ typedef struct {
 /* 1 - image is compressed. Should be uncompressed before execution. */
 #define MON_GUEST_FLAG_IMAGE_COMPRESSED           BIT_VALUE(2)
 
+/* 1 - enable EPT accessed/dirty flags (and page modification logging when
+ *     supported) for the guest, so its dirty pages can be harvested */
+#define MON_GUEST_FLAG_EPT_ACCESSED_DIRTY         BIT_VALUE(3)
+
 /* This structure should be aligned on 8 bytes */
 #define MON_GUEST_STARTUP_ALIGNMENT               8
 
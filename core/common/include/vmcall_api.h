@@ -36,6 +36,10 @@ typedef enum {
 
 	VMCALL_UPDATE_LVT,                      /* Temporary for TSC deadline debugging */
 
+	VMCALL_GET_VMEXIT_STATS,
+	VMCALL_EPT_GET_DIRTY_LOG,
+	VMCALL_TRACE_EXPORT,
+
 	VMCALL_LAST_USED_INTERNAL = 1024        /* must be the last */
 } vmcall_id_t;
 
@@ -236,4 +240,127 @@ typedef struct {
 	mon_status_t	status;
 } mon_write_string_params_t;
 
+/*========================================================================== */
+
+/* histogram bucket 0 counts exits shorter than 128 TSC cycles, bucket N
+ * counts exits of [2^(N+6), 2^(N+7)) cycles, the last bucket is open ended */
+#define MON_VMEXIT_STATS_HISTOGRAM_BUCKETS      16
+
+typedef struct {
+	vmcall_id_t	vmcall_id;      /* IN must be "VMCALL_GET_VMEXIT_STATS" */
+	uint32_t	reason;         /* IN basic VMEXIT reason */
+	uint64_t	count;          /* OUT number of VMEXITs */
+	uint64_t	cycles;         /* OUT TSC cycles from VMEXIT to VMRESUME */
+	uint64_t	histogram[MON_VMEXIT_STATS_HISTOGRAM_BUCKETS]; /* OUT */
+	mon_status_t	status;         /* OUT */
+	uint8_t		padding[4];
+} mon_vmexit_stats_params_t;
+
+/*---------------------------------------------------------------------------*
+ *  FUNCTION : hw_vmcall_get_vmexit_stats()
+ *  PURPOSE  : Call for MON service for collecting VMEXIT statistics of the
+ *           : calling guest, summed over all host CPUs
+ *  ARGUMENTS: param - pointer to "mon_vmexit_stats_params_t" structure
+ *  RETURNS  : MON_OK = ok, other - error code
+ *
+ *  mon_status_t hw_vmcall_get_vmexit_stats(mon_vmexit_stats_params_t* param);
+ *--------------------------------------------------------------------------*/
+#define hw_vmcall_get_vmexit_stats(vmexit_stats_params_ptr) \
+	hw_vmcall(VMCALL_GET_VMEXIT_STATS, (vmexit_stats_params_ptr), NULL, NULL)
+
+/*========================================================================== */
+
+/* one call covers at most this many 4K pages (a 4K page of bitmap) */
+#define MON_EPT_DIRTY_LOG_MAX_PAGES             (4096 * 8)
+
+typedef struct {
+	vmcall_id_t	vmcall_id;      /* IN must be "VMCALL_EPT_GET_DIRTY_LOG" */
+	uint32_t	clear;          /* IN non-zero - restart dirty tracking */
+	uint64_t	gpa;            /* IN 4K aligned start of the range */
+	uint64_t	size;           /* IN size of the range, 4K multiple */
+	uint64_t	bitmap_gva;     /* IN/OUT one bit per 4K page of the range,
+					 * rounded up to 64 bits */
+	mon_status_t	status;         /* OUT */
+	uint8_t		padding[4];
+} mon_ept_dirty_log_params_t;
+
+/*---------------------------------------------------------------------------*
+ *  FUNCTION : hw_vmcall_ept_get_dirty_log()
+ *  PURPOSE  : Call for MON service reporting pages of the calling guest
+ *           : written since dirty tracking was last restarted for them.
+ *           : Requires EPT accessed/dirty flags enabled for the guest
+ *           : (MON_GUEST_FLAG_EPT_ACCESSED_DIRTY)
+ *  ARGUMENTS: param - pointer to "mon_ept_dirty_log_params_t" structure
+ *  RETURNS  : MON_OK = ok, other - error code
+ *
+ *  mon_status_t hw_vmcall_ept_get_dirty_log(mon_ept_dirty_log_params_t* param);
+ *--------------------------------------------------------------------------*/
+#define hw_vmcall_ept_get_dirty_log(ept_dirty_log_params_ptr) \
+	hw_vmcall(VMCALL_EPT_GET_DIRTY_LOG, (ept_dirty_log_params_ptr), NULL, NULL)
+
+/*========================================================================== */
+
+#define MON_TRACE_RECORD_MAX_ARGS               4
+
+/* binary trace record, event ids are mon_trace_event_t */
+typedef struct {
+	uint64_t	tsc;
+	uint64_t	guest_rip;
+	uint32_t	exit_reason;
+	uint16_t	event_id;
+	uint16_t	guest_id;
+	uint16_t	guest_cpu_id;
+	uint16_t	padding0;
+	uint32_t	padding1;
+	uint64_t	args[MON_TRACE_RECORD_MAX_ARGS];
+} mon_trace_record_t;
+
+/* producer (head) or consumer (tail) index of one host CPU ring, counts
+ * records ever added or removed. One cache line */
+typedef struct {
+	volatile uint64_t	count;
+	uint64_t		padding[7];
+} mon_trace_index_t;
+
+/*
+ * The trace window is mapped at gpa of the calling guest:
+ *   head_offset    - mon_trace_index_t per host CPU, read-only
+ *   tail_offset    - mon_trace_index_t per host CPU, written by the guest
+ *   records_offset - records_per_cpu mon_trace_record_t per host CPU,
+ *                    read-only
+ * Record number N of a CPU is at index N % records_per_cpu of its ring.
+ * Records [max(tail, head - records_per_cpu), head) are valid; MON overwrites
+ * the oldest records when the guest does not keep up, so a consumer must
+ * recheck head after copying a record.
+ */
+typedef struct {
+	vmcall_id_t	vmcall_id;      /* IN must be "VMCALL_TRACE_EXPORT" */
+	uint32_t	num_host_cpus;  /* OUT */
+	uint64_t	gpa;            /* IN 4K aligned unused guest physical
+					 * range to map the window at */
+	uint64_t	size;           /* IN size of the range, OUT size of the
+					 * window */
+	uint32_t	head_offset;    /* OUT */
+	uint32_t	tail_offset;    /* OUT */
+	uint32_t	records_offset; /* OUT */
+	uint32_t	records_per_cpu; /* OUT */
+	mon_status_t	status;         /* OUT */
+	uint8_t		padding[4];
+} mon_trace_export_params_t;
+
+/*---------------------------------------------------------------------------*
+ *  FUNCTION : hw_vmcall_trace_export()
+ *  PURPOSE  : Call for MON service mapping the MON trace rings into the
+ *           : physical address space of the calling guest and enabling
+ *           : recycled trace. Only the primary guest may export the trace, the
+ *           : call returns error status for other guests. If size is
+ *           : too small, status is error and size returns the required size
+ *  ARGUMENTS: param - pointer to "mon_trace_export_params_t" structure
+ *  RETURNS  : MON_OK = ok, other - error code
+ *
+ *  mon_status_t hw_vmcall_trace_export(mon_trace_export_params_t* param);
+ *--------------------------------------------------------------------------*/
+#define hw_vmcall_trace_export(trace_export_params_ptr) \
+	hw_vmcall(VMCALL_TRACE_EXPORT, (trace_export_params_ptr), NULL, NULL)
+
 #endif    /* _VMCALL_API_H_ */
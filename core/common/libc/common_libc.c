@@ -21,32 +21,50 @@
  */
 
 #include "common_libc.h"
+#include "hw_utils.h"
 
 extern void mon_lock_xchg_byte(uint8_t *dst, uint8_t *src);
 
+/* Strings shorter than this are cheaper to handle with the plain loops
+ * than to pay the rep string startup cost, unless the CPU reports fast
+ * short rep movsb */
+#define LIBC_REP_STRING_THRESHOLD   256
+
+extern void mon_rep_stosb(void *dst, uint8_t filler, size_t count);
+extern void mon_rep_stosq(void *dst, uint64_t filler, size_t count);
+extern void mon_rep_movsb(void *dst, const void *src, size_t count);
+extern void mon_rep_movsq(void *dst, const void *src, size_t count);
+
+/* selected once by mon_memops_init() on BSP, before APs are started */
+static boolean_t libc_erms = FALSE;     /* enhanced rep movsb/stosb */
+static boolean_t libc_fsrm = FALSE;     /* fast short rep movsb */
+
+void mon_memops_init(void)
+{
+	libc_erms = is_erms_supported();
+	libc_fsrm = is_fsrm_supported();
+}
+
 void *CDECL mon_memset(void *dest, int filler, size_t count)
 {
 	size_t i = 0, j, cnt_64bit;
 	uint64_t filler_64;
-	uint64_t *fill = &filler_64;
 
-	cnt_64bit = count >> 3;
+	filler_64 = (uint8_t)filler * 0x0101010101010101ULL;
 
-	if (cnt_64bit) {
-		if (filler != 0) {
-			*(uint8_t *)fill = (uint8_t)filler;
-			*((uint8_t *)fill + 1) = (uint8_t)filler;
-			*((uint16_t *)fill + 1) = *(uint16_t *)fill;
-			*((uint32_t *)fill + 1) = *(uint32_t *)fill;
+	if (count >= LIBC_REP_STRING_THRESHOLD) {
+		if (libc_erms) {
+			mon_rep_stosb(dest, (uint8_t)filler, count);
+			return dest;
 		}
+		mon_rep_stosq(dest, filler_64, count >> 3);
+		i = count & ~(size_t)7;
+	} else {
+		cnt_64bit = count >> 3;
+
+		for (i = 0; i < cnt_64bit; i++)
+			((uint64_t *)dest)[i] = filler_64;
 
-		for (i = 0; i < cnt_64bit; i++) {
-			if (filler == 0) {
-				((uint64_t *)dest)[i] = 0;
-			} else {
-				((uint64_t *)dest)[i] = filler_64;
-			}
-		}
 		i = i << 3;
 	}
 
@@ -56,6 +74,27 @@ void *CDECL mon_memset(void *dest, int filler, size_t count)
 	return dest;
 }
 
+/*-------------------------------------------------------------------------
+ * Function: mon_memset64
+ *  Description: fill count qwords at dest with value. dest is expected to be
+ *               8 bytes aligned. Used to initialize whole pages, such as
+ *               freshly allocated heap memory or page tables.
+ *  Input: dest - start of the area
+ *         value - qword to store
+ *         count - number of qwords
+ *------------------------------------------------------------------------- */
+void CDECL mon_memset64(void *dest, uint64_t value, size_t count)
+{
+	size_t i;
+
+	if ((count << 3) >= LIBC_REP_STRING_THRESHOLD) {
+		mon_rep_stosq(dest, value, count);
+		return;
+	}
+
+	for (i = 0; i < count; i++)
+		((uint64_t *)dest)[i] = value;
+}
 
 void *CDECL mon_memcpy_ascending(void *dest, const void *src, size_t count)
 {
@@ -63,9 +102,17 @@ void *CDECL mon_memcpy_ascending(void *dest, const void *src, size_t count)
 	uint64_t *d = (uint64_t *)dest;
 	const uint64_t *s = (const uint64_t *)src;
 
+	if (libc_fsrm || (count >= LIBC_REP_STRING_THRESHOLD && libc_erms)) {
+		mon_rep_movsb(dest, src, count);
+		return dest;
+	}
+
 	cnt_64bit = count >> 3;
 
-	if (cnt_64bit) {
+	if (count >= LIBC_REP_STRING_THRESHOLD) {
+		mon_rep_movsq(dest, src, cnt_64bit);
+		i = cnt_64bit << 3;
+	} else if (cnt_64bit) {
 		for (i = 0; i < cnt_64bit; i++)
 			((uint64_t *)d)[i] = ((uint64_t *)s)[i];
 
@@ -100,7 +147,9 @@ void *CDECL mon_memcpy_descending(void *dest, const void *src, size_t count)
 
 void *CDECL mon_memcpy(void *dest, const void *src, size_t count)
 {
-	if (dest >= src) {
+	/* copying backwards is only needed when dest overlaps the tail of src */
+	if (((uint8_t *)dest > (const uint8_t *)src) &&
+	    ((uint8_t *)dest < (const uint8_t *)src + count)) {
 		return mon_memcpy_descending(dest, src, count);
 	} else {
 		return mon_memcpy_ascending(dest, src, count);
@@ -17,6 +17,7 @@
 #include "guest_cpu.h"
 #include "scheduler.h"
 #include "common_libc.h"
+#include "libc.h"
 #include "mon_dbg.h"
 #include "guest_cpu_vmenter_event.h"
 #include "vmcs_api.h"
@@ -80,6 +81,7 @@ void mon_deadloop_internal(uint32_t file_code, uint32_t line_num,
 
 	/* send cpu id, file code, line number to serial port */
 	mon_printf("%02d%04d%04d\n", cpu_id, file_code, line_num);
+	mon_io_drain(TRUE);
 
 	/* must match format defined in file_line_info_t */
 	size = mon_sprintf_s(buffer,
@@ -242,6 +244,8 @@ boolean_t deadloop_helper(const char *assert_condition, const char *func_name,
 		mon_printf("MON assert (%s) failed\n\t in %s() at %s:%d\n",
 			assert_condition, func_name, file_name, line_num);
 	}
+	/* the CPU may never get to drain the log again */
+	mon_io_drain(TRUE);
 
 	return TRUE;
 }
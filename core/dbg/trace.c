@@ -21,266 +21,175 @@
 #include "trace.h"
 #include "heap.h"
 #include "common_libc.h"
+#include "hw_interlocked.h"
 
-#define CYCLIC_INCREMENT(x)     \
-	do { (x)++; if ((x) == MAX_RECORDS_IN_BUFFER) { (x) = 0; } } while (0)
-
-#define NON_CYCLIC_INCREMENT(x) \
-	do { (x)++; if ((x) == MAX_RECORDS_IN_BUFFER) { (x)--; } } while (0)
-
-#define FOREACH_BUFFER(apply_function, param) \
-	do { \
-		uint32_t vm_index = 0, cpu_index = 0, buffer_index = 0; \
-		for (vm_index = 0; vm_index < trace_state->max_num_guests; \
-		     vm_index++) { \
-			for (cpu_index = 0; \
-			     cpu_index < trace_state->max_num_guest_cpus; \
-			     cpu_index++) { \
-				for (buffer_index = 0; \
-				     buffer_index < MAX_TRACE_BUFFERS; \
-				     buffer_index++) { \
-					apply_function(vm_index, \
-						cpu_index, \
-						buffer_index, \
-						param); \
-				} \
-			} \
-		} \
-	} while (0)
-
-typedef struct {
-	boolean_t		valid;
-	uint32_t		index;
-	trace_record_data_t	data;
-	struct trace_buffer_t	*buffer;
-} trace_record_t;
-
-typedef struct trace_buffer_t {
-	uint32_t	vm_index;
-	uint32_t	cpu_index;
-	uint32_t	buffer_index;
-	uint32_t	next_record_index;
-	trace_record_t	records[MAX_RECORDS_IN_BUFFER];
-} trace_buffer_t;
+#define TRACE_RECORD(cpu, count)  \
+	(&trace_state.records[(cpu) * MAX_RECORDS_IN_BUFFER + \
+			      ((count) & (MAX_RECORDS_IN_BUFFER - 1))])
 
+/*
+ * All trace memory is one page aligned block, so it can be exported to a
+ * guest as is (see trace_get_layout):
+ *   heads   - records ever added to each host CPU ring, advanced only by the
+ *             owner CPU
+ *   tails   - records ever removed from each host CPU ring, advanced by the
+ *             consumer (dump code or exporting guest)
+ *   records - MAX_RECORDS_IN_BUFFER records per host CPU
+ * Recycled rings overwrite their oldest records, so the oldest record still
+ * present is max(tail, head - MAX_RECORDS_IN_BUFFER)
+ */
 typedef struct {
-	uint32_t	global_counter;
-	boolean_t	locked;
-	uint32_t	max_num_guests;
-	uint32_t	max_num_guest_cpus;
-	trace_buffer_t	buffers[1]; /* pointer to buffers */
+	volatile boolean_t	locked;
+	uint32_t		padding;
+	trace_index_t		*heads;
+	trace_index_t		*tails;
+	trace_record_t		*records;
+	trace_layout_t		layout;
 } trace_state_t;
 
 static boolean_t trace_initialized = FALSE;
-static trace_state_t *trace_state;
+static trace_state_t trace_state;
 static boolean_t trace_recyclable = TRUE;
 
-#define GET_BUFFER(vm_index, cpu_index, buffer_index) \
-	(trace_state->buffers + \
-	 vm_index * trace_state->max_num_guest_cpus * MAX_TRACE_BUFFERS \
-	 + cpu_index * MAX_TRACE_BUFFERS \
-	 + buffer_index)
-
-static
-void initialize_trace_buffer(uint32_t vm_index, uint32_t cpu_index,
-			     uint32_t buffer_index, void *param UNUSED)
+boolean_t trace_init(uint32_t num_host_cpus)
 {
-	trace_buffer_t *buffer;
-	uint32_t record_index;
-
-	buffer = GET_BUFFER(vm_index, cpu_index, buffer_index);
+	trace_layout_t *layout = &trace_state.layout;
+	uint32_t index_size;
+	uint8_t *base;
 
-	buffer->vm_index = vm_index;
-	buffer->cpu_index = cpu_index;
-	buffer->buffer_index = buffer_index;
-
-	for (record_index = 0; record_index < MAX_RECORDS_IN_BUFFER;
-	     record_index++) {
-		buffer->records[record_index].valid = FALSE;
-		buffer->records[record_index].buffer = buffer;
-	}
-
-	buffer->next_record_index = 0;
-}
-
-boolean_t trace_init(uint32_t max_num_guests, uint32_t max_num_guest_cpus)
-{
 	if (trace_initialized) {
 		return FALSE;
 	}
-	/* trace_state already includes one buffer */
-	trace_state = mon_memory_alloc(sizeof(trace_state_t) +
-		max_num_guests * max_num_guest_cpus *
-		MAX_TRACE_BUFFERS * sizeof(trace_buffer_t)
-		- 1);
-	if (NULL == trace_state) {
-		return FALSE;
-	}
-
-	trace_state->global_counter = 0;
-	trace_state->locked = FALSE;
-	trace_state->max_num_guests = max_num_guests;
-	trace_state->max_num_guest_cpus = max_num_guest_cpus;
 
-	FOREACH_BUFFER(initialize_trace_buffer, NULL);
+	index_size = (uint32_t)ALIGN_FORWARD(num_host_cpus *
+		sizeof(trace_index_t), PAGE_4KB_SIZE);
 
-	trace_initialized = TRUE;
-	return TRUE;
-}
-
-static
-void add_record(trace_buffer_t *buffer, trace_record_data_t *data)
-{
-	trace_record_t *record = &buffer->records[buffer->next_record_index];
-
-	record->valid = TRUE;
-	record->index = trace_state->global_counter++;
-
-	record->data.tsc = data->tsc;
-	record->data.exit_reason = data->exit_reason;
-	record->data.guest_eip = data->guest_eip;
-	mon_strcpy_s(record->data.string, MAX_STRING_LENGTH, data->string);
-
-	if (trace_recyclable) {
-		CYCLIC_INCREMENT(buffer->next_record_index);
-	} else {
-		NON_CYCLIC_INCREMENT(buffer->next_record_index);
-	}
-}
+	layout->num_host_cpus = num_host_cpus;
+	layout->head_offset = 0;
+	layout->tail_offset = index_size;
+	layout->records_offset = 2 * index_size;
+	layout->size = layout->records_offset + num_host_cpus *
+		       MAX_RECORDS_IN_BUFFER * sizeof(trace_record_t);
 
-boolean_t trace_add_record(IN uint32_t vm_index,
-			   IN uint32_t cpu_index,
-			   IN uint32_t buffer_index,
-			   IN trace_record_data_t *data)
-{
-	if (!trace_initialized || trace_state->locked || data == NULL
-	    || vm_index >= trace_state->max_num_guests
-	    || cpu_index >= trace_state->max_num_guest_cpus
-	    || buffer_index >= MAX_TRACE_BUFFERS) {
+	base = mon_memory_alloc(layout->size);
+	if (NULL == base) {
 		return FALSE;
 	}
 
-	add_record(GET_BUFFER(vm_index, cpu_index, buffer_index), data);
+	layout->base = base;
+	trace_state.heads = (trace_index_t *)(base + layout->head_offset);
+	trace_state.tails = (trace_index_t *)(base + layout->tail_offset);
+	trace_state.records = (trace_record_t *)(base + layout->records_offset);
+	trace_state.locked = FALSE;
 
+	trace_initialized = TRUE;
 	return TRUE;
 }
 
-static
-void remove_record(trace_record_t *record)
+const trace_layout_t *trace_get_layout(void)
 {
-	record->valid = FALSE;
-	CYCLIC_INCREMENT(record->buffer->next_record_index);
+	return trace_initialized ? &trace_state.layout : NULL;
 }
 
-static
-void set_buffer_pointer_to_oldest_record(uint32_t vm_index, uint32_t cpu_index,
-					 uint32_t buffer_index,
-					 void *param UNUSED)
+trace_record_t *trace_start_record(cpu_id_t host_cpu)
 {
-	trace_buffer_t *buffer = GET_BUFFER(vm_index, cpu_index, buffer_index);
+	uint64_t head;
 
-	if (!buffer->records[buffer->next_record_index].valid) {
-		uint32_t i;
+	if (!trace_initialized || trace_state.locked
+	    || host_cpu >= trace_state.layout.num_host_cpus) {
+		return NULL;
+	}
 
-		for (i = 0; i < MAX_RECORDS_IN_BUFFER; i++) {
-			if (buffer->records[i].valid) {
-				/* found */
-				break;
-			}
-		}
-		buffer->next_record_index = (i < MAX_RECORDS_IN_BUFFER) ? i : 0;
+	head = trace_state.heads[host_cpu].count;
+
+	if (!trace_recyclable &&
+	    (head - trace_state.tails[host_cpu].count >=
+	     MAX_RECORDS_IN_BUFFER)) {
+		/* full, keep the oldest records */
+		return NULL;
 	}
+
+	return TRACE_RECORD(host_cpu, head);
 }
 
-static
-void find_buffer_with_oldest_record(uint32_t vm_index, uint32_t cpu_index,
-				    uint32_t buffer_index, void *param)
+void trace_commit_record(cpu_id_t host_cpu)
 {
-	trace_record_t **oldest_record_ptr = (trace_record_t **)param;
-	trace_buffer_t *buffer = GET_BUFFER(vm_index, cpu_index, buffer_index);
-	trace_record_t *record = &buffer->records[buffer->next_record_index];
-
-	if (record->valid) {
-		if ((*oldest_record_ptr == NULL) ||
-		    (record->index < (*oldest_record_ptr)->index)) {
-			/* this record is the first record encountered */
-			/* and this record is older than the oldest record */
-			*oldest_record_ptr = record;
-		}
-	}
+	/* record content must be in memory before it is published */
+	hw_compiler_barrier();
+	trace_state.heads[host_cpu].count++;
 }
 
 static
-trace_record_t *find_oldest_record(void)
+uint64_t trace_oldest_count(uint32_t cpu)
 {
-	trace_record_t *oldest_record = NULL;
-
-	/* find the oldest record in each buffer */
-	FOREACH_BUFFER(set_buffer_pointer_to_oldest_record, NULL);
+	uint64_t head = trace_state.heads[cpu].count;
+	uint64_t tail = trace_state.tails[cpu].count;
 
-	/* find the globally oldest record */
-	FOREACH_BUFFER(find_buffer_with_oldest_record, &oldest_record);
-
-	return oldest_record;
+	/* tail may be written by a guest, any value is safe here */
+	if ((tail > head) || (head - tail > MAX_RECORDS_IN_BUFFER)) {
+		return (head > MAX_RECORDS_IN_BUFFER) ?
+		       head - MAX_RECORDS_IN_BUFFER : 0;
+	}
+	return tail;
 }
 
-boolean_t trace_remove_oldest_record(OUT uint32_t *vm_index,
-				     OUT uint32_t *cpu_index,
-				     OUT uint32_t *buffer_index,
-				     OUT uint32_t *record_index,
-				     OUT trace_record_data_t *data)
+boolean_t trace_remove_oldest_record(OUT cpu_id_t *host_cpu,
+				     OUT trace_record_t *record)
 {
-	trace_record_t *oldest_record;
+	trace_record_t *oldest_record = NULL;
+	uint64_t oldest_count = 0;
+	uint32_t cpu, oldest_cpu = 0;
 
 	if (!trace_initialized) {
 		return FALSE;
 	}
 
-	oldest_record = find_oldest_record();
+	/* merge the rings by TSC */
+	for (cpu = 0; cpu < trace_state.layout.num_host_cpus; cpu++) {
+		uint64_t count = trace_oldest_count(cpu);
+
+		if (count == trace_state.heads[cpu].count) {
+			continue;
+		}
+		if ((oldest_record == NULL) ||
+		    (TRACE_RECORD(cpu, count)->tsc < oldest_record->tsc)) {
+			oldest_record = TRACE_RECORD(cpu, count);
+			oldest_count = count;
+			oldest_cpu = cpu;
+		}
+	}
+
 	if (oldest_record == NULL) {
 		return FALSE;
 	}
 
-	remove_record(oldest_record);
-
-	if (vm_index != NULL) {
-		*vm_index = oldest_record->buffer->vm_index;
-	}
-	if (cpu_index != NULL) {
-		*cpu_index = oldest_record->buffer->cpu_index;
+	if (record != NULL) {
+		*record = *oldest_record;
 	}
-	if (buffer_index != NULL) {
-		*buffer_index = oldest_record->buffer->buffer_index;
-	}
-	if (record_index != NULL) {
-		*record_index = oldest_record->index;
-	}
-	if (data != NULL) {
-		data->exit_reason = oldest_record->data.exit_reason;
-		data->guest_eip = oldest_record->data.guest_eip;
-		data->tsc = oldest_record->data.tsc;
-		mon_strcpy_s(data->string, MAX_STRING_LENGTH,
-			oldest_record->data.string);
+	if (host_cpu != NULL) {
+		*host_cpu = (cpu_id_t)oldest_cpu;
 	}
 
+	trace_state.tails[oldest_cpu].count = oldest_count + 1;
+
 	return TRUE;
 }
 
 boolean_t trace_lock(void)
 {
-	if (!trace_initialized || trace_state->locked) {
+	if (!trace_initialized || trace_state.locked) {
 		return FALSE;
 	}
-	trace_state->locked = TRUE;
+	trace_state.locked = TRUE;
 	return TRUE;
 }
 
 boolean_t trace_unlock(void)
 {
-	if (!trace_initialized || !trace_state->locked) {
+	if (!trace_initialized || !trace_state.locked) {
 		return FALSE;
 	}
-	trace_state->locked = FALSE;
+	trace_state.locked = FALSE;
 	return TRUE;
 }
 
@@ -18,30 +18,44 @@
 #define TRACE_H
 
 #include "mon_defs.h"
+#include "vmcall_api.h"
 
-#define MAX_TRACE_BUFFERS       1
-#define MAX_STRING_LENGTH       128
+/* records per host CPU ring, must be a power of 2 */
 #define MAX_RECORDS_IN_BUFFER   2048
 
+/* Binary trace record, one cache line. Only raw values are stored when the
+ * record is added; the text is produced from the event format string when
+ * records are dumped. The layout is shared with guests, see vmcall_api.h */
+typedef mon_trace_record_t trace_record_t;
+
+typedef mon_trace_index_t trace_index_t;
+
+/* trace memory, offsets are 4K aligned */
 typedef struct {
-	uint64_t	tsc;
-	uint64_t	exit_reason;
-	uint64_t	guest_eip;
-	char		string[MAX_STRING_LENGTH];
-} trace_record_data_t;
-
-boolean_t trace_init(uint32_t max_num_guests, uint32_t max_num_guest_cpus);
-
-boolean_t trace_add_record(IN uint32_t vm_index,
-			   IN uint32_t cpu_index,
-			   IN uint32_t buffer_index,
-			   IN trace_record_data_t *data);
-
-boolean_t trace_remove_oldest_record(OUT uint32_t *vm_index,
-				     OUT uint32_t *cpu_index,
-				     OUT uint32_t *buffer_index,
-				     OUT uint32_t *record_index,
-				     OUT trace_record_data_t *data);
+	void		*base;
+	uint32_t	size;
+	uint32_t	num_host_cpus;
+	uint32_t	head_offset;    /* trace_index_t per host CPU */
+	uint32_t	tail_offset;    /* trace_index_t per host CPU */
+	uint32_t	records_offset; /* MAX_RECORDS_IN_BUFFER per host CPU */
+	uint32_t	padding;
+} trace_layout_t;
+
+boolean_t trace_init(uint32_t num_host_cpus);
+
+/* NULL if trace was not initialized */
+const trace_layout_t *trace_get_layout(void);
+
+/* Each host CPU adds records only to its own ring, so no lock is taken.
+ * trace_start_record() returns the slot to fill or NULL if the record must
+ * be dropped, trace_commit_record() publishes the filled slot. */
+trace_record_t *trace_start_record(cpu_id_t host_cpu);
+
+void trace_commit_record(cpu_id_t host_cpu);
+
+/* Removes the record with the lowest TSC over all host CPU rings */
+boolean_t trace_remove_oldest_record(OUT cpu_id_t *host_cpu,
+				     OUT trace_record_t *record);
 
 boolean_t trace_lock(void);
 
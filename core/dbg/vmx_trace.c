@@ -14,6 +14,9 @@
 * limitations under the License.
 *******************************************************************************/
 
+#include "file_codes.h"
+#define MON_DEADLOOP()          MON_DEADLOOP_LOG(VMX_TRACE_C)
+#define MON_ASSERT(__condition) MON_ASSERT_LOG(VMX_TRACE_C, __condition)
 #include "vmx_trace.h"
 #include "trace.h"
 #include "common_libc.h"
@@ -21,19 +24,35 @@
 #include "scheduler.h"
 #include "hw_utils.h"
 #include "mon_dbg.h"
-#include "file_codes.h"
+#include "mon_globals.h"
+#include "guest.h"
+#include "gpm_api.h"
+#include "host_memory_manager_api.h"
+#include "memory_address_mapper_api.h"
+#include "guest_cpu_vmenter_event.h"
+#include "vmcall.h"
+#include "mon_api.h"
 
-#define MON_DEADLOOP()          MON_DEADLOOP_LOG(VMX_TRACE_C)
-#define MON_ASSERT(__condition) MON_ASSERT_LOG(VMX_TRACE_C, __condition)
+#define MAX_MESSAGE_LENGTH      128
 
 static mon_trace_state_t mon_trace_state = MON_TRACE_DISABLED;
 
-boolean_t mon_trace_init(uint32_t max_num_guests, uint32_t max_num_guest_cpus)
+/* the trace memory is mapped to the primary guest only */
+static boolean_t mon_trace_exported = FALSE;
+static uint64_t mon_trace_export_gpa;
+
+/* format strings of mon_trace_event_t, applied to the record arguments */
+static const char *mon_trace_formats[MON_TRACE_EVENT_COUNT] = {
+	[MON_TRACE_EVENT_VMEXIT] = "",
+	[MON_TRACE_EVENT_SIPI_LEAVE] = "[sipi] Leave SIPI State",
+};
+
+boolean_t mon_trace_init(uint32_t num_host_cpus)
 {
 	static boolean_t called = FALSE;
 
 	if (!called) {
-		called = trace_init(max_num_guests, max_num_guest_cpus);
+		called = trace_init(num_host_cpus);
 	}
 
 	return called;
@@ -53,45 +72,17 @@ void mon_trace_state_set(mon_trace_state_t state)
 	}
 }
 
-static size_t
-mon_trace_print_string(const char *format, va_list marker, char *string)
-{
-	char formatted_string[MAX_STRING_LENGTH];
-	size_t max_index, length;
-
-	if (MON_TRACE_DISABLED == mon_trace_state) {
-		return 0;
-	}
-
-	max_index = mon_strlen(format);
-	if (max_index >= MAX_STRING_LENGTH) {
-		MON_DEADLOOP();
-	}
-
-	mon_strcpy_s(formatted_string, MAX_STRING_LENGTH, format);
-	formatted_string[max_index] = '\0';
-
-	length =
-		mon_vsprintf_s(string,
-			MAX_STRING_LENGTH,
-			formatted_string,
-			marker);
-	if (length > MAX_STRING_LENGTH) {
-		MON_DEADLOOP();
-	}
-
-	return length;
-}
-
-boolean_t mon_trace_buffer(guest_cpu_handle_t guest_cpu,
-			   uint8_t buffer_index, const char *format, ...)
+boolean_t mon_trace_event(guest_cpu_handle_t guest_cpu,
+			  mon_trace_event_t event,
+			  uint64_t arg0,
+			  uint64_t arg1,
+			  uint64_t arg2,
+			  uint64_t arg3)
 {
-	va_list marker;
-	trace_record_data_t data;
-	vmcs_object_t *vmcs_obj = 0;
-	const virtual_cpu_id_t *virtual_cpu_id = 0;
-	guest_id_t guest_id = 0;
-	cpu_id_t gcpu_id = 0;
+	cpu_id_t host_cpu;
+	trace_record_t *record;
+	vmcs_object_t *vmcs_obj;
+	const virtual_cpu_id_t *virtual_cpu_id;
 
 	if (MON_TRACE_DISABLED == mon_trace_state) {
 		return FALSE;
@@ -106,82 +97,161 @@ boolean_t mon_trace_buffer(guest_cpu_handle_t guest_cpu,
 			guest_cpu);
 		MON_DEADLOOP();
 	}
+	MON_ASSERT(event < MON_TRACE_EVENT_COUNT);
 
-	mon_memset(&data, 0, sizeof(data));
+	host_cpu = hw_cpu_id();
+	record = trace_start_record(host_cpu);
+	if (record == NULL) {
+		return FALSE;
+	}
 
-	va_start(marker, format);
-	mon_trace_print_string(format, marker, data.string);
-	va_end(marker);
+	record->tsc = hw_rdtsc();
+	record->event_id = (uint16_t)event;
+	record->args[0] = arg0;
+	record->args[1] = arg1;
+	record->args[2] = arg2;
+	record->args[3] = arg3;
 
+	/* both fields are in the VMCS software cache on the VMEXIT path */
 	vmcs_obj = mon_gcpu_get_vmcs(guest_cpu);
-	virtual_cpu_id = mon_guest_vcpu(guest_cpu);
-
 	if (vmcs_obj != NULL) {
-		data.exit_reason =
-			mon_vmcs_read(vmcs_obj, VMCS_EXIT_INFO_REASON);
-		data.guest_eip = mon_vmcs_read(vmcs_obj, VMCS_GUEST_RIP);
+		record->exit_reason =
+			(uint32_t)mon_vmcs_read(vmcs_obj,
+				VMCS_EXIT_INFO_REASON);
+		record->guest_rip = mon_vmcs_read(vmcs_obj, VMCS_GUEST_RIP);
+	} else {
+		record->exit_reason = 0;
+		record->guest_rip = 0;
 	}
-	data.tsc = (buffer_index == (MAX_TRACE_BUFFERS - 1)) ? hw_rdtsc() : 0;
 
+	virtual_cpu_id = mon_guest_vcpu(guest_cpu);
 	if (virtual_cpu_id != NULL) {
-		guest_id = virtual_cpu_id->guest_id;
-		gcpu_id = virtual_cpu_id->guest_cpu_id;
+		record->guest_id = virtual_cpu_id->guest_id;
+		record->guest_cpu_id = virtual_cpu_id->guest_cpu_id;
+	} else {
+		record->guest_id = 0;
+		record->guest_cpu_id = 0;
 	}
 
-	return trace_add_record(guest_id, gcpu_id, buffer_index, &data);
+	trace_commit_record(host_cpu);
+
+	return TRUE;
 }
 
-boolean_t mon_trace(guest_cpu_handle_t guest_cpu, const char *format, ...)
+/*--------------------------------------------------------------------------*
+*  FUNCTION : mon_trace_export_map()
+*  PURPOSE  : Maps the trace memory at gpa of the guest. Heads and records are
+*           : read-only for the guest, tails are writable
+*  ARGUMENTS: guest - guest to map the trace memory to
+*           : gpa - 4K aligned guest physical address of the window
+*  RETURNS  : TRUE if mapped, otherwise nothing is left mapped
+*--------------------------------------------------------------------------*/
+static
+boolean_t mon_trace_export_map(guest_handle_t guest, uint64_t gpa)
 {
-	va_list marker;
-	trace_record_data_t data;
-	vmcs_object_t *vmcs_obj = 0;
-	const virtual_cpu_id_t *virtual_cpu_id = 0;
-	guest_id_t guest_id = 0;
-	cpu_id_t gcpu_id = 0;
-
-	if (MON_TRACE_DISABLED == mon_trace_state) {
-		return FALSE;
+	const trace_layout_t *layout = trace_get_layout();
+	gpm_handle_t gpm = mon_guest_get_startup_gpm(guest);
+	boolean_t ok = TRUE;
+	uint32_t offset;
+	hpa_t hpa;
+
+	guest_begin_physical_memory_modifications(guest);
+
+	for (offset = 0; offset < layout->size; offset += PAGE_4KB_SIZE) {
+		boolean_t writable = (offset >= layout->tail_offset) &&
+				     (offset < layout->records_offset);
+
+		if (!mon_hmm_hva_to_hpa((hva_t)layout->base + offset, &hpa) ||
+		    !mon_gpm_add_mapping(gpm, gpa + offset, hpa,
+			    PAGE_4KB_SIZE,
+			    writable ? mam_rw_attrs : mam_ro_attrs)) {
+			/* drop the pages mapped so far */
+			if (offset != 0) {
+				mon_gpm_remove_mapping(gpm, gpa, offset);
+			}
+			ok = FALSE;
+			break;
+		}
 	}
 
-	if (guest_cpu == NULL) {
-		MON_LOG(mask_anonymous,
-			level_trace,
-			"%a %d: Invalid parameter(s): guest_cpu 0x%x\n",
-			__FUNCTION__,
-			__LINE__,
-			guest_cpu);
-		MON_DEADLOOP();
-	}
+	guest_end_physical_memory_modifications(guest);
 
-	mon_memset(&data, 0, sizeof(data));
+	return ok;
+}
 
-	va_start(marker, format);
-	mon_trace_print_string(format, marker, data.string);
-	va_end(marker);
+/*--------------------------------------------------------------------------*
+*  FUNCTION : mon_trace_export_vmcall_handler()
+*  PURPOSE  : VMCALL_TRACE_EXPORT service. Maps the trace rings into the
+*           : primary guest and enables recycled trace. Other guests get
+*           : MON_ERROR in the status and no layout
+*  ARGUMENTS: arg1 - guest virtual address of mon_trace_export_params_t
+*  RETURNS  : mon_status_t
+*--------------------------------------------------------------------------*/
+static
+mon_status_t mon_trace_export_vmcall_handler(guest_cpu_handle_t gcpu,
+					     address_t *arg1,
+					     address_t *arg2 UNUSED,
+					     address_t *arg3 UNUSED)
+{
+	mon_trace_export_params_t params;
+	const trace_layout_t *layout;
+	guest_handle_t guest = mon_gcpu_guest_handle(gcpu);
+
+	if (copy_from_gva(gcpu, (uint64_t)*arg1, sizeof(params),
+		    (uint64_t)&params) != 0) {
+		mon_gcpu_inject_gp0(gcpu);
+		return MON_ERROR;
+	}
 
-	vmcs_obj = mon_gcpu_get_vmcs(guest_cpu);
-	virtual_cpu_id = mon_guest_vcpu(guest_cpu);
+	params.status = MON_ERROR;
+	mon_trace_init(g_num_of_cpus);
+	layout = trace_get_layout();
+
+	if ((params.vmcall_id == VMCALL_TRACE_EXPORT) && (layout != NULL) &&
+	    guest_is_primary(guest)) {
+		if (mon_trace_exported) {
+			/* already exported, only the same window may be asked
+			 * again */
+			if (mon_trace_export_gpa == params.gpa) {
+				params.status = MON_OK;
+			}
+		} else if ((params.size >= layout->size) &&
+			   ALIGN_BACKWARD(params.gpa, PAGE_4KB_SIZE) ==
+			   params.gpa &&
+			   mon_trace_export_map(guest, params.gpa)) {
+			mon_trace_exported = TRUE;
+			mon_trace_export_gpa = params.gpa;
+			mon_trace_state_set(MON_TRACE_ENABLED_RECYCLED);
+			params.status = MON_OK;
+		}
 
-	if (vmcs_obj != NULL) {
-		data.exit_reason =
-			mon_vmcs_read(vmcs_obj, VMCS_EXIT_INFO_REASON);
-		data.guest_eip = mon_vmcs_read(vmcs_obj, VMCS_GUEST_RIP);
-		data.tsc = 0;
+		params.num_host_cpus = layout->num_host_cpus;
+		params.size = layout->size;
+		params.head_offset = layout->head_offset;
+		params.tail_offset = layout->tail_offset;
+		params.records_offset = layout->records_offset;
+		params.records_per_cpu = MAX_RECORDS_IN_BUFFER;
 	}
 
-	if (virtual_cpu_id != NULL) {
-		guest_id = virtual_cpu_id->guest_id;
-		gcpu_id = virtual_cpu_id->guest_cpu_id;
+	if (copy_to_gva(gcpu, (uint64_t)*arg1, sizeof(params),
+		    (uint64_t)&params) != 0) {
+		mon_gcpu_inject_gp0(gcpu);
+		return MON_ERROR;
 	}
-	return trace_add_record(guest_id, gcpu_id, 0, &data);
+
+	return MON_OK;
+}
+
+void mon_trace_guest_initialize(guest_id_t guest_id)
+{
+	mon_vmcall_register(guest_id, VMCALL_TRACE_EXPORT,
+		mon_trace_export_vmcall_handler, FALSE);
 }
 
 boolean_t mon_trace_print_all(uint32_t guest_num, char *guest_names[])
 {
-	trace_record_data_t record_data;
-	uint32_t vm_index = 0, cpu_index = 0, buffer_index = 0, record_index =
-		0;
+	trace_record_t record;
+	cpu_id_t host_cpu = 0;
 	int cnt = 0;
 
 	if (MON_TRACE_DISABLED == mon_trace_state) {
@@ -191,41 +261,46 @@ boolean_t mon_trace_print_all(uint32_t guest_num, char *guest_names[])
 
 	MON_LOG(mask_anonymous, level_trace, "\nTrace Events\n");
 
-	while (trace_remove_oldest_record(&vm_index,
-		       &cpu_index,
-		       &buffer_index,
-		       &record_index,
-		       &record_data)) {
+	while (trace_remove_oldest_record(&host_cpu, &record)) {
 		char *vm_name;
 		char buffer[5];
+		char message[MAX_MESSAGE_LENGTH];
 
 		if (0 == cnt++ % 0x1F) {
 			MON_LOG(mask_anonymous,
 				level_trace,
-				"Buf   Index    TSC           | VM CPU  Exit Guest"
-				"       EIP    | Message\n"
-				"-----------------------------+--------------------"
+				"CPU   TSC             | VM CPU  Exit Guest"
+				"       RIP    | Message\n"
+				"----------------------+--------------------"
 				"-------------+---------------------\n");
 		}
 
-		if (vm_index < guest_num) {
-			vm_name = guest_names[vm_index];
+		if (record.guest_id < guest_num) {
+			vm_name = guest_names[record.guest_id];
 		} else {
-			mon_sprintf_s(buffer, sizeof(buffer), "%4d", vm_index);
+			mon_sprintf_s(buffer, sizeof(buffer), "%4d",
+				record.guest_id);
 			vm_name = buffer;
 		}
 
+		message[0] = '\0';
+		if (record.event_id < MON_TRACE_EVENT_COUNT) {
+			mon_sprintf_s(message, sizeof(message),
+				mon_trace_formats[record.event_id],
+				record.args[0], record.args[1],
+				record.args[2], record.args[3]);
+		}
+
 		MON_LOG(mask_anonymous,
 			level_trace,
-			"%2d %8d %016lx |%4s %1d  %4d  %018P | %s",
-			buffer_index,
-			record_index,
-			record_data.tsc,
+			"%3d %016lx |%4s %1d  %4d  %018P | %s\n",
+			host_cpu,
+			record.tsc,
 			vm_name,
-			cpu_index,
-			record_data.exit_reason,
-			record_data.guest_eip,
-			record_data.string);
+			record.guest_cpu_id,
+			record.exit_reason,
+			record.guest_rip,
+			message);
 	}
 
 	trace_unlock();
@@ -265,6 +265,20 @@ void guest_set_real_BIOS_access_enabled(guest_handle_t guest)
 	SET_GUEST_BIOS_ACCESS_ENABLED_FLAG(guest);
 }
 
+void guest_set_ept_accessed_dirty_enabled(guest_handle_t guest)
+{
+	MON_ASSERT(guest);
+
+	SET_GUEST_EPT_ACCESSED_DIRTY_FLAG(guest);
+}
+
+boolean_t guest_is_ept_accessed_dirty_enabled(const guest_handle_t guest)
+{
+	MON_ASSERT(guest);
+
+	return GET_GUEST_EPT_ACCESSED_DIRTY_FLAG(guest) != 0;
+}
+
 void guest_set_nmi_owner(guest_handle_t guest)
 {
 	MON_ASSERT(guest);
@@ -462,6 +476,20 @@ msr_vmexit_control_t *guest_get_msr_control(guest_handle_t guest)
 	return guest->msr_control;
 }
 
+void guest_set_control(guest_handle_t guest, guest_control_id_t control_id,
+		       void *control)
+{
+	MON_ASSERT(guest);
+	MON_ASSERT(control_id < GUEST_CONTROL_COUNT);
+
+	guest->controls[control_id] = control;
+}
+
+void *guest_get_control(guest_handle_t guest, guest_control_id_t control_id)
+{
+	return guest->controls[control_id];
+}
+
 /* assumption - all CPUs are running */
 void guest_begin_physical_memory_modifications(guest_handle_t guest)
 {
@@ -52,8 +52,6 @@
 /* list of all guest cpus */
 static guest_cpu_handle_t g_gcpus;
 
-/* this is a shortcut pointer for assembler code */
-guest_cpu_save_area_t **g_guest_regs_save_area = NULL;
 static uint32_t g_host_cpu_count;
 
 CLI_CODE(static void gcpu_install_show_service(void);)
@@ -121,6 +119,32 @@ void cache_fx_state(const guest_cpu_t *gcpu)
 	hw_fxsave(vgcpu->save_area.fxsave_area);
 }
 
+/* extended (XMM) state
+ * MON code is built without vector instructions, so guest XMM registers stay
+ * live in hw across VMEXIT and are not saved in gcpu_save_registers().
+ * Any code that is about to use XMM registers, or to access guest XMM values
+ * in the save area, must call gcpu_save_ext_state() first. The save area is
+ * loaded back to hw by gcpu_resume() right before VMENTRY. */
+void gcpu_save_ext_state(guest_cpu_handle_t gcpu)
+{
+	if (!gcpu->ext_state_live) {
+		return;
+	}
+
+	hw_xmm_save((uint128_t *)(void *)&gcpu->save_area.xmm);
+	gcpu->ext_state_live = FALSE;
+}
+
+void gcpu_restore_ext_state(guest_cpu_t *gcpu)
+{
+	if (gcpu->ext_state_live) {
+		return;
+	}
+
+	hw_xmm_restore((uint128_t *)(void *)&gcpu->save_area.xmm);
+	gcpu->ext_state_live = TRUE;
+}
+
 /*
  * perform minimal init of vmcs
  *
@@ -192,11 +216,6 @@ void gcpu_manager_init(uint16_t host_cpu_count)
 	MON_ASSERT(host_cpu_count);
 
 	g_host_cpu_count = host_cpu_count;
-	g_guest_regs_save_area =
-		mon_memory_alloc(
-			sizeof(guest_cpu_save_area_t *) * host_cpu_count);
-	MON_ASSERT(g_guest_regs_save_area);
-
 	/* init subcomponents */
 	vmcs_hw_init();
 	vmcs_manager_init();
@@ -239,6 +258,8 @@ guest_cpu_handle_t gcpu_allocate(virtual_cpu_id_t vcpu, guest_handle_t guest)
 	gcpu->next_guest_level = GUEST_LEVEL_1_SIMPLE;
 	gcpu->state_flags = 0;
 	gcpu->caching_flags = 0;
+	/* initial XMM values are taken from the save area on first resume */
+	gcpu->ext_state_live = FALSE;
 	/* gcpu->vmcs = vmcs_allocate(); */
 	status = vmcs_hierarchy_create(&gcpu->vmcs_hierarchy, gcpu);
 	MON_ASSERT(MON_OK == status);
@@ -329,6 +350,7 @@ boolean_t gcpu_uses_host_page_tables(guest_cpu_handle_t gcpu)
 void gcpu_do_use_host_page_tables(guest_cpu_handle_t gcpu, boolean_t use)
 {
 	gcpu->use_host_page_tables = (uint8_t)use;
+	gcpu_gva_cache_flush(gcpu);
 }
 
 /*--------------------------------------------------------------------------
@@ -359,6 +381,25 @@ guest_handle_t mon_gcpu_guest_handle(const guest_cpu_handle_t gcpu)
 	return gcpu->guest_handle;
 }
 
+/*--------------------------------------------------------------------------
+ *
+ * Get/Set the gcpu-scope observers of the event manager
+ *
+ *-------------------------------------------------------------------------- */
+void *gcpu_get_event_observers(const guest_cpu_handle_t gcpu)
+{
+	MON_ASSERT(gcpu);
+
+	return gcpu->event_observers;
+}
+
+void gcpu_set_event_observers(guest_cpu_handle_t gcpu, void *observers)
+{
+	MON_ASSERT(gcpu);
+
+	gcpu->event_observers = observers;
+}
+
 boolean_t gcpu_process_interrupt(vector_id_t vector_id)
 {
 	return FALSE;
@@ -483,18 +524,115 @@ void gcpu_initialize(guest_cpu_handle_t gcpu,
 }
 
 /*
- *  Find the GPA corresponding to the GVA, for the indicated CR3
- *  If CR3 is 0, the current CR3 should be used in the page walk.
+ *  GVA translation cache
  */
-boolean_t mon_gcpu_gva_to_gpa(guest_cpu_handle_t gcpu,
-			      gva_t gva,
-			      uint64_t cr3,
-			      gpa_t *gpa)
+#define GCPU_GVA_CACHE_INDEX(__gva) \
+	((uint32_t)ADDRESS_TO_FN(__gva) & (GCPU_GVA_CACHE_SIZE - 1))
+
+void gcpu_gva_cache_flush(guest_cpu_handle_t gcpu)
+{
+	gcpu->gva_cache.valid = 0;
+	gcpu->gva_cache.hva_valid = 0;
+}
+
+void gcpu_gva_cache_invalidate_page(guest_cpu_handle_t gcpu, gva_t gva)
+{
+	/* INVLPG invalidates the page for all PCIDs. When gva is mapped by a
+	 * large page, the whole large page is invalidated, which may be cached
+	 * in several 4K entries */
+	gcpu_gva_cache_entry_t *entry;
+	uint32_t index;
+
+	for (index = 0; index < GCPU_GVA_CACHE_SIZE; index++) {
+		entry = &gcpu->gva_cache.entries[index];
+		if (BIT_GET(gcpu->gva_cache.valid, index) &&
+		    (ALIGN_BACKWARD(entry->gva_page, entry->page_size) ==
+		     ALIGN_BACKWARD(gva, entry->page_size))) {
+			BIT_CLR(gcpu->gva_cache.valid, index);
+			BIT_CLR(gcpu->gva_cache.hva_valid, index);
+		}
+	}
+}
+
+/* flush the cache if anything except guest page tables contents and CR3,
+ * which are checked per entry, changed since it was filled */
+static
+void gcpu_gva_cache_revalidate(guest_cpu_handle_t gcpu, uint64_t visible_cr0)
+{
+	gcpu_gva_cache_t *cache = &gcpu->gva_cache;
+	gpm_handle_t gpm = gcpu_get_current_gpm(mon_gcpu_guest_handle(gcpu));
+	uint32_t gpm_generation = gpm_get_generation(gpm);
+	uint64_t paging_mode;
+
+	paging_mode = (visible_cr0 & CR0_PG) |
+		      (gcpu_get_guest_visible_control_reg(gcpu, IA32_CTRL_CR4) &
+		       (CR4_PAE | CR4_PSE)) |
+		      (gcpu_get_msr_reg(gcpu, IA32_MON_MSR_EFER) & EFER_LME);
+
+	if ((cache->gpm != gpm) || (cache->gpm_generation != gpm_generation) ||
+	    (cache->paging_mode != paging_mode)) {
+		gcpu_gva_cache_flush(gcpu);
+		cache->gpm = gpm;
+		cache->gpm_generation = gpm_generation;
+		cache->paging_mode = paging_mode;
+	}
+}
+
+static
+gcpu_gva_cache_entry_t *gcpu_gva_cache_find(guest_cpu_handle_t gcpu,
+					    gva_t gva,
+					    uint64_t cr3)
+{
+	uint32_t index = GCPU_GVA_CACHE_INDEX(gva);
+	gcpu_gva_cache_entry_t *entry = &gcpu->gva_cache.entries[index];
+
+	if (BIT_GET(gcpu->gva_cache.valid, index) &&
+	    (entry->gva_page == ALIGN_BACKWARD(gva, PAGE_4KB_SIZE)) &&
+	    (entry->cr3 == cr3)) {
+		return entry;
+	}
+	return NULL;
+}
+
+static
+gcpu_gva_cache_entry_t *gcpu_gva_cache_insert(guest_cpu_handle_t gcpu,
+					      gva_t gva,
+					      uint64_t cr3,
+					      gpa_t gpa,
+					      uint64_t page_size)
+{
+	uint32_t index = GCPU_GVA_CACHE_INDEX(gva);
+	gcpu_gva_cache_entry_t *entry = &gcpu->gva_cache.entries[index];
+
+	entry->gva_page = ALIGN_BACKWARD(gva, PAGE_4KB_SIZE);
+	entry->cr3 = cr3;
+	entry->gpa_page = ALIGN_BACKWARD(gpa, PAGE_4KB_SIZE);
+	entry->page_size = page_size;
+	BIT_SET(gcpu->gva_cache.valid, index);
+	BIT_CLR(gcpu->gva_cache.hva_valid, index);
+	return entry;
+}
+
+/*
+ *  Translate GVA to GPA through the translation cache. cache_entry is set
+ *  to the entry used, or to NULL when the translation does not go through
+ *  guest page tables and so is not cached.
+ */
+static
+boolean_t gcpu_gva_to_gpa_cached(guest_cpu_handle_t gcpu,
+				 gva_t gva,
+				 uint64_t cr3,
+				 gpa_t *gpa,
+				 gcpu_gva_cache_entry_t **cache_entry)
 {
 	uint64_t gpa_tmp;
 	uint64_t pfec_tmp;
-	boolean_t res;
+	uint64_t page_size;
+	pw_retval_t res;
 	em64t_cr0_t visible_cr0;
+	gcpu_gva_cache_entry_t *entry;
+
+	*cache_entry = NULL;
 
 	visible_cr0.uint64 =
 		gcpu_get_guest_visible_control_reg(gcpu, IA32_CTRL_CR0);
@@ -508,24 +646,52 @@ boolean_t mon_gcpu_gva_to_gpa(guest_cpu_handle_t gcpu,
 	if (IS_FLAT_PT_INSTALLED(gcpu)) {
 		*gpa = gva;
 		return TRUE;
-	} else {
-		res =
-			pw_perform_page_walk(gcpu,
-				gva,
-				cr3,
-				FALSE,
-				FALSE,
-				FALSE,
-				FALSE,
-				&gpa_tmp,
-				&pfec_tmp);
-		if (res == PW_RETVAL_SUCCESS) {
-			*gpa = gpa_tmp;
-			return TRUE;
-		}
 	}
 
-	return FALSE;
+	if (cr3 == 0) {
+		cr3 = gcpu_get_guest_visible_control_reg(gcpu, IA32_CTRL_CR3);
+	}
+
+	gcpu_gva_cache_revalidate(gcpu, visible_cr0.uint64);
+	entry = gcpu_gva_cache_find(gcpu, gva, cr3);
+	if (entry != NULL) {
+		*gpa = entry->gpa_page | (gva & PAGE_4KB_MASK);
+		*cache_entry = entry;
+		return TRUE;
+	}
+
+	res = pw_perform_page_walk(gcpu,
+		gva,
+		cr3,
+		FALSE,
+		FALSE,
+		FALSE,
+		FALSE,
+		&gpa_tmp,
+		&pfec_tmp,
+		&page_size);
+	if (res != PW_RETVAL_SUCCESS) {
+		return FALSE;
+	}
+
+	*cache_entry = gcpu_gva_cache_insert(gcpu, gva, cr3, gpa_tmp,
+		page_size);
+	*gpa = gpa_tmp;
+	return TRUE;
+}
+
+/*
+ *  Find the GPA corresponding to the GVA, for the indicated CR3
+ *  If CR3 is 0, the current CR3 should be used in the page walk.
+ */
+boolean_t mon_gcpu_gva_to_gpa(guest_cpu_handle_t gcpu,
+			      gva_t gva,
+			      uint64_t cr3,
+			      gpa_t *gpa)
+{
+	gcpu_gva_cache_entry_t *entry;
+
+	return gcpu_gva_to_gpa_cached(gcpu, gva, cr3, gpa, &entry);
 }
 
 boolean_t gcpu_gva_to_hva(guest_cpu_handle_t gcpu, gva_t gva, hva_t *hva)
@@ -534,8 +700,9 @@ boolean_t gcpu_gva_to_hva(guest_cpu_handle_t gcpu, gva_t gva, hva_t *hva)
 	gpm_handle_t gpm_handle;
 	uint64_t gpa;
 	uint64_t hva_tmp;
+	gcpu_gva_cache_entry_t *entry;
 
-	if (!mon_gcpu_gva_to_gpa(gcpu, gva, 0, &gpa)) {
+	if (!gcpu_gva_to_gpa_cached(gcpu, gva, 0, &gpa, &entry)) {
 		MON_LOG(mask_mon,
 			level_error,
 			"%s: Failed to convert gva=%P to gpa\n",
@@ -544,6 +711,13 @@ boolean_t gcpu_gva_to_hva(guest_cpu_handle_t gcpu, gva_t gva, hva_t *hva)
 		return FALSE;
 	}
 
+	if ((entry != NULL) &&
+	    BIT_GET(gcpu->gva_cache.hva_valid,
+		    (uint32_t)(entry - gcpu->gva_cache.entries))) {
+		*hva = entry->hva_page | (gva & PAGE_4KB_MASK);
+		return TRUE;
+	}
+
 	guest_handle = mon_gcpu_guest_handle(gcpu);
 	gpm_handle = gcpu_get_current_gpm(guest_handle);
 
@@ -556,6 +730,12 @@ boolean_t gcpu_gva_to_hva(guest_cpu_handle_t gcpu, gva_t gva, hva_t *hva)
 		return FALSE;
 	}
 
+	if (entry != NULL) {
+		entry->hva_page = ALIGN_BACKWARD(hva_tmp, PAGE_4KB_SIZE);
+		BIT_SET(gcpu->gva_cache.hva_valid,
+			(uint32_t)(entry - gcpu->gva_cache.entries));
+	}
+
 	*hva = hva_tmp;
 	return TRUE;
 }
@@ -217,6 +217,8 @@ void gcpu_set_xmm_reg(guest_cpu_handle_t gcpu, mon_ia32_xmm_registers_t reg,
 {
 	MON_ASSERT(gcpu && IS_MODE_NATIVE(gcpu));
 	MON_ASSERT(reg < IA32_REG_XMM_COUNT);
+	/* make the save area hold the guest state, it is loaded on resume */
+	gcpu_save_ext_state(gcpu);
 	gcpu->save_area.xmm.reg[reg] = value;
 }
 
@@ -419,12 +421,20 @@ void gcpu_set_guest_visible_control_reg_layered(const guest_cpu_handle_t gcpu,
 	if (reg == IA32_CTRL_CR3) {
 		MON_ASSERT(level == VMCS_MERGED);
 		gcpu->save_area.gp.reg[CR3_SAVE_AREA] = value;
+		/* CR3 load flushes guest TLB */
+		gcpu_gva_cache_flush(gcpu);
 	} else if (reg == IA32_CTRL_CR0) {
 		SET_IMPORTANT_EVENT_OCCURED_FLAG(gcpu);
 		mon_vmcs_write(vmcs_hierarchy_get_vmcs(&gcpu->vmcs_hierarchy,
 				level),
 			VMCS_CR0_READ_SHADOW, value);
 	} else if (reg == IA32_CTRL_CR4) {
+		/* toggling CR4.PGE or CR4.PCIDE flushes guest TLB */
+		if ((gcpu_get_guest_visible_control_reg_layered(gcpu,
+			     IA32_CTRL_CR4, level) ^ value) &
+		    (CR4_PGE | CR4_PCIDE)) {
+			gcpu_gva_cache_flush(gcpu);
+		}
 		mon_vmcs_write(vmcs_hierarchy_get_vmcs(&gcpu->vmcs_hierarchy,
 				level),
 			VMCS_CR4_READ_SHADOW, value);
@@ -1222,6 +1222,22 @@ boolean_t gcpu_cr3_virtualized(guest_cpu_handle_t gcpu)
 	return proc_ctrl.bits.cr3_store && proc_ctrl.bits.cr3_load;
 }
 
+/* TRUE if every guest TLB invalidation causes VMEXIT: CR3 loads, INVLPG,
+ * INVPCID (exits together with INVLPG) and toggling CR4.PGE/PCIDE */
+boolean_t gcpu_tlb_invalidation_virtualized(guest_cpu_handle_t gcpu)
+{
+	processor_based_vm_execution_controls_t proc_ctrl;
+	uint64_t cr4_mask;
+
+	proc_ctrl.uint32 =
+		(uint32_t)(gcpu->vmexit_setup.processor_ctrls.bit_field);
+	cr4_mask = GET_FINAL_SETTINGS(gcpu, cr4,
+		gcpu->vmexit_setup.cr4.bit_field);
+	return proc_ctrl.bits.cr3_load && proc_ctrl.bits.invlpg &&
+	       ((cr4_mask & (CR4_PGE | CR4_PCIDE)) ==
+		(CR4_PGE | CR4_PCIDE));
+}
+
 /*
  *   Enforce settings on hardware VMCS only
  *   these changes are not reflected in vmcs#0
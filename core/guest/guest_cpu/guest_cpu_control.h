@@ -62,6 +62,9 @@ void gcpu_temp_exceptions_setup(guest_cpu_handle_t gcpu,
 
 boolean_t gcpu_cr3_virtualized(guest_cpu_handle_t gcpu);
 
+/* TRUE if guest CR3 loads and INVLPG both cause VMEXITs */
+boolean_t gcpu_tlb_invalidation_virtualized(guest_cpu_handle_t gcpu);
+
 void gcpu_enforce_settings_on_hardware(guest_cpu_handle_t gcpu,
 				       gcpu_temp_exceptions_setup_t action);
 
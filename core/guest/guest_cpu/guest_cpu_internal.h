@@ -65,15 +65,15 @@ typedef struct {
 } PACKED mon_other_msrs_t;
 
 typedef struct {
-	/* the next 2 fields must be the first in this structure because
-	 * they are referenced in assembler */
+	/* gp must be the first in this structure because it is referenced in
+	 * assembler. xmm is filled on demand, see gcpu_save_ext_state() */
 	/* note:
 	 * RSP, RIP and RFLAGS are not used - use VMCS
 	 * RSP entry is used for CR2
 	 * RFLAGS entry is used for CR3
 	 * RIP entry is used for CR8 */
 	mon_gp_registers_t	gp;
-	ALIGN16(mon_xmm_registers_t, xmm); /* restored AFTER FXRSTOR */
+	ALIGN16(mon_xmm_registers_t, xmm); /* loaded by gcpu_restore_ext_state() */
 
 	/* not referenced in assembler */
 	mon_debug_register_t	debug; /* dr7 is not used - use VMCS */
@@ -100,6 +100,33 @@ typedef struct {
 	uint32_t	padding;
 } fvs_cpu_descriptor_t;
 
+/*
+ * Software GVA -> GPA/HVA translation cache, direct mapped by 4K page.
+ * Entries are tagged with the CR3 (PCID included) they were walked from;
+ * the whole cache is tagged with GPM + GPM generation and with the paging
+ * mode bits the page walker depends on. Each entry keeps the size of the
+ * guest page it belongs to, so INVLPG of a large page drops all its entries.
+ */
+#define GCPU_GVA_CACHE_SIZE     16
+
+typedef struct {
+	uint64_t	gva_page;
+	uint64_t	cr3;
+	uint64_t	gpa_page;
+	uint64_t	hva_page;       /* valid if set in hva_valid */
+	uint64_t	page_size;      /* size of the guest page, 4K or larger */
+} gcpu_gva_cache_entry_t;
+
+typedef struct {
+	gcpu_gva_cache_entry_t	entries[GCPU_GVA_CACHE_SIZE];
+	uint32_t		valid;          /* bitmap of valid entries */
+	uint32_t		hva_valid;      /* bitmap of entries with hva_page */
+	gpm_handle_t		gpm;
+	uint32_t		gpm_generation;
+	uint32_t		padding;
+	uint64_t		paging_mode;    /* CR0.PG, CR4.PAE/PSE, EFER.LME */
+} gcpu_gva_cache_t;
+
 /* invalid CR3 value used to specify that CR3_SAVE_AREA is not up-to-date */
 #define INVALID_CR3_SAVED_VALUE     UINT64_ALL_ONES
 
@@ -119,7 +146,7 @@ typedef struct guest_cpu_t {
 	uint32_t			hw_enforcements;
 	uint8_t				merge_required;
 	uint8_t				cached_activity_state; /* Used to determine activity state switch */
-	uint8_t				pad;
+	uint8_t				ext_state_live;        /* 1 - guest XMM state is in hw, save_area.xmm is stale */
 	uint8_t				use_host_page_tables;
 
 	gcpu_vmexit_controls_t		vmexit_setup;
@@ -128,6 +155,7 @@ typedef struct guest_cpu_t {
 	func_gcpu_vmexit_t		vmexit_func;
 	void				*vmdb;  /* guest debugger handler */
 	void				*timer;
+	void				*event_observers; /* gcpu-scope events */
 
 	gpm_handle_t			active_gpm;
 
@@ -136,6 +164,8 @@ typedef struct guest_cpu_t {
 	uint32_t			trigger_log_event;
 	uint8_t				pad2[4];
 	ve_descriptor_t			ve_desc;
+
+	gcpu_gva_cache_t		gva_cache;
 } guest_cpu_t;
 
 /* ----------------------- state ------------------------------------------- */
@@ -253,15 +283,11 @@ typedef enum {
 #define SET_ALL_MODIFIED(gcpu)     { (gcpu)->caching_flags = (uint8_t)-1; }
 #define CLR_ALL_CACHED(gcpu)       { (gcpu)->caching_flags = 0; }
 
-/* ---------------------------- globals ------------------------------------- */
-
-/* this is a shortcut pointer for assembler code */
-extern guest_cpu_save_area_t **g_guest_regs_save_area;
-
 /* ---------------------------- internal API ----------------------------------
  */
 void cache_debug_registers(const guest_cpu_t *gcpu);
 void cache_fx_state(const guest_cpu_t *gcpu);
+void gcpu_restore_ext_state(guest_cpu_t *gcpu);
 
 INLINE uint64_t
 gcpu_get_msr_reg_internal(const guest_cpu_handle_t gcpu,
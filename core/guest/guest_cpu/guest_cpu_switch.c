@@ -36,6 +36,7 @@
 #include "unrestricted_guest.h"
 #include "fvs.h"
 #include "ept.h"
+#include "hw_pcpu.h"
 
 extern boolean_t is_ib_registered(void);
 
@@ -68,7 +69,6 @@ typedef enum {                  /* bit values */
 	VMCS_HW_ENFORCE_CACHE_DISABLED = 4,
 } vmcs_hw_enforcement_id_t;
 
-extern boolean_t vmcs_sw_shadow_disable[];
 
 static
 mon_status_t gcpu_set_hw_enforcement(guest_cpu_handle_t gcpu,
@@ -453,6 +453,9 @@ void gcpu_swap_out(guest_cpu_handle_t gcpu)
 		cache_fx_state(gcpu);
 	}
 
+	/* next gcpu on this host CPU owns XMM registers */
+	gcpu_save_ext_state(gcpu);
+
 	vmcs_deactivate(vmcs);
 }
 
@@ -462,7 +465,7 @@ void gcpu_swap_in(const guest_cpu_handle_t gcpu)
 	vmcs_object_t *vmcs = mon_gcpu_get_vmcs(gcpu);
 
 	/* make global assembler save area for this host CPU point to new guest */
-	g_guest_regs_save_area[hw_cpu_id()] = &(gcpu->save_area);
+	hw_pcpu()->gcpu_save_area = &(gcpu->save_area);
 
 	vmcs_activate(vmcs);
 
@@ -485,9 +488,15 @@ void gcpu_vmexit_start(const guest_cpu_handle_t gcpu)
 	 * and should be cached by CR3-access handler */
 	gcpu->save_area.gp.reg[CR8_SAVE_AREA] = hw_read_cr8();
 
-	if (!vmcs_sw_shadow_disable[hw_cpu_id()]) {
+	if (!hw_pcpu()->vmcs_sw_shadow_disable) {
 		CLR_ALL_CACHED(gcpu);
 		vmcs_clear_cache(vmcs);
+		vmcs_act_prefetch_exit_info(vmcs);
+	}
+	/* cached GVA translations are only kept across VMEXITs if the guest
+	 * can not invalidate its TLB behind our back */
+	if (!gcpu_tlb_invalidation_virtualized(gcpu)) {
+		gcpu_gva_cache_flush(gcpu);
 	}
 	/* if CR3 is not virtualized, update
 	 * internal storage with user-visible guest value */
@@ -667,6 +676,7 @@ void gcpu_process_activity_state_change(guest_cpu_handle_t gcpu)
 void gcpu_resume(guest_cpu_handle_t gcpu)
 {
 	vmcs_object_t *vmcs;
+	hw_pcpu_t *pcpu = hw_pcpu();
 
 	if (IS_MODE_NATIVE(gcpu)) {
 		gcpu = gcpu->resume_func(gcpu); /* layered specific resume */
@@ -799,11 +809,14 @@ void gcpu_resume(guest_cpu_handle_t gcpu)
 	}
 
 	/* flash VMCS */
-	if (!vmcs_sw_shadow_disable[hw_cpu_id()]) {
+	if (!pcpu->vmcs_sw_shadow_disable) {
 		vmcs_flush_to_cpu(vmcs);
 	}
 
-	vmcs_sw_shadow_disable[hw_cpu_id()] = FALSE;
+	pcpu->vmcs_sw_shadow_disable = FALSE;
+
+	/* reload guest XMM registers if anybody saved them during this VMEXIT */
+	gcpu_restore_ext_state(gcpu);
 
 	if (!vmcs_launch_required(vmcs)) {
 		nmi_window_update_before_vmresume(vmcs);
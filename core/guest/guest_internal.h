@@ -53,6 +53,7 @@ typedef struct guest_descriptor_t {
 
 	list_element_t			cpuid_filter_list[1];
 	msr_vmexit_control_t		msr_control[1];
+	void				*controls[GUEST_CONTROL_COUNT];
 
 	uint32_t			padding2;
 	boolean_t			is_initialization_finished;
@@ -65,6 +66,7 @@ typedef enum {
 	GUEST_IS_ACPI_OWNER_FLAG,
 	GUEST_IS_DEFAULT_DEVICE_OWNER_FLAG,
 	GUEST_BIOS_ACCESS_ENABLED_FLAG,
+	GUEST_EPT_ACCESSED_DIRTY_FLAG,
 
 	GUEST_SAVED_IMAGE_IS_COMPRESSED_FLAG
 } guest_flags_t;
@@ -104,6 +106,13 @@ typedef enum {
 #define GET_GUEST_BIOS_ACCESS_ENABLED_FLAG(guest)       \
 	BIT_GET((guest)->flags, GUEST_BIOS_ACCESS_ENABLED_FLAG)
 
+#define SET_GUEST_EPT_ACCESSED_DIRTY_FLAG(guest)        \
+	BIT_SET((guest)->flags, GUEST_EPT_ACCESSED_DIRTY_FLAG)
+#define CLR_GUEST_EPT_ACCESSED_DIRTY_FLAG(guest)        \
+	BIT_CLR((guest)->flags, GUEST_EPT_ACCESSED_DIRTY_FLAG)
+#define GET_GUEST_EPT_ACCESSED_DIRTY_FLAG(guest)        \
+	BIT_GET((guest)->flags, GUEST_EPT_ACCESSED_DIRTY_FLAG)
+
 #define SET_GUEST_SAVED_IMAGE_IS_COMPRESSED_FLAG(guest) \
 	BIT_SET((guest)->flags, GUEST_SAVED_IMAGE_IS_COMPRESSED_FLAG)
 #define CLR_GUEST_SAVED_IMAGE_IS_COMPRESSED_FLAG(guest) \
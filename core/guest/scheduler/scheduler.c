@@ -25,6 +25,7 @@
 #include "list.h"
 #include "memory_allocator.h"
 #include "lock.h"
+#include "hw_pcpu.h"
 
 /*
  *
@@ -83,10 +84,26 @@ static scheduler_vcpu_object_t *g_registered_vcpus;
 /* scheduler state per host CPU */
 static scheduler_cpu_state_t *g_scheduler_state;
 
-/* lock to support guest addition while performing scheduling operations */
-static mon_read_write_lock_t g_registration_lock[1];
+/* lock to support guest addition while performing scheduling operations,
+ * phase-fair so registration at guest bring-up is not starved by lookups */
+static mon_pf_rw_lock_t g_registration_lock[1];
 
 /* --------------------------- internal functions ------------------------- */
+
+/* state of the current host CPU, reached through its per CPU data block */
+INLINE scheduler_cpu_state_t *scheduler_current_cpu_state(void)
+{
+	return (scheduler_cpu_state_t *)hw_pcpu()->scheduler_state;
+}
+
+/* the gcpu is mirrored in the per CPU data block for
+ * mon_scheduler_current_gcpu() */
+INLINE void scheduler_set_current_vcpu(scheduler_cpu_state_t *state,
+				       scheduler_vcpu_object_t *vcpu_obj)
+{
+	state->current_vcpu_obj = vcpu_obj;
+	hw_pcpu()->current_gcpu = vcpu_obj->gcpu;
+}
 static
 scheduler_vcpu_object_t *gcpu_2_vcpu_obj(guest_cpu_handle_t gcpu)
 {
@@ -118,6 +135,7 @@ void add_to_per_cpu_list(scheduler_vcpu_object_t *vcpu_obj)
 void scheduler_init(uint16_t number_of_host_cpus)
 {
 	uint32_t memory_for_state = 0;
+	cpu_id_t host_cpu;
 
 	mon_memset(g_registration_lock, 0, sizeof(g_registration_lock));
 
@@ -128,12 +146,16 @@ void scheduler_init(uint16_t number_of_host_cpus)
 	/* count needed memory amount */
 	memory_for_state = sizeof(scheduler_cpu_state_t) * g_host_cpus_count;
 
-	lock_initialize_read_write_lock(g_registration_lock);
+	pf_rw_lock_initialize(g_registration_lock);
 
 	g_scheduler_state =
 		(scheduler_cpu_state_t *)mon_malloc(memory_for_state);
 
 	MON_ASSERT(g_scheduler_state != 0);
+
+	for (host_cpu = 0; host_cpu < g_host_cpus_count; host_cpu++)
+		hw_pcpu_of(host_cpu)->scheduler_state =
+			&(g_scheduler_state[host_cpu]);
 }
 
 /* register guest cpu */
@@ -148,7 +170,7 @@ void scheduler_register_gcpu(guest_cpu_handle_t gcpu_handle,
 				scheduler_vcpu_object_t));
 	MON_ASSERT(vcpu_obj);
 
-	interruptible_lock_acquire_writelock(g_registration_lock);
+	interruptible_pf_rw_lock_acquire_writelock(g_registration_lock);
 
 	vcpu_obj->next_all_cpus = g_registered_vcpus;
 	g_registered_vcpus = vcpu_obj;
@@ -168,19 +190,17 @@ void scheduler_register_gcpu(guest_cpu_handle_t gcpu_handle,
 	/* add to the per-host-cpu list */
 	add_to_per_cpu_list(vcpu_obj);
 
-	lock_release_writelock(g_registration_lock);
+	pf_rw_lock_release_writelock(g_registration_lock);
 }
 
 /* Get current guest_cpu_handle_t */
 guest_cpu_handle_t mon_scheduler_current_gcpu(void)
 {
-	scheduler_vcpu_object_t *vcpu_obj = 0;
-
-	vcpu_obj = g_scheduler_state[hw_cpu_id()].current_vcpu_obj;
+	guest_cpu_handle_t gcpu = hw_pcpu()->current_gcpu;
 
-	MON_ASSERT(vcpu_obj != NULL);
+	MON_ASSERT(gcpu != NULL);
 
-	return vcpu_obj == NULL ? NULL : vcpu_obj->gcpu;
+	return gcpu;
 }
 
 /* Get Host CPU Id for which given Guest CPU is assigned.
@@ -190,10 +210,10 @@ uint16_t scheduler_get_host_cpu_id(guest_cpu_handle_t gcpu)
 {
 	scheduler_vcpu_object_t *vcpu_obj = NULL;
 
-	interruptible_lock_acquire_readlock(g_registration_lock);
+	interruptible_pf_rw_lock_acquire_readlock(g_registration_lock);
 	vcpu_obj = gcpu_2_vcpu_obj(gcpu);
 	MON_ASSERT(vcpu_obj);
-	lock_release_readlock(g_registration_lock);
+	pf_rw_lock_release_readlock(g_registration_lock);
 
 	return vcpu_obj->host_cpu;
 }
@@ -240,8 +260,7 @@ scheduler_same_host_cpu_gcpu_first(scheduler_gcpu_iterator_t *ctx,
  */
 guest_cpu_handle_t scheduler_select_initial_gcpu(void)
 {
-	cpu_id_t host_cpu = hw_cpu_id();
-	scheduler_cpu_state_t *state = &(g_scheduler_state[host_cpu]);
+	scheduler_cpu_state_t *state = scheduler_current_cpu_state();
 	scheduler_vcpu_object_t *next_vcpu = state->vcpu_obj_list;
 
 	/* very simple implementation */
@@ -250,7 +269,7 @@ guest_cpu_handle_t scheduler_select_initial_gcpu(void)
 		return NULL;
 	}
 
-	state->current_vcpu_obj = next_vcpu;
+	scheduler_set_current_vcpu(state, next_vcpu);
 	/* load full state of new guest from memory */
 	gcpu_swap_in(state->current_vcpu_obj->gcpu);
 
@@ -259,8 +278,7 @@ guest_cpu_handle_t scheduler_select_initial_gcpu(void)
 
 guest_cpu_handle_t scheduler_select_next_gcpu(void)
 {
-	cpu_id_t host_cpu = hw_cpu_id();
-	scheduler_cpu_state_t *state = &(g_scheduler_state[host_cpu]);
+	scheduler_cpu_state_t *state = scheduler_current_cpu_state();
 	scheduler_vcpu_object_t *next_vcpu = NULL;
 
 	if (state->current_vcpu_obj != NULL) {
@@ -280,7 +298,7 @@ guest_cpu_handle_t scheduler_select_next_gcpu(void)
 			/* save full state of prev. guest in memory */
 			gcpu_swap_out(state->current_vcpu_obj->gcpu);
 		}
-		state->current_vcpu_obj = next_vcpu;
+		scheduler_set_current_vcpu(state, next_vcpu);
 		/* load full state of new guest from memory */
 		gcpu_swap_in(state->current_vcpu_obj->gcpu);
 	}
@@ -292,7 +310,6 @@ guest_cpu_handle_t scheduler_select_next_gcpu(void)
  * Validate in caller function.  */
 guest_cpu_handle_t scheduler_schedule_gcpu(guest_cpu_handle_t gcpu)
 {
-	cpu_id_t host_cpu = hw_cpu_id();
 	scheduler_cpu_state_t *state = NULL;
 	scheduler_vcpu_object_t *next_vcpu = gcpu_2_vcpu_obj(gcpu);
 
@@ -300,14 +317,14 @@ guest_cpu_handle_t scheduler_schedule_gcpu(guest_cpu_handle_t gcpu)
 		return NULL;
 	}
 
-	state = &(g_scheduler_state[host_cpu]);
+	state = scheduler_current_cpu_state();
 
 	if (state->current_vcpu_obj != next_vcpu) {
 		if (state->current_vcpu_obj != NULL) {
 			/* save full state of prev. guest in memory */
 			gcpu_swap_out(state->current_vcpu_obj->gcpu);
 		}
-		state->current_vcpu_obj = next_vcpu;
+		scheduler_set_current_vcpu(state, next_vcpu);
 		/* load full state of new guest from memory */
 		gcpu_swap_in(state->current_vcpu_obj->gcpu);
 	}
@@ -321,7 +338,7 @@ guest_cpu_handle_t mon_scheduler_get_current_gcpu_for_guest(guest_id_t guest_id)
 	const virtual_cpu_id_t *vcpu_id = NULL;
 
 	MON_ASSERT(g_scheduler_state);
-	for (vcpu_obj = g_scheduler_state[hw_cpu_id()].vcpu_obj_list;
+	for (vcpu_obj = scheduler_current_cpu_state()->vcpu_obj_list;
 	     NULL != vcpu_obj; vcpu_obj = vcpu_obj->next_same_host_cpu) {
 		vcpu_id = mon_guest_vcpu(vcpu_obj->gcpu);
 		/* paranoid check. If assertion fails, possible memory corruption. */
@@ -29,6 +29,7 @@
 #include "scheduler.h"
 #include "hw_utils.h"
 #include "em64t_defs.h"
+#include "hw_pcpu.h"
 #include "file_codes.h"
 
 #define MON_DEADLOOP()          MON_DEADLOOP_LOG(HOST_CPU_C)
@@ -59,7 +60,6 @@ typedef struct {
 	ia32_vmx_msr_entry_t	*vmexit_msr_load_list;
 	uint32_t		vmexit_msr_load_count;
 	uint32_t		max_vmexit_msr_load_count;
-	guest_cpu_handle_t	last_vmexit_gcpu;
 
 	uint64_t		host_dr7;
 } PACKED host_cpu_save_area_t;
@@ -345,14 +345,10 @@ void host_cpu_vmcs_init(guest_cpu_handle_t gcpu)
 
 	/*
 	 *  GS (Selector + Base)
+	 *  Base is the per host CPU data block, not the one from the GDT
 	 */
-	status =
-		hw_gdt_parse_entry((uint8_t *)gdtr.base,
-			hw_read_gs(), &base, &limit,
-			&attributes);
-	MON_ASSERT(status == MON_OK);
 	mon_vmcs_write(vmcs, VMCS_HOST_GS_SELECTOR, hw_read_gs());
-	mon_vmcs_write(vmcs, VMCS_HOST_GS_BASE, base);
+	mon_vmcs_write(vmcs, VMCS_HOST_GS_BASE, (uint64_t)hw_pcpu_of(cpu));
 
 	/*
 	 *  TR (Selector + Base)
@@ -504,14 +500,11 @@ void host_cpu_enable_usage_of_xmm_regs(void)
 	hw_write_cr4(cr4.uint64);
 }
 
-void host_cpu_store_vmexit_gcpu(cpu_id_t cpu_id, guest_cpu_handle_t gcpu)
+void host_cpu_store_vmexit_gcpu(guest_cpu_handle_t gcpu)
 {
-	if (cpu_id < g_max_host_cpus) {
-		g_host_cpus[cpu_id].last_vmexit_gcpu = gcpu;
+	hw_pcpu()->vmexit_gcpu = gcpu;
 
-		MON_DEBUG_CODE(mon_trace(gcpu, "\n");
-			)
-	}
+	mon_trace_event(gcpu, MON_TRACE_EVENT_VMEXIT, 0, 0, 0, 0);
 }
 
 guest_cpu_handle_t host_cpu_get_vmexit_gcpu(cpu_id_t cpu_id)
@@ -519,7 +512,7 @@ guest_cpu_handle_t host_cpu_get_vmexit_gcpu(cpu_id_t cpu_id)
 	guest_cpu_handle_t gcpu = NULL;
 
 	if (cpu_id < g_max_host_cpus) {
-		gcpu = g_host_cpus[cpu_id].last_vmexit_gcpu;
+		gcpu = hw_pcpu_of(cpu_id)->vmexit_gcpu;
 	}
 	return gcpu;
 }
@@ -21,6 +21,7 @@
 #include "em64t_defs.h"
 #include "ia32_defs.h"
 #include "gdt.h"
+#include "hw_pcpu.h"
 #include "mon_dbg.h"
 #include "file_codes.h"
 
@@ -228,6 +229,9 @@ void hw_gdt_load(IN cpu_id_t cpu_id)
 	hw_write_es(0);
 	hw_write_fs(0);
 	hw_write_gs(0);
+
+	/* loading GS selector clears GS base */
+	hw_pcpu_load(cpu_id);
 }
 
 /*-------------------------------------------------------*
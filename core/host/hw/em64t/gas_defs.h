@@ -65,4 +65,9 @@
 #define XMM_REG_OFFSET(__xmm_reg_id)      \
 	(GR_REG_OFFSET(IA32_REG_COUNT) + __xmm_reg_id * 16)
 
+/* -- offsets in hw_pcpu_t, must match hw_pcpu.h */
+#define HW_PCPU_SELF_OFFSET             0
+#define HW_PCPU_GCPU_SAVE_AREA_OFFSET   8
+#define HW_PCPU_CPU_ID_OFFSET           16
+
 #endif /* _GAS_DEFS_H_ */
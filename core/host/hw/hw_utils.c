@@ -17,6 +17,8 @@
 #include "mon_defs.h"
 #include "hw_utils.h"
 #include "hw_interlocked.h"
+#include "hw_pcpu.h"
+#include "msr_defs.h"
 #include "trial_exec.h"
 #include "local_apic.h"
 #include "8259a_pic.h"
@@ -28,6 +30,11 @@
 
 static uint64_t hw_tsc_ticks_per_second;
 
+/* per host CPU data blocks, statically allocated so that they are usable
+ * from the very first instructions of each CPU */
+static ALIGN_N(hw_pcpu_t, hw_pcpus[MON_MAX_CPU_SUPPORTED],
+	HW_PCPU_ALIGNMENT);
+
 #define IA32_DEBUG_IO_PORT   0x80
 
 /*================================== hw_stall() ===========================
@@ -151,3 +158,18 @@ boolean_t hw_rdmsr_safe(uint32_t msr_id,
 	END_TRY;
 	return ret;
 }
+
+hw_pcpu_t *hw_pcpu_of(cpu_id_t cpu_id)
+{
+	MON_ASSERT(cpu_id < MON_MAX_CPU_SUPPORTED);
+	return &hw_pcpus[cpu_id];
+}
+
+void hw_pcpu_load(cpu_id_t cpu_id)
+{
+	hw_pcpu_t *pcpu = hw_pcpu_of(cpu_id);
+
+	pcpu->self = pcpu;
+	pcpu->cpu_id = cpu_id;
+	hw_write_msr(IA32_MSR_GS_BASE, (uint64_t)pcpu);
+}
@@ -28,6 +28,9 @@ typedef void (*func_cache64_field_process_t) (uint32_t entry_no, void *arg);
 
 cache64_object_t cache64_create(uint32_t num_of_entries);
 void cache64_write(cache64_object_t cache, uint64_t value, uint32_t entry_no);
+/* set entry value without marking it dirty (for values read from backing
+ * store); dirty entries are left untouched */
+void cache64_fill(cache64_object_t cache, uint64_t value, uint32_t entry_no);
 /* return TRUE if entry is valid */
 boolean_t cache64_read(cache64_object_t cache,
 		       uint64_t *p_value,
@@ -48,6 +51,10 @@ void cache64_flush_to_memory(cache64_object_t cache,
 			     uint32_t max_bytes);
 /* return TRUE if any field is dirty valid */
 boolean_t cache64_is_dirty(cache64_object_t cache);
+/* return TRUE if any field in [first_entry, last_entry] is dirty */
+boolean_t cache64_is_dirty_range(cache64_object_t cache,
+				 uint32_t first_entry,
+				 uint32_t last_entry);
 void cache64_destroy(cache64_object_t cache);
 
 #endif  /* _CACHE64_H_ */
@@ -92,6 +92,16 @@ boolean_t gpm_add_mmio_range(IN gpm_handle_t gpm_handle,
 			     IN gpa_t gpa,
 			     IN uint64_t size);
 
+/*--------------------------------------------------------------------------
+ * Function: gpm_get_generation
+ * Description: Returns a counter that changes on every modification of
+ *              GPA -> HPA mapping. Users caching translations compare it
+ *              to the value seen when the translation was cached.
+ * Input: gpm_handle - handle received from "gpm_create_mapping"
+ * Return Value: current generation
+ *--------------------------------------------------------------------------*/
+uint32_t gpm_get_generation(IN gpm_handle_t gpm_handle);
+
 /*--------------------------------------------------------------------------
  * Function: gpm_is_mmio_address
  * Description: This function gives an information whether given address is
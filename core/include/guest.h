@@ -111,6 +111,10 @@ guest_id_t guest_get_primary_guest_id(void);
 
 void guest_set_real_BIOS_access_enabled(guest_handle_t guest);
 
+/* EPT accessed/dirty flags; takes effect only if supported by the CPU */
+void guest_set_ept_accessed_dirty_enabled(guest_handle_t guest);
+boolean_t guest_is_ept_accessed_dirty_enabled(const guest_handle_t guest);
+
 void guest_set_nmi_owner(guest_handle_t guest);
 boolean_t guest_is_nmi_owner(const guest_handle_t guest);
 
@@ -127,6 +131,18 @@ gpm_handle_t mon_guest_get_startup_gpm(guest_handle_t guest);
 gpm_handle_t gcpu_get_current_gpm(guest_handle_t guest);
 void mon_gcpu_set_current_gpm(guest_cpu_handle_t gcpu, gpm_handle_t gpm);
 
+/*--------------------------------------------------------------------------
+ * Change guest physical memory at runtime
+ *
+ * begin stops all CPUs, the startup GPM may be modified in between, end
+ * notifies guest CPUs, rebuilds EPT and resumes all CPUs. perm_update ends
+ * a modification of the default EPT permissions instead, invalidating
+ * only the ranges reported with mon_ept_add_pending_invalidation()
+ *-------------------------------------------------------------------------- */
+void guest_begin_physical_memory_modifications(guest_handle_t guest);
+void guest_end_physical_memory_modifications(guest_handle_t guest);
+void guest_end_physical_memory_perm_update(guest_handle_t guest);
+
 /*--------------------------------------------------------------------------
  * Guest executable image
  *
@@ -178,6 +194,23 @@ list_element_t *guest_get_cpuid_list(guest_handle_t guest);
 
 msr_vmexit_control_t *guest_get_msr_control(guest_handle_t guest);
 
+/*--------------------------------------------------------------------------
+ * Per-guest control blocks of the VMEXIT, IO VMEXIT and VMCALL dispatchers
+ *
+ * The blocks are attached to the guest descriptor, so the dispatchers find
+ * them in constant time on every VMEXIT.
+ *-------------------------------------------------------------------------- */
+typedef enum {
+	GUEST_VMEXIT_CONTROL = 0,
+	GUEST_IO_VMEXIT_CONTROL,
+	GUEST_VMCALL_CONTROL,
+	GUEST_CONTROL_COUNT
+} guest_control_id_t;
+
+void guest_set_control(guest_handle_t guest, guest_control_id_t control_id,
+		       void *control);
+void *guest_get_control(guest_handle_t guest, guest_control_id_t control_id);
+
 /*--------------------------------------------------------------------------
  * enumerate guests
  *
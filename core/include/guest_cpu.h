@@ -218,6 +218,14 @@ const virtual_cpu_id_t *mon_guest_vcpu(const guest_cpu_handle_t gcpu);
  *-------------------------------------------------------------------------- */
 guest_handle_t mon_gcpu_guest_handle(const guest_cpu_handle_t gcpu);
 
+/*--------------------------------------------------------------------------
+ *
+ * Get/Set the gcpu-scope observers of the event manager
+ *
+ *-------------------------------------------------------------------------- */
+void *gcpu_get_event_observers(const guest_cpu_handle_t gcpu);
+void gcpu_set_event_observers(guest_cpu_handle_t gcpu, void *observers);
+
 /*--------------------------------------------------------------------------
  *
  * Context switching
@@ -413,6 +421,10 @@ boolean_t mon_gcpu_gva_to_gpa(guest_cpu_handle_t gcpu,
 /* convert GVA to HVA */
 boolean_t gcpu_gva_to_hva(guest_cpu_handle_t gcpu, gva_t gva, hva_t *hva);
 
+/* drop cached GVA translations (all, or of the given page only) */
+void gcpu_gva_cache_flush(guest_cpu_handle_t gcpu);
+void gcpu_gva_cache_invalidate_page(guest_cpu_handle_t gcpu, gva_t gva);
+
 /* Private API for guest.c */
 void gcpu_manager_init(uint16_t host_cpu_count);
 guest_cpu_handle_t gcpu_allocate(virtual_cpu_id_t vcpu, guest_handle_t guest);
@@ -438,6 +450,10 @@ void gcpu_set_xmm_reg(guest_cpu_handle_t gcpu,
 		      mon_ia32_xmm_registers_t reg,
 		      uint128_t value);
 
+/* Guest XMM registers are not saved on VMEXIT. Call before using XMM
+ * registers in MON code; they are reloaded on the next VMENTRY */
+void gcpu_save_ext_state(guest_cpu_handle_t gcpu);
+
 /*
  *   Below are placed wrappers for access functions for default case
  *   i.e. applied to merged VMCS
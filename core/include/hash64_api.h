@@ -36,8 +36,16 @@ typedef void *hash64_multiple_values_hash_iterator_t;
  */
 uint32_t hash64_get_node_size(void);
 
+/* Default hash is open addressing hash, see hash64_create_open_hash() */
 hash64_handle_t hash64_create_default_hash(uint32_t hash_size);
 
+/* Open addressing hash: keys and values are kept inline (no per-node
+ * allocation) and the hash grows automatically. hash_size is the initial
+ * number of slots, rounded up to a power of 2. Modifications must be
+ * serialized by the caller, hash64_lookup() may run concurrently with them.
+ * hash64_change_size_and_rehash() may only enlarge it. */
+hash64_handle_t hash64_create_open_hash(uint32_t hash_size);
+
 /*------------------------------------------------------------*
 * Function: hash64_create_hash
 * Description: This function is used in order to create 1-1 hash
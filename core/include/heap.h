@@ -28,6 +28,13 @@ typedef struct {
 	HEAP_PAGE_INT	number_of_pages : 31;
 	/* 1=InUse */
 	HEAP_PAGE_INT	in_use : 1;
+	/* free list links, valid in the first page of a free block only.
+	 * They grow the descriptor from 4 to 12 bytes (0.3% of the heap
+	 * instead of 0.1%). They can't be kept in the free pages themselves:
+	 * heap pages may be unmapped from the host address space, like the
+	 * VMCS regions are by hmm_unmap_hpa() */
+	HEAP_PAGE_INT	next_free;
+	HEAP_PAGE_INT	prev_free;
 
 #ifdef DEBUG
 	int32_t		line_number;
@@ -82,7 +82,7 @@ host_cpu_init_vmexit_store_and_vmenter_load_msr_lists_according_to_vmexit_load_l
 /*
  * Debug support
  */
-void host_cpu_store_vmexit_gcpu(cpu_id_t cpu_id, guest_cpu_handle_t gcpu);
+void host_cpu_store_vmexit_gcpu(guest_cpu_handle_t gcpu);
 guest_cpu_handle_t host_cpu_get_vmexit_gcpu(cpu_id_t cpu_id);
 
 void host_cpu_save_dr7(cpu_id_t cpu_id);
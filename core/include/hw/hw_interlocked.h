@@ -170,6 +170,13 @@ void hw_store_fence(void);
 		*(p_number) = (new_value); \
 	} while (0)
 
+/*-------------------------------------------------------------------------
+ *
+ * Compiler-only barrier, memory accesses are not moved across it
+ *
+ *------------------------------------------------------------------------- */
+#define hw_compiler_barrier() __asm__ __volatile__ ("" : : : "memory")
+
 /*-------------------------------------------------------------------------
  *
  * Execute assembler 'pause' instruction
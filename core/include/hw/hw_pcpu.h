@@ -0,0 +1,82 @@
+/*******************************************************************************
+* Copyright (c) 2015 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef _HW_PCPU_H_
+#define _HW_PCPU_H_
+
+#include "mon_defs.h"
+#include "mon_objects.h"
+
+/*
+ * Per host CPU data block
+ *
+ * GS base of each host CPU points to its own block, both in MON code before
+ * the first VMLAUNCH and after each VMEXIT (VMCS host GS base), so the state
+ * of the current host CPU is reached with gs-relative loads instead of
+ * indexing global arrays with hw_cpu_id().
+ *
+ * The first fields are accessed from assembler, offsets must match the
+ * HW_PCPU_xxx_OFFSET definitions below.
+ */
+typedef struct hw_pcpu_t {
+	struct hw_pcpu_t	*self;          /* linear address of the block */
+	void			*gcpu_save_area; /* guest_cpu_save_area_t of the
+						  * gcpu active on this CPU */
+	cpu_id_t		cpu_id;
+	uint16_t		padding0;       /* not used */
+	boolean_t		vmcs_sw_shadow_disable;
+	guest_cpu_handle_t	current_gcpu;   /* selected by the scheduler */
+	guest_cpu_handle_t	vmexit_gcpu;    /* last gcpu that did VMEXIT */
+	void			*scheduler_state;
+	void			*ipc_context;
+	boolean_t		nmi_window;
+	uint32_t		padding1;       /* not used */
+} hw_pcpu_t;
+
+#define HW_PCPU_SELF_OFFSET             0
+#define HW_PCPU_GCPU_SAVE_AREA_OFFSET   8
+#define HW_PCPU_CPU_ID_OFFSET           16
+
+#define HW_PCPU_ALIGNMENT               64
+
+/*-------------------------------------------------------------------------
+ * Function: hw_pcpu
+ *  Description: Returns the data block of the current host CPU.
+ *------------------------------------------------------------------------- */
+INLINE hw_pcpu_t *hw_pcpu(void)
+{
+	hw_pcpu_t *pcpu;
+
+	__asm__ __volatile__ ("movq %%gs:0, %0" : "=r" (pcpu));
+	return pcpu;
+}
+
+/*-------------------------------------------------------------------------
+ * Function: hw_pcpu_of
+ *  Description: Returns the data block of given host CPU. Used to access
+ *               other CPUs and before GS base of a CPU is set.
+ *------------------------------------------------------------------------- */
+hw_pcpu_t *hw_pcpu_of(cpu_id_t cpu_id);
+
+/*-------------------------------------------------------------------------
+ * Function: hw_pcpu_load
+ *  Description: Points GS base of the current host CPU to the data block of
+ *               cpu_id. Must be called on each CPU before hw_cpu_id() is
+ *               used, and again after GS selector is reloaded.
+ *------------------------------------------------------------------------- */
+void hw_pcpu_load(cpu_id_t cpu_id);
+
+#endif /* _HW_PCPU_H_ */
@@ -134,6 +134,12 @@ typedef struct {
 /* ebx bit 7 for supporting SMEP */
 #define CPUID_LEAF_7H_0H_EBX_SMEP_BIT          7
 
+/* ebx bit 9 for enhanced REP MOVSB/STOSB */
+#define CPUID_LEAF_7H_0H_EBX_ERMS_BIT          9
+
+/* edx bit 4 for fast short REP MOVSB */
+#define CPUID_LEAF_7H_0H_EDX_FSRM_BIT          4
+
 
 #define CPUID_VALUE_EAX(cpuid_info) ((uint32_t)((cpuid_info).data[0]))
 #define CPUID_VALUE_EBX(cpuid_info) ((uint32_t)((cpuid_info).data[1]))
@@ -212,6 +218,40 @@ INLINE boolean_t is_fsgsbase_supported(void)
 		CPUID_LEAF_7H_0H_EBX_FSGSBASE_BIT) ? TRUE : FALSE;
 }
 
+/*-------------------------------------------------------------------------
+ * check enhanced REP MOVSB/STOSB is hw supported
+ * if CPUID.(EAX=07H, ECX=0H):EBX.ERMS[bit 9] = 1
+ *------------------------------------------------------------------------- */
+INLINE boolean_t is_erms_supported(void)
+{
+	cpuid_params_t cpuid_params = { 0 };
+
+	cpuid_params.m_rax = CPUID_LEAF_7H;
+	cpuid_params.m_rcx = CPUID_SUB_LEAF_0H;
+
+	hw_cpuid(&cpuid_params);
+
+	return BIT_GET64(cpuid_params.m_rbx,
+		CPUID_LEAF_7H_0H_EBX_ERMS_BIT) ? TRUE : FALSE;
+}
+
+/*-------------------------------------------------------------------------
+ * check fast short REP MOVSB is hw supported
+ * if CPUID.(EAX=07H, ECX=0H):EDX.FSRM[bit 4] = 1
+ *------------------------------------------------------------------------- */
+INLINE boolean_t is_fsrm_supported(void)
+{
+	cpuid_params_t cpuid_params = { 0 };
+
+	cpuid_params.m_rax = CPUID_LEAF_7H;
+	cpuid_params.m_rcx = CPUID_SUB_LEAF_0H;
+
+	hw_cpuid(&cpuid_params);
+
+	return BIT_GET64(cpuid_params.m_rdx,
+		CPUID_LEAF_7H_0H_EDX_FSRM_BIT) ? TRUE : FALSE;
+}
+
 /*-------------------------------------------------------------------------
  * check "Process-context identifiers" is hw supported
  * if CPUID.(EAX=01H):ECX.PCID[bit 17] = 1
@@ -292,7 +332,7 @@ uint64_t ASM_FUNCTION hw_read_rsp(void);
  *
  * Get current host cpu id
  *
- * Note: calulations are based on FS register
+ * Note: read from the per host CPU data block (GS base), see hw_pcpu.h
  *
  *------------------------------------------------------------------------- */
 cpu_id_t ASM_FUNCTION hw_cpu_id(void);
@@ -367,6 +407,16 @@ void ASM_FUNCTION hw_disable_interrupts(void);
 void ASM_FUNCTION hw_fxsave(void *buffer);
 void ASM_FUNCTION hw_fxrestore(void *buffer);
 
+/*-------------------------------------------------------------------------
+ * Save/Restore XMM0-XMM15 only
+ *
+ * Argument buffer should point to 16 bytes aligned array of IA32_REG_XMM_COUNT
+ * uint128_t entries
+ *
+ *------------------------------------------------------------------------- */
+void ASM_FUNCTION hw_xmm_save(uint128_t *buffer);
+void ASM_FUNCTION hw_xmm_restore(uint128_t *buffer);
+
 INLINE uint32_t hw_read_memory_mapped_register(address_t base, address_t offset)
 {
 	return *((volatile uint32_t *)(base + offset));
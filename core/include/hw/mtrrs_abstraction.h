@@ -87,6 +87,13 @@ boolean_t mtrrs_abstraction_ap_initialize(void);
  *------------------------------------------------------------------------*/
 mon_phys_mem_type_t mtrrs_abstraction_get_memory_type(hpa_t address);
 
+/*------------------------------------------------------------------------
+ * Function: mtrrs_abstraction_get_range_memory_type
+ *  Description: This function returns the memory type of given HPA and in
+ *               size the length of the same-type extent starting at it.
+ *               The extent may exceed totalsize, callers should clip it.
+ *  Return Value: Memory type.
+ *------------------------------------------------------------------------*/
 mon_phys_mem_type_t mtrrs_abstraction_get_range_memory_type(hpa_t address,
 							    OUT uint64_t *size,
 							    uint64_t totalsize);
@@ -206,7 +206,9 @@ typedef union {
 		uint32_t reserved_0:4;
 		uint32_t enable_invpcid:1;
 		uint32_t vmfunc:1;     /* bit 13 */
-		uint32_t reserved_1:4;
+		uint32_t vmcs_shadowing:1; /* bit 14 */
+		uint32_t reserved_1:2;
+		uint32_t enable_pml:1; /* bit 17 */
 		uint32_t ve:1;         /* bit 18 */
 		uint32_t reserved_2:13;
 	} PACKED bits;
@@ -351,7 +353,8 @@ typedef union {
 		uint32_t sp_48_bit:1;
 
 		uint32_t invept_supported:1;
-		uint32_t reserved2:3;
+		uint32_t ept_accessed_dirty:1;  /* bit 21 */
+		uint32_t reserved2:2;
 		/* INVEPT Support */
 		uint32_t invept_individual_address:1;
 		uint32_t invept_context_wide:1;
@@ -88,6 +88,9 @@
 
 #define VM_X_VE_INFO_ADDRESS                    0x0000202A
 #define VM_X_VE_INFO_ADDRESS_HIGH               0x0000202B
+#define VM_X_PML_ADDRESS                        0x0000200E
+#define VM_X_PML_ADDRESS_HIGH                   0x0000200F
+#define VM_X_GUEST_PML_INDEX                    0x00000812
 #define VM_X_EPTP_ADDRESS                       0x0000201A
 #define VM_X_EPTP_ADDRESS_HIGH                  0x0000201B
 #define VM_X_PREEMTION_TIMER                    0x0000482E
@@ -381,10 +384,13 @@ typedef enum {
 
 	IA32_VMX_EXIT_BASIC_REASON_PLACE_HOLDER_1 = 56,
 	IA32_VMX_EXIT_BASIC_REASON_PLACE_HOLDER_2 = 57,
-	IA32_VMX_EXIT_BASIC_REASON_PLACE_HOLDER_3 = 58,
+	IA32_VMX_EXIT_BASIC_REASON_INVPCID_INSTRUCTION = 58,
 	IA32_VMX_EXIT_BASIC_REASON_INVALID_VMFUNC = 59,
+	IA32_VMX_EXIT_BASIC_REASON_ENCLS_INSTRUCTION = 60,
+	IA32_VMX_EXIT_BASIC_REASON_RDSEED_INSTRUCTION = 61,
+	IA32_VMX_EXIT_BASIC_REASON_PML_FULL = 62,
 
-	IA32_VMX_EXIT_BASIC_REASON_COUNT = 60,
+	IA32_VMX_EXIT_BASIC_REASON_COUNT = 63,
 } ia32_vmx_exit_basic_reason_t;
 
 /* enable non-standard bitfield */
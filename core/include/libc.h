@@ -41,6 +41,23 @@ uint8_t mon_putc(uint8_t ch);
 uint8_t mon_putc_nolock(uint8_t ch);
 uint8_t mon_getc(void);
 
+/*-------------------------------------------------------------------------
+ *
+ * Asynchronous log
+ *
+ * mon_io_async_init() switches mon_printf() to per host CPU log rings.
+ * mon_io_drain() writes the rings to the debug port; with wait == FALSE it
+ * writes only what the UART accepts without waiting and returns at once if
+ * nothing was logged or another CPU prints. With wait == TRUE it returns at
+ * once if the current CPU is in the middle of printing. MON_IO_DRAIN_CPU
+ * drains on each VMEXIT.
+ *
+ *------------------------------------------------------------------------- */
+#define MON_IO_DRAIN_CPU        0
+
+void mon_io_async_init(uint32_t num_of_cpus);
+void mon_io_drain(boolean_t wait);
+
 /*-------------------------------------------------------------------------
  *
  * mon_printf() is declared in the common_libc.h
@@ -42,6 +42,56 @@ typedef struct {
 	volatile int32_t	readers;
 } mon_read_write_lock_t;
 
+/*
+ * Contention counters, updated by the lock owner
+ */
+typedef struct {
+	uint64_t	acquisitions;
+	uint64_t	contended;      /* acquisitions that had to wait */
+	uint64_t	spins;          /* total wait loop iterations */
+	uint64_t	max_hold_tsc;   /* longest hold time in TSC ticks */
+	uint64_t	acquire_tsc;    /* TSC of the current acquisition */
+} mon_lock_stats_t;
+
+/*
+ * Queued (MCS) spinlock
+ *
+ * Waiters are served in FIFO order and each one spins on its own cache
+ * line, so a contended lock does not bounce between all waiting CPUs.
+ * Queue nodes are per-CPU, a CPU may hold up to MCS_NODES_PER_CPU of these
+ * locks at the same time. A CPU whose id is not set up yet takes the lock
+ * as a plain spinlock, without a queue node.
+ */
+#define MCS_NODES_PER_CPU   4
+
+typedef struct {
+	volatile uint32_t	tail;   /* encoded queue node of the last waiter */
+	volatile cpu_id_t	owner_cpu_id;
+	uint16_t		owner_node;
+	volatile boolean_t	handoff; /* released by an owner without node */
+	uint32_t		padding; /* not in use */
+	mon_lock_stats_t	stats;
+} mon_mcs_lock_t;
+
+/*
+ * Phase-fair reader/writer lock
+ *
+ * Writers are served in FIFO order by tickets. Readers and writers
+ * alternate phases, so neither side can starve the other: readers arriving
+ * while a writer waits are blocked until that writer is done, and a writer
+ * waits only for the readers that came before it.
+ * Statistics cover the writer side only.
+ */
+typedef struct {
+	volatile uint32_t	rin;    /* readers in, low bits writer phase */
+	volatile uint32_t	rout;   /* readers out */
+	volatile uint32_t	win;    /* writer tickets taken */
+	volatile uint32_t	wout;   /* writer tickets served */
+	volatile cpu_id_t	writer_cpu_id;
+	char			padding[6];
+	mon_lock_stats_t	stats;
+} mon_pf_rw_lock_t;
+
 /*
  * Various locking routines
  */
@@ -71,4 +121,30 @@ void interruptible_lock_acquire_writelock(mon_read_write_lock_t *lock);
 
 void lock_release_writelock(mon_read_write_lock_t *lock);
 
+void mcs_lock_initialize(mon_mcs_lock_t *lock);
+
+void mcs_lock_acquire(mon_mcs_lock_t *lock);
+
+void interruptible_mcs_lock_acquire(mon_mcs_lock_t *lock);
+
+void mcs_lock_release(mon_mcs_lock_t *lock);
+
+void pf_rw_lock_initialize(mon_pf_rw_lock_t *lock);
+
+void pf_rw_lock_acquire_readlock(mon_pf_rw_lock_t *lock);
+
+void interruptible_pf_rw_lock_acquire_readlock(mon_pf_rw_lock_t *lock);
+
+void pf_rw_lock_release_readlock(mon_pf_rw_lock_t *lock);
+
+void pf_rw_lock_acquire_writelock(mon_pf_rw_lock_t *lock);
+
+void interruptible_pf_rw_lock_acquire_writelock(mon_pf_rw_lock_t *lock);
+
+void pf_rw_lock_release_writelock(mon_pf_rw_lock_t *lock);
+
+#ifdef DEBUG
+void lock_print_stats(const char *name, const mon_lock_stats_t *stats);
+#endif
+
 #endif    /* _MON_LOCK_H_ */
@@ -76,6 +76,15 @@ extern mam_attributes_t mam_ro_attrs;
 
 #define MAM_NO_ATTRIBUTES mam_no_attributes
 
+/* One element of the vector passed to "mam_insert_ranges" */
+typedef struct {
+	uint64_t		src_addr;
+	uint64_t		tgt_addr;
+	uint64_t		size;
+	mam_attributes_t	attrs;
+	uint32_t		padding;
+} mam_range_desc_t;
+
 typedef uint32_t mam_mapping_result_t;
 #define MAM_MAPPING_SUCCESSFUL   ((mam_mapping_result_t)0x0)
 #define MAM_UNKNOWN_MAPPING ((mam_mapping_result_t)0x7fffffff)
@@ -172,6 +181,30 @@ boolean_t mam_insert_range(IN mam_handle_t mam_handle,
 			   IN mam_attributes_t attrs);
 
 
+/*-------------------------------------------------------------------------
+ * Function: mam_insert_ranges
+ *  Description: Inserts a vector of mappings in one update. The result is
+ *               the same as calling "mam_insert_range" for each element in
+ *               array order, but the update lock is taken once, neighbouring
+ *               elements which are contiguous both in source and target
+ *               and have the same attributes are coalesced, so 2M/1G leaves
+ *               can be used across them, and the tables are compacted
+ *               in a single pass at the end instead of after every range.
+ *               For best results the vector should be sorted by src_addr.
+ *  Input: mam_handle  - handle created by "mam_create_mapping";
+ *         ranges      - vector of ranges to map
+ *         count       - number of elements in the vector
+ *  Return value: - TRUE in case of success.
+ *                - FALSE on alignment/limit error (nothing is mapped) or
+ *                  when there was not enough memory to allocate for
+ *                  internal data structures. In the latter case the
+ *                  mapping may be partial as with "mam_insert_range".
+ *------------------------------------------------------------------------- */
+boolean_t mam_insert_ranges(IN mam_handle_t mam_handle,
+			    IN const mam_range_desc_t *ranges,
+			    IN uint32_t count);
+
+
 /*-------------------------------------------------------------------------
  * Function: mam_insert_not_existing_range
  *  Description: Inserts new information (reason) or overwrites existing
@@ -248,6 +281,61 @@ boolean_t mam_remove_permissions_from_existing_mapping(
 	IN uint64_t size,
 	IN mam_attributes_t attrs);
 
+/*-------------------------------------------------------------------------
+ * Function: mam_update_permissions_in_place
+ *  Description: Changes permissions of existing leaf entries in place
+ *               without splitting or merging tables, so the mapping may
+ *               stay in use by hardware while it is updated: every leaf is
+ *               replaced with a single 64-bit compare-exchange, which also
+ *               keeps bits the hardware sets concurrently.
+ *               Not present entries inside the range are left alone.
+ *               If a present leaf is only partly covered by the range
+ *               nothing is changed and FALSE is returned; such update
+ *               must go through the regular functions above.
+ *               The caller is responsible for TLB/EPT invalidation.
+ *  Input: mam_handle  - handle created by "mam_create_mapping";
+ *         src_addr    - source address (4K aligned)
+ *         size        - size of the range (4K aligned)
+ *         attrs_to_set   - permissions to add
+ *         attrs_to_clear - permissions to remove
+ *                          ("pat_index"/"emt" must be "0" in both)
+ *  Return value: - TRUE when all the leaves in range were updated.
+ *                - FALSE when a table split would be required.
+ *------------------------------------------------------------------------- */
+boolean_t mam_update_permissions_in_place(IN mam_handle_t mam_handle,
+					  IN uint64_t src_addr,
+					  IN uint64_t size,
+					  IN mam_attributes_t attrs_to_set,
+					  IN mam_attributes_t attrs_to_clear);
+
+/*-------------------------------------------------------------------------
+ * Function: mam_get_ept_dirty_pages
+ *  Description: Reports pages mapped by leaf entries with the EPT dirty flag
+ *               set and optionally clears the flag. Leaves are created
+ *               dirty, so a newly inserted range is reported until it is
+ *               cleared once. A dirty large leaf reports all its pages
+ *               inside the range, and is cleared only when the range
+ *               covers it entirely.
+ *               Works on mapping converted by "mon_mam_convert_to_ept" and
+ *               does not change the table structure, so the mapping may be
+ *               in use by hardware meanwhile. The caller is responsible for
+ *               EPT invalidation after clearing the flags.
+ *  Input: mam_handle - handle created by "mam_create_mapping";
+ *         src_addr   - source address (4K aligned)
+ *         size       - size of the range (4K aligned)
+ *         bitmap     - bit "i" is set for the dirty page src_addr + i * 4K,
+ *                      other bits are left as is; may be NULL
+ *         clear      - clear the dirty flags of the reported leaves the
+ *                      range covers entirely
+ *  Return value: - TRUE in case of success
+ *                - FALSE when the mapping is not EPT or range is unaligned
+ *------------------------------------------------------------------------- */
+boolean_t mam_get_ept_dirty_pages(IN mam_handle_t mam_handle,
+				  IN uint64_t src_addr,
+				  IN uint64_t size,
+				  OUT uint64_t *bitmap,
+				  IN boolean_t clear);
+
 /*-------------------------------------------------------------------------
  * Function: mam_convert_to_64bit_page_tables
  *  Description: This functions converts internal optimized mapping to 64 bits
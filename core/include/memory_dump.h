@@ -92,7 +92,6 @@ extern uint64_t ept_compute_eptp(guest_handle_t guest,
 extern void ept_get_default_ept(guest_handle_t guest,
 				uint64_t *ept_root_table_hpa,
 				uint32_t *ept_gaw);
-extern boolean_t vmcs_sw_shadow_disable[];
 
 void mon_deadloop_internal(uint32_t file_code,
 			   uint32_t line_num,
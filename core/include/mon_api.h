@@ -268,7 +268,19 @@ boolean_t mon_set_vmcs_control_state(guest_cpu_handle_t gcpu,
 *             hva (IN) -- Pointer of Host Virtual Address
 *  RETURNS  : 0 if successful
 *-------------------------------------------------------*/
-int copy_from_gva(guest_cpu_handle_t gcpu, uint64_t gva, int size,
+int copy_from_gva(guest_cpu_handle_t gcpu, uint64_t gva, uint32_t size,
 		  uint64_t hva);
 
+/*-------------------------------------------------------*
+*  PURPOSE  : Copy the given memory from given hva to
+*             given gva
+*  ARGUMENTS: gcpu(IN) -- Guest CPU Handle
+*             gva (IN) -- Guest Virtual Address
+*             size(IN) -- size of the range at gva
+*             hva (IN) -- Pointer of Host Virtual Address
+*  RETURNS  : 0 if successful
+*-------------------------------------------------------*/
+int copy_to_gva(guest_cpu_handle_t gcpu, uint64_t gva, uint32_t size,
+		uint64_t hva);
+
 #endif /*_MON_API_H */
@@ -76,6 +76,14 @@ char mon_serial_putc_nolock(void *h_device, char c);
  * Return: Character that was sent */
 char mon_serial_putc(void *h_device, char c);
 
+/*=========================== mon_serial_tx_room() ======================= */
+
+/* Returns the number of characters mon_serial_putc() can send right now
+ * without waiting for the UART. Same locking rules as mon_serial_putc().
+ * Inputs: h_device - Handle of the device
+ * Return: Free space in the transmit FIFO, 0 if tx is blocked */
+uint32_t mon_serial_tx_room(void *h_device);
+
 /*======================= mon_serial_puts_nolock() ======================= */
 
 /* Write a string to a serial device in a non-locked mode.
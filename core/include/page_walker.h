@@ -47,6 +47,8 @@ typedef enum {
  *             for detailed information about this value.
  *       pfec - page fault error code in case when page walk will return
  *              "PW_RETVAL_PF".
+ *       page_size - size of the page which maps virt_addr (4K, 2M, 4M or
+ *                   1G) in case of "PW_RETVAL_SUCCESS". May be NULL.
  * Ret. value:
  *       PW_RETVAL_SUCCESS - the page walk succeeded, "gpa" output variable
  *                           contains the final physical address, "pfec" output
@@ -80,7 +82,8 @@ pw_retval_t pw_perform_page_walk(IN guest_cpu_handle_t gcpu,
 				 IN boolean_t is_fetch,
 				 IN boolean_t set_ad_bits,
 				 OUT uint64_t *gpa,
-				 OUT uint64_t *pfec);
+				 OUT uint64_t *pfec,
+				 OUT uint64_t *page_size);
 
 /*-------------------------------------------------------------------------
  * Function: pw_is_pdpt_in_32_bit_pae_mode_valid
@@ -25,6 +25,8 @@ typedef void *pool_handle_t;
 
 pool_handle_t assync_pool_create(uint32_t size_of_single_element);
 
+pool_handle_t sync_pool_create(uint32_t size_of_single_element);
+
 void *pool_allocate(pool_handle_t pool_handle);
 
 void pool_free(pool_handle_t pool_handle, void *data);
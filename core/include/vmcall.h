@@ -24,8 +24,6 @@ typedef mon_status_t (*vmcall_handler_t) (guest_cpu_handle_t gcpu,
 					  address_t *arg1, address_t *arg2,
 					  address_t *arg3);
 
-void vmcall_intialize(void);
-
 void vmcall_guest_intialize(guest_id_t guest_id);
 
 void mon_vmcall_register(guest_id_t guest_id,
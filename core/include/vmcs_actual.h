@@ -63,6 +63,7 @@ vmcs_object_t *vmcs_act_create(guest_cpu_handle_t gcpu);
  *  but are specific to VMCS applied to real hardware
  */
 void vmcs_clear_cache(vmcs_object_t *);
+void vmcs_act_prefetch_exit_info(vmcs_object_t *);
 void vmcs_activate(vmcs_object_t *);
 void vmcs_deactivate(vmcs_object_t *);
 boolean_t vmcs_launch_required(const vmcs_object_t *);
@@ -168,12 +168,25 @@ typedef enum {
 
 	VMCS_VE_INFO_ADDRESS,
 
+	VMCS_PML_ADDRESS,
+	/* guest state, must stay last - see vmcs_is_group_dirty() */
+	VMCS_GUEST_PML_INDEX,
+
 	/* last */
 	VMCS_FIELD_COUNT
 } vmcs_field_t;
 
 #define VMCS_CR3_TARGET_VALUE(__x) (VMCS_CR3_TARGET_VALUE_0 + (__x))
 
+/* Field groups tracked separately by the layered merge. Everything that is
+ * neither guest nor host state belongs to VMCS_GROUP_CONTROLS */
+typedef enum {
+	VMCS_GROUP_CONTROLS = 0,
+	VMCS_GROUP_GUEST_STATE,
+	VMCS_GROUP_HOST_STATE,
+	VMCS_GROUP_COUNT
+} vmcs_field_group_t;
+
 #define VMCS_NOT_EXISTS         0
 #define VMCS_READABLE           1
 #define VMCS_WRITABLE           2
@@ -202,6 +215,9 @@ typedef struct vmcs_object_t {
 	void (*vmcs_flush_to_cpu)(const struct vmcs_object_t *vmcs);
 	void (*vmcs_flush_to_memory)(struct vmcs_object_t *vmcs);
 	boolean_t (*vmcs_is_dirty)(const struct vmcs_object_t *vmcs);
+	boolean_t (*vmcs_is_dirty_range)(const struct vmcs_object_t *vmcs,
+					 vmcs_field_t first_field,
+					 vmcs_field_t last_field);
 	guest_cpu_handle_t (*vmcs_get_owner)(const struct vmcs_object_t *vmcs);
 	void (*vmcs_destroy)(struct vmcs_object_t *vmcs);
 	void (*vmcs_add_msr_to_vmexit_store_list)(struct vmcs_object_t *vmcs,
@@ -240,6 +256,8 @@ void vmcs_write_nocheck(vmcs_object_t *vmcs,
 			uint64_t value);
 uint64_t mon_vmcs_read(const vmcs_object_t *vmcs, vmcs_field_t field_id);
 boolean_t vmcs_field_is_supported(vmcs_field_t field_id);
+boolean_t vmcs_is_group_dirty(const vmcs_object_t *vmcs,
+			      vmcs_field_group_t group);
 
 INLINE void vmcs_flush_to_cpu(const vmcs_object_t *vmcs)
 {
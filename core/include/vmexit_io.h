@@ -37,15 +37,6 @@ typedef boolean_t (*io_access_handler_t) (guest_cpu_handle_t gcpu,
 					  /* gva for string I/O; otherwise hva. */
 					  void *p_value, void *handler_context);
 
-/*-----------------------------------------------------------------------*
-*  FUNCTION : io_vmexit_setup()
-*  PURPOSE  : Allocate and initialize IO VMEXITs related data structures,
-*           : common for all guests
-*  ARGUMENTS: guest_id_t    num_of_guests
-*  RETURNS  : void
-*-----------------------------------------------------------------------*/
-void io_vmexit_initialize(void);
-
 /*-----------------------------------------------------------------------*
 *  FUNCTION : io_vmexit_guest_setup()
 *  PURPOSE  : Allocate and initialize IO VMEXITs related data structures for
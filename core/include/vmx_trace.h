@@ -32,15 +32,26 @@ typedef enum {
 	MON_TRACE_ENABLED_NON_RECYCLED
 } mon_trace_state_t;
 
-boolean_t mon_trace_init(uint32_t max_num_guests, uint32_t max_num_guest_cpus);
+/* Trace events. Each event has a format string in vmx_trace.c that is
+ * applied to the event arguments when the trace is printed */
+typedef enum {
+	MON_TRACE_EVENT_VMEXIT,
+	MON_TRACE_EVENT_SIPI_LEAVE,
+
+	MON_TRACE_EVENT_COUNT
+} mon_trace_event_t;
+
+boolean_t mon_trace_init(uint32_t num_host_cpus);
 
-boolean_t mon_trace(guest_cpu_handle_t guest_cpu, const char *format, ...);
+boolean_t mon_trace_event(guest_cpu_handle_t guest_cpu,
+			  mon_trace_event_t event,
+			  uint64_t arg0,
+			  uint64_t arg1,
+			  uint64_t arg2,
+			  uint64_t arg3);
 
-boolean_t
-mon_trace_buffer(guest_cpu_handle_t guest_cpu,
-		 uint8_t buffer_index,
-		 const char *format,
-		 ...);
+/* registers VMCALL_TRACE_EXPORT for the guest */
+void mon_trace_guest_initialize(guest_id_t guest_id);
 
 boolean_t mon_trace_print_all(uint32_t guest_num, char *guest_names[]);
 
@@ -519,8 +519,7 @@ static
 void ipc_nmi_interrupt_handler(const isr_parameters_on_stack_t *
 			       p_stack UNUSED)
 {
-	cpu_id_t cpu_id = IPC_CPU_ID();
-	ipc_cpu_context_t *ipc = &ipc_cpu_contexts[cpu_id];
+	ipc_cpu_context_t *ipc = IPC_CPU_CONTEXT();
 	guest_cpu_handle_t gcpu = NULL;
 
 	hw_interlocked_increment64(
@@ -537,8 +536,7 @@ void ipc_nmi_interrupt_handler(const isr_parameters_on_stack_t *
  * Decide on injecting NMIs to guest if required. */
 boolean_t ipc_nmi_window_vmexit_handler(guest_cpu_handle_t gcpu)
 {
-	cpu_id_t cpu_id = IPC_CPU_ID();
-	ipc_cpu_context_t *ipc = &ipc_cpu_contexts[cpu_id];
+	ipc_cpu_context_t *ipc = IPC_CPU_CONTEXT();
 
 	MON_ASSERT(gcpu != NULL);
 
@@ -555,8 +553,7 @@ boolean_t ipc_nmi_window_vmexit_handler(guest_cpu_handle_t gcpu)
  * Reflect NMI back to guest if it is hardware or guest initiated NMI. */
 boolean_t ipc_nmi_vmexit_handler(guest_cpu_handle_t gcpu)
 {
-	cpu_id_t cpu_id = IPC_CPU_ID();
-	ipc_cpu_context_t *ipc = &ipc_cpu_contexts[cpu_id];
+	ipc_cpu_context_t *ipc = IPC_CPU_CONTEXT();
 
 	hw_interlocked_increment64((int64_t *)&ipc->num_received_nmi_interrupts);
 
@@ -571,8 +568,7 @@ boolean_t ipc_nmi_vmexit_handler(guest_cpu_handle_t gcpu)
  * RETURN VALUE: TRUE, if SIPI was due to IPC, FALSE otherwise. */
 boolean_t ipc_sipi_vmexit_handler(guest_cpu_handle_t gcpu)
 {
-	cpu_id_t cpu_id = IPC_CPU_ID();
-	ipc_cpu_context_t *ipc = &ipc_cpu_contexts[cpu_id];
+	ipc_cpu_context_t *ipc = IPC_CPU_CONTEXT();
 	vmcs_object_t *vmcs = mon_gcpu_get_vmcs(gcpu);
 	ia32_vmx_exit_qualification_t qualification;
 	boolean_t ret_val = FALSE;
@@ -764,7 +760,7 @@ uint32_t ipc_send_message_sync(ipc_destination_t dst, ipc_message_type_t type,
 boolean_t ipc_process_one_ipc(void)
 {
 	cpu_id_t cpu_id = IPC_CPU_ID();
-	ipc_cpu_context_t *ipc = &ipc_cpu_contexts[cpu_id];
+	ipc_cpu_context_t *ipc = IPC_CPU_CONTEXT();
 	ipc_message_t *msg = 0;
 	func_ipc_handler_t handler = NULL;
 	void *arg = NULL;
@@ -816,7 +812,7 @@ boolean_t ipc_process_one_ipc(void)
 void ipc_change_state_to_active(guest_cpu_handle_t gcpu UNUSED)
 {
 	cpu_id_t cpu_id = IPC_CPU_ID();
-	ipc_cpu_context_t *ipc = &ipc_cpu_contexts[cpu_id];
+	ipc_cpu_context_t *ipc = IPC_CPU_CONTEXT();
 
 	if (cpu_activity_state[cpu_id] == IPC_CPU_ACTIVE) {
 		return;
@@ -841,7 +837,7 @@ void ipc_change_state_to_active(guest_cpu_handle_t gcpu UNUSED)
 void ipc_change_state_to_sipi(guest_cpu_handle_t gcpu)
 {
 	cpu_id_t cpu_id = IPC_CPU_ID();
-	ipc_cpu_context_t *ipc = &ipc_cpu_contexts[cpu_id];
+	ipc_cpu_context_t *ipc = IPC_CPU_CONTEXT();
 
 	if (cpu_activity_state[cpu_id] == IPC_CPU_SIPI) {
 		return;
@@ -867,8 +863,7 @@ void ipc_change_state_to_sipi(guest_cpu_handle_t gcpu)
  * Adjust right ounters. */
 void ipc_mni_injection_failed(void)
 {
-	cpu_id_t cpu_id = IPC_CPU_ID();
-	ipc_cpu_context_t *ipc = &ipc_cpu_contexts[cpu_id];
+	ipc_cpu_context_t *ipc = IPC_CPU_CONTEXT();
 
 	/* count blocked NMI injection. */
 	hw_interlocked_increment64((int64_t *)
@@ -928,6 +923,7 @@ boolean_t ipc_state_init(uint16_t number_of_host_processors)
 
 	for (i = 0; i < number_of_host_processors; i++) {
 		ipc = &ipc_cpu_contexts[i];
+		hw_pcpu_of((cpu_id_t)i)->ipc_context = ipc;
 
 		message_queue_offset =
 			ipc_cpu_context_size +
@@ -22,11 +22,16 @@
 #include "list.h"
 #include "ipc.h"
 #include "lock.h"
+#include "hw_pcpu.h"
 
 #define IPC_ALIGNMENT                         ARCH_ADDRESS_WIDTH
 
 #define IPC_CPU_ID()                          hw_cpu_id()
 
+/* ipc_cpu_context_t of the current host CPU */
+#define IPC_CPU_CONTEXT()                     \
+	((ipc_cpu_context_t *)hw_pcpu()->ipc_context)
+
 #define NMI_VECTOR                            2
 
 #define NMIS_WAITING_FOR_PROCESSING(ipc)      \
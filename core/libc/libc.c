@@ -24,6 +24,7 @@ void mon_libc_init(void)
 		return;
 	}
 
+	mon_memops_init();
 	mon_io_init();
 
 	g_init_done = TRUE;
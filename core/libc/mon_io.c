@@ -22,6 +22,8 @@
 #include "host_memory_manager_api.h"
 #include "mon_globals.h"
 #include "mon_serial.h"
+#include "hw_utils.h"
+#include "heap.h"
 
 extern int CLI_active(void);
 /*
@@ -36,6 +38,13 @@ extern int CLI_active(void);
  */
 static uint32_t printf_lock;
 
+/* CPU holding printf_lock, known once the per CPU data is set up (with the
+ * asynchronous log). Lets a CPU that dies while printing skip the final
+ * drain instead of waiting for itself. */
+#define PRINTF_LOCK_NO_OWNER    ((cpu_id_t)-1)
+static volatile cpu_id_t printf_lock_owner = PRINTF_LOCK_NO_OWNER;
+static boolean_t printf_lock_owner_known;
+
 /*
  *-------------- Internal functions ----------------------
  */
@@ -106,6 +115,25 @@ void raw_unlock(volatile uint32_t *p_lock_var)
 	}
 }
 
+INLINE cpu_id_t printf_lock_this_cpu(void)
+{
+	return printf_lock_owner_known ? hw_cpu_id() : PRINTF_LOCK_NO_OWNER;
+}
+
+static
+void printf_lock_acquire(void)
+{
+	raw_lock(&printf_lock);
+	printf_lock_owner = printf_lock_this_cpu();
+}
+
+static
+void printf_lock_release(void)
+{
+	printf_lock_owner = PRINTF_LOCK_NO_OWNER;
+	raw_unlock(&printf_lock);
+}
+
 /*=========================================================================
  *
  * Generic Debug Port Static Variables
@@ -290,7 +318,10 @@ int mon_debug_port_puts_direct(boolean_t is_locked, const char *string)
 			/* until we're done.  Note that here we may interfere with ongoing */
 			/* regular prints - but this is the nature of "nolock". */
 
+			cpu_id_t owner = printf_lock_owner;
+
 			raw_force_lock(&printf_lock);
+			printf_lock_owner = printf_lock_this_cpu();
 
 			/* Print using the "nolock" function */
 
@@ -298,6 +329,7 @@ int mon_debug_port_puts_direct(boolean_t is_locked, const char *string)
 
 			/* Unlock */
 
+			printf_lock_owner = owner;
 			raw_unlock(&printf_lock);
 		}
 	}
@@ -334,11 +366,11 @@ mon_status_t mon_io_vmcall_puts_handler(guest_cpu_handle_t gcpu UNUSED,
 {
 	const char *string = (const char *)*arg1;
 
-	raw_lock(&printf_lock);
+	printf_lock_acquire();
 
 	mon_debug_port_puts_direct(TRUE, string);
 
-	raw_unlock(&printf_lock);
+	printf_lock_release();
 
 	return MON_OK;
 }
@@ -362,7 +394,7 @@ int mon_printf_int(boolean_t use_lock, char *buffer, uint32_t buffer_size,
 	uint32_t printed_size = 0;
 
 	if (use_lock) {
-		raw_lock(&printf_lock);
+		printf_lock_acquire();
 	}
 
 	printed_size = mon_vsprintf_s(buffer, buffer_size, format, args);
@@ -372,7 +404,7 @@ int mon_printf_int(boolean_t use_lock, char *buffer, uint32_t buffer_size,
 	}
 
 	if (use_lock) {
-		raw_unlock(&printf_lock);
+		printf_lock_release();
 	}
 
 	return printed_size;
@@ -387,6 +419,196 @@ int CDECL mon_printf_nolock_alloc_buffer(const char *format, va_list args)
 	return mon_printf_int(FALSE, buffer, PRINTF_BUFFER_SIZE, format, args);
 }
 
+/*=========================================================================
+ *
+ * Asynchronous log
+ *
+ * After mon_io_async_init() mon_printf() only formats the message into the
+ * ring of the current host CPU. The debug port is written by mon_io_drain(),
+ * called by MON_IO_DRAIN_CPU on each VMEXIT, so a log does not stall the
+ * printing CPU on the UART and CPUs do not serialize on printf_lock.
+ * Each ring has a single producer (its CPU) and a single consumer (the
+ * drainer, under printf_lock), so appending takes no lock. Messages that do
+ * not fit are dropped and counted.
+ *
+ *========================================================================= */
+
+/* must be a power of 2 */
+#define LOG_RING_SIZE           PAGE_4KB_SIZE
+
+typedef struct {
+	volatile uint32_t	head;   /* bytes ever appended */
+	volatile uint32_t	tail;   /* bytes ever drained */
+	volatile uint32_t	dropped; /* messages not appended */
+	uint32_t		reported_dropped;
+	boolean_t		busy;   /* formatting on this CPU */
+	uint32_t		padding;
+	char			buffer[PRINTF_BUFFER_SIZE];
+	char			data[LOG_RING_SIZE];
+} log_ring_t;
+
+static log_ring_t *log_rings;
+static uint32_t log_num_rings;
+/* ring the drain continues with, rings are drained one by one so messages
+ * of different CPUs are not mixed */
+static uint32_t log_drain_ring;
+/* set by the producers when there is something to drain, so the drain on
+ * each VMEXIT does not touch printf_lock for nothing */
+static volatile uint32_t log_pending;
+
+static
+int mon_printf_async(log_ring_t *ring, const char *format, va_list args)
+{
+	uint32_t printed_size;
+	uint32_t head, i;
+
+	if (ring->busy) {
+		/* mon_printf() from an exception handler interrupted a print on
+		 * this CPU */
+		ring->dropped++;
+		log_pending = 1;
+		return 0;
+	}
+	ring->busy = TRUE;
+
+	printed_size = mon_vsprintf_s(ring->buffer, PRINTF_BUFFER_SIZE,
+		format, args);
+
+	if (printed_size && (printed_size != UINT32_ALL_ONES)) {
+		head = ring->head;
+
+		if (printed_size > LOG_RING_SIZE - (head - ring->tail)) {
+			ring->dropped++;
+			printed_size = 0;
+		} else {
+			for (i = 0; i < printed_size; i++) {
+				ring->data[(head + i) & (LOG_RING_SIZE - 1)] =
+					ring->buffer[i];
+			}
+			/* message must be in memory before it is published */
+			hw_compiler_barrier();
+			ring->head = head + printed_size;
+		}
+	}
+
+	ring->busy = FALSE;
+
+	/* message (or drop notice) must be visible before the flag */
+	hw_compiler_barrier();
+	if (log_pending == 0) {
+		log_pending = 1;
+	}
+
+	return printed_size;
+}
+
+/* returns FALSE if stopped because the debug port is busy */
+static
+boolean_t log_ring_drain(log_ring_t *ring, uint32_t ring_index,
+			 boolean_t wait)
+{
+	uint32_t room = 0;
+	uint32_t dropped;
+	char notice[64];
+
+	while (ring->tail != ring->head) {
+		if (debug_port_type != MON_DEBUG_PORT_SERIAL) {
+			/* nowhere to print */
+			ring->tail = ring->head;
+			break;
+		}
+		if (!wait && (room == 0)) {
+			room = mon_serial_tx_room(debug_port_handle);
+			if (room == 0) {
+				return FALSE;
+			}
+		}
+		mon_debug_port_putc(
+			ring->data[ring->tail & (LOG_RING_SIZE - 1)]);
+		ring->tail++;
+		if (room) {
+			room--;
+		}
+	}
+
+	/* ring is empty, i.e. at message boundary */
+	dropped = ring->dropped;
+	if (dropped != ring->reported_dropped) {
+		mon_sprintf_s(notice, sizeof(notice),
+			"CPU%d: %d log messages dropped\n", ring_index,
+			dropped - ring->reported_dropped);
+		ring->reported_dropped = dropped;
+		mon_debug_port_puts(TRUE, notice);
+	}
+
+	return TRUE;
+}
+
+/*
+ *-------------- Interface functions ----------------------
+ */
+void mon_io_async_init(uint32_t num_of_cpus)
+{
+	log_ring_t *rings;
+
+	if (log_rings != NULL) {
+		return;
+	}
+
+	/* the per CPU data is set up on all CPUs by now */
+	printf_lock_owner_known = TRUE;
+
+	rings = mon_memory_alloc(num_of_cpus * sizeof(log_ring_t));
+	if (rings == NULL) {
+		/* keep printing synchronously */
+		return;
+	}
+
+	log_num_rings = num_of_cpus;
+	hw_compiler_barrier();
+	log_rings = rings;
+}
+
+void mon_io_drain(boolean_t wait)
+{
+	uint32_t count;
+
+	if (log_rings == NULL) {
+		return;
+	}
+
+	if (wait) {
+		if (printf_lock_owner == hw_cpu_id()) {
+			/* called from a deadloop or assert while this CPU prints,
+			 * waiting for the lock would hang it */
+			return;
+		}
+		printf_lock_acquire();
+	} else if ((log_pending == 0) ||
+		   (0 != hw_interlocked_compare_exchange(
+			    (int32_t *)&printf_lock, 0, 1))) {
+		/* nothing to print or somebody else is printing */
+		return;
+	} else {
+		printf_lock_owner = hw_cpu_id();
+	}
+
+	/* messages published after this are seen by the next drain */
+	hw_interlocked_assign((volatile int32_t *)&log_pending, 0);
+
+	for (count = 0; count < log_num_rings; count++) {
+		if (!log_ring_drain(&log_rings[log_drain_ring], log_drain_ring,
+			    wait)) {
+			/* the debug port is busy, continue next time */
+			log_pending = 1;
+			break;
+		}
+		log_drain_ring = (log_drain_ring + 1) % log_num_rings;
+	}
+
+	printf_lock_release();
+}
+
 /*
  *-------------- Interface functions ----------------------
  */
@@ -416,7 +638,7 @@ int mon_puts(const char *string)
 {
 	int ret = 1;
 
-	raw_lock(&printf_lock);
+	printf_lock_acquire();
 
 	ret = mon_debug_port_puts(TRUE, string);
 
@@ -426,7 +648,7 @@ int mon_puts(const char *string)
 		mon_debug_port_puts(TRUE, "\n\r");
 	}
 
-	raw_unlock(&printf_lock);
+	printf_lock_release();
 
 	return ret;
 }
@@ -434,6 +656,8 @@ int mon_puts(const char *string)
 uint8_t mon_getc(void)
 {
 	if (CLI_active()) {
+		/* show pending output while waiting for input */
+		mon_io_drain(FALSE);
 		return mon_debug_port_getc();
 	} else {
 		return 0;
@@ -449,11 +673,11 @@ uint8_t mon_putc_nolock(uint8_t ch)
 
 uint8_t mon_putc(uint8_t ch)
 {
-	raw_lock(&printf_lock);
+	printf_lock_acquire();
 
 	ch = mon_debug_port_putc(ch);
 
-	raw_unlock(&printf_lock);
+	printf_lock_release();
 
 	return ch;
 }
@@ -463,6 +687,15 @@ int CDECL mon_vprintf(const char *format, va_list args)
 	/* use static buffer to save stack space */
 
 	static char buffer[PRINTF_BUFFER_SIZE];
+	cpu_id_t cpu_id;
+
+	if (log_rings != NULL) {
+		cpu_id = hw_cpu_id();
+		if (cpu_id < log_num_rings) {
+			return mon_printf_async(&log_rings[cpu_id], format,
+				args);
+		}
+	}
 
 	return mon_printf_int(TRUE, buffer, PRINTF_BUFFER_SIZE, format, args);
 }
@@ -763,6 +763,36 @@ mon_serial_putc(void *h_device, char c)
 	return c;
 }
 
+/*=========================== mon_serial_tx_room() ======================= */
+/*
+ * Returns the number of characters mon_serial_putc() can send right now
+ * without waiting for the UART. Same locking rules as mon_serial_putc().
+ * Input: Handle of the device
+ * Return: Free space in the transmit FIFO, 0 if tx is blocked
+ */
+uint32_t mon_serial_tx_room(void *h_device)
+{
+	mon_serial_device_t *p_device;
+	/* Line Status Register image */
+	uart_lsr_t lsr;
+
+	p_device = h_device;
+
+	MON_ASSERT(p_device->is_initialized);
+
+	lsr.data = hw_read_port_8(p_device->io_base + UART_REGISTER_LSR);
+	if (lsr.bits.thre == 1) { /* The Tx FIFO is empty */
+		p_device->chars_in_tx_fifo = 0;
+	}
+
+	if (p_device->puts_lock || !is_hw_tx_handshake_go(p_device) ||
+	    (p_device->chars_in_tx_fifo >= p_device->hw_fifo_size)) {
+		return 0;
+	}
+
+	return p_device->hw_fifo_size - p_device->chars_in_tx_fifo;
+}
+
 /*======================= mon_serial_puts_nolock() ======================= */
 /*
  * Write a string to a serial device in a non-locked mode.
@@ -62,8 +62,7 @@
 #include "fvs.h"
 #include "mon_acpi.h"
 #include "gpm_api.h"
-
-boolean_t vmcs_sw_shadow_disable[MON_MAX_CPU_SUPPORTED];
+#include "hw_pcpu.h"
 
 typedef struct {
 	uint64_t	local_apic_id;
@@ -252,6 +251,9 @@ void CDECL mon_main(uint32_t local_apic_id,
 	mon_input_params_t input_params;
 	cpu_id_t cpu_id = (cpu_id_t)local_apic_id;
 
+	/* hw_cpu_id() and the rest of per CPU data are reached through GS */
+	hw_pcpu_load(cpu_id);
+
 	/* Sanity check */
 	MON_ASSERT(startup_struct != NULL);
 
@@ -613,7 +615,7 @@ void mon_bsp_proc_main(uint32_t local_apic_id,
 		}
 	}
 
-	MON_DEBUG_CODE(mon_trace_init(MON_MAX_GUESTS_SUPPORTED, num_of_cpus));
+	MON_DEBUG_CODE(mon_trace_init(num_of_cpus));
 #ifdef PCI_SCAN
 	host_pci_initialize();
 #endif
@@ -735,9 +737,6 @@ void mon_bsp_proc_main(uint32_t local_apic_id,
 			"\nFAILURE: IPC initialization failed\n");
 		MON_DEADLOOP();
 	}
-	for (i = 0; i < MON_MAX_CPU_SUPPORTED; i++)
-		vmcs_sw_shadow_disable[i] = FALSE;
-
 	if (g_is_post_launch) {
 		if (INVALID_PHYSICAL_ADDRESS ==
 		    application_params_struct->fadt_gpa ||
@@ -848,6 +847,9 @@ void mon_bsp_proc_main(uint32_t local_apic_id,
 
 	MON_LOG(mask_mon, level_trace, "BSP: Resuming the first Guest CPU\n");
 
+	/* from now on logs go to per CPU rings drained by MON_IO_DRAIN_CPU */
+	mon_io_async_init(num_of_cpus);
+
 	event_raise(EVENT_GUEST_LAUNCH, initial_gcpu, &local_apic_id);
 
 	/* enable unrestricted guest support in early boot
@@ -43,6 +43,9 @@
 #include "unrestricted_guest.h"
 #include "fvs.h"
 #include "ve.h"
+#include "vmcall.h"
+#include "vmexit.h"
+#include "mon_api.h"
 
 ept_state_t ept;
 hpa_t redirect_physical_addr = 0;
@@ -56,6 +59,8 @@ hpa_t redirect_physical_addr = 0;
 /* static functions */
 static
 boolean_t ept_guest_cpu_initialize(guest_cpu_handle_t gcpu);
+static
+uint64_t ept_get_guest_address_limit(gpm_handle_t gpm);
 
 boolean_t ept_page_walk(uint64_t first_table, uint64_t addr, uint32_t gaw);
 
@@ -95,7 +100,7 @@ void ept_acquire_lock(void)
 		ept.lock_count++;
 		return;
 	}
-	interruptible_lock_acquire(&ept.lock);
+	interruptible_mcs_lock_acquire(&ept.lock);
 	ept.lock_count = 1;
 }
 
@@ -103,7 +108,7 @@ void ept_release_lock(void)
 {
 	ept.lock_count--;
 	if (ept.lock_count == 0) {
-		lock_release(&ept.lock);
+		mcs_lock_release(&ept.lock);
 	}
 }
 
@@ -301,9 +306,53 @@ void ept_get_default_ept(guest_handle_t guest, uint64_t *ept_root_table_hpa,
 	*ept_gaw = ept_guest->gaw;
 }
 
+/*
+ * With PML a fresh EPT is reported dirty as a whole: its leaves are created
+ * with the dirty flag set, so their writes are not logged until the flag is
+ * cleared by a harvest.
+ */
+static
+void ept_set_dirty_log(ept_guest_state_t *ept_guest,
+		       uint64_t gpa,
+		       uint64_t size)
+{
+	uint64_t page = gpa / PAGE_4KB_SIZE;
+	uint64_t end_page = ALIGN_FORWARD(gpa + size, PAGE_4KB_SIZE) /
+			    PAGE_4KB_SIZE;
+
+	end_page = MIN(end_page, ept_guest->dirty_log_pages);
+
+	lock_acquire(&ept_guest->dirty_log_lock);
+	for (; page < end_page; page++)
+		BITMAP_ARRAY64_SET(ept_guest->dirty_log, page);
+	lock_release(&ept_guest->dirty_log_lock);
+}
+
+static
+void ept_reset_dirty_log(ept_guest_state_t *ept_guest, gpm_handle_t gpm)
+{
+	uint64_t pages = ALIGN_FORWARD(ept_get_guest_address_limit(gpm),
+		PAGE_4KB_SIZE) / PAGE_4KB_SIZE;
+	uint64_t *dirty_log = ept_guest->dirty_log;
+
+	if (pages != ept_guest->dirty_log_pages) {
+		if (dirty_log != NULL) {
+			mon_memory_free(dirty_log);
+		}
+		dirty_log = (uint64_t *)mon_memory_alloc(
+			(uint32_t)(ALIGN_FORWARD(pages, 64) / 8));
+		MON_ASSERT(dirty_log);
+		ept_guest->dirty_log = dirty_log;
+		ept_guest->dirty_log_pages = pages;
+	}
+
+	ept_set_dirty_log(ept_guest, 0, pages * PAGE_4KB_SIZE);
+}
+
 void ept_create_default_ept(guest_handle_t guest, gpm_handle_t gpm)
 {
 	ept_guest_state_t *ept_guest = NULL;
+	mam_ept_super_page_support_t sp_support;
 
 	MON_ASSERT(guest);
 	MON_ASSERT(gpm);
@@ -321,10 +370,19 @@ void ept_create_default_ept(guest_handle_t guest, gpm_handle_t gpm)
 			mon_ept_get_guest_address_width(gpm));
 	MON_ASSERT(ept_guest->gaw != (uint32_t)-1);
 
+	/* PML logs the 4K page written, but only when the dirty flag of the
+	 * leaf changes, so large leaves would hide writes to their other pages */
+	if (ept_guest->pml) {
+		sp_support = MAM_EPT_NO_SUPER_PAGE_SUPPORT;
+		ept_reset_dirty_log(ept_guest, gpm);
+	} else {
+		sp_support = mon_ept_get_mam_super_page_support();
+	}
+
 	ept_guest->address_space =
 		mon_ept_create_guest_address_space(gpm, TRUE);
 	MON_ASSERT(mon_mam_convert_to_ept(ept_guest->address_space,
-			mon_ept_get_mam_super_page_support(),
+			sp_support,
 			mon_ept_get_mam_supported_gaw(ept_guest->gaw),
 			mon_ve_is_hw_supported(),
 			&(ept_guest->ept_root_table_hpa)));
@@ -336,6 +394,478 @@ mam_ept_supported_gaw_t mon_ept_get_mam_supported_gaw(uint32_t gaw)
 	       mon_ept_hw_get_guest_address_width_encoding(gaw);
 }
 
+/*
+ * Host CPUs that may cache translations of the guest EPTs. gcpus are pinned
+ * to host CPUs, so these are the host CPUs of all gcpus of the guest, no
+ * matter which EPT they run right now. The current CPU is not put into the
+ * bitmap; the return value tells whether it belongs to the set.
+ */
+static
+boolean_t ept_get_guest_host_cpus(guest_handle_t guest,
+				  ipc_destination_t *ipc_dest)
+{
+	guest_cpu_handle_t gcpu;
+	guest_gcpu_econtext_t gcpu_context;
+	uint16_t host_cpu_id;
+	boolean_t includes_self = FALSE;
+
+	mon_zeromem(ipc_dest, sizeof(ipc_destination_t));
+	ipc_dest->addr_shorthand = IPI_DST_CORE_ID_BITMAP;
+
+	for (gcpu = mon_guest_gcpu_first(guest, &gcpu_context); gcpu;
+	     gcpu = mon_guest_gcpu_next(&gcpu_context)) {
+		host_cpu_id = scheduler_get_host_cpu_id(gcpu);
+		if (host_cpu_id == hw_cpu_id()) {
+			includes_self = TRUE;
+		} else {
+			BITMAP_ARRAY64_SET(ipc_dest->core_bitmap, host_cpu_id);
+		}
+	}
+
+	return includes_self;
+}
+
+static
+void ept_clear_pending_invalidations(ept_guest_state_t *ept_guest)
+{
+	ept_guest->num_of_pending_ranges = 0;
+	ept_guest->pending_overflow = FALSE;
+}
+
+/*
+ * Record GPA range whose EPT entries were changed during the current GPM
+ * modification (between EVENT_BEGIN_GPM_MODIFICATION_BEFORE_CPUS_STOPPED
+ * and EVENT_END_GPM_MODIFICATION_BEFORE_CPUS_RESUMED). All ranges recorded
+ * in one modification are invalidated together at its end, so every change
+ * of the default EPT made in a permission update must be recorded.
+ * Overlapping and adjacent ranges are merged; when more than
+ * EPT_MAX_PENDING_INVALIDATIONS disjoint ranges remain, the whole context
+ * is invalidated.
+ */
+void mon_ept_add_pending_invalidation(guest_id_t guest_id,
+				      uint64_t gpa,
+				      uint64_t size)
+{
+	ept_guest_state_t *ept_guest = ept_find_guest_state(guest_id);
+	ept_gpa_range_t *range;
+	uint64_t start = ALIGN_BACKWARD(gpa, PAGE_4KB_SIZE);
+	uint64_t end = ALIGN_FORWARD(gpa + size, PAGE_4KB_SIZE);
+	uint32_t i = 0;
+
+	MON_ASSERT(ept_guest);
+	/* the EPT lock is held for the whole GPM modification */
+	MON_ASSERT(ept.lock.owner_cpu_id == hw_cpu_id());
+
+	if (ept_guest->pending_overflow || (size == 0)) {
+		return;
+	}
+
+	/* absorb every overlapping or adjacent range, the grown range may
+	 * reach ranges which were disjoint from the original one */
+	while (i < ept_guest->num_of_pending_ranges) {
+		range = &ept_guest->pending_ranges[i];
+		if ((start <= range->gpa + range->size) && (range->gpa <= end)) {
+			start = MIN(start, range->gpa);
+			end = MAX(end, range->gpa + range->size);
+			*range = ept_guest->pending_ranges[
+				--ept_guest->num_of_pending_ranges];
+			i = 0;
+			continue;
+		}
+		i++;
+	}
+
+	if (ept_guest->num_of_pending_ranges == EPT_MAX_PENDING_INVALIDATIONS) {
+		ept_guest->pending_overflow = TRUE;
+		return;
+	}
+
+	range = &ept_guest->pending_ranges[ept_guest->num_of_pending_ranges++];
+	range->gpa = start;
+	range->size = end - start;
+}
+
+/*
+ * Use per address INVEPT for the given ranges when the hardware supports
+ * it and there are only a few pages, single context INVEPT otherwise
+ * (also when no range is given).
+ */
+static
+void ept_prepare_invept_cmd(const ept_gpa_range_t *ranges,
+			    uint32_t num_of_ranges,
+			    uint64_t eptp,
+			    ept_invept_cmd_t *invept_cmd)
+{
+	uint64_t num_of_pages = 0;
+	uint32_t i;
+
+	mon_zeromem(invept_cmd, sizeof(ept_invept_cmd_t));
+	invept_cmd->host_cpu_id = ANY_CPU_ID;
+	invept_cmd->cmd = INVEPT_CONTEXT_WIDE;
+	invept_cmd->eptp = eptp;
+
+	if ((num_of_ranges == 0) ||
+	    !ept_hw_is_invept_individual_address_supported()) {
+		return;
+	}
+
+	for (i = 0; i < num_of_ranges; i++) {
+		num_of_pages += ranges[i].size / PAGE_4KB_SIZE;
+	}
+	if (num_of_pages > EPT_MAX_INDIVIDUAL_INVALIDATIONS) {
+		return;
+	}
+
+	invept_cmd->cmd = INVEPT_INDIVIDUAL_ADDRESS;
+	invept_cmd->ranges = ranges;
+	invept_cmd->num_of_ranges = num_of_ranges;
+}
+
+/*
+ * Change permissions of the default EPT of the guest while its CPUs keep
+ * running. Only leaf entries that are entirely inside the range are
+ * rewritten, with compare-exchange, and then only the CPUs hosting the
+ * guest are asked to invalidate the range. Returns FALSE without changing
+ * anything when a large page would have to be split; the caller should
+ * then use mon_ept_update_permissions(), which stops all CPUs.
+ */
+boolean_t mon_ept_update_permissions_in_place(guest_id_t guest_id,
+					      uint64_t gpa,
+					      uint64_t size,
+					      mam_attributes_t attrs_to_set,
+					      mam_attributes_t attrs_to_clear)
+{
+	guest_handle_t guest = mon_guest_handle(guest_id);
+	ept_guest_state_t *ept_guest = ept_find_guest_state(guest_id);
+	ept_gpa_range_t range;
+	ept_invept_cmd_t invept_cmd;
+	ipc_destination_t ipc_dest;
+	boolean_t includes_self;
+
+	MON_ASSERT(guest);
+	MON_ASSERT(ept_guest);
+
+	range.gpa = ALIGN_BACKWARD(gpa, PAGE_4KB_SIZE);
+	range.size = ALIGN_FORWARD(gpa + size, PAGE_4KB_SIZE) - range.gpa;
+
+	/* serialize with GPM modifications, which may recreate the EPT */
+	ept_acquire_lock();
+
+	if (!mam_update_permissions_in_place(ept_guest->address_space,
+		    range.gpa, range.size, attrs_to_set, attrs_to_clear)) {
+		ept_release_lock();
+		return FALSE;
+	}
+
+	/* rewritten leaves are dirty again, so they are not logged */
+	if (ept_guest->pml) {
+		ept_set_dirty_log(ept_guest, range.gpa, range.size);
+	}
+
+	ept_prepare_invept_cmd(&range, 1,
+		mon_ept_compute_eptp(guest, ept_guest->ept_root_table_hpa,
+			ept_guest->gaw),
+		&invept_cmd);
+
+	includes_self = ept_get_guest_host_cpus(guest, &ipc_dest);
+	if (includes_self) {
+		mon_ept_invalidate_ept(ANY_CPU_ID, &invept_cmd);
+	}
+	ipc_execute_handler_sync(ipc_dest, mon_ept_invalidate_ept,
+		(void *)&invept_cmd);
+
+	ept_release_lock();
+
+	return TRUE;
+}
+
+/*
+ * Change permissions of the default EPT of the guest. Tries the in-place
+ * update first; when large pages have to be split all CPUs are stopped, and
+ * only the changed range is invalidated when they resume.
+ */
+boolean_t mon_ept_update_permissions(guest_id_t guest_id,
+				     uint64_t gpa,
+				     uint64_t size,
+				     mam_attributes_t attrs_to_set,
+				     mam_attributes_t attrs_to_clear)
+{
+	guest_handle_t guest = mon_guest_handle(guest_id);
+	ept_guest_state_t *ept_guest = ept_find_guest_state(guest_id);
+	uint64_t start = ALIGN_BACKWARD(gpa, PAGE_4KB_SIZE);
+	uint64_t end = ALIGN_FORWARD(gpa + size, PAGE_4KB_SIZE);
+	boolean_t res = TRUE;
+
+	MON_ASSERT(guest);
+	MON_ASSERT(ept_guest);
+
+	if (mon_ept_update_permissions_in_place(guest_id, gpa, size,
+		    attrs_to_set, attrs_to_clear)) {
+		return TRUE;
+	}
+
+	guest_begin_physical_memory_modifications(guest);
+
+	if (attrs_to_set.uint32 != 0) {
+		res = mam_add_permissions_to_existing_mapping(
+			ept_guest->address_space, start, end - start,
+			attrs_to_set);
+	}
+	if (res && (attrs_to_clear.uint32 != 0)) {
+		res = mam_remove_permissions_from_existing_mapping(
+			ept_guest->address_space, start, end - start,
+			attrs_to_clear);
+	}
+	/* recorded even on failure, part of the range may have changed */
+	mon_ept_add_pending_invalidation(guest_id, start, end - start);
+
+	guest_end_physical_memory_perm_update(guest);
+
+	return res;
+}
+
+boolean_t mon_ept_is_accessed_dirty_enabled(guest_id_t guest_id)
+{
+	ept_guest_state_t *ept_guest = ept_find_guest_state(guest_id);
+
+	return (ept_guest != NULL) && ept_guest->accessed_dirty;
+}
+
+/*
+ * Move the GPAs logged by the CPU into the dirty log of the guest and
+ * restart the page modification log. The CPU fills the log from the last
+ * entry down and the PML index wraps below 0 when the log is full.
+ */
+static
+void ept_drain_pml(ept_guest_state_t *ept_guest, guest_cpu_handle_t gcpu)
+{
+	const virtual_cpu_id_t *vcpu_id = mon_guest_vcpu(gcpu);
+	ept_guest_cpu_state_t *ept_guest_cpu;
+	uint32_t index;
+	uint64_t page;
+
+	MON_ASSERT(vcpu_id);
+	ept_guest_cpu = ept_guest->gcpu_state[vcpu_id->guest_cpu_id];
+	if (!ept_guest_cpu->pml_enabled) {
+		return;
+	}
+
+	index = ept_hw_get_pml_index(gcpu);
+	index = (index > EPT_PML_LAST_INDEX) ? 0 : index + 1;
+	if (index == EPT_PML_NUM_OF_ENTRIES) {
+		/* nothing logged */
+		return;
+	}
+
+	lock_acquire(&ept_guest->dirty_log_lock);
+	for (; index < EPT_PML_NUM_OF_ENTRIES; index++) {
+		page = ept_guest_cpu->pml_buffer[index] / PAGE_4KB_SIZE;
+		if (page < ept_guest->dirty_log_pages) {
+			BITMAP_ARRAY64_SET(ept_guest->dirty_log, page);
+		}
+	}
+	lock_release(&ept_guest->dirty_log_lock);
+
+	ept_hw_reset_pml_index(gcpu);
+}
+
+static
+void ept_drain_remote_pml(cpu_id_t from UNUSED, void *arg)
+{
+	guest_id_t guest_id = *(guest_id_t *)arg;
+	guest_cpu_handle_t gcpu;
+
+	gcpu = mon_scheduler_get_current_gcpu_for_guest(guest_id);
+
+	if (gcpu == NULL) {
+		return;
+	}
+
+	ept_drain_pml(ept_find_guest_state(guest_id), gcpu);
+}
+
+static
+vmexit_handling_status_t ept_pml_full_vmexit(guest_cpu_handle_t gcpu)
+{
+	vmcs_object_t *vmcs = mon_gcpu_get_vmcs(gcpu);
+	ia32_vmx_exit_qualification_t qualification;
+	ia32_vmx_vmcs_vmexit_info_idt_vectoring_t idt_vectoring_info;
+	ia32_vmx_vmcs_guest_interruptibility_t guest_interruptibility;
+
+	ept_drain_pml(ept_find_guest_state(mon_guest_vcpu(gcpu)->guest_id),
+		gcpu);
+
+	/* same NMI unblocking bit as for EPT violations */
+	qualification.uint64 = mon_vmcs_read(vmcs,
+		VMCS_EXIT_INFO_QUALIFICATION);
+	idt_vectoring_info.uint32 = (uint32_t)mon_vmcs_read(vmcs,
+		VMCS_EXIT_INFO_IDT_VECTORING);
+	if (qualification.ept_violation.nmi_unblocking &&
+	    !idt_vectoring_info.bits.valid) {
+		guest_interruptibility.uint32 = (uint32_t)mon_vmcs_read(vmcs,
+			VMCS_GUEST_INTERRUPTIBILITY);
+		guest_interruptibility.bits.block_nmi = 1;
+		mon_vmcs_write(vmcs, VMCS_GUEST_INTERRUPTIBILITY,
+			(uint64_t)guest_interruptibility.uint32);
+	}
+
+	return VMEXIT_HANDLED;
+}
+
+/*
+ * Report the pages of guest physical range [gpa, gpa + size) written since
+ * dirty tracking was last restarted for them, one bit per 4K page in
+ * "bitmap" (rounded up to 64 bits), and restart tracking when "clear" is
+ * set. Pages of a new mapping count as written. Only accesses through the
+ * default EPT are tracked. Without PML, tracking of a large page the range
+ * covers only partly is not restarted: its pages keep being reported until
+ * a range covering the whole page is cleared.
+ *
+ * Tracking is restarted before the log is read, so a write racing with the
+ * harvest is either reported now or by the next harvest.
+ */
+boolean_t mon_ept_get_dirty_log(guest_id_t guest_id,
+				uint64_t gpa,
+				uint64_t size,
+				uint64_t *bitmap,
+				boolean_t clear)
+{
+	guest_handle_t guest = mon_guest_handle(guest_id);
+	ept_guest_state_t *ept_guest = ept_find_guest_state(guest_id);
+	guest_cpu_handle_t gcpu;
+	ept_gpa_range_t range;
+	ept_invept_cmd_t invept_cmd;
+	ipc_destination_t ipc_dest;
+	boolean_t includes_self;
+	uint64_t num_of_pages, first_page, page;
+
+	MON_ASSERT(guest);
+	MON_ASSERT(bitmap);
+
+	if ((ept_guest == NULL) || !ept_guest->accessed_dirty ||
+	    (size == 0) || ((gpa | size) & PAGE_4KB_MASK)) {
+		return FALSE;
+	}
+
+	num_of_pages = size / PAGE_4KB_SIZE;
+	first_page = gpa / PAGE_4KB_SIZE;
+	mon_memset(bitmap, 0, ALIGN_FORWARD(num_of_pages, 64) / 8);
+
+	/* serialize with GPM modifications, which may recreate the EPT */
+	ept_acquire_lock();
+
+	includes_self = ept_get_guest_host_cpus(guest, &ipc_dest);
+
+	if (clear || !ept_guest->pml) {
+		/* without PML the dirty flags are the log */
+		if (!mam_get_ept_dirty_pages(ept_guest->address_space, gpa, size,
+			    ept_guest->pml ? NULL : bitmap, clear)) {
+			ept_release_lock();
+			return FALSE;
+		}
+	}
+
+	if (clear) {
+		range.gpa = gpa;
+		range.size = size;
+		ept_prepare_invept_cmd(&range, 1,
+			mon_ept_compute_eptp(guest, ept_guest->ept_root_table_hpa,
+				ept_guest->gaw),
+			&invept_cmd);
+
+		if (includes_self) {
+			mon_ept_invalidate_ept(ANY_CPU_ID, &invept_cmd);
+		}
+		ipc_execute_handler_sync(ipc_dest, mon_ept_invalidate_ept,
+			(void *)&invept_cmd);
+	}
+
+	if (ept_guest->pml) {
+		gcpu = mon_scheduler_get_current_gcpu_for_guest(guest_id);
+		if (includes_self && (gcpu != NULL)) {
+			ept_drain_pml(ept_guest, gcpu);
+		}
+		ipc_execute_handler_sync(ipc_dest, ept_drain_remote_pml,
+			(void *)&guest_id);
+
+		lock_acquire(&ept_guest->dirty_log_lock);
+		for (page = 0; (page < num_of_pages) &&
+		     (first_page + page < ept_guest->dirty_log_pages); page++) {
+			if (!BITMAP_ARRAY64_GET(ept_guest->dirty_log,
+				    first_page + page)) {
+				continue;
+			}
+			BITMAP_ARRAY64_SET(bitmap, page);
+			if (clear) {
+				BITMAP_ARRAY64_CLR(ept_guest->dirty_log,
+					first_page + page);
+			}
+		}
+		lock_release(&ept_guest->dirty_log_lock);
+	}
+
+	ept_release_lock();
+
+	return TRUE;
+}
+
+/*--------------------------------------------------------------------------*
+*  FUNCTION : ept_dirty_log_vmcall_handler()
+*  PURPOSE  : VMCALL_EPT_GET_DIRTY_LOG service. Reports dirty pages of the
+*           : calling guest
+*  ARGUMENTS: arg1 - guest virtual address of mon_ept_dirty_log_params_t
+*  RETURNS  : mon_status_t
+*--------------------------------------------------------------------------*/
+static
+mon_status_t ept_dirty_log_vmcall_handler(guest_cpu_handle_t gcpu,
+					  address_t *arg1,
+					  address_t *arg2 UNUSED,
+					  address_t *arg3 UNUSED)
+{
+	mon_ept_dirty_log_params_t params;
+	uint64_t *bitmap = NULL;
+	uint32_t bitmap_size = 0;
+
+	if (copy_from_gva(gcpu, (uint64_t)*arg1, sizeof(params),
+		    (uint64_t)&params) != 0) {
+		mon_gcpu_inject_gp0(gcpu);
+		return MON_ERROR;
+	}
+
+	params.status = MON_ERROR;
+	if ((params.vmcall_id == VMCALL_EPT_GET_DIRTY_LOG) &&
+	    (params.size / PAGE_4KB_SIZE <= MON_EPT_DIRTY_LOG_MAX_PAGES)) {
+		bitmap_size = (uint32_t)(ALIGN_FORWARD(params.size /
+						       PAGE_4KB_SIZE, 64) / 8);
+		bitmap = (uint64_t *)mon_memory_alloc(MAX(bitmap_size,
+				sizeof(uint64_t)));
+	}
+
+	if ((bitmap != NULL) &&
+	    mon_ept_get_dirty_log(mon_guest_vcpu(gcpu)->guest_id, params.gpa,
+		    params.size, bitmap, params.clear != 0)) {
+		if (copy_to_gva(gcpu, params.bitmap_gva, bitmap_size,
+			    (uint64_t)bitmap) != 0) {
+			mon_memory_free(bitmap);
+			mon_gcpu_inject_gp0(gcpu);
+			return MON_ERROR;
+		}
+		params.status = MON_OK;
+	}
+
+	if (bitmap != NULL) {
+		mon_memory_free(bitmap);
+	}
+
+	if (copy_to_gva(gcpu, (uint64_t)*arg1, sizeof(params),
+		    (uint64_t)&params) != 0) {
+		mon_gcpu_inject_gp0(gcpu);
+		return MON_ERROR;
+	}
+
+	return MON_OK;
+}
+
 static
 boolean_t ept_begin_gpm_modification_before_cpus_stop(
 	guest_cpu_handle_t gcpu UNUSED,
@@ -350,6 +880,7 @@ boolean_t ept_end_gpm_modification_before_cpus_resume(guest_cpu_handle_t gcpu,
 						      void *pv)
 {
 	guest_handle_t guest = NULL;
+	ept_guest_state_t *ept_guest = NULL;
 	ept_set_eptp_cmd_t set_eptp_cmd;
 	ept_invept_cmd_t invept_cmd;
 	ipc_destination_t ipc_dest;
@@ -357,24 +888,51 @@ boolean_t ept_end_gpm_modification_before_cpus_resume(guest_cpu_handle_t gcpu,
 		(event_gpm_modification_data_t *)pv;
 	uint64_t default_ept_root_table_hpa;
 	uint32_t default_ept_gaw;
+	boolean_t includes_self;
+	uint32_t i;
 
 	MON_ASSERT(pv);
 
 	guest = mon_guest_handle(gpm_modification_data->guest_id);
-	if (gpm_modification_data->operation == MON_MEM_OP_UPDATE) {
+	ept_guest = ept_find_guest_state(gpm_modification_data->guest_id);
+	MON_ASSERT(ept_guest);
+
+	/* only CPUs hosting the guest may cache its translations */
+	includes_self = ept_get_guest_host_cpus(guest, &ipc_dest);
+
+	if ((gpm_modification_data->operation == MON_MEM_OP_UPDATE) &&
+	    (ept_guest->pending_overflow ||
+	     (ept_guest->num_of_pending_ranges != 0))) {
 		ept_get_default_ept(guest, &default_ept_root_table_hpa,
 			&default_ept_gaw);
-		invept_cmd.host_cpu_id = ANY_CPU_ID;
-		invept_cmd.cmd = INVEPT_CONTEXT_WIDE;
-		invept_cmd.eptp =
+		ept_prepare_invept_cmd(ept_guest->pending_ranges,
+			ept_guest->pending_overflow ?
+			0 : ept_guest->num_of_pending_ranges,
 			mon_ept_compute_eptp(guest, default_ept_root_table_hpa,
-				default_ept_gaw);
+				default_ept_gaw),
+			&invept_cmd);
 
-		mon_ept_invalidate_ept(ANY_CPU_ID, &invept_cmd);
+		if (includes_self) {
+			mon_ept_invalidate_ept(ANY_CPU_ID, &invept_cmd);
+		}
 
-		ipc_dest.addr_shorthand = IPI_DST_ALL_EXCLUDING_SELF;
+		/* one shootdown for all the changes of this modification */
 		ipc_execute_handler_sync(ipc_dest, mon_ept_invalidate_ept,
 			(void *)&invept_cmd);
+
+		/* changed leaves are created dirty, so they are not logged */
+		if (ept_guest->pml && ept_guest->pending_overflow) {
+			ept_set_dirty_log(ept_guest, 0,
+				ept_guest->dirty_log_pages * PAGE_4KB_SIZE);
+		} else if (ept_guest->pml) {
+			for (i = 0; i < ept_guest->num_of_pending_ranges; i++) {
+				ept_set_dirty_log(ept_guest,
+					ept_guest->pending_ranges[i].gpa,
+					ept_guest->pending_ranges[i].size);
+			}
+		}
+	} else if (gpm_modification_data->operation == MON_MEM_OP_UPDATE) {
+		/* no EPT entry was changed */
 	} else if (gpm_modification_data->operation == MON_MEM_OP_RECREATE) {
 		/* Recreate Default EPT */
 		ept_create_default_ept(guest, mon_guest_get_startup_gpm(guest));
@@ -391,6 +949,8 @@ boolean_t ept_end_gpm_modification_before_cpus_resume(guest_cpu_handle_t gcpu,
 			mon_ept_compute_eptp(guest,
 				default_ept_root_table_hpa,
 				default_ept_gaw);
+		invept_cmd.ranges = NULL;
+		invept_cmd.num_of_ranges = 0;
 		mon_ept_invalidate_ept(ANY_CPU_ID, &invept_cmd);
 
 		set_eptp_cmd.guest_id = gpm_modification_data->guest_id;
@@ -398,7 +958,6 @@ boolean_t ept_end_gpm_modification_before_cpus_resume(guest_cpu_handle_t gcpu,
 		set_eptp_cmd.gaw = default_ept_gaw;
 		set_eptp_cmd.invept_cmd = &invept_cmd;
 
-		ipc_dest.addr_shorthand = IPI_DST_ALL_EXCLUDING_SELF;
 		ipc_execute_handler_sync(ipc_dest, ept_set_remote_eptp,
 			(void *)&set_eptp_cmd);
 	} else {
@@ -407,6 +966,8 @@ boolean_t ept_end_gpm_modification_before_cpus_resume(guest_cpu_handle_t gcpu,
 			MON_MEM_OP_SWITCH);
 	}
 
+	ept_clear_pending_invalidations(ept_guest);
+
 	return TRUE;
 }
 
@@ -689,15 +1250,14 @@ void ept_gcpu_activity_state_change(guest_cpu_handle_t gcpu,
 	}
 }
 
-uint32_t mon_ept_get_guest_address_width(gpm_handle_t gpm)
+static
+uint64_t ept_get_guest_address_limit(gpm_handle_t gpm)
 {
 	gpm_ranges_iterator_t gpm_iter = 0;
 	gpa_t guest_range_addr = 0;
 	uint64_t guest_range_size = 0;
 	gpa_t guest_highest_range_addr = 0;
 	uint64_t guest_highest_range_size = 0;
-	uint64_t guest_address_limit = 0;
-	uint32_t guest_address_limit_msb_index = 0;
 
 	MON_ASSERT(gpm);
 
@@ -715,8 +1275,13 @@ uint32_t mon_ept_get_guest_address_width(gpm_handle_t gpm)
 		}
 	}
 
-	guest_address_limit = guest_highest_range_addr +
-			      guest_highest_range_size;
+	return guest_highest_range_addr + guest_highest_range_size;
+}
+
+uint32_t mon_ept_get_guest_address_width(gpm_handle_t gpm)
+{
+	uint64_t guest_address_limit = ept_get_guest_address_limit(gpm);
+	uint32_t guest_address_limit_msb_index = 0;
 
 	hw_scan_bit_backward64(&guest_address_limit_msb_index,
 		guest_address_limit);
@@ -737,6 +1302,9 @@ mam_handle_t mon_ept_create_guest_address_space(gpm_handle_t gpm,
 	boolean_t status = FALSE;
 	uint64_t same_memory_type_range_size = 0, covered_guest_range_size = 0;
 	mon_phys_mem_type_t mem_type;
+	mam_range_desc_t *batch;
+	uint32_t batch_count = 0;
+	const uint32_t batch_capacity = PAGE_4KB_SIZE / sizeof(mam_range_desc_t);
 
 	MON_ASSERT(gpm);
 
@@ -748,6 +1316,15 @@ mam_handle_t mon_ept_create_guest_address_space(gpm_handle_t gpm,
 	address_space = mam_create_mapping(attributes);
 	MON_ASSERT(address_space);
 
+	/* GPM ranges come sorted by GPA; collect the per memory type slices
+	 * and insert them in batches, which lets MAM coalesce neighbours into
+	 * large leaves and compact the tables once per batch */
+	batch = (mam_range_desc_t *)mon_memory_alloc(PAGE_4KB_SIZE);
+	MON_ASSERT(batch);
+	if (batch == NULL) {
+		return NULL;
+	}
+
 	gpm_iter = gpm_get_ranges_iterator(gpm);
 
 	while (GPM_INVALID_RANGES_ITERATOR != gpm_iter) {
@@ -814,34 +1391,46 @@ mam_handle_t mon_ept_create_guest_address_space(gpm_handle_t gpm,
 				 *         same_memory_type_range_size,
 				 *         mem_type);
 				 */
-				if (!mam_insert_range(address_space,
-					guest_range_addr + covered_guest_range_size,
-					host_range_addr + covered_guest_range_size,
-					same_memory_type_range_size,
-					attributes)) {
-					EPT_LOG
-					(
-						"EPT add range failed,"
-						"gpa %p -> hpa %p; size %p; mem_type %d\r\n",
-						guest_range_addr + covered_guest_range_size,
-						host_range_addr + covered_guest_range_size,
-						same_memory_type_range_size,
-						attributes.ept_attr.emt);
-					return NULL;
+				if (batch_count == batch_capacity) {
+					if (!mam_insert_ranges(address_space,
+						    batch, batch_count)) {
+						EPT_LOG("EPT add ranges failed\r\n");
+						mon_memory_free(batch);
+						return NULL;
+					}
+					batch_count = 0;
 				}
 
+				batch[batch_count].src_addr =
+					guest_range_addr + covered_guest_range_size;
+				batch[batch_count].tgt_addr =
+					host_range_addr + covered_guest_range_size;
+				batch[batch_count].size = same_memory_type_range_size;
+				batch[batch_count].attrs = attributes;
+				batch_count++;
+
 				covered_guest_range_size +=
 					same_memory_type_range_size;
 			} while (covered_guest_range_size < guest_range_size);
 		}
 	}
 
+	if (!mam_insert_ranges(address_space, batch, batch_count)) {
+		EPT_LOG("EPT add ranges failed\r\n");
+		mon_memory_free(batch);
+		return NULL;
+	}
+
+	mon_memory_free(batch);
+
 	return address_space;
 }
 
 void mon_ept_invalidate_ept(cpu_id_t from UNUSED, void *arg)
 {
 	ept_invept_cmd_t *invept_cmd = (ept_invept_cmd_t *)arg;
+	uint64_t gpa;
+	uint32_t i;
 
 	if (invept_cmd->host_cpu_id != ANY_CPU_ID &&
 	    invept_cmd->host_cpu_id != hw_cpu_id()) {
@@ -862,10 +1451,20 @@ void mon_ept_invalidate_ept(cpu_id_t from UNUSED, void *arg)
 		ept_hw_invept_context(invept_cmd->eptp);
 		break;
 
-	/* Not being used currently */
 	case INVEPT_INDIVIDUAL_ADDRESS:
-		ept_hw_invept_individual_address(invept_cmd->eptp,
-			invept_cmd->gpa);
+		if (invept_cmd->ranges == NULL) {
+			ept_hw_invept_individual_address(invept_cmd->eptp,
+				invept_cmd->gpa);
+			break;
+		}
+		for (i = 0; i < invept_cmd->num_of_ranges; i++) {
+			const ept_gpa_range_t *range = &invept_cmd->ranges[i];
+
+			for (gpa = range->gpa; gpa < range->gpa + range->size;
+			     gpa += PAGE_4KB_SIZE)
+				ept_hw_invept_individual_address(
+					invept_cmd->eptp, gpa);
+		}
 		break;
 
 	default:
@@ -895,6 +1494,8 @@ uint64_t mon_ept_compute_eptp(guest_handle_t guest, uint64_t ept_root_table_hpa,
 	eptp.uint64 = ept_root_table_hpa;
 	eptp.bits.gaw = mon_ept_hw_get_guest_address_width_encoding(gaw);
 	eptp.bits.etmt = mon_ept_hw_get_ept_memory_type();
+	eptp.bits.accessed_dirty =
+		mon_ept_is_accessed_dirty_enabled(guest_get_id(guest)) ? 1 : 0;
 	eptp.bits.reserved = 0;
 
 	return eptp.uint64;
@@ -905,6 +1506,9 @@ boolean_t mon_ept_enable(guest_cpu_handle_t gcpu)
 {
 	uint64_t ept_root_table_hpa = 0;
 	uint32_t gaw = 0;
+	const virtual_cpu_id_t *vcpu_id = NULL;
+	ept_guest_state_t *ept_guest = NULL;
+	ept_guest_cpu_state_t *ept_guest_cpu = NULL;
 
 	MON_ASSERT(gcpu);
 
@@ -919,6 +1523,19 @@ boolean_t mon_ept_enable(guest_cpu_handle_t gcpu)
 		goto failure;
 	}
 
+	vcpu_id = mon_guest_vcpu(gcpu);
+	MON_ASSERT(vcpu_id);
+	ept_guest = ept_find_guest_state(vcpu_id->guest_id);
+	MON_ASSERT(ept_guest);
+	ept_guest_cpu = ept_guest->gcpu_state[vcpu_id->guest_cpu_id];
+	if (ept_guest->pml) {
+		if (!ept_hw_enable_pml(gcpu, ept_guest_cpu->pml_buffer_hpa)) {
+			EPT_PRINTERROR("EPT: failed to enable pml\r\n");
+			goto failure;
+		}
+		ept_guest_cpu->pml_enabled = TRUE;
+	}
+
 	return TRUE;
 
 failure:
@@ -928,6 +1545,22 @@ failure:
 /* NOTE: This function is expected to be always called with the lock acquired */
 void mon_ept_disable(guest_cpu_handle_t gcpu)
 {
+	const virtual_cpu_id_t *vcpu_id = mon_guest_vcpu(gcpu);
+	ept_guest_state_t *ept_guest = NULL;
+	ept_guest_cpu_state_t *ept_guest_cpu = NULL;
+
+	MON_ASSERT(vcpu_id);
+	ept_guest = ept_find_guest_state(vcpu_id->guest_id);
+	MON_ASSERT(ept_guest);
+	ept_guest_cpu = ept_guest->gcpu_state[vcpu_id->guest_cpu_id];
+
+	/* PML requires EPT */
+	if (ept_guest_cpu->pml_enabled) {
+		ept_drain_pml(ept_guest, gcpu);
+		ept_hw_disable_pml(gcpu);
+		ept_guest_cpu->pml_enabled = FALSE;
+	}
+
 	ept_hw_disable_ept(gcpu);
 }
 
@@ -941,7 +1574,9 @@ boolean_t ept_set_eptp(guest_cpu_handle_t gcpu, uint64_t ept_root_table_hpa,
 		       uint32_t gaw)
 {
 	MON_ASSERT(gcpu);
-	return ept_hw_set_eptp(gcpu, ept_root_table_hpa, gaw);
+	return ept_hw_set_eptp(gcpu, ept_root_table_hpa, gaw,
+		mon_ept_is_accessed_dirty_enabled(
+			mon_guest_vcpu(gcpu)->guest_id));
 }
 
 void ept_set_remote_eptp(cpu_id_t from, void *arg)
@@ -990,8 +1625,16 @@ boolean_t ept_guest_initialize(guest_handle_t guest)
 	MON_ASSERT(ept_guest);
 
 	ept_guest->guest_id = guest_get_id(guest);
+	ept_clear_pending_invalidations(ept_guest);
 	list_add(ept.guest_state, ept_guest->list);
 
+	ept_guest->accessed_dirty = guest_is_ept_accessed_dirty_enabled(guest)
+				    && ept_hw_is_accessed_dirty_supported();
+	ept_guest->pml = ept_guest->accessed_dirty && ept_hw_is_pml_supported();
+	ept_guest->dirty_log = NULL;
+	ept_guest->dirty_log_pages = 0;
+	lock_initialize(&ept_guest->dirty_log_lock);
+
 	ept_guest->gcpu_state =
 		(ept_guest_cpu_state_t **)mon_malloc(ept.num_of_cpus *
 			sizeof(ept_guest_cpu_state_t *));
@@ -1002,8 +1645,29 @@ boolean_t ept_guest_initialize(guest_handle_t guest)
 			(ept_guest_cpu_state_t *)mon_malloc(sizeof(
 					ept_guest_cpu_state_t));
 		MON_ASSERT(ept_guest->gcpu_state[i]);
+
+		if (ept_guest->pml) {
+			ept_guest->gcpu_state[i]->pml_buffer =
+				(uint64_t *)mon_memory_alloc(PAGE_4KB_SIZE);
+			MON_ASSERT(ept_guest->gcpu_state[i]->pml_buffer);
+			if (!mon_hmm_hva_to_hpa(
+				    (hva_t)ept_guest->gcpu_state[i]->pml_buffer,
+				    &ept_guest->gcpu_state[i]->pml_buffer_hpa)) {
+				MON_DEADLOOP();
+			}
+		}
 	}
 
+	if (ept_guest->pml) {
+		vmexit_install_handler(ept_guest->guest_id, ept_pml_full_vmexit,
+			IA32_VMX_EXIT_BASIC_REASON_PML_FULL);
+	}
+	mon_vmcall_register(ept_guest->guest_id, VMCALL_EPT_GET_DIRTY_LOG,
+		ept_dirty_log_vmcall_handler, FALSE);
+
+	EPT_LOG("EPT: guest#%d accessed/dirty flags %d pml %d\r\n",
+		ept_guest->guest_id, ept_guest->accessed_dirty, ept_guest->pml);
+
 	event_global_register(EVENT_BEGIN_GPM_MODIFICATION_BEFORE_CPUS_STOPPED,
 		ept_begin_gpm_modification_before_cpus_stop);
 	event_global_register(EVENT_END_GPM_MODIFICATION_BEFORE_CPUS_RESUMED,
@@ -1152,7 +1816,7 @@ void init_ept_addon(uint32_t num_of_cpus)
 	EPT_LOG("init_ept_addon: Initialize EPT num_cpus %d\n", num_of_cpus);
 
 	list_init(ept.guest_state);
-	lock_initialize(&ept.lock);
+	mcs_lock_initialize(&ept.lock);
 
 	event_global_register(EVENT_GUEST_CREATE, ept_add_dynamic_guest);
 	event_global_register(EVENT_GCPU_ADD, (event_callback_t)ept_add_gcpu);
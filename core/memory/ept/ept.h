@@ -26,13 +26,28 @@
 
 #define ANY_CPU_ID                                   ((cpu_id_t)-1)
 
+/* Number of GPA ranges remembered inside one GPM modification; on
+ * overflow the whole context is invalidated */
+#define EPT_MAX_PENDING_INVALIDATIONS                16
+/* Above this number of pages single context INVEPT is cheaper */
+#define EPT_MAX_INDIVIDUAL_INVALIDATIONS             64
+
 /* internal data structures */
+typedef struct {
+	uint64_t	gpa;
+	uint64_t	size;
+} ept_gpa_range_t;
+
 typedef struct {
 	cpu_id_t		host_cpu_id;
 	char			padding[2];
 	invept_cmd_type_t	cmd;
 	uint64_t		eptp; /* context */
 	uint64_t		gpa;
+	/* INVEPT_INDIVIDUAL_ADDRESS over ranges instead of single gpa */
+	const ept_gpa_range_t	*ranges;
+	uint32_t		num_of_ranges;
+	uint32_t		padding2;
 } ept_invept_cmd_t;
 
 typedef struct {
@@ -50,7 +65,10 @@ typedef struct {
 	boolean_t	ept_enabled_save;
 	uint64_t	active_ept_root_table_hpa;
 	uint32_t	active_ept_gaw;
-	uint32_t	padding;
+	boolean_t	pml_enabled;
+	/* page modification log of the gcpu */
+	uint64_t	*pml_buffer;
+	uint64_t	pml_buffer_hpa;
 } ept_guest_cpu_state_t;
 
 typedef struct {
@@ -61,12 +79,24 @@ typedef struct {
 	uint16_t		padding;
 	ept_guest_cpu_state_t **gcpu_state;
 	list_element_t		list[1];
+	/* GPA ranges changed since the GPM modification began */
+	ept_gpa_range_t		pending_ranges[EPT_MAX_PENDING_INVALIDATIONS];
+	uint32_t		num_of_pending_ranges;
+	boolean_t		pending_overflow;
+	/* EPT accessed/dirty flags and page modification logging in use */
+	boolean_t		accessed_dirty;
+	boolean_t		pml;
+	/* with PML: pages logged as dirty and not harvested yet, one bit per
+	 * 4K page below dirty_log_pages */
+	uint64_t		*dirty_log;
+	uint64_t		dirty_log_pages;
+	mon_lock_t		dirty_log_lock;
 } ept_guest_state_t;
 
 typedef struct {
 	list_element_t	guest_state[1]; /* ept_guest_state_t */
 	uint32_t	num_of_cpus;
-	mon_lock_t	lock;
+	mon_mcs_lock_t	lock;
 	uint32_t	lock_count;
 } ept_state_t;
 
@@ -99,6 +129,26 @@ uint64_t mon_ept_compute_eptp(guest_handle_t guest,
 			      uint64_t ept_root_table_hpa,
 			      uint32_t gaw);
 void mon_ept_invalidate_ept(cpu_id_t from, void *arg);
+void mon_ept_add_pending_invalidation(guest_id_t guest_id,
+				      uint64_t gpa,
+				      uint64_t size);
+boolean_t mon_ept_update_permissions_in_place(guest_id_t guest_id,
+					      uint64_t gpa,
+					      uint64_t size,
+					      mam_attributes_t attrs_to_set,
+					      mam_attributes_t attrs_to_clear);
+boolean_t mon_ept_update_permissions(guest_id_t guest_id,
+				     uint64_t gpa,
+				     uint64_t size,
+				     mam_attributes_t attrs_to_set,
+				     mam_attributes_t attrs_to_clear);
+
+boolean_t mon_ept_is_accessed_dirty_enabled(guest_id_t guest_id);
+boolean_t mon_ept_get_dirty_log(guest_id_t guest_id,
+				uint64_t gpa,
+				uint64_t size,
+				uint64_t *bitmap,
+				boolean_t clear);
 
 ept_guest_state_t *ept_find_guest_state(guest_id_t guest_id);
 
@@ -58,6 +58,25 @@ boolean_t ept_hw_is_ept_supported(void)
 	       enable_ept;
 }
 
+boolean_t ept_hw_is_accessed_dirty_supported(void)
+{
+	const vmcs_hw_constraints_t *hw_constraints =
+		mon_vmcs_hw_get_vmx_constraints();
+
+	return ept_hw_is_ept_supported()
+	       && hw_constraints->ept_vpid_capabilities.bits.ept_accessed_dirty;
+}
+
+boolean_t ept_hw_is_pml_supported(void)
+{
+	const vmcs_hw_constraints_t *hw_constraints =
+		mon_vmcs_hw_get_vmx_constraints();
+
+	return ept_hw_is_accessed_dirty_supported()
+	       && hw_constraints->may1_processor_based_exec_ctrl2.bits.
+	       enable_pml;
+}
+
 void ept_hw_set_pdtprs(guest_cpu_handle_t gcpu, uint64_t pdptr[])
 {
 	vmcs_object_t *vmcs = mon_gcpu_get_vmcs(gcpu);
@@ -161,7 +180,8 @@ uint64_t ept_hw_get_eptp(guest_cpu_handle_t gcpu)
 
 boolean_t ept_hw_set_eptp(guest_cpu_handle_t gcpu,
 			  hpa_t ept_root_hpa,
-			  uint32_t gaw)
+			  uint32_t gaw,
+			  boolean_t accessed_dirty)
 {
 	vmcs_object_t *vmcs = mon_gcpu_get_vmcs(gcpu);
 	eptp_t eptp;
@@ -184,6 +204,8 @@ boolean_t ept_hw_set_eptp(guest_cpu_handle_t gcpu,
 	eptp.uint64 = ept_root_hpa;
 	eptp.bits.etmt = mon_ept_hw_get_ept_memory_type();
 	eptp.bits.gaw = mon_ept_hw_get_guest_address_width_encoding(ept_gaw);
+	eptp.bits.accessed_dirty =
+		(accessed_dirty && ept_hw_is_accessed_dirty_supported()) ? 1 : 0;
 	eptp.bits.reserved = 0;
 
 	mon_vmcs_write(vmcs, VMCS_EPTP_ADDRESS, eptp.uint64);
@@ -218,6 +240,16 @@ boolean_t ept_hw_is_invept_supported(void)
 	return FALSE;
 }
 
+boolean_t ept_hw_is_invept_individual_address_supported(void)
+{
+	const vmcs_hw_constraints_t *hw_constraints =
+		mon_vmcs_hw_get_vmx_constraints();
+
+	return ept_hw_is_invept_supported() &&
+	       hw_constraints->ept_vpid_capabilities.bits.
+	       invept_individual_address;
+}
+
 /* invalidate VPID */
 boolean_t ept_hw_is_invvpid_supported(void)
 {
@@ -307,7 +339,7 @@ boolean_t ept_hw_invept_individual_address(uint64_t eptp, address_t gpa)
 
 	mon_zeromem(&arg, sizeof(arg));
 
-	MON_ASSERT((eptp != 0) && (gpa != 0));
+	MON_ASSERT(eptp != 0);
 	arg.eptp = eptp;
 	arg.gpa = gpa;
 
@@ -475,3 +507,74 @@ void ept_hw_disable_ept(guest_cpu_handle_t gcpu)
 
 	/* EPT_LOG("CPU#%d disable EPT\r\n", hw_cpu_id()); */
 }
+
+/*
+ * Page modification logging: the CPU stores GPAs of pages whose EPT dirty
+ * flag it sets into the 4K buffer, from the entry at the PML index down to
+ * entry 0, and exits with PML_FULL when the buffer has no room left.
+ */
+boolean_t ept_hw_enable_pml(guest_cpu_handle_t gcpu, hpa_t pml_buffer_hpa)
+{
+	processor_based_vm_execution_controls2_t proc_ctrls2;
+	vmexit_control_t vmexit_request;
+	vmcs_object_t *vmcs = mon_gcpu_get_vmcs(gcpu);
+
+	CHECK_EXECUTION_ON_LOCAL_HOST_CPU(gcpu);
+
+	MON_ASSERT(gcpu);
+	MON_ASSERT(ALIGN_BACKWARD(pml_buffer_hpa, PAGE_4KB_SIZE) ==
+		pml_buffer_hpa);
+
+	if (!ept_hw_is_pml_supported()) {
+		return FALSE;
+	}
+
+	mon_vmcs_write(vmcs, VMCS_PML_ADDRESS, pml_buffer_hpa);
+	mon_vmcs_write(vmcs, VMCS_GUEST_PML_INDEX, EPT_PML_LAST_INDEX);
+
+	proc_ctrls2.uint32 = 0;
+	mon_zeromem(&vmexit_request, sizeof(vmexit_request));
+
+	proc_ctrls2.bits.enable_pml = 1;
+	vmexit_request.proc_ctrls2.bit_mask = proc_ctrls2.uint32;
+	vmexit_request.proc_ctrls2.bit_request = UINT64_ALL_ONES;
+
+	gcpu_control_setup(gcpu, &vmexit_request);
+
+	return TRUE;
+}
+
+void ept_hw_disable_pml(guest_cpu_handle_t gcpu)
+{
+	processor_based_vm_execution_controls2_t proc_ctrls2;
+	vmexit_control_t vmexit_request;
+
+	CHECK_EXECUTION_ON_LOCAL_HOST_CPU(gcpu);
+
+	proc_ctrls2.uint32 = 0;
+	mon_zeromem(&vmexit_request, sizeof(vmexit_request));
+
+	proc_ctrls2.bits.enable_pml = 1;
+	vmexit_request.proc_ctrls2.bit_mask = proc_ctrls2.uint32;
+	vmexit_request.proc_ctrls2.bit_request = 0;
+
+	gcpu_control_setup(gcpu, &vmexit_request);
+}
+
+/* Index of the next PML entry to be written; above EPT_PML_LAST_INDEX (the
+ * 16-bit field wrapped below 0) when the buffer is full */
+uint32_t ept_hw_get_pml_index(guest_cpu_handle_t gcpu)
+{
+	CHECK_EXECUTION_ON_LOCAL_HOST_CPU(gcpu);
+
+	return (uint32_t)mon_vmcs_read(mon_gcpu_get_vmcs(gcpu),
+		VMCS_GUEST_PML_INDEX) & 0xFFFF;
+}
+
+void ept_hw_reset_pml_index(guest_cpu_handle_t gcpu)
+{
+	CHECK_EXECUTION_ON_LOCAL_HOST_CPU(gcpu);
+
+	mon_vmcs_write(mon_gcpu_get_vmcs(gcpu), VMCS_GUEST_PML_INDEX,
+		EPT_PML_LAST_INDEX);
+}
@@ -27,11 +27,16 @@
 
 #define EPT_NUM_PDPTRS      4
 
+/* page modification log: 512 GPAs in one 4K page */
+#define EPT_PML_NUM_OF_ENTRIES  512
+#define EPT_PML_LAST_INDEX      (EPT_PML_NUM_OF_ENTRIES - 1)
+
 typedef union {
 	struct {
 		uint32_t etmt:3;
 		uint32_t gaw:3;
-		uint32_t reserved:6;
+		uint32_t accessed_dirty:1;
+		uint32_t reserved:5;
 		uint32_t address_space_root_low:20;
 		uint32_t address_space_root_high;
 	} bits;
@@ -60,7 +65,15 @@ void ept_hw_disable_ept(guest_cpu_handle_t gcpu);
 uint64_t ept_hw_get_eptp(guest_cpu_handle_t gcpu);
 boolean_t ept_hw_set_eptp(guest_cpu_handle_t gcpu,
 			  hpa_t ept_root_hpa,
-			  uint32_t gaw);
+			  uint32_t gaw,
+			  boolean_t accessed_dirty);
+
+boolean_t ept_hw_is_accessed_dirty_supported(void);
+boolean_t ept_hw_is_pml_supported(void);
+boolean_t ept_hw_enable_pml(guest_cpu_handle_t gcpu, hpa_t pml_buffer_hpa);
+void ept_hw_disable_pml(guest_cpu_handle_t gcpu);
+uint32_t ept_hw_get_pml_index(guest_cpu_handle_t gcpu);
+void ept_hw_reset_pml_index(guest_cpu_handle_t gcpu);
 
 mon_phys_mem_type_t mon_ept_hw_get_ept_memory_type(void);
 
@@ -71,6 +84,7 @@ uint32_t ept_hw_get_guest_address_width_from_encoding(uint32_t gaw_encoding);
 void ept_hw_set_pdtprs(guest_cpu_handle_t gcpu, uint64_t pdptr[]);
 
 boolean_t ept_hw_is_invept_supported(void);
+boolean_t ept_hw_is_invept_individual_address_supported(void);
 boolean_t ept_hw_invept_all_contexts(void);
 boolean_t ept_hw_invept_context(uint64_t eptp);
 boolean_t ept_hw_invept_individual_address(uint64_t eptp, address_t gpa);
@@ -39,7 +39,6 @@ static
 hpa_t fvs_get_eptp_list_paddress(guest_cpu_handle_t gcpu);
 
 extern uint32_t vmexit_reason(void);
-extern boolean_t vmcs_sw_shadow_disable[];
 
 void fvs_initialize(guest_handle_t guest, uint32_t number_of_host_processors)
 {
@@ -145,6 +144,8 @@ boolean_t mon_fvs_add_entry_to_eptp_list(guest_handle_t guest,
 		eptp.bits.etmt = mon_ept_hw_get_ept_memory_type();
 		eptp.bits.gaw = mon_ept_hw_get_guest_address_width_encoding(
 			ept_gaw);
+		eptp.bits.accessed_dirty =
+			mon_ept_is_accessed_dirty_enabled(guest->id) ? 1 : 0;
 		eptp.bits.reserved = 0;
 		MON_LOG(mask_anonymous,
 			level_trace,
@@ -188,6 +189,8 @@ boolean_t mon_fvs_update_entry_in_eptp_list(guest_handle_t guest,
 		eptp.bits.etmt = mon_ept_hw_get_ept_memory_type();
 		eptp.bits.gaw = mon_ept_hw_get_guest_address_width_encoding(
 			ept_gaw);
+		eptp.bits.accessed_dirty =
+			mon_ept_is_accessed_dirty_enabled(guest->id) ? 1 : 0;
 		eptp.bits.reserved = 0;
 		MON_LOG(mask_anonymous,
 			level_trace,
@@ -231,6 +234,8 @@ boolean_t mon_fvs_add_entry_to_eptp_list_single_core(guest_handle_t guest,
 		eptp.bits.etmt = mon_ept_hw_get_ept_memory_type();
 		eptp.bits.gaw = mon_ept_hw_get_guest_address_width_encoding(
 			ept_gaw);
+		eptp.bits.accessed_dirty =
+			mon_ept_is_accessed_dirty_enabled(guest->id) ? 1 : 0;
 		eptp.bits.reserved = 0;
 		MON_LOG(mask_anonymous, level_trace,
 			"adding eptp entry at index=%d for CPU %d\n",
@@ -32,6 +32,9 @@
 typedef struct {
 	mam_handle_t	gpa_to_hpa;
 	mam_handle_t	hpa_to_gpa;
+	/* bumped on every GPA -> HPA change, lets users cache translations */
+	volatile uint32_t generation;
+	uint32_t	padding;
 } gpm_t;
 
 static boolean_t
@@ -148,6 +151,7 @@ boolean_t mon_gpm_add_mapping(IN gpm_handle_t gpm_handle,
 	gpm_t *gpm = (gpm_t *)gpm_handle;
 	mam_handle_t gpa_to_hpa;
 	mam_handle_t hpa_to_gpa;
+	boolean_t result;
 
 	if (gpm_handle == GPM_INVALID_HANDLE) {
 		return FALSE;
@@ -156,11 +160,10 @@ boolean_t mon_gpm_add_mapping(IN gpm_handle_t gpm_handle,
 	gpa_to_hpa = gpm->gpa_to_hpa;
 	hpa_to_gpa = gpm->hpa_to_gpa;
 
-	if (!mam_insert_range(gpa_to_hpa, (uint64_t)gpa, (uint64_t)hpa, size,
-		    attrs)) {
-		return FALSE;
-	}
-	return TRUE;
+	result = mam_insert_range(gpa_to_hpa, (uint64_t)gpa, (uint64_t)hpa,
+		size, attrs);
+	gpm->generation++;
+	return result;
 }
 
 boolean_t mon_gpm_remove_mapping(IN gpm_handle_t gpm_handle,
@@ -169,16 +172,19 @@ boolean_t mon_gpm_remove_mapping(IN gpm_handle_t gpm_handle,
 {
 	gpm_t *gpm = (gpm_t *)gpm_handle;
 	mam_handle_t gpa_to_hpa;
+	boolean_t result;
 
 	if (gpm_handle == GPM_INVALID_HANDLE) {
 		return FALSE;
 	}
 
 	gpa_to_hpa = gpm->gpa_to_hpa;
-	return (boolean_t)mam_insert_not_existing_range(gpa_to_hpa,
+	result = (boolean_t)mam_insert_not_existing_range(gpa_to_hpa,
 		(uint64_t)gpa,
 		size,
 		GPM_INVALID_MAPPING);
+	gpm->generation++;
+	return result;
 }
 
 boolean_t gpm_add_mmio_range(IN gpm_handle_t gpm_handle,
@@ -187,15 +193,26 @@ boolean_t gpm_add_mmio_range(IN gpm_handle_t gpm_handle,
 {
 	gpm_t *gpm = (gpm_t *)gpm_handle;
 	mam_handle_t gpa_to_hpa;
+	boolean_t result;
 
 	if (gpm_handle == GPM_INVALID_HANDLE) {
 		return FALSE;
 	}
 
 	gpa_to_hpa = gpm->gpa_to_hpa;
-	return (boolean_t)mam_insert_not_existing_range(gpa_to_hpa,
+	result = (boolean_t)mam_insert_not_existing_range(gpa_to_hpa,
 		(uint64_t)gpa,
 		size, GPM_MMIO);
+	gpm->generation++;
+	return result;
+}
+
+uint32_t gpm_get_generation(IN gpm_handle_t gpm_handle)
+{
+	gpm_t *gpm = (gpm_t *)gpm_handle;
+
+	MON_ASSERT(gpm_handle != GPM_INVALID_HANDLE);
+	return gpm->generation;
 }
 
 boolean_t mon_gpm_is_mmio_address(IN gpm_handle_t gpm_handle, IN gpa_t gpa)
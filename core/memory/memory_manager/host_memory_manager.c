@@ -61,6 +61,227 @@ INLINE boolean_t hmm_is_page_available_for_allocation(
 	       || (result == HMM_INVALID_MEMORY_TYPE);
 }
 
+/*
+ * Direct map - RAM ranges mapped with HVA == HPA
+ *
+ * Updates are done under the update lock or during initialization, while
+ * lookups are lock-free and retry if they raced with an update.
+ */
+INLINE void hmm_direct_map_write_begin(void)
+{
+	g_hmm->direct_map_generation++;
+	hw_compiler_barrier();
+}
+
+INLINE void hmm_direct_map_write_end(void)
+{
+	hw_compiler_barrier();
+	g_hmm->direct_map_generation++;
+}
+
+static
+boolean_t hmm_direct_map_contains(uint64_t addr)
+{
+	hmm_direct_map_range_t *ranges = g_hmm->direct_map;
+	uint32_t generation;
+	uint32_t low;
+	uint32_t high;
+	uint32_t middle;
+	boolean_t found;
+
+	for (;; ) {
+		generation = g_hmm->direct_map_generation;
+		if (generation & 1) {
+			hw_pause();
+			continue;
+		}
+		hw_compiler_barrier();
+
+		found = FALSE;
+		low = 0;
+		high = g_hmm->num_of_direct_map_ranges;
+		while (low < high) {
+			middle = (low + high) / 2;
+			if (addr < ranges[middle].start) {
+				high = middle;
+			} else if (addr >= ranges[middle].end) {
+				low = middle + 1;
+			} else {
+				found = TRUE;
+				break;
+			}
+		}
+
+		hw_compiler_barrier();
+		if (generation == g_hmm->direct_map_generation) {
+			return found;
+		}
+	}
+}
+
+/* add [start, end) to the direct map, merging with adjacent ranges */
+static
+void hmm_direct_map_insert(uint64_t start, uint64_t end)
+{
+	hmm_direct_map_range_t *ranges = g_hmm->direct_map;
+	uint32_t count = g_hmm->num_of_direct_map_ranges;
+	uint32_t i;
+	uint32_t j;
+
+	if (start >= end) {
+		return;
+	}
+
+	/* first range that ends at or after start */
+	for (i = 0; (i < count) && (ranges[i].end < start); i++) {
+	}
+
+	if ((i < count) && (ranges[i].start <= end)) {
+		/* overlaps or touches range i, absorb following ranges too */
+		if (start < ranges[i].start) {
+			ranges[i].start = start;
+		}
+		if (end > ranges[i].end) {
+			ranges[i].end = end;
+		}
+		for (j = i + 1; (j < count) && (ranges[j].start <= ranges[i].end);
+		     j++) {
+			if (ranges[j].end > ranges[i].end) {
+				ranges[i].end = ranges[j].end;
+			}
+		}
+		/* drop the absorbed ranges i + 1 .. j - 1 */
+		count -= j - (i + 1);
+		for (i = i + 1; i < count; i++, j++)
+			ranges[i] = ranges[j];
+		g_hmm->num_of_direct_map_ranges = count;
+		return;
+	}
+
+	if (count == HMM_MAX_DIRECT_MAP_RANGES) {
+		/* the range is just translated through MAM */
+		return;
+	}
+
+	for (j = count; j > i; j--)
+		ranges[j] = ranges[j - 1];
+	ranges[i].start = start;
+	ranges[i].end = end;
+	g_hmm->num_of_direct_map_ranges = count + 1;
+}
+
+/* add the RAM part of an identity mapped range to the direct map */
+static
+void hmm_direct_map_add_ram(uint64_t start, uint64_t size)
+{
+	e820_abstraction_range_iterator_t e820_iter;
+	uint64_t end = start + size;
+
+	hmm_direct_map_write_begin();
+
+	e820_iter = e820_abstraction_iterator_get_first(E820_ORIGINAL_MAP);
+	while (e820_iter != E820_ABSTRACTION_NULL_ITERATOR) {
+		const int15_e820_memory_map_entry_ext_t *e820_entry =
+			e820_abstraction_iterator_get_range_details(e820_iter);
+
+		if (e820_entry->basic_entry.address_range_type ==
+		    INT15_E820_ADDRESS_RANGE_TYPE_MEMORY) {
+			uint64_t ram_start = ALIGN_FORWARD(
+				e820_entry->basic_entry.base_address,
+				PAGE_4KB_SIZE);
+			uint64_t ram_end = ALIGN_BACKWARD(
+				e820_entry->basic_entry.base_address +
+				e820_entry->basic_entry.length,
+				PAGE_4KB_SIZE);
+
+			hmm_direct_map_insert(MAX(ram_start, start),
+				MIN(ram_end, end));
+		}
+
+		e820_iter =
+			e820_abstraction_iterator_get_next(E820_ORIGINAL_MAP,
+				e820_iter);
+	}
+
+	hmm_direct_map_write_end();
+}
+
+/* remove [start, start + size) from the direct map */
+static
+void hmm_direct_map_remove(uint64_t start, uint64_t size)
+{
+	hmm_direct_map_range_t *ranges = g_hmm->direct_map;
+	uint64_t end = start + size;
+	uint32_t i;
+	uint32_t j;
+
+	hmm_direct_map_write_begin();
+
+	for (i = 0; i < g_hmm->num_of_direct_map_ranges; i++) {
+		if ((ranges[i].end <= start) || (ranges[i].start >= end)) {
+			continue;
+		}
+
+		if ((start <= ranges[i].start) && (end >= ranges[i].end)) {
+			/* whole range */
+			g_hmm->num_of_direct_map_ranges--;
+			for (j = i; j < g_hmm->num_of_direct_map_ranges; j++)
+				ranges[j] = ranges[j + 1];
+			i--;
+		} else if (start <= ranges[i].start) {
+			ranges[i].start = end;
+		} else if (end >= ranges[i].end) {
+			ranges[i].end = start;
+		} else if (g_hmm->num_of_direct_map_ranges <
+			   HMM_MAX_DIRECT_MAP_RANGES) {
+			/* split */
+			for (j = g_hmm->num_of_direct_map_ranges; j > i + 1; j--)
+				ranges[j] = ranges[j - 1];
+			ranges[i + 1].start = end;
+			ranges[i + 1].end = ranges[i].end;
+			ranges[i].end = start;
+			g_hmm->num_of_direct_map_ranges++;
+			break;
+		} else {
+			/* no room to split, keep the bigger part */
+			if (start - ranges[i].start >= ranges[i].end - end) {
+				ranges[i].end = start;
+			} else {
+				ranges[i].start = end;
+			}
+			break;
+		}
+	}
+
+	hmm_direct_map_write_end();
+}
+
+/*
+ * All updates of HMM mappings go through these, so an address whose
+ * mapping changes (in either direction) drops out of the direct map.
+ */
+static
+boolean_t hmm_mam_insert_range(IN mam_handle_t mam_handle,
+			       IN uint64_t src_addr,
+			       IN uint64_t tgt_addr,
+			       IN uint64_t size,
+			       IN mam_attributes_t attrs)
+{
+	hmm_direct_map_remove(src_addr, size);
+	return mam_insert_range(mam_handle, src_addr, tgt_addr, size, attrs);
+}
+
+static
+boolean_t hmm_mam_insert_not_existing_range(IN mam_handle_t mam_handle,
+					    IN uint64_t src_addr,
+					    IN uint64_t size,
+					    IN mam_mapping_result_t reason)
+{
+	hmm_direct_map_remove(src_addr, size);
+	return mam_insert_not_existing_range(mam_handle, src_addr, size,
+		reason);
+}
+
 static
 boolean_t hmm_allocate_continuous_free_virtual_pages(uint32_t num_of_pages,
 						     uint64_t *hva)
@@ -236,20 +457,25 @@ boolean_t hmm_map_remaining_memory(IN mam_attributes_t mapping_attrs)
 		}
 
 		if (actual_size > 0) {
-			if (!mam_insert_range
+			if (!hmm_mam_insert_range
 				    (hva_to_hpa, virt_range_start,
 				    phys_range_start, actual_size,
 				    mapping_attrs)) {
 				return FALSE;
 			}
 
-			if (!mam_insert_range
+			if (!hmm_mam_insert_range
 				    (hpa_to_hva, phys_range_start,
 				    virt_range_start, actual_size,
 				    MAM_NO_ATTRIBUTES)) {
 				return FALSE;
 			}
 
+			if (virt_range_start == phys_range_start) {
+				hmm_direct_map_add_ram(phys_range_start,
+					actual_size);
+			}
+
 			virt_range_start += actual_size;
 			phys_range_start += actual_size;
 
@@ -324,20 +550,22 @@ boolean_t hmm_map_remaining_memory(IN mam_attributes_t mapping_attrs)
 			/* Round up to next page boundry */
 			length_to_map = ALIGN_FORWARD(length_to_map,
 				PAGE_4KB_SIZE);
-			if (!mam_insert_range
+			if (!hmm_mam_insert_range
 				    (hva_to_hpa, base_addr_to_map,
 				    base_addr_to_map, length_to_map,
 				    mapping_attrs)) {
 				return FALSE;
 			}
 
-			if (!mam_insert_range
+			if (!hmm_mam_insert_range
 				    (hpa_to_hva, base_addr_to_map,
 				    base_addr_to_map, length_to_map,
 				    MAM_NO_ATTRIBUTES)) {
 				return FALSE;
 			}
 
+			hmm_direct_map_add_ram(base_addr_to_map, length_to_map);
+
 			hmm_set_final_mapped_virt_address(g_hmm,
 				base_addr_to_map + length_to_map);
 		}
@@ -478,7 +706,7 @@ boolean_t hmm_map_phys_page_full_attrs(IN hpa_t page_hpa,
 		MON_ASSERT(mapping_result == MAM_MAPPING_SUCCESSFUL);
 
 		if (attrs_tmp.uint32 != attrs.uint32) {
-			if (!mam_insert_range
+			if (!hmm_mam_insert_range
 				    (hva_to_hpa, hva_tmp, page_hpa,
 				    PAGE_4KB_SIZE, attrs)) {
 				result = FALSE;
@@ -510,18 +738,18 @@ boolean_t hmm_map_phys_page_full_attrs(IN hpa_t page_hpa,
 	if (hmm_is_page_available_for_allocation(mapping_result)) {
 		/* the 1-1 mapping is possible; */
 
-		if (!mam_insert_range
+		if (!hmm_mam_insert_range
 			    (hva_to_hpa, page_hpa, page_hpa, PAGE_4KB_SIZE,
 			    attrs)) {
 			result = FALSE; /* insufficient memory */
 			goto out;
 		}
 
-		if (!mam_insert_range
+		if (!hmm_mam_insert_range
 			    (hpa_to_hva, page_hpa, page_hpa, PAGE_4KB_SIZE,
 			    MAM_NO_ATTRIBUTES)) {
 			/* try to restore previous hva_to_hpa mapping */
-			mam_insert_not_existing_range(hva_to_hpa,
+			hmm_mam_insert_not_existing_range(hva_to_hpa,
 				page_hpa,
 				page_hpa,
 				mapping_result);
@@ -545,13 +773,13 @@ boolean_t hmm_map_phys_page_full_attrs(IN hpa_t page_hpa,
 	MON_ASSERT(mam_get_mapping(hva_to_hpa, hva_tmp, &hpa_tmp, &attrs_tmp) !=
 		MAM_MAPPING_SUCCESSFUL);
 
-	if (!mam_insert_range(hva_to_hpa, hva_tmp, page_hpa, PAGE_4KB_SIZE,
+	if (!hmm_mam_insert_range(hva_to_hpa, hva_tmp, page_hpa, PAGE_4KB_SIZE,
 		    attrs)) {
 		result = FALSE;
 		goto out;
 	}
 
-	if (!mam_insert_range
+	if (!hmm_mam_insert_range
 		    (hpa_to_hva, page_hpa, hva_tmp, PAGE_4KB_SIZE,
 		    MAM_NO_ATTRIBUTES)) {
 		result = FALSE;
@@ -599,7 +827,7 @@ boolean_t remove_initial_hva_to_hpa_mapping_for_extended_heap(void)
 		MON_ASSERT(mapping_result == MAM_MAPPING_SUCCESSFUL);
 
 		/* Remove old HVA-->HPA mapping */
-		if (!mam_insert_not_existing_range
+		if (!hmm_mam_insert_not_existing_range
 			    (hva_to_hpa, page_hva, PAGE_4KB_SIZE,
 			    HMM_INVALID_MEMORY_TYPE)) {
 			result = FALSE;
@@ -636,7 +864,7 @@ boolean_t build_extend_heap_hpa_to_hva(void)
 		MON_ASSERT(mapping_result == MAM_MAPPING_SUCCESSFUL);
 
 		/* Insert new HPA-->HVA mapping */
-		if (!mam_insert_range
+		if (!hmm_mam_insert_range
 			    (hpa_to_hva, page_hpa, page_hva, PAGE_4KB_SIZE,
 			    MAM_NO_ATTRIBUTES)) {
 			result = FALSE;
@@ -749,7 +977,7 @@ boolean_t hmm_map_continuous_virtual_buffer_for_pages_internal(IN uint64_t *
 
 		/* Add new HVA-->HPA mapping */
 		page_hva = buffer_hva + (i * PAGE_4KB_SIZE);
-		if (!mam_insert_range
+		if (!hmm_mam_insert_range
 			    (hva_to_hpa, page_hva, page_hpa, PAGE_4KB_SIZE,
 			    attrs)) {
 			MON_LOG(mask_anonymous,
@@ -774,7 +1002,7 @@ boolean_t hmm_map_continuous_virtual_buffer_for_pages_internal(IN uint64_t *
 			MON_ASSERT(mapping_result == MAM_MAPPING_SUCCESSFUL);
 
 			/* Remove old HVA-->HPA mapping */
-			if (!mam_insert_not_existing_range
+			if (!hmm_mam_insert_not_existing_range
 				    (hva_to_hpa, old_page_hva, PAGE_4KB_SIZE,
 				    HMM_INVALID_MEMORY_TYPE)) {
 				MON_LOG(mask_anonymous,
@@ -787,7 +1015,7 @@ boolean_t hmm_map_continuous_virtual_buffer_for_pages_internal(IN uint64_t *
 			}
 
 			/* Insert new HPA-->HVA mapping */
-			if (!mam_insert_range
+			if (!hmm_mam_insert_range
 				    (hpa_to_hva, page_hpa, page_hva,
 				    PAGE_4KB_SIZE,
 				    MAM_NO_ATTRIBUTES)) {
@@ -1051,7 +1279,7 @@ boolean_t hmm_initialize(const mon_startup_struct_t *startup_struct)
 		goto destroy_hpa_to_hva_mapping_exit;
 	}
 
-	if (!mam_insert_not_existing_range
+	if (!hmm_mam_insert_not_existing_range
 		    (hva_to_hpa, 0, PAGE_4KB_SIZE, HMM_INVALID_MEMORY_TYPE)) {
 		MON_LOG(mask_anonymous, level_trace,
 			"Failed to remove mapping of first page\n");
@@ -1068,7 +1296,7 @@ boolean_t hmm_initialize(const mon_startup_struct_t *startup_struct)
 		goto destroy_hpa_to_hva_mapping_exit;
 	}
 
-	if (!mam_insert_range
+	if (!hmm_mam_insert_range
 		    (hva_to_hpa, first_page_new_hva, first_page_hpa,
 		    PAGE_4KB_SIZE,
 		    final_mapping_attrs)) {
@@ -1078,7 +1306,7 @@ boolean_t hmm_initialize(const mon_startup_struct_t *startup_struct)
 		goto destroy_hpa_to_hva_mapping_exit;
 	}
 
-	if (!mam_insert_range
+	if (!hmm_mam_insert_range
 		    (hpa_to_hva, first_page_hpa, first_page_new_hva,
 		    PAGE_4KB_SIZE,
 		    MAM_NO_ATTRIBUTES)) {
@@ -1133,7 +1361,7 @@ boolean_t hmm_initialize(const mon_startup_struct_t *startup_struct)
 				goto destroy_hpa_to_hva_mapping_exit;
 			}
 
-			if (!mam_insert_not_existing_range
+			if (!hmm_mam_insert_not_existing_range
 				    (hva_to_hpa, page, PAGE_4KB_SIZE,
 				    HMM_INVALID_MEMORY_TYPE)) {
 				MON_LOG(mask_anonymous,
@@ -1143,7 +1371,7 @@ boolean_t hmm_initialize(const mon_startup_struct_t *startup_struct)
 				goto destroy_hpa_to_hva_mapping_exit;
 			}
 
-			if (!mam_insert_not_existing_range
+			if (!hmm_mam_insert_not_existing_range
 				    (hpa_to_hva, page_hpa, PAGE_4KB_SIZE,
 				    HMM_INVALID_MEMORY_TYPE)) {
 				MON_LOG(mask_anonymous,
@@ -1184,7 +1412,7 @@ boolean_t hmm_initialize(const mon_startup_struct_t *startup_struct)
 					(PAGE_4KB_SIZE * 2),
 					&page_hpa_tmp));
 
-			if (!mam_insert_not_existing_range
+			if (!hmm_mam_insert_not_existing_range
 				    (hva_to_hpa, current_extra_stack_hva,
 				    PAGE_4KB_SIZE,
 				    HMM_VIRT_MEMORY_NOT_FOR_USE)) {
@@ -1199,7 +1427,7 @@ boolean_t hmm_initialize(const mon_startup_struct_t *startup_struct)
 			page_to_assign_hva = current_extra_stack_hva +
 					     PAGE_4KB_SIZE;
 
-			if (!mam_insert_range
+			if (!hmm_mam_insert_range
 				    (hva_to_hpa, page_to_assign_hva, page_hpa,
 				    PAGE_4KB_SIZE,
 				    final_mapping_attrs)) {
@@ -1212,7 +1440,7 @@ boolean_t hmm_initialize(const mon_startup_struct_t *startup_struct)
 				goto destroy_hpa_to_hva_mapping_exit;
 			}
 
-			if (!mam_insert_range
+			if (!hmm_mam_insert_range
 				    (hpa_to_hva, page_hpa, page_to_assign_hva,
 				    PAGE_4KB_SIZE,
 				    MAM_NO_ATTRIBUTES)) {
@@ -1225,7 +1453,7 @@ boolean_t hmm_initialize(const mon_startup_struct_t *startup_struct)
 				goto destroy_hpa_to_hva_mapping_exit;
 			}
 
-			if (!mam_insert_not_existing_range
+			if (!hmm_mam_insert_not_existing_range
 				    (hva_to_hpa, current_extra_stack_hva +
 				    (PAGE_4KB_SIZE * 2),
 				    PAGE_4KB_SIZE,
@@ -1341,6 +1569,11 @@ boolean_t mon_hmm_hva_to_hpa(IN hva_t hva, OUT hpa_t *hpa)
 		return TRUE;
 	}
 
+	if (hmm_direct_map_contains(hva_tmp)) {
+		*hpa = (hpa_t)hva;
+		return TRUE;
+	}
+
 	if (mam_get_mapping(hva_to_hpa, hva_tmp, &hpa_tmp, &attrs_tmp) ==
 	    MAM_MAPPING_SUCCESSFUL) {
 		*hpa = *((hpa_t *)(&hpa_tmp));
@@ -1363,6 +1596,11 @@ boolean_t mon_hmm_hpa_to_hva(IN hpa_t hpa, OUT hva_t *hva)
 		return TRUE;
 	}
 
+	if (hmm_direct_map_contains(hpa_tmp)) {
+		*hva = (hva_t)hpa;
+		return TRUE;
+	}
+
 	if (mam_get_mapping(hpa_to_hva, hpa_tmp, &hva_tmp, &attrs_tmp) ==
 	    MAM_MAPPING_SUCCESSFUL) {
 		*hva = *((hva_t *)(&hva_tmp));
@@ -1416,7 +1654,7 @@ boolean_t hmm_unmap_hpa(IN hpa_t hpa,
 					&hpa_tmp) && (hpa_tmp == hpa));
 			MON_ASSERT(ALIGN_BACKWARD(hva, PAGE_4KB_SIZE) == hva);
 
-			if (!mam_insert_not_existing_range
+			if (!hmm_mam_insert_not_existing_range
 				    (hpa_to_hva, hpa, PAGE_4KB_SIZE,
 				    HMM_INVALID_MEMORY_TYPE)) {
 				MON_LOG(mask_anonymous,
@@ -1427,7 +1665,7 @@ boolean_t hmm_unmap_hpa(IN hpa_t hpa,
 				goto out;
 			}
 
-			if (!mam_insert_not_existing_range
+			if (!hmm_mam_insert_not_existing_range
 				    (hva_to_hpa, hva, PAGE_4KB_SIZE,
 				    HMM_INVALID_MEMORY_TYPE)) {
 				MON_LOG(mask_anonymous,
@@ -27,6 +27,18 @@
 
 #define HMM_WP_BIT_MASK ((uint64_t)0x10000)
 
+/*
+ * RAM ranges which are mapped 1:1 (HVA == HPA), so translation needs no
+ * MAM walk. Kept sorted and non-overlapping; any later remapping of an
+ * address removes it from here.
+ */
+#define HMM_MAX_DIRECT_MAP_RANGES 128
+
+typedef struct {
+	uint64_t	start;
+	uint64_t	end;    /* exclusive */
+} hmm_direct_map_range_t;
+
 typedef struct {
 	mam_handle_t		hva_to_hpa_mapping;
 	mam_handle_t		hpa_to_hva_mapping;
@@ -38,6 +50,10 @@ typedef struct {
 	uint64_t		final_mapped_virt_address;
 	uint32_t		wb_pat_index;
 	uint32_t		uc_pat_index;
+	hmm_direct_map_range_t	direct_map[HMM_MAX_DIRECT_MAP_RANGES];
+	uint32_t		num_of_direct_map_ranges;
+	/* odd while direct_map is being updated */
+	volatile uint32_t	direct_map_generation;
 } hmm_t;   /* Host Memory Manager */
 
 INLINE mam_handle_t hmm_get_hva_to_hpa_mapping(hmm_t *hmm)
@@ -199,23 +199,27 @@ void mam_update_inner_vtdpt_entry(mam_t *mam,
 static
 void mam_update_attributes_in_leaf_internal_entry(mam_entry_t *entry,
 						  mam_attributes_t attrs,
+						  mam_entry_type_t leaf_type,
 						  const mam_level_ops_t *
 						  level_ops);
 
 static
 void mam_update_attributes_in_leaf_page_table_entry(mam_entry_t *entry,
 						    mam_attributes_t attrs,
+						    mam_entry_type_t leaf_type,
 						    const mam_level_ops_t *
 						    level_ops);
 
 static
 void mam_update_attributes_in_leaf_ept_entry(mam_entry_t *entry,
 					     mam_attributes_t attrs,
+					     mam_entry_type_t leaf_type,
 					     const mam_level_ops_t *level_ops);
 
 static
 void mam_update_attributes_in_leaf_vtdpt_entry(mam_entry_t *entry,
 					       mam_attributes_t attrs,
+					       mam_entry_type_t leaf_type,
 					       const mam_level_ops_t *level_ops);
 
 static
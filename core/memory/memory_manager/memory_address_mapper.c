@@ -314,6 +314,13 @@ INLINE mam_entry_type_t get_mam_entry_type(IN mam_entry_t *entry)
 				   MAM_INNER_ENTRY_TYPE_MASK);
 	if (entry_type != MAM_VTDPT_ENTRY) {
 		entry_type = (mam_entry_type_t)(entry->any_entry.avl);
+		if ((entry_type == MAM_LEAF_PAGE_TABLE_ENTRY) &&
+		    (entry->uint64 & MAM_EPT_CLEAN_LEAF_MARK) &&
+		    (entry->ept_entry.readable || entry->ept_entry.writable ||
+		     entry->ept_entry.executable)) {
+			/* EPT leaf with the dirty flag cleared */
+			entry_type = MAM_LEAF_EPT_ENTRY;
+		}
 	} else {
 		entry_type =
 			(mam_entry_type_t)(entry_type |
@@ -515,6 +522,7 @@ INLINE void mam_update_attributes_in_leaf_entry(mam_entry_t *entry,
 {
 	entry_ops->mam_update_attributes_in_leaf_entry_fn(entry,
 		attrs,
+		mam_get_leaf_entry_type(entry_ops),
 		level_ops);
 }
 
@@ -578,7 +586,7 @@ uint64_t mam_get_address_from_leaf_ept_entry(IN mam_entry_t *entry,
 					     IN const mam_level_ops_t *
 					     level_ops UNUSED)
 {
-	MON_ASSERT(entry->any_entry.avl == MAM_LEAF_EPT_ENTRY);
+	MON_ASSERT(get_mam_entry_type(entry) == MAM_LEAF_EPT_ENTRY);
 
 	return mam_get_address_from_any_entry(entry);
 }
@@ -773,9 +781,10 @@ mam_attributes_t mam_get_attributes_from_ept_entry(IN mam_entry_t *entry,
 						   level_ops UNUSED)
 {
 	mam_attributes_t attrs;
+	mam_entry_type_t entry_type = get_mam_entry_type(entry);
 
-	MON_ASSERT((entry->any_entry.avl == MAM_INNER_EPT_ENTRY)
-		|| (entry->any_entry.avl == MAM_LEAF_EPT_ENTRY));
+	MON_ASSERT((entry_type == MAM_INNER_EPT_ENTRY)
+		|| (entry_type == MAM_LEAF_EPT_ENTRY));
 
 	attrs.uint32 = 0;
 	attrs.ept_attr.readable = (uint32_t)entry->ept_entry.readable;
@@ -785,7 +794,7 @@ mam_attributes_t mam_get_attributes_from_ept_entry(IN mam_entry_t *entry,
 	attrs.ept_attr.emt = (uint32_t)entry->ept_entry.emt;
 	attrs.ept_attr.suppress_ve = (uint32_t)entry->ept_entry.suppress_ve;
 
-	if ((entry->any_entry.avl == MAM_INNER_EPT_ENTRY)
+	if ((entry_type == MAM_INNER_EPT_ENTRY)
 	    && (attrs.ept_attr.igmt == 1)) {
 		MON_ASSERT(0);
 	}
@@ -880,8 +889,8 @@ boolean_t mam_is_page_table_entry_present(IN mam_entry_t *entry)
 static
 boolean_t mam_is_ept_entry_present(IN mam_entry_t *entry)
 {
-	MON_ASSERT((entry->any_entry.avl == MAM_INNER_EPT_ENTRY)
-		|| (entry->any_entry.avl == MAM_LEAF_EPT_ENTRY));
+	MON_ASSERT((get_mam_entry_type(entry) == MAM_INNER_EPT_ENTRY)
+		|| (get_mam_entry_type(entry) == MAM_LEAF_EPT_ENTRY));
 
 	return (entry->ept_entry.readable != 0) ||
 	       (entry->ept_entry.writable != 0) ||
@@ -1149,10 +1158,11 @@ void mam_update_inner_vtdpt_entry(mam_t *mam, mam_entry_t *entry,
 static
 void mam_update_attributes_in_leaf_internal_entry(mam_entry_t *entry,
 						  mam_attributes_t attrs,
+						  mam_entry_type_t leaf_type,
 						  const mam_level_ops_t *
 						  level_ops UNUSED)
 {
-	MON_ASSERT(entry->any_entry.avl == MAM_LEAF_INTERNAL_ENTRY);
+	MON_ASSERT(entry->any_entry.avl == leaf_type);
 
 	entry->mam_internal_entry.attributes = attrs.uint32;
 	MON_ASSERT(mam_is_internal_entry_present(entry));
@@ -1161,12 +1171,13 @@ void mam_update_attributes_in_leaf_internal_entry(mam_entry_t *entry,
 static
 void mam_update_attributes_in_leaf_page_table_entry(mam_entry_t *entry,
 						    mam_attributes_t attrs,
+						    mam_entry_type_t leaf_type,
 						    const mam_level_ops_t *
 						    level_ops)
 {
 	uint32_t pwt_bit, pcd_bit, pat_bit;
 
-	MON_ASSERT(entry->any_entry.avl == MAM_LEAF_PAGE_TABLE_ENTRY);
+	MON_ASSERT(entry->any_entry.avl == leaf_type);
 
 	entry->page_table_entry.writable = attrs.paging_attr.writable;
 	entry->page_table_entry.user = attrs.paging_attr.user;
@@ -1196,8 +1207,16 @@ void mam_update_attributes_in_leaf_page_table_entry(mam_entry_t *entry,
 static
 void mam_update_attributes_in_leaf_ept_entry(mam_entry_t *entry,
 					     mam_attributes_t attrs,
+					     mam_entry_type_t leaf_type,
 					     const mam_level_ops_t *level_ops)
 {
+	MON_ASSERT(get_mam_entry_type(entry) == leaf_type);
+
+	/* Type the leaf in "avl" again: get_mam_entry_type() recognizes a
+	 * clean leaf only while R, W or X is set, which may not hold after
+	 * the update. The type sets the dirty flag, as for new leaves */
+	entry->uint64 &= ~MAM_EPT_CLEAN_LEAF_MARK;
+	entry->any_entry.avl = leaf_type;
 	entry->ept_entry.readable = attrs.ept_attr.readable;
 	entry->ept_entry.writable = attrs.ept_attr.writable;
 	entry->ept_entry.executable = attrs.ept_attr.executable;
@@ -1208,14 +1227,18 @@ void mam_update_attributes_in_leaf_ept_entry(mam_entry_t *entry,
 		entry->ept_entry.sp = 1;
 	}
 
-	MON_ASSERT(mam_is_ept_entry_present(entry));
+	/* removing R, W and X leaves a non present entry */
+	MON_ASSERT(get_mam_entry_type(entry) == leaf_type);
 }
 
 static
 void mam_update_attributes_in_leaf_vtdpt_entry(mam_entry_t *entry,
 					       mam_attributes_t attrs,
+					       mam_entry_type_t leaf_type,
 					       const mam_level_ops_t *level_ops)
 {
+	MON_ASSERT(get_mam_entry_type(entry) == leaf_type);
+
 	entry->vtdpt_entry.readable = attrs.vtdpt_attr.readable;
 	entry->vtdpt_entry.writable = attrs.vtdpt_attr.writable;
 	entry->vtdpt_entry.snoop = attrs.vtdpt_attr.snoop;
@@ -1258,16 +1281,14 @@ void mam_invalidate_all_entries_in_table(IN mam_hav_t table,
 					 IN mam_mapping_result_t reason,
 					 IN mam_entry_type_t entry_type)
 {
-	uint64_t entry_increment = sizeof(mam_entry_t);
-	mam_hav_t entry_hva;
-
-	entry_hva = table;
-	while (entry_hva <
-	       (table + (entry_increment * MAM_NUM_OF_ENTRIES_IN_TABLE))) {
-		mam_entry_t *entry = (mam_entry_t *)mam_hva_to_ptr(entry_hva);
-		mam_invalidate_entry(entry, reason, entry_type);
-		entry_hva += entry_increment;
-	}
+	mam_entry_t invalid_entry;
+
+	/* All the entries are identical, so build one and replicate it over
+	 * the whole table with a single string store */
+	invalid_entry.uint64 = 0;
+	mam_invalidate_entry(&invalid_entry, reason, entry_type);
+	mon_memset64(mam_hva_to_ptr(table), invalid_entry.uint64,
+		MAM_NUM_OF_ENTRIES_IN_TABLE);
 }
 
 /* -----------------------------------------------------------------------
@@ -2151,7 +2172,7 @@ boolean_t mam_update_table(IN mam_t *mam,
 			}
 		}
 
-		if (check_for_retraction) {
+		if (check_for_retraction && !mam->defer_retraction) {
 			/* There is a chance that table pointed by current inner level
 			 * entry can be retracted to single entry */
 			mam_try_to_retract_inner_entry_to_leaf(mam,
@@ -2171,6 +2192,307 @@ boolean_t mam_update_table(IN mam_t *mam,
 	return TRUE;
 }
 
+/* -----------------------------------------------------------------------
+ * Function: mam_retract_range_in_table
+ * Description: The function recursively (bottom-up) tries to retract the
+ *              inner entries which map the given range. Used after batched
+ *              updates which were done with retraction deferred.
+ * Input: mam - main mam_t structure
+ *        level_ops - virtual table for relevant table operations
+ *        table - HVA of the table to compact
+ *        first_mapped_address - first source address that is mapped through
+ *                               this table
+ *        src_addr - source address of the updated range
+ *        size - size of range
+ * -----------------------------------------------------------------------*/
+static
+void mam_retract_range_in_table(IN mam_t *mam,
+				IN const mam_level_ops_t *level_ops,
+				IN mam_hav_t table,
+				IN uint64_t first_mapped_address,
+				IN uint64_t src_addr,
+				IN uint64_t size)
+{
+	uint32_t curr_entry_index;
+	uint32_t final_entry_index;
+	uint64_t curr_entry_first_mapped_address;
+	/* virtual call */
+	uint64_t size_covered_by_entry =
+		mam_get_size_covered_by_entry(level_ops);
+	uint64_t end_addr = src_addr + size;
+	const mam_entry_ops_t *entry_ops;
+	/* virtual call */
+	const mam_level_ops_t *lower_level_ops = mam_get_lower_level_ops(
+		level_ops);
+
+	if (lower_level_ops == NULL) {
+		/* only leaf entries in the last level */
+		return;
+	}
+
+	/* virtual call */
+	curr_entry_index = mam_get_entry_index(level_ops, src_addr);
+	final_entry_index = mam_get_entry_index(level_ops, end_addr - 1);
+	curr_entry_first_mapped_address =
+		first_mapped_address +
+		(curr_entry_index * size_covered_by_entry);
+
+	entry_ops = mam_get_entry_ops(mam_hva_to_ptr(table));
+
+	while (curr_entry_index <= final_entry_index) {
+		mam_entry_t *entry = mam_hva_to_ptr(table +
+			(curr_entry_index * sizeof(mam_entry_t)));
+
+		if (!mam_is_leaf_entry(entry)) {
+			uint64_t range_start = MAX(src_addr,
+				curr_entry_first_mapped_address);
+			uint64_t range_end = MIN(end_addr,
+				curr_entry_first_mapped_address +
+				size_covered_by_entry);
+
+			/* Compact the lower levels first, so the current entry
+			 * can see leaves created there */
+			mam_retract_range_in_table(mam,
+				lower_level_ops,
+				mam_get_table_pointed_by_entry(entry, entry_ops),
+				curr_entry_first_mapped_address,
+				range_start,
+				range_end - range_start);
+			mam_try_to_retract_inner_entry_to_leaf(mam,
+				entry,
+				level_ops,
+				entry_ops);
+		}
+
+		curr_entry_index++;
+		curr_entry_first_mapped_address += size_covered_by_entry;
+	}
+}
+
+/* -----------------------------------------------------------------------
+ * Function: mam_update_permissions_in_place_in_table
+ * Description: The function recursively goes over present leaf entries
+ *              which map the given range. When "apply" is FALSE it only
+ *              checks that every such leaf lies entirely inside the range,
+ *              otherwise it updates the permissions of the leaves with
+ *              compare-exchange.
+ * Input: mam - main mam_t structure
+ *        level_ops - virtual table for relevant table operations
+ *        table - HVA of the table
+ *        first_mapped_address - first source address that is mapped through
+ *                               this table
+ *        src_addr - source address of the range
+ *        size - size of range
+ *        attrs_to_set, attrs_to_clear - permissions update
+ *        apply - check only or update
+ * Return value - FALSE when a leaf is only partly covered by the range
+ * -----------------------------------------------------------------------*/
+static
+boolean_t mam_update_permissions_in_place_in_table(
+	IN mam_t *mam,
+	IN const mam_level_ops_t *level_ops,
+	IN mam_hav_t table,
+	IN uint64_t first_mapped_address,
+	IN uint64_t src_addr,
+	IN uint64_t size,
+	IN mam_attributes_t attrs_to_set,
+	IN mam_attributes_t attrs_to_clear,
+	IN boolean_t apply)
+{
+	uint32_t curr_entry_index;
+	uint32_t final_entry_index;
+	uint64_t curr_entry_first_mapped_address;
+	/* virtual call */
+	uint64_t size_covered_by_entry =
+		mam_get_size_covered_by_entry(level_ops);
+	uint64_t end_addr = src_addr + size;
+	const mam_entry_ops_t *entry_ops;
+	/* virtual call */
+	const mam_level_ops_t *lower_level_ops = mam_get_lower_level_ops(
+		level_ops);
+
+	/* virtual call */
+	curr_entry_index = mam_get_entry_index(level_ops, src_addr);
+	final_entry_index = mam_get_entry_index(level_ops, end_addr - 1);
+	curr_entry_first_mapped_address =
+		first_mapped_address +
+		(curr_entry_index * size_covered_by_entry);
+
+	entry_ops = mam_get_entry_ops(mam_hva_to_ptr(table));
+
+	while (curr_entry_index <= final_entry_index) {
+		mam_entry_t *entry = mam_hva_to_ptr(table +
+			(curr_entry_index * sizeof(mam_entry_t)));
+		uint64_t range_start = MAX(src_addr,
+			curr_entry_first_mapped_address);
+		uint64_t range_end = MIN(end_addr,
+			curr_entry_first_mapped_address +
+			size_covered_by_entry);
+
+		if (!mam_is_entry_present(entry, entry_ops)) {
+			/* nothing to update */
+		} else if (!mam_is_leaf_entry(entry)) {
+			MON_ASSERT(lower_level_ops != NULL);
+			if (!mam_update_permissions_in_place_in_table(mam,
+				    lower_level_ops,
+				    mam_get_table_pointed_by_entry(entry,
+					    entry_ops),
+				    curr_entry_first_mapped_address,
+				    range_start,
+				    range_end - range_start,
+				    attrs_to_set,
+				    attrs_to_clear,
+				    apply)) {
+				return FALSE;
+			}
+		} else if ((range_end - range_start) != size_covered_by_entry) {
+			/* the leaf would have to be split */
+			MON_ASSERT(!apply);
+			return FALSE;
+		} else if (apply) {
+			mam_entry_t old_entry;
+			mam_entry_t new_entry;
+			mam_attributes_t old_attrs;
+			mam_attributes_t attrs;
+
+			do {
+				old_entry.uint64 = entry->uint64;
+				new_entry.uint64 = old_entry.uint64;
+
+				/* virtual call */
+				old_attrs = mam_get_attributes_from_entry(
+					&new_entry,
+					level_ops,
+					entry_ops);
+				attrs.uint32 = (old_attrs.uint32 |
+						attrs_to_set.uint32) &
+					       ~attrs_to_clear.uint32;
+				if (attrs.uint32 == old_attrs.uint32) {
+					/* don't mark clean EPT leaves dirty */
+					break;
+				}
+				/* virtual call */
+				mam_update_attributes_in_leaf_entry(&new_entry,
+					attrs,
+					level_ops,
+					entry_ops);
+			} while (hw_interlocked_compare_exchange_8(
+					 (volatile int64_t *)&entry->uint64,
+					 (int64_t)old_entry.uint64,
+					 (int64_t)new_entry.uint64) !=
+				 (int64_t)old_entry.uint64);
+		}
+
+		curr_entry_index++;
+		curr_entry_first_mapped_address += size_covered_by_entry;
+	}
+
+	return TRUE;
+}
+
+/* -----------------------------------------------------------------------
+ * Function: mam_get_ept_dirty_pages_in_table
+ * Description: The function recursively goes over present leaf entries
+ *              which map the given range, reports those with the dirty
+ *              flag set and optionally clears the flag with compare-exchange.
+ *              Only leaves entirely inside the range are cleared.
+ * Input: mam - main mam_t structure
+ *        level_ops - virtual table for relevant table operations
+ *        table - HVA of the table
+ *        first_mapped_address - first source address that is mapped through
+ *                               this table
+ *        src_addr - source address of the range
+ *        size - size of range
+ *        bitmap_base - source address of the page reported in bit 0
+ *        bitmap - output bitmap (may be NULL)
+ *        clear - whether the dirty flags should be cleared
+ * -----------------------------------------------------------------------*/
+static
+void mam_get_ept_dirty_pages_in_table(IN mam_t *mam,
+				      IN const mam_level_ops_t *level_ops,
+				      IN mam_hav_t table,
+				      IN uint64_t first_mapped_address,
+				      IN uint64_t src_addr,
+				      IN uint64_t size,
+				      IN uint64_t bitmap_base,
+				      OUT uint64_t *bitmap,
+				      IN boolean_t clear)
+{
+	uint32_t curr_entry_index;
+	uint32_t final_entry_index;
+	uint64_t curr_entry_first_mapped_address;
+	/* virtual call */
+	uint64_t size_covered_by_entry =
+		mam_get_size_covered_by_entry(level_ops);
+	uint64_t end_addr = src_addr + size;
+	/* virtual call */
+	const mam_level_ops_t *lower_level_ops = mam_get_lower_level_ops(
+		level_ops);
+
+	/* virtual call */
+	curr_entry_index = mam_get_entry_index(level_ops, src_addr);
+	final_entry_index = mam_get_entry_index(level_ops, end_addr - 1);
+	curr_entry_first_mapped_address =
+		first_mapped_address +
+		(curr_entry_index * size_covered_by_entry);
+
+	while (curr_entry_index <= final_entry_index) {
+		mam_entry_t *entry = mam_hva_to_ptr(table +
+			(curr_entry_index * sizeof(mam_entry_t)));
+		uint64_t range_start = MAX(src_addr,
+			curr_entry_first_mapped_address);
+		uint64_t range_end = MIN(end_addr,
+			curr_entry_first_mapped_address +
+			size_covered_by_entry);
+		uint64_t old_entry;
+		uint64_t page;
+
+		if (!mam_is_entry_present(entry, MAM_EPT_ENTRY_OPS)) {
+			/* hardware never sets the flags of not present entries */
+		} else if (!mam_is_leaf_entry(entry)) {
+			MON_ASSERT(lower_level_ops != NULL);
+			mam_get_ept_dirty_pages_in_table(mam,
+				lower_level_ops,
+				mam_get_table_pointed_by_entry(entry,
+					MAM_EPT_ENTRY_OPS),
+				curr_entry_first_mapped_address,
+				range_start,
+				range_end - range_start,
+				bitmap_base, bitmap, clear);
+		} else if (entry->uint64 & MAM_EPT_LEAF_DIRTY_BIT) {
+			if (bitmap != NULL) {
+				for (page = range_start; page < range_end;
+				     page += PAGE_4KB_SIZE)
+					BITMAP_ARRAY64_SET(bitmap,
+						(page - bitmap_base) /
+						PAGE_4KB_SIZE);
+			}
+
+			/* A leaf the range covers only partly keeps its flag:
+			 * the pages outside the range would lose theirs. It is
+			 * reported again until a range covering it is cleared.
+			 * Hardware may set the accessed flag meanwhile */
+			while (clear &&
+			       ((range_end - range_start) ==
+				size_covered_by_entry)) {
+				old_entry = entry->uint64;
+				if ((uint64_t)hw_interlocked_compare_exchange_8(
+					    &entry->uint64,
+					    old_entry,
+					    (old_entry &
+					     ~MAM_EPT_LEAF_DIRTY_BIT) |
+					    MAM_EPT_CLEAN_LEAF_MARK) ==
+				    old_entry) {
+					break;
+				}
+			}
+		}
+
+		curr_entry_index++;
+		curr_entry_first_mapped_address += size_covered_by_entry;
+	}
+}
+
 /* -----------------------------------------------------------------------
  * Function: mam_remove_range_from_table
  * Description: The function recursively finds the entries that must
@@ -2841,6 +3163,7 @@ mam_handle_t mam_create_mapping(mam_attributes_t inner_level_attributes)
 	lock_initialize(&(mam->update_lock));
 	mam->update_counter = 0;
 	mam->update_on_cpu = 0;
+	mam->defer_retraction = FALSE;
 	mam->is_32bit_page_tables = FALSE;
 	mam->last_iterator = MAM_INVALID_MEMORY_RANGES_ITERATOR;
 	mam->last_range_size = 0;
@@ -2992,6 +3315,131 @@ out:
 	return res;
 }
 
+boolean_t mam_insert_ranges(IN mam_handle_t mam_handle,
+			    IN const mam_range_desc_t *ranges,
+			    IN uint32_t count)
+{
+	mam_t *mam = (mam_t *)mam_handle;
+	const mam_level_ops_t *first_table_ops = NULL;
+	mam_hav_t first_table = 0;
+	uint64_t lowest_addr = MAM_INVALID_ADDRESS;
+	uint64_t highest_addr = 0;
+	uint32_t i;
+	boolean_t res = TRUE;
+
+	if ((mam_handle == MAM_INVALID_HANDLE) || (ranges == NULL)) {
+		return FALSE;
+	}
+
+	if (count == 0) {
+		return TRUE;
+	}
+
+	/* Validate the whole vector before touching the tables */
+	for (i = 0; i < count; i++) {
+		const mam_range_desc_t *range = &ranges[i];
+
+		if ((range->src_addr & (PAGE_4KB_SIZE - 1)) ||
+		    (range->tgt_addr & (PAGE_4KB_SIZE - 1)) ||
+		    (range->size & (PAGE_4KB_SIZE - 1)) || (range->size == 0)) {
+			MON_LOG(mask_anonymous, level_trace,
+				"MAM ERROR: %s: Alignment error: src_addr=%P "
+				"tgt_addr=%P size=%P\n",
+				__FUNCTION__, range->src_addr, range->tgt_addr,
+				range->size);
+			return FALSE;
+		}
+
+		if ((range->src_addr + range->size) >
+		    mam_get_size_covered_by_table(MAM_LEVEL4_OPS)) {
+			MON_LOG(mask_anonymous, level_trace,
+				"MAM ERROR: %s: Range exceeds permitted limit:"
+				" src_addr=%P size=%P\n",
+				__FUNCTION__, range->src_addr, range->size);
+			return FALSE;
+		}
+
+		lowest_addr = MIN(lowest_addr, range->src_addr);
+		highest_addr = MAX(highest_addr, range->src_addr + range->size);
+	}
+
+	lock_acquire(&(mam->update_lock));
+
+	mam->update_on_cpu = hw_cpu_id();
+	/* first update (becomes odd number) */
+	mam->update_counter++;
+	MON_ASSERT((mam->update_counter & 0x1) != 0);
+
+	/* Grow the hierarchy once for the whole vector */
+	mam_update_first_table_to_cover_requested_range(mam, 0, highest_addr);
+
+	first_table = mam->first_table;
+	first_table_ops = mam->first_table_ops;
+	MON_ASSERT(first_table_ops != NULL);
+
+	if (highest_addr > mam_get_size_covered_by_table(first_table_ops)) {
+		MON_LOG(mask_anonymous, level_trace,
+			"MAM ERROR: %s: Range exceeds permitted limit (2)\n",
+			__FUNCTION__);
+		res = FALSE;
+		goto out;
+	}
+
+	mam->defer_retraction = TRUE;
+
+	i = 0;
+	while (res && (i < count)) {
+		uint64_t src_addr = ranges[i].src_addr;
+		uint64_t tgt_addr = ranges[i].tgt_addr;
+		uint64_t size = ranges[i].size;
+		mam_attributes_t attrs = ranges[i].attrs;
+
+		/* Coalesce the following ranges which continue this one,
+		 * so large leaves may be used across their boundaries */
+		for (i++; i < count; i++) {
+			if ((ranges[i].src_addr != (src_addr + size)) ||
+			    (ranges[i].tgt_addr != (tgt_addr + size)) ||
+			    (ranges[i].attrs.uint32 != attrs.uint32)) {
+				break;
+			}
+			size += ranges[i].size;
+		}
+
+		res = mam_update_table(mam,
+			first_table_ops,
+			first_table,
+			0,
+			src_addr,
+			tgt_addr, size, attrs, MAM_OVERWRITE_ADDR_AND_ATTRS);
+	}
+
+	mam->defer_retraction = FALSE;
+
+	MON_DEBUG_CODE(
+		if (!res) {
+			MON_LOG(mask_anonymous, level_trace,
+				"MAM ERROR: %s: Memory allocation error\n",
+				__FUNCTION__);
+			}
+		);
+
+	/* Compact whatever was touched, also after partial failure */
+	mam_retract_range_in_table(mam,
+		first_table_ops,
+		first_table,
+		0,
+		lowest_addr,
+		highest_addr - lowest_addr);
+
+out:
+	/* second update (becomes even number); */
+	mam->update_counter++;
+	MON_ASSERT((mam->update_counter & 0x1) == 0);
+	mam->update_on_cpu = MAM_INVALID_CPU_ID;
+	lock_release(&(mam->update_lock));
+	return res;
+}
+
 boolean_t mam_insert_not_existing_range(IN mam_handle_t mam_handle,
 					IN uint64_t src_addr,
 					IN uint64_t size,
@@ -3064,6 +3512,28 @@ out:
 	return res;
 }
 
+/* -----------------------------------------------------------------------
+ * Function: mam_clip_range_to_first_table
+ * Description: Clips the range to the part covered by the first table;
+ *              nothing can be mapped beyond it, so updates of existing
+ *              mappings have nothing to do there.
+ * Return value - FALSE when nothing of the range remains
+ * -----------------------------------------------------------------------*/
+static
+boolean_t mam_clip_range_to_first_table(
+	IN const mam_level_ops_t *first_table_ops,
+	IN uint64_t src_addr,
+	IN OUT uint64_t *size)
+{
+	uint64_t covered_size = mam_get_size_covered_by_table(first_table_ops);
+
+	if ((*size == 0) || (src_addr >= covered_size)) {
+		return FALSE;
+	}
+	*size = MIN(*size, covered_size - src_addr);
+	return TRUE;
+}
+
 boolean_t mam_add_permissions_to_existing_mapping(IN mam_handle_t mam_handle,
 						  IN uint64_t src_addr,
 						  IN uint64_t size,
@@ -3095,6 +3565,11 @@ boolean_t mam_add_permissions_to_existing_mapping(IN mam_handle_t mam_handle,
 	first_table_ops = mam->first_table_ops;
 	MON_ASSERT(first_table_ops != NULL);
 
+	if (!mam_clip_range_to_first_table(first_table_ops, src_addr, &size)) {
+		res = TRUE;
+		goto out;
+	}
+
 	res = mam_update_table(mam,
 		first_table_ops,
 		first_table,
@@ -3143,6 +3618,11 @@ boolean_t mam_remove_permissions_from_existing_mapping(
 	first_table_ops = mam->first_table_ops;
 	MON_ASSERT(first_table_ops != NULL);
 
+	if (!mam_clip_range_to_first_table(first_table_ops, src_addr, &size)) {
+		res = TRUE;
+		goto out;
+	}
+
 	res = mam_update_table(mam,
 		first_table_ops,
 		first_table,
@@ -3158,6 +3638,109 @@ out:
 	return res;
 }
 
+boolean_t mam_update_permissions_in_place(IN mam_handle_t mam_handle,
+					  IN uint64_t src_addr,
+					  IN uint64_t size,
+					  IN mam_attributes_t attrs_to_set,
+					  IN mam_attributes_t attrs_to_clear)
+{
+	mam_t *mam = (mam_t *)mam_handle;
+	const mam_level_ops_t *first_table_ops = NULL;
+	mam_hav_t first_table = 0;
+	boolean_t res;
+
+	if (mam_handle == MAM_INVALID_HANDLE) {
+		return FALSE;
+	}
+
+	if ((src_addr & (PAGE_4KB_SIZE - 1)) || (size & (PAGE_4KB_SIZE - 1))) {
+		/* Must be 4K aligned */
+		return FALSE;
+	}
+
+	MON_ASSERT((attrs_to_set.ept_attr.emt == 0) &&
+		(attrs_to_clear.ept_attr.emt == 0));
+
+	lock_acquire(&(mam->update_lock));
+
+	first_table = mam->first_table;
+	first_table_ops = mam->first_table_ops;
+	MON_ASSERT(first_table_ops != NULL);
+
+	if (!mam_clip_range_to_first_table(first_table_ops, src_addr, &size)) {
+		res = TRUE;
+		goto out;
+	}
+
+	/* First make sure no table has to be split, so the update is either
+	 * done as a whole or not at all. Only leaves are changed, the table
+	 * structure stays as is, hence lock-less readers need no retry. */
+	res = mam_update_permissions_in_place_in_table(mam,
+		first_table_ops,
+		first_table,
+		0,
+		src_addr,
+		size, attrs_to_set, attrs_to_clear, FALSE);
+	if (res) {
+		mam_update_permissions_in_place_in_table(mam,
+			first_table_ops,
+			first_table,
+			0,
+			src_addr,
+			size, attrs_to_set, attrs_to_clear, TRUE);
+	}
+
+out:
+	lock_release(&(mam->update_lock));
+	return res;
+}
+
+boolean_t mam_get_ept_dirty_pages(IN mam_handle_t mam_handle,
+				  IN uint64_t src_addr,
+				  IN uint64_t size,
+				  OUT uint64_t *bitmap,
+				  IN boolean_t clear)
+{
+	mam_t *mam = (mam_t *)mam_handle;
+	const mam_level_ops_t *first_table_ops = NULL;
+	mam_hav_t first_table = 0;
+
+	if (mam_handle == MAM_INVALID_HANDLE) {
+		return FALSE;
+	}
+
+	if ((src_addr & (PAGE_4KB_SIZE - 1)) || (size & (PAGE_4KB_SIZE - 1))) {
+		/* Must be 4K aligned */
+		return FALSE;
+	}
+
+	lock_acquire(&(mam->update_lock));
+
+	first_table = mam->first_table;
+	first_table_ops = mam->first_table_ops;
+	MON_ASSERT(first_table_ops != NULL);
+
+	if (mam_get_entry_ops(mam_hva_to_ptr(first_table)) !=
+	    MAM_EPT_ENTRY_OPS) {
+		/* not converted to EPT yet */
+		lock_release(&(mam->update_lock));
+		return FALSE;
+	}
+
+	if (mam_clip_range_to_first_table(first_table_ops, src_addr, &size)) {
+		/* Only the flags change, lock-less readers need no retry */
+		mam_get_ept_dirty_pages_in_table(mam,
+			first_table_ops,
+			first_table,
+			0,
+			src_addr,
+			size, src_addr, bitmap, clear);
+	}
+
+	lock_release(&(mam->update_lock));
+	return TRUE;
+}
+
 boolean_t mon_mam_overwrite_permissions_in_existing_mapping(
 	IN mam_handle_t mam_handle,
 	IN uint64_t src_addr,
@@ -3190,6 +3773,11 @@ boolean_t mon_mam_overwrite_permissions_in_existing_mapping(
 	first_table_ops = mam->first_table_ops;
 	MON_ASSERT(first_table_ops != NULL);
 
+	if (!mam_clip_range_to_first_table(first_table_ops, src_addr, &size)) {
+		res = TRUE;
+		goto out;
+	}
+
 	res = mam_update_table(mam,
 		first_table_ops,
 		first_table,
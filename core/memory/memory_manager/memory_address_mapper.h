@@ -103,6 +103,16 @@ typedef union {
 	uint64_t uint64;
 } mam_entry_t;
 
+/* With EPT accessed/dirty flags enabled, bit 9 of an EPT leaf is its dirty
+ * flag. It is also the lowest bit of MAM_LEAF_EPT_ENTRY kept in "avl", so
+ * leaves are created dirty, and so are leaves whose attributes are
+ * rewritten, since that sets their type again. A leaf whose dirty flag was
+ * cleared looks like MAM_LEAF_PAGE_TABLE_ENTRY and is told apart by bit 52,
+ * which is ignored by hardware in EPT entries and never set by MAM in page
+ * table entries */
+#define MAM_EPT_LEAF_DIRTY_BIT          ((uint64_t)1 << 9)
+#define MAM_EPT_CLEAN_LEAF_MARK         ((uint64_t)1 << 52)
+
 typedef enum {
 	MAM_GENERAL_MAPPING,
 	MAM_PAGE_TABLES_COMPLIANT_MAPPING,
@@ -208,6 +218,7 @@ typedef void (*func_mam_update_innter_level_entry_t) (mam_t *, mam_entry_t *,
 						      const mam_level_ops_t *);
 typedef void (*func_mam_update_attributes_in_leaf_entry_t) (mam_entry_t *,
 							    mam_attributes_t,
+							    mam_entry_type_t,
 							    const
 mam_level_ops_t *);
 typedef mam_entry_type_t (*func_mam_get_leaf_entry_type_t) (void);
@@ -237,6 +248,8 @@ struct mam_t {
 	mon_lock_t			update_lock;
 	volatile uint32_t		update_counter;
 	uint32_t			update_on_cpu;
+	/* mam_insert_ranges() compacts the tables once at the end */
+	boolean_t			defer_retraction;
 	boolean_t			is_32bit_page_tables;
 	mam_vtdpt_super_page_support_t	vtdpt_supper_page_support;
 	mam_vtdpt_snoop_behavior_t	vtdpt_snoop_behavior;
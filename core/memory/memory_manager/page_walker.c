@@ -684,7 +684,8 @@ pw_retval_t pw_perform_page_walk(IN guest_cpu_handle_t gcpu,
 				 IN boolean_t is_fetch,
 				 IN boolean_t set_ad_bits,
 				 OUT uint64_t *gpa_out,
-				 OUT uint64_t *pfec_out)
+				 OUT uint64_t *pfec_out,
+				 OUT uint64_t *page_size_out)
 {
 	pw_retval_t retval = PW_RETVAL_SUCCESS;
 	pw_pfec_t native_pfec;
@@ -699,6 +700,7 @@ pw_retval_t pw_perform_page_walk(IN guest_cpu_handle_t gcpu,
 	boolean_t is_pae = ((cr4 & CR4_PAE) != 0);
 	boolean_t is_pse = ((cr4 & CR4_PSE) != 0);
 	uint64_t gpa = PW_INVALID_GPA;
+	uint64_t page_size = PAGE_4KB_SIZE;
 	uint32_t pml4te_index;
 	uint32_t pdpte_index;
 	uint32_t pde_index;
@@ -825,6 +827,7 @@ pw_retval_t pw_perform_page_walk(IN guest_cpu_handle_t gcpu,
 			TRUE);
 		/* Calculate full guest accessed physical address */
 		gpa = big_page_addr + offset_in_big_page;
+		page_size = PAGE_1GB_SIZE;
 
 		if ((is_write) &&
 		    (!pw_is_write_access_permitted
@@ -917,6 +920,7 @@ pw_retval_t pw_perform_page_walk(IN guest_cpu_handle_t gcpu,
 			FALSE);
 		/* Calculate full guest accessed physical address */
 		gpa = big_page_addr + offset_in_big_page;
+		page_size = (is_pae) ? PAGE_2MB_SIZE : PAGE_4MB_SIZE;
 
 		if ((is_write) &&
 		    (!pw_is_write_access_permitted
@@ -1057,6 +1061,10 @@ out:
 	if ((retval == PW_RETVAL_PF) && (pfec_out != NULL)) {
 		*pfec_out = native_pfec.uint64;
 	}
+
+	if ((retval == PW_RETVAL_SUCCESS) && (page_size_out != NULL)) {
+		*page_size_out = page_size;
+	}
 	return retval;
 }
 
@@ -20,6 +20,8 @@
 #include <common_libc.h>
 #include "pool.h"
 #include "mon_dbg.h"
+#include "mon_globals.h"
+#include "hw_utils.h"
 #include "file_codes.h"
 
 #define MON_DEADLOOP()          MON_DEADLOOP_LOG(POOL_C)
@@ -892,6 +894,12 @@ pool_handle_t pool_create_internal(uint32_t size_of_single_element,
 		pool_clear_must_succeed_allocation(pool);
 		pool_clear_alloc_free_ops_counter(pool);
 
+		/* magazines are optional, pool works without them */
+		pool->magazines = (pool_magazine_t *)mon_memory_alloc(
+			g_num_of_cpus * sizeof(pool_magazine_t));
+		pool->num_of_magazines =
+			(NULL != pool->magazines) ? g_num_of_cpus : 0;
+
 		MON_ASSERT(pool_is_allocation_counters_ok(pool));
 	}
 
@@ -906,9 +914,28 @@ pool_handle_t assync_pool_create(uint32_t size_of_single_element)
 	return pool_create_internal(size_of_single_element, FALSE);
 }
 
+/* Create pool guarded by mutual exclussion lock. */
+pool_handle_t sync_pool_create(uint32_t size_of_single_element)
+{
+	return pool_create_internal(size_of_single_element, TRUE);
+}
+
+/* returns magazine of the current host CPU, NULL if not available */
+static
+pool_magazine_t *pool_get_magazine(pool_t *pool)
+{
+	cpu_id_t cpu_id = hw_cpu_id();
+
+	if (cpu_id >= pool->num_of_magazines) {
+		return NULL;
+	}
+	return &pool->magazines[cpu_id];
+}
+
 void *pool_allocate(pool_handle_t pool_handle)
 {
 	pool_t *pool = (pool_t *)pool_handle;
+	pool_magazine_t *magazine;
 	void *tmp;
 
 	MON_ASSERT(pool != NULL);
@@ -917,18 +944,37 @@ void *pool_allocate(pool_handle_t pool_handle)
 		return NULL;
 	}
 
-	POOL_AQUIRE_LOCK(pool);
+	magazine = pool_get_magazine(pool);
+	if (NULL == magazine) {
+		POOL_AQUIRE_LOCK(pool);
+		tmp = pool_allocate_internal(pool);
+		POOL_RELEASE_LOCK(pool);
+		return tmp;
+	}
 
-	tmp = pool_allocate_internal(pool);
+	/* the magazine is accessed by its own host CPU only, no lock */
+	if (0 == magazine->num_of_elements) {
+		POOL_AQUIRE_LOCK(pool);
+		while (magazine->num_of_elements < POOL_MAGAZINE_BATCH) {
+			tmp = pool_allocate_internal(pool);
+			if (NULL == tmp) {
+				break;
+			}
+			magazine->elements[magazine->num_of_elements++] = tmp;
+		}
+		POOL_RELEASE_LOCK(pool);
 
-	POOL_RELEASE_LOCK(pool);
+		if (0 == magazine->num_of_elements) {
+			return NULL;
+		}
+	}
 
-	return tmp;
+	return magazine->elements[--magazine->num_of_elements];
 }
 
-void pool_free(pool_handle_t pool_handle, void *data)
+static
+void pool_free_internal(pool_t *pool, void *data)
 {
-	pool_t *pool = (pool_t *)pool_handle;
 	pool_list_element_t *element = (pool_list_element_t *)data;
 	uint64_t element_addr = (uint64_t)element;
 	uint64_t page_addr = ALIGN_BACKWARD(element_addr, PAGE_4KB_SIZE);
@@ -937,14 +983,6 @@ void pool_free(pool_handle_t pool_handle, void *data)
 	boolean_t res;
 	uint64_t num_of_elements;
 
-	MON_ASSERT(pool != NULL);
-
-	if (pool == NULL) {
-		return;
-	}
-
-	POOL_AQUIRE_LOCK(pool);
-
 	free_elements_list = pool_get_free_pool_elements_list(pool);
 	hash = pool_get_hash(pool);
 
@@ -976,7 +1014,41 @@ void pool_free(pool_handle_t pool_handle, void *data)
 	MON_ASSERT(pool_is_allocation_counters_ok(pool));
 
 	pool_report_alloc_free_op(pool);
-
-	POOL_RELEASE_LOCK(pool);
 }
 
+void pool_free(pool_handle_t pool_handle, void *data)
+{
+	pool_t *pool = (pool_t *)pool_handle;
+	pool_magazine_t *magazine;
+
+	MON_ASSERT(pool != NULL);
+
+	if (pool == NULL) {
+		return;
+	}
+
+	magazine = pool_get_magazine(pool);
+	if (NULL == magazine) {
+		POOL_AQUIRE_LOCK(pool);
+		pool_free_internal(pool, data);
+		POOL_RELEASE_LOCK(pool);
+		return;
+	}
+
+	/* return the older half of a full magazine to the pool */
+	if (POOL_MAGAZINE_SIZE == magazine->num_of_elements) {
+		uint32_t i;
+
+		POOL_AQUIRE_LOCK(pool);
+		for (i = 0; i < POOL_MAGAZINE_BATCH; ++i)
+			pool_free_internal(pool, magazine->elements[i]);
+		POOL_RELEASE_LOCK(pool);
+
+		for (i = POOL_MAGAZINE_BATCH; i < POOL_MAGAZINE_SIZE; ++i)
+			magazine->elements[i - POOL_MAGAZINE_BATCH] =
+				magazine->elements[i];
+		magazine->num_of_elements -= POOL_MAGAZINE_BATCH;
+	}
+
+	magazine->elements[magazine->num_of_elements++] = data;
+}
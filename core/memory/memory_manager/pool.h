@@ -76,6 +76,19 @@ typedef struct {
 #define pool_list_head_set_num_of_elements(list_head_, num_of_elements_) \
 	{ list_head_->num_of_elements = num_of_elements_; }
 
+/*----------------------------------------------------------*/
+#define POOL_MAGAZINE_SIZE 16
+/* number of elements moved between a magazine and the pool at once */
+#define POOL_MAGAZINE_BATCH (POOL_MAGAZINE_SIZE / 2)
+
+/* Per host CPU LIFO stack of free elements. Elements in a magazine are
+ * allocated from the pool point of view. Padded to the cache line size. */
+typedef struct {
+	void		*elements[POOL_MAGAZINE_SIZE];
+	uint32_t	num_of_elements;
+	uint32_t	padding[15]; /* not for use */
+} pool_magazine_t;
+
 /*----------------------------------------------------------*/
 typedef struct {
 	pool_list_head_t	free_hash_elements;
@@ -97,7 +110,8 @@ typedef struct {
 	uint32_t		num_of_pages_used_for_pool_elements;
 	mon_lock_t		access_lock;
 	boolean_t		mutex_flag;
-	uint32_t		pad0;
+	uint32_t		num_of_magazines;
+	pool_magazine_t		*magazines;
 } pool_t;
 
 /* pool_list_head_t* pool_get_free_hash_elements_list(pool_t* pool) */
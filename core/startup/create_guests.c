@@ -164,6 +164,11 @@ static guest_handle_t init_single_guest(uint32_t number_of_host_processors,
 		guest_set_real_BIOS_access_enabled(guest);
 	}
 
+	if (BITMAP_GET(gstartup->flags,
+		    MON_GUEST_FLAG_EPT_ACCESSED_DIRTY) != 0) {
+		guest_set_ept_accessed_dirty_enabled(guest);
+	}
+
 	msr_vmexit_guest_setup(guest); /* setup MSR-related control structure */
 
 	/* init cpus. */
@@ -18,51 +18,66 @@
 #include "mon_dbg.h"
 #include "common_libc.h"
 #include "memory_allocator.h"
+#include "hw_utils.h"
 #include "cache64.h"
 #include "file_codes.h"
 
 #define MON_DEADLOOP()          MON_DEADLOOP_LOG(CACHE64_C)
 #define MON_ASSERT(__condition) MON_ASSERT_LOG(CACHE64_C, __condition)
 
+/*
+ * Valid and dirty state is kept in 64-bit words, so a lookup is a single
+ * AND and flushing all dirty entries costs one bit scan per dirty entry
+ * instead of a walk over the whole byte array.
+ */
 typedef struct cache64_struct_t {
 	uint32_t	num_of_entries;
-	/* bitmap size in bytes */
-	uint16_t	bitmap_size;
+	/* bitmap size in 64-bit words */
+	uint16_t	bitmap_words;
 	uint16_t	flags;
 	uint64_t	*table;
-	uint8_t		*dirty_bits;
-	uint8_t		*valid_bits;
+	uint64_t	*dirty_bits;
+	uint64_t	*valid_bits;
 } cache64_struct_t;
 
 /*
  * Helper macros
  */
-#define CACHE_FIELD_IS_VALID(__cache, __entry_no)   \
-	BITARRAY_GET((__cache)->valid_bits, __entry_no)
-#define CACHE_FIELD_SET_VALID(__cache, __entry_no)  \
-	BITARRAY_SET((__cache)->valid_bits, __entry_no)
-#define CACHE_FIELD_CLR_VALID(__cache, __entry_no)  \
-	BITARRAY_CLR((__cache)->valid_bits, __entry_no)
-
-#define CACHE_FIELD_IS_DIRTY(__cache, __entry_no)   \
-	BITARRAY_GET((__cache)->dirty_bits, __entry_no)
-#define CACHE_FIELD_SET_DIRTY(__cache, __entry_no)  \
-	BITARRAY_SET((__cache)->dirty_bits, __entry_no)
-#define CACHE_FIELD_CLR_DIRTY(__cache, __entry_no)  \
-	BITARRAY_CLR((__cache)->dirty_bits, __entry_no)
-
-#define ENUMERATE_DIRTY_ENTRIES(__cache, __func, __arg)                        \
-	BITARRAY_ENUMERATE((__cache)->dirty_bits,                                 \
-	(__cache)->num_of_entries,                             \
-	__func, __arg)
+#define CACHE_BITMAP_WORDS(__num_of_entries) (((__num_of_entries) + 63) / 64)
+#define CACHE_BITMAP_WORD(__entry_no)        ((__entry_no) >> 6)
+#define CACHE_BITMAP_MASK(__entry_no)        BIT_VALUE64((__entry_no) & 63)
+
+#define CACHE_FIELD_IS_VALID(__cache, __entry_no)                              \
+	((__cache)->valid_bits[CACHE_BITMAP_WORD(__entry_no)] &                \
+	 CACHE_BITMAP_MASK(__entry_no))
+#define CACHE_FIELD_SET_VALID(__cache, __entry_no)                             \
+	((__cache)->valid_bits[CACHE_BITMAP_WORD(__entry_no)] |=               \
+		 CACHE_BITMAP_MASK(__entry_no))
+#define CACHE_FIELD_CLR_VALID(__cache, __entry_no)                             \
+	((__cache)->valid_bits[CACHE_BITMAP_WORD(__entry_no)] &=               \
+		 ~CACHE_BITMAP_MASK(__entry_no))
+
+#define CACHE_FIELD_IS_DIRTY(__cache, __entry_no)                              \
+	((__cache)->dirty_bits[CACHE_BITMAP_WORD(__entry_no)] &                \
+	 CACHE_BITMAP_MASK(__entry_no))
+#define CACHE_FIELD_SET_DIRTY(__cache, __entry_no)                             \
+	((__cache)->dirty_bits[CACHE_BITMAP_WORD(__entry_no)] |=               \
+		 CACHE_BITMAP_MASK(__entry_no))
+#define CACHE_FIELD_CLR_DIRTY(__cache, __entry_no)                             \
+	((__cache)->dirty_bits[CACHE_BITMAP_WORD(__entry_no)] &=               \
+		 ~CACHE_BITMAP_MASK(__entry_no))
+
+#define CACHE_BITMAP_SIZE(__cache) \
+	(sizeof(uint64_t) * (__cache)->bitmap_words)
 
 cache64_object_t cache64_create(uint32_t num_of_entries)
 {
 	cache64_struct_t *cache;
 	uint64_t *table;
-	uint8_t *dirty_bits;
-	uint8_t *valid_bits;
-	uint16_t bitmap_size = (uint16_t)BITARRAY_SIZE_IN_BYTES(num_of_entries);
+	uint64_t *dirty_bits;
+	uint64_t *valid_bits;
+	uint16_t bitmap_words = (uint16_t)CACHE_BITMAP_WORDS(num_of_entries);
+	uint32_t bitmap_size = sizeof(uint64_t) * bitmap_words;
 
 	cache = mon_malloc(sizeof(cache64_struct_t));
 	table = mon_malloc(sizeof(uint64_t) * num_of_entries);
@@ -73,7 +88,7 @@ cache64_object_t cache64_create(uint32_t num_of_entries)
 	    NULL != dirty_bits && NULL != valid_bits) {
 		/* everything is OK. fill the fields */
 		cache->num_of_entries = num_of_entries;
-		cache->bitmap_size = bitmap_size;
+		cache->bitmap_words = bitmap_words;
 		cache->flags = 0;
 		cache->table = table;
 		cache->dirty_bits = dirty_bits;
@@ -103,14 +118,8 @@ cache64_object_t cache64_create(uint32_t num_of_entries)
 	return cache;
 }
 
-extern boolean_t vmcs_sw_shadow_disable[];
-
 void cache64_write(cache64_object_t cache, uint64_t value, uint32_t entry_no)
 {
-	if (vmcs_sw_shadow_disable[hw_cpu_id()]) {
-		return;
-	}
-
 	MON_ASSERT(cache);
 	MON_ASSERT(entry_no < cache->num_of_entries);
 
@@ -125,16 +134,27 @@ void cache64_write(cache64_object_t cache, uint64_t value, uint32_t entry_no)
 	}
 }
 
+/* store value which is already in sync with the backing store: the entry
+ * becomes valid, but not dirty */
+void cache64_fill(cache64_object_t cache, uint64_t value, uint32_t entry_no)
+{
+	MON_ASSERT(cache);
+	MON_ASSERT(entry_no < cache->num_of_entries);
+
+	if (entry_no < cache->num_of_entries) {
+		if (!CACHE_FIELD_IS_DIRTY(cache, entry_no)) {
+			cache->table[entry_no] = value;
+			CACHE_FIELD_SET_VALID(cache, entry_no);
+		}
+	}
+}
+
 boolean_t cache64_read(cache64_object_t cache,
 		       uint64_t *p_value,
 		       uint32_t entry_no)
 {
 	boolean_t is_valid = FALSE;
 
-	if (vmcs_sw_shadow_disable[hw_cpu_id()]) {
-		return FALSE;
-	}
-
 	MON_ASSERT(cache);
 	MON_ASSERT(entry_no < cache->num_of_entries);
 	MON_ASSERT(p_value);
@@ -159,8 +179,8 @@ void cache64_invalidate(cache64_object_t cache, uint32_t entry_no)
 	} else {
 		/* invalidate all entries */
 		BITMAP_CLR(cache->flags, CACHE_VALID_FLAG);
-		mon_memset(cache->valid_bits, 0, cache->bitmap_size);
-		mon_memset(cache->dirty_bits, 0, cache->bitmap_size);
+		mon_memset(cache->valid_bits, 0, CACHE_BITMAP_SIZE(cache));
+		mon_memset(cache->dirty_bits, 0, CACHE_BITMAP_SIZE(cache));
 	}
 }
 
@@ -170,6 +190,10 @@ void cache64_flush_dirty(cache64_object_t cache, uint32_t entry_no,
 			 func_cache64_field_process_t function,
 			 void *arg)
 {
+	uint32_t word;
+	uint32_t bit;
+	uint64_t dirty;
+
 	MON_ASSERT(cache);
 
 	if (entry_no < cache->num_of_entries) {
@@ -184,10 +208,19 @@ void cache64_flush_dirty(cache64_object_t cache, uint32_t entry_no,
 		/* flush all entries */
 		BITMAP_CLR(cache->flags, CACHE_DIRTY_FLAG);
 
-		if (NULL != function) {
-			ENUMERATE_DIRTY_ENTRIES(cache, function, arg);
-		} else {
-			mon_memset(cache->dirty_bits, 0, cache->bitmap_size);
+		if (NULL == function) {
+			mon_memset(cache->dirty_bits, 0, CACHE_BITMAP_SIZE(cache));
+			return;
+		}
+
+		for (word = 0; word < cache->bitmap_words; ++word) {
+			dirty = cache->dirty_bits[word];
+			cache->dirty_bits[word] = 0;
+
+			while (hw_scan_bit_forward64(&bit, dirty)) {
+				dirty &= ~BIT_VALUE64(bit);
+				function(word * 64 + bit, arg);
+			}
 		}
 	}
 }
@@ -217,6 +250,40 @@ boolean_t cache64_is_dirty(cache64_object_t cache)
 	return 0 != BITMAP_GET(cache->flags, CACHE_DIRTY_FLAG);
 }
 
+boolean_t cache64_is_dirty_range(cache64_object_t cache,
+				 uint32_t first_entry,
+				 uint32_t last_entry)
+{
+	uint32_t word;
+	uint32_t last_word;
+	uint64_t mask;
+
+	MON_ASSERT(cache);
+	MON_ASSERT(first_entry <= last_entry);
+
+	if (0 == BITMAP_GET(cache->flags, CACHE_DIRTY_FLAG)) {
+		return FALSE;
+	}
+	if (last_entry >= cache->num_of_entries) {
+		last_entry = cache->num_of_entries - 1;
+	}
+
+	last_word = CACHE_BITMAP_WORD(last_entry);
+	for (word = CACHE_BITMAP_WORD(first_entry); word <= last_word; ++word) {
+		mask = UINT64_ALL_ONES;
+		if (word == CACHE_BITMAP_WORD(first_entry)) {
+			mask &= ~(CACHE_BITMAP_MASK(first_entry) - 1);
+		}
+		if (word == last_word && (last_entry & 63) != 63) {
+			mask &= (CACHE_BITMAP_MASK(last_entry) << 1) - 1;
+		}
+		if (0 != (cache->dirty_bits[word] & mask)) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
 void cache64_destroy(cache64_object_t cache)
 {
 	MON_ASSERT(cache);
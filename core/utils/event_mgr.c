@@ -27,17 +27,24 @@
 #include "common_libc.h"
 #include "mon_dbg.h"
 #include "heap.h"
-#include "hash64_api.h"
 #include "memory_allocator.h"
 #include "guest.h"
 #include "list.h"
+#include "hw_interlocked.h"
 
 #define OBSERVERS_LIMIT         5
 #define NO_EVENT_SPECIFIC_LIMIT ((uint32_t)-1)
 
+/*
+ * Observers of an event: NULL terminated array, allocated with room for the
+ * event's observers limit on the first registration and never replaced, so
+ * raising an event takes no lock. Every slot is changed with a single
+ * pointer store: registration fills the first free slot in front of the
+ * terminator, unregistration overwrites the callback with
+ * event_observer_removed(), which raise skips and registration reuses.
+ */
 typedef struct {
-	mon_read_write_lock_t	lock;
-	event_callback_t	call[OBSERVERS_LIMIT];
+	event_callback_t *volatile observers;
 } event_entry_t;
 
 typedef struct {
@@ -52,10 +59,17 @@ typedef struct {
 } guest_events_t;
 
 typedef struct {
-	hash64_handle_t gcpu_events;
 	list_element_t	guest_events;
 	/* events not related to particular gcpu, e.g. guest create */
 	event_entry_t	general_event[EVENTS_COUNT];
+	/* serializes registrations */
+	mon_lock_t	lock;
+	uint32_t	pad;
+	/* bit per event which has observers of the scope on any gcpu or guest,
+	 * lets raise skip the lookups */
+	uint64_t	gcpu_observed;
+	uint64_t	guest_observed;
+	uint64_t	global_observed;
 } event_manager_t;
 
 uint32_t host_physical_cpus;
@@ -159,12 +173,13 @@ static
 boolean_t event_manager_add_gcpu(guest_cpu_handle_t gcpu, void *pv);
 static
 boolean_t event_register_internal(event_entry_t *p_event, mon_event_t e,        /* in: * event */
-				  event_callback_t call);                       /* in: callback to register on event e */
+				  event_callback_t call,                        /* in: callback to register on event e */
+				  uint64_t *observed);                          /* in: scope bitmap of observed events */
 static
 boolean_t event_unregister_internal(event_entry_t *p_event, mon_event_t e,      /* in: * event */
-				    event_callback_t call);                     /* in: callback to register on event e */
+				    event_callback_t call);                     /* in: callback to unregister from event e */
 static
-boolean_t event_raise_internal(event_entry_t *p_event, mon_event_t e,           /* in: event */
+boolean_t event_raise_internal(event_entry_t *p_event,                          /* in: observers */
 			       guest_cpu_handle_t gcpu,                         /* in: guest cpu */
 			       void *p);                                        /* in: pointer to event specific structure */
 static
@@ -185,18 +200,9 @@ boolean_t event_gcpu_raise(mon_event_t e,
 static
 event_entry_t *get_gcpu_observers(mon_event_t e, guest_cpu_handle_t gcpu)
 {
-	const virtual_cpu_id_t *p_vcpu;
-	cpu_events_t *p_cpu_events = NULL;
+	cpu_events_t *p_cpu_events = (cpu_events_t *)gcpu_get_event_observers(
+		gcpu);
 	event_entry_t *p_event = NULL;
-	boolean_t res;
-
-	p_vcpu = mon_guest_vcpu(gcpu);
-	MON_ASSERT(p_vcpu);
-	res = hash64_lookup(event_mgr.gcpu_events,
-		(uint64_t)(p_vcpu->guest_id << (8 *
-						sizeof(guest_id_t)) |
-			   p_vcpu->guest_cpu_id),
-		(uint64_t *)&p_cpu_events);
 
 	if (p_cpu_events != NULL) {
 		p_event = &(p_cpu_events->event[e]);
@@ -256,8 +262,6 @@ uint32_t event_observers_limit(mon_event_t e)
 
 uint32_t event_manager_initialize(uint32_t num_of_host_cpus)
 {
-	event_entry_t *general_event;
-	int i;
 	guest_handle_t guest = NULL;
 	guest_id_t guest_id = INVALID_GUEST_ID;
 	guest_econtext_t context;
@@ -267,19 +271,13 @@ uint32_t event_manager_initialize(uint32_t num_of_host_cpus)
 	 *  and in the events enumeration mon_event_t
 	 */
 	MON_ASSERT(ARRAY_SIZE(events_characteristics) == EVENTS_COUNT);
+	/* one bit per event in the "observed" bitmaps */
+	MON_ASSERT(EVENTS_COUNT <= 64);
 
 	host_physical_cpus = num_of_host_cpus;
 
 	mon_memset(&event_mgr, 0, sizeof(event_mgr));
-
-	event_mgr.gcpu_events =
-		hash64_create_default_hash(
-			host_physical_cpus * host_physical_cpus);
-
-	for (i = 0; i < EVENTS_COUNT; i++) {
-		general_event = &(event_mgr.general_event[i]);
-		lock_initialize_read_write_lock(&(general_event->lock));
-	}
+	lock_initialize(&event_mgr.lock);
 
 	list_init(&event_mgr.guest_events);
 
@@ -300,19 +298,11 @@ uint32_t event_manager_guest_initialize(guest_id_t guest_id)
 	guest_gcpu_econtext_t gcpu_context;
 	guest_handle_t guest = mon_guest_handle(guest_id);
 	guest_events_t *p_new_guest_events;
-	event_entry_t *event;
-	int i;
 
 	p_new_guest_events = mon_malloc(sizeof(*p_new_guest_events));
 	MON_ASSERT(p_new_guest_events);
 	mon_memset(p_new_guest_events, 0, sizeof(*p_new_guest_events));
 
-	/* init lock for each event */
-	for (i = 0; i < EVENTS_COUNT; i++) {
-		event = &(p_new_guest_events->event[i]);
-		lock_initialize_read_write_lock(&(event->lock));
-	}
-
 	p_new_guest_events->guest_id = guest_id;
 
 	/* for each guest/cpu we keep the event (callbacks) array */
@@ -338,63 +328,106 @@ uint32_t event_manager_gcpu_initialize(guest_cpu_handle_t gcpu)
 {
 	const virtual_cpu_id_t *p_vcpu = NULL;
 	cpu_events_t *gcpu_events = NULL;
-	event_entry_t *event = NULL;
-	int i;
 
 	p_vcpu = mon_guest_vcpu(gcpu);
 	MON_ASSERT(p_vcpu);
+
+	if (gcpu_get_event_observers(gcpu) != NULL) {
+		/* already added */
+		return 0;
+	}
+
 	gcpu_events = (cpu_events_t *)mon_malloc(sizeof(cpu_events_t));
 	MON_ASSERT(gcpu_events);
+	mon_memset(gcpu_events, 0, sizeof(cpu_events_t));
 
 	MON_LOG(mask_anonymous, level_trace,
-		"event mgr add gcpu guest id=%d cpu id=%d with key %p\n",
-		p_vcpu->guest_id, p_vcpu->guest_cpu_id,
-		(uint64_t)(p_vcpu->guest_id << (8 *
-						sizeof(guest_id_t)) |
-			   p_vcpu->guest_cpu_id));
-	hash64_insert(event_mgr.gcpu_events,
-		(uint64_t)(p_vcpu->guest_id << (8 * sizeof(guest_id_t)) |
-			   p_vcpu->guest_cpu_id), (uint64_t)gcpu_events);
-
-	/* init lock for each event */
-	for (i = 0; i < EVENTS_COUNT; i++) {
-		event = &(gcpu_events->event[i]);
-		lock_initialize_read_write_lock(&(event->lock));
-	}
+		"event mgr add gcpu guest id=%d cpu id=%d\n",
+		p_vcpu->guest_id, p_vcpu->guest_cpu_id);
+
+	gcpu_set_event_observers(gcpu, gcpu_events);
 
 	return 0;
 }
 
+/* placeholder of an unregistered observer, never called */
+static
+boolean_t event_observer_removed(guest_cpu_handle_t gcpu UNUSED, void *p UNUSED)
+{
+	return FALSE;
+}
+
 boolean_t event_register_internal(event_entry_t *p_event,
 				  mon_event_t e,                /* in: event */
-				  event_callback_t call)        /* in: callback to register on event e */
+				  event_callback_t call,        /* in: callback to register on event e */
+				  uint64_t *observed)           /* in: scope bitmap of observed events */
 {
 	uint32_t i = 0;
 	uint32_t observers_limits;
-	boolean_t registered = FALSE;
+	event_callback_t *observers;
 
 	observers_limits = event_observers_limit(e);
 
-	lock_acquire_writelock(&p_event->lock);
+	lock_acquire(&event_mgr.lock);
+
+	observers = p_event->observers;
+	if (observers == NULL) {
+		/* the extra slot keeps the terminator when the limit is reached */
+		observers = (event_callback_t *)mon_malloc((observers_limits + 1) *
+			sizeof(event_callback_t));
+		MON_ASSERT(observers);
+		mon_memset(observers, 0,
+			(observers_limits + 1) * sizeof(event_callback_t));
+		/* the array must be zeroed before raise can see it */
+		hw_assign_as_barrier(&p_event->observers, observers);
+	}
 
-	/*
-	 *  Find free observer slot
-	 */
-	while (i < observers_limits && p_event->call[i])
+	while (observers[i] && observers[i] != event_observer_removed)
 		++i;
 
-	if (i < observers_limits) {
-		p_event->call[i] = call;
-		registered = TRUE;
-	} else {
+	if (i >= observers_limits) {
 		/*
 		 *  Exceeding allowed observers count
 		 */
+		lock_release(&event_mgr.lock);
 		MON_DEADLOOP();
+		return FALSE;
 	}
 
-	lock_release_writelock(&p_event->lock);
-	return registered;
+	hw_assign_as_barrier(&observers[i], call);
+	BIT_SET64(*observed, e);
+
+	lock_release(&event_mgr.lock);
+	return TRUE;
+}
+
+/*
+ * The scope bit in the "observed" bitmap stays set: other gcpus or guests may
+ * still observe the event, and a stale bit only costs raise a lookup.
+ */
+boolean_t event_unregister_internal(event_entry_t *p_event,
+				    mon_event_t e UNUSED,       /* in: event */
+				    event_callback_t call)      /* in: callback to unregister from event e */
+{
+	uint32_t i = 0;
+	event_callback_t *observers;
+	boolean_t unregistered = FALSE;
+
+	lock_acquire(&event_mgr.lock);
+
+	observers = p_event->observers;
+	while (observers != NULL && observers[i]) {
+		if (observers[i] == call) {
+			hw_assign_as_barrier(&observers[i],
+				event_observer_removed);
+			unregistered = TRUE;
+			break;
+		}
+		++i;
+	}
+
+	lock_release(&event_mgr.lock);
+	return unregistered;
 }
 
 boolean_t event_global_register(mon_event_t e,                  /* in: event */
@@ -412,7 +445,8 @@ boolean_t event_global_register(mon_event_t e,                  /* in: event */
 		return FALSE;
 	}
 	list = get_global_observers(e);
-	return event_register_internal(list, e, call);
+	return event_register_internal(list, e, call,
+		&event_mgr.global_observed);
 }
 
 boolean_t event_gcpu_register(mon_event_t e,                    /* in: event */
@@ -434,32 +468,93 @@ boolean_t event_gcpu_register(mon_event_t e,                    /* in: event */
 
 	list = get_gcpu_observers(e, gcpu);
 	if (NULL != list) {
-		registered = event_register_internal(list, e, call);
+		registered = event_register_internal(list, e, call,
+			&event_mgr.gcpu_observed);
 	}
 	return registered;
 }
 
+boolean_t event_guest_register(mon_event_t e,                   /* in: event */
+			       guest_handle_t guest,            /* in: guest handle */
+			       event_callback_t call)           /* in: callback to register on event e */
+{
+	event_entry_t *list;
+	boolean_t registered = FALSE;
+
+	if (call == 0) {
+		return FALSE;
+	}
+	if (e >= EVENTS_COUNT) {
+		return FALSE;
+	}
+	if (0 == (events_characteristics[e].scope & EVENT_GUEST_SCOPE)) {
+		return FALSE;
+	}
+
+	list = get_guest_observers(e, guest);
+	if (NULL != list) {
+		registered = event_register_internal(list, e, call,
+			&event_mgr.guest_observed);
+	}
+	return registered;
+}
+
+boolean_t event_global_unregister(mon_event_t e,                /* in: event */
+				  event_callback_t call)        /* in: callback to unregister from event e */
+{
+	event_entry_t *list;
+
+	if (call == 0) {
+		return FALSE;
+	}
+	if (e >= EVENTS_COUNT) {
+		return FALSE;
+	}
+	list = get_global_observers(e);
+	return event_unregister_internal(list, e, call);
+}
+
+boolean_t event_guest_unregister(mon_event_t e,                 /* in: event */
+				 guest_handle_t guest,          /* in: guest handle */
+				 event_callback_t call)         /* in: callback to unregister from event e */
+{
+	event_entry_t *list;
+	boolean_t unregistered = FALSE;
+
+	if (call == 0) {
+		return FALSE;
+	}
+	if (e >= EVENTS_COUNT) {
+		return FALSE;
+	}
+
+	list = get_guest_observers(e, guest);
+	if (NULL != list) {
+		unregistered = event_unregister_internal(list, e, call);
+	}
+	return unregistered;
+}
+
 boolean_t event_raise_internal(event_entry_t *p_event,
-			       mon_event_t e,                   /* in: event */
 			       guest_cpu_handle_t gcpu,         /* in: guest cpu */
 			       void *p)                         /* in: pointer to event specific structure */
 {
-	uint32_t i = 0;
-	uint32_t observers_limits;
-	event_callback_t call[OBSERVERS_LIMIT];
+	/* slots may change under the walk, each one is read once */
+	event_callback_t *call = p_event->observers;
 	boolean_t event_is_handled = FALSE;
 
-	observers_limits = event_observers_limit(e);
+	if (call == NULL) {
+		return FALSE;
+	}
 
-	lock_acquire_readlock(&p_event->lock);
-	MON_ASSERT(observers_limits <= OBSERVERS_LIMIT);
-	mon_memcpy(call, p_event->call, sizeof(call));
-	lock_release_readlock(&p_event->lock);
+	while (*call) {
+		event_callback_t observer = *call;
 
-	while (i < observers_limits && call[i]) {
-		call[i] (gcpu, p);
-		event_is_handled = TRUE;
-		++i;
+		if (observer != event_observer_removed) {
+			observer(gcpu, p);
+			event_is_handled = TRUE;
+		}
+		++call;
 	}
 
 	return event_is_handled;
@@ -472,7 +567,7 @@ boolean_t event_global_raise(mon_event_t e,             /* in: event */
 	event_entry_t *list;
 
 	list = get_global_observers(e);
-	return event_raise_internal(list, e, gcpu, p);
+	return event_raise_internal(list, gcpu, p);
 }
 
 boolean_t event_guest_raise(mon_event_t e,              /* in: event */
@@ -489,7 +584,7 @@ boolean_t event_guest_raise(mon_event_t e,              /* in: event */
 	MON_ASSERT(guest);
 	list = get_guest_observers(e, guest);
 	if (NULL != list) {
-		event_handled = event_raise_internal(list, e, gcpu, p);
+		event_handled = event_raise_internal(list, gcpu, p);
 	}
 	return event_handled;
 }
@@ -503,7 +598,7 @@ boolean_t event_gcpu_raise(mon_event_t e,               /* in: event */
 
 	list = get_gcpu_observers(e, gcpu);
 	if (NULL != list) {
-		event_handled = event_raise_internal(list, e, gcpu, p);
+		event_handled = event_raise_internal(list, gcpu, p);
 	}
 
 	return event_handled;
@@ -518,18 +613,23 @@ boolean_t event_raise(mon_event_t e,                    /* in: event */
 	MON_ASSERT(e < EVENTS_COUNT);
 
 	if (e < EVENTS_COUNT) {
-		if (NULL != gcpu) {
+		/* skip the lookups of scopes nobody observes the event in */
+		if ((NULL != gcpu) &&
+		    BIT_GET64(event_mgr.gcpu_observed, e)) {
 			/* try to raise GCPU-scope event */
 			raised = event_gcpu_raise(e, gcpu, p);
 		}
 
-		if (NULL != gcpu) {
+		if ((NULL != gcpu) &&
+		    BIT_GET64(event_mgr.guest_observed, e)) {
 			/* try to raise GUEST-scope event */
 			raised = raised || event_guest_raise(e, gcpu, p);
 		}
 
 		/* try to raise global-scope event */
-		raised = raised || event_global_raise(e, gcpu, p);
+		if (BIT_GET64(event_mgr.global_observed, e)) {
+			raised = raised || event_global_raise(e, gcpu, p);
+		}
 	}
 	return raised;
 }
@@ -19,6 +19,7 @@
 #include <hash64_api.h>
 #include <common_libc.h>
 #include <mon_dbg.h>
+#include <hw_interlocked.h>
 #include "hash64.h"
 #include "file_codes.h"
 
@@ -148,6 +149,227 @@ boolean_t hash64_insert_internal(hash64_table_t *hash,
 	return TRUE;
 }
 
+/*
+ * Open addressing hash - linear probing, backward shift deletion.
+ *
+ * Writers are serialized by the caller. Each modification makes the
+ * generation odd for its duration; a lock-free reader retries when it
+ * started during a modification or the generation changed meanwhile.
+ * A reader may still walk a slot array replaced by a resize, so replaced
+ * arrays are never freed while the hash exists. They are chained from the
+ * new array and released by hash64_destroy(); since the hash only grows by
+ * doubling, they take less memory than the current array.
+ */
+#define HASH64_OPEN_MIN_SIZE            16
+#define HASH64_OPEN_MAX_LOAD_PERCENT    75
+#define HASH64_OPEN_TABLE_MEM_SIZE(__size) \
+	(sizeof(hash64_open_table_t) + sizeof(hash64_slot_t) * ((__size) - 1))
+
+INLINE uint32_t hash64_open_home_slot(uint64_t key, uint32_t size)
+{
+	/* multiplicative hashing, size is a power of 2 */
+	return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & (size - 1);
+}
+
+INLINE void hash64_open_write_begin(hash64_table_t *hash)
+{
+	hash->generation++;
+	hw_compiler_barrier();
+}
+
+INLINE void hash64_open_write_end(hash64_table_t *hash)
+{
+	hw_compiler_barrier();
+	hash->generation++;
+}
+
+static
+uint32_t hash64_open_round_size(uint32_t hash_size)
+{
+	uint32_t size = HASH64_OPEN_MIN_SIZE;
+
+	while (size < hash_size)
+		size <<= 1;
+	return size;
+}
+
+static
+boolean_t hash64_open_find(hash64_open_table_t *table,
+			   uint64_t key,
+			   uint32_t *slot_index)
+{
+	uint32_t mask = table->size - 1;
+	uint32_t i = hash64_open_home_slot(key, table->size);
+	uint32_t probes;
+
+	for (probes = 0; probes < table->size; probes++) {
+		if (!table->slots[i].in_use) {
+			return FALSE;
+		}
+		if (table->slots[i].key == key) {
+			*slot_index = i;
+			return TRUE;
+		}
+		i = (i + 1) & mask;
+	}
+	return FALSE;
+}
+
+/* key must not be in the table, table must not be full */
+static
+void hash64_open_place(hash64_open_table_t *table,
+		       uint64_t key,
+		       uint64_t value)
+{
+	uint32_t mask = table->size - 1;
+	uint32_t i = hash64_open_home_slot(key, table->size);
+
+	while (table->slots[i].in_use)
+		i = (i + 1) & mask;
+
+	table->slots[i].key = key;
+	table->slots[i].value = value;
+	table->slots[i].in_use = TRUE;
+}
+
+static
+boolean_t hash64_open_resize(hash64_table_t *hash, uint32_t new_size)
+{
+	hash64_open_table_t *old_table = hash->open_table;
+	hash64_open_table_t *new_table;
+	uint32_t i;
+
+	MON_ASSERT(new_size >= hash64_get_element_count(hash));
+
+	new_table = (hash64_open_table_t *)hash64_mem_alloc(hash,
+		(uint32_t)HASH64_OPEN_TABLE_MEM_SIZE(new_size));
+	if (new_table == NULL) {
+		return FALSE;
+	}
+	mon_zeromem(new_table, HASH64_OPEN_TABLE_MEM_SIZE(new_size));
+	new_table->size = new_size;
+	new_table->retired = old_table;
+
+	for (i = 0; i < old_table->size; i++) {
+		if (old_table->slots[i].in_use) {
+			hash64_open_place(new_table, old_table->slots[i].key,
+				old_table->slots[i].value);
+		}
+	}
+
+	hash64_open_write_begin(hash);
+	hash->open_table = new_table;
+	hash64_set_hash_size(hash, new_size);
+	hash64_open_write_end(hash);
+
+	return TRUE;
+}
+
+static
+boolean_t hash64_open_insert(hash64_table_t *hash,
+			     uint64_t key,
+			     uint64_t value,
+			     boolean_t update_when_found)
+{
+	hash64_open_table_t *table = hash->open_table;
+	uint32_t element_count = hash64_get_element_count(hash);
+	uint32_t slot_index;
+
+	if (hash64_open_find(table, key, &slot_index)) {
+		MON_ASSERT(update_when_found);
+		hash64_open_write_begin(hash);
+		table->slots[slot_index].value = value;
+		hash64_open_write_end(hash);
+		return TRUE;
+	}
+
+	if ((element_count + 1) * 100 >
+	    table->size * HASH64_OPEN_MAX_LOAD_PERCENT) {
+		/* if grow fails, keep going while there is a free slot */
+		if (!hash64_open_resize(hash, table->size * 2) &&
+		    (element_count + 1 >= table->size)) {
+			return FALSE;
+		}
+		table = hash->open_table;
+	}
+
+	hash64_open_write_begin(hash);
+	hash64_open_place(table, key, value);
+	hash64_inc_element_count(hash);
+	hash64_open_write_end(hash);
+	return TRUE;
+}
+
+static
+boolean_t hash64_open_remove(hash64_table_t *hash, uint64_t key)
+{
+	hash64_open_table_t *table = hash->open_table;
+	uint32_t mask = table->size - 1;
+	uint32_t i;
+	uint32_t j;
+	uint32_t home;
+
+	if (!hash64_open_find(table, key, &i)) {
+		return FALSE;
+	}
+
+	hash64_open_write_begin(hash);
+	/* shift back following entries of the cluster, which may be placed
+	 * into the freed slot */
+	for (j = (i + 1) & mask; table->slots[j].in_use; j = (j + 1) & mask) {
+		home = hash64_open_home_slot(table->slots[j].key, table->size);
+		/* entry stays if its home slot is cyclically in (i, j] */
+		if ((i <= j) ? ((i < home) && (home <= j)) :
+		    ((i < home) || (home <= j))) {
+			continue;
+		}
+		table->slots[i] = table->slots[j];
+		i = j;
+	}
+	table->slots[i].in_use = FALSE;
+	MON_ASSERT(hash64_get_element_count(hash) > 0);
+	hash64_dec_element_count(hash);
+	hash64_open_write_end(hash);
+	return TRUE;
+}
+
+static
+boolean_t hash64_open_lookup(hash64_table_t *hash,
+			     uint64_t key,
+			     uint64_t *value)
+{
+	hash64_open_table_t *table;
+	uint32_t generation;
+	uint32_t slot_index;
+	uint64_t found_value = 0;
+	boolean_t found;
+
+	for (;; ) {
+		generation = hash->generation;
+		if (generation & 1) {
+			hw_pause();
+			continue;
+		}
+		hw_compiler_barrier();
+
+		table = hash->open_table;
+		found = hash64_open_find(table, key, &slot_index);
+		if (found) {
+			found_value = table->slots[slot_index].value;
+		}
+
+		hw_compiler_barrier();
+		if (generation == hash->generation) {
+			break;
+		}
+	}
+
+	if (found) {
+		*value = found_value;
+	}
+	return found;
+}
+
 static
 hash64_handle_t hash64_create_hash_internal(func_hash64_t hash_func,
 					    func_hash64_internal_mem_allocation_t mem_alloc_func,
@@ -205,6 +427,8 @@ hash64_handle_t hash64_create_hash_internal(func_hash64_t hash_func,
 	hash64_set_allocation_deallocation_context(hash,
 		node_allocation_deallocation_context);
 	hash64_clear_element_count(hash);
+	hash->is_open_addressing = FALSE;
+	hash->generation = 0;
 	if (is_multiple_values_hash) {
 		hash64_set_multiple_values_hash(hash);
 	} else {
@@ -231,6 +455,19 @@ void hash64_destroy_hash_internal(hash64_table_t *hash)
 	hash64_node_t **array;
 	uint32_t i;
 
+	if (hash64_is_open_addressing(hash)) {
+		hash64_open_table_t *table = hash->open_table;
+		hash64_open_table_t *retired;
+
+		while (table != NULL) {
+			retired = table->retired;
+			hash64_mem_free(hash, table);
+			table = retired;
+		}
+		hash64_mem_free(hash, hash);
+		return;
+	}
+
 	array = hash64_get_array(hash);
 	mem_dealloc_func = hash64_get_mem_dealloc_func(hash);
 	node_dealloc_func = hash64_get_node_dealloc_func(hash);
@@ -337,12 +574,41 @@ void hash64_default_node_dealloc_func(void *context UNUSED, void *data)
 
 hash64_handle_t hash64_create_default_hash(uint32_t hash_size)
 {
-	return hash64_create_hash(hash64_default_hash_func,
-		NULL,
-		NULL,
-		hash64_default_node_alloc_func,
-		hash64_default_node_dealloc_func,
-		NULL, hash_size);
+	return hash64_create_open_hash(hash_size);
+}
+
+hash64_handle_t hash64_create_open_hash(uint32_t hash_size)
+{
+	hash64_table_t *hash;
+	uint32_t size = hash64_open_round_size(hash_size);
+
+	hash = (hash64_table_t *)mon_memory_alloc(sizeof(hash64_table_t));
+	if (hash == NULL) {
+		return HASH64_INVALID_HANDLE;
+	}
+
+	hash->open_table = (hash64_open_table_t *)mon_memory_alloc(
+		(uint32_t)HASH64_OPEN_TABLE_MEM_SIZE(size));
+	if (hash->open_table == NULL) {
+		mon_memory_free(hash);
+		return HASH64_INVALID_HANDLE;
+	}
+	hash->open_table->size = size;
+	hash->open_table->retired = NULL;
+
+	hash64_set_hash_size(hash, size);
+	hash64_set_hash_func(hash, hash64_default_hash_func);
+	hash64_set_mem_alloc_func(hash, NULL);
+	hash64_set_mem_dealloc_func(hash, NULL);
+	hash64_set_node_alloc_func(hash, hash64_default_node_alloc_func);
+	hash64_set_node_dealloc_func(hash, hash64_default_node_dealloc_func);
+	hash64_set_allocation_deallocation_context(hash, NULL);
+	hash64_clear_element_count(hash);
+	hash64_set_single_value_hash(hash);
+	hash->is_open_addressing = TRUE;
+	hash->generation = 0;
+
+	return (hash64_handle_t)hash;
 }
 
 boolean_t hash64_lookup(hash64_handle_t hash_handle,
@@ -356,6 +622,10 @@ boolean_t hash64_lookup(hash64_handle_t hash_handle,
 		return FALSE;
 	}
 
+	if (hash64_is_open_addressing(hash)) {
+		return hash64_open_lookup(hash, key, value);
+	}
+
 	node = hash64_find(hash, key);
 	if (node != NULL) {
 		MON_ASSERT(hash64_node_get_key(node) == key);
@@ -375,6 +645,10 @@ boolean_t hash64_insert(hash64_handle_t hash_handle,
 		return FALSE;
 	}
 
+	if (hash64_is_open_addressing(hash)) {
+		return hash64_open_insert(hash, key, value, FALSE);
+	}
+
 	return hash64_insert_internal(hash, key, value, FALSE);
 }
 
@@ -388,6 +662,10 @@ boolean_t hash64_update(hash64_handle_t hash_handle,
 		return FALSE;
 	}
 
+	if (hash64_is_open_addressing(hash)) {
+		return hash64_open_insert(hash, key, value, TRUE);
+	}
+
 	return hash64_insert_internal(hash, key, value, TRUE);
 }
 
@@ -401,6 +679,10 @@ boolean_t hash64_remove(hash64_handle_t hash_handle, uint64_t key)
 		return FALSE;
 	}
 
+	if (hash64_is_open_addressing(hash)) {
+		return hash64_open_remove(hash, key);
+	}
+
 	MON_ASSERT(hash64_find(hash, key) != NULL);
 
 	cell = hash64_retrieve_appropriate_array_cell(hash, key);
@@ -460,6 +742,14 @@ boolean_t hash64_change_size_and_rehash(hash64_handle_t hash_handle,
 		return FALSE;
 	}
 
+	if (hash64_is_open_addressing(hash)) {
+		hash_size = hash64_open_round_size(hash_size);
+		if (hash_size <= hash64_get_hash_size(hash)) {
+			return TRUE;
+		}
+		return hash64_open_resize(hash, hash_size);
+	}
+
 	new_array =
 		(hash64_node_t **)hash64_mem_alloc(hash,
 			sizeof(hash64_node_t *) * hash_size);
@@ -533,6 +823,20 @@ void hash64_print(hash64_handle_t hash_handle)
 	MON_LOG(mask_anonymous, level_trace, "Num of elements: %d\n",
 		hash64_get_element_count(hash));
 
+	if (hash64_is_open_addressing(hash)) {
+		hash64_open_table_t *table = hash->open_table;
+
+		for (i = 0; i < table->size; i++) {
+			if (table->slots[i].in_use) {
+				MON_LOG(mask_anonymous, level_trace,
+					"[%d]: (%P : %P)\n", i,
+					table->slots[i].key,
+					table->slots[i].value);
+			}
+		}
+		return;
+	}
+
 	array = hash64_get_array(hash);
 	for (i = 0; i < hash64_get_hash_size(hash); i++) {
 		if (array[i] != NULL) {
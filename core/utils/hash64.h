@@ -56,8 +56,26 @@ INLINE void hash64_node_set_value(hash64_node_t *cell, uint64_t value)
 	cell->value = value;
 }
 
+/* slot of open addressing hash */
+typedef struct {
+	uint64_t	key;
+	uint64_t	value;
+	uint64_t	in_use;
+} hash64_slot_t;
+
+/* slots array of open addressing hash together with its size, replaced
+ * as a whole when the hash grows. Replaced arrays are kept on the retired
+ * list of the current one until the hash is destroyed */
+typedef struct hash64_open_table_t {
+	struct hash64_open_table_t	*retired;
+	uint32_t			size;
+	uint32_t			padding; /* not in use */
+	hash64_slot_t			slots[1];
+} hash64_open_table_t;
+
 typedef struct {
 	hash64_node_t				**array;
+	hash64_open_table_t			*open_table;
 	func_hash64_t				hash_func;
 	func_hash64_internal_mem_allocation_t	mem_alloc_func;
 	func_hash64_internal_mem_deallocation_t mem_dealloc_func;
@@ -67,6 +85,8 @@ typedef struct {
 	uint32_t				size;
 	uint32_t				element_count;
 	boolean_t				is_multiple_values_hash;
+	boolean_t				is_open_addressing;
+	volatile uint32_t			generation;
 	uint32_t				padding; /* not in use */
 } hash64_table_t;
 
@@ -198,4 +218,9 @@ INLINE void hash64_set_single_value_hash(hash64_table_t *hash)
 	hash->is_multiple_values_hash = FALSE;
 }
 
+INLINE boolean_t hash64_is_open_addressing(hash64_table_t *hash)
+{
+	return hash->is_open_addressing;
+}
+
 #endif
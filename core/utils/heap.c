@@ -18,6 +18,7 @@
 #include "common_libc.h"
 #include "lock.h"
 #include "heap.h"
+#include "hw_utils.h"
 #include "mon_dbg.h"
 #include "file_codes.h"
 
@@ -48,13 +49,22 @@ typedef struct {
 
 #define HEAP_MAX_NUM_OF_RECORDED_CALLBACKS 20
 
+/*
+ * Free blocks are kept in segregated free lists: list N holds the blocks of
+ * 2^N..2^(N+1)-1 pages. The first and the last page descriptors of a free
+ * block both hold the block size, so a released buffer is coalesced with
+ * its neighbors without scanning. All pages of a free block have in_use=0.
+ */
+#define HEAP_FREE_LISTS         31
+#define HEAP_INVALID_PAGE       ((HEAP_PAGE_INT)-1)
+
 static heap_page_descriptor_t *heap_array;
 /* address at which the heap is located */
 static address_t heap_base;
 /* actual number of pages */
 static HEAP_PAGE_INT heap_total_pages;
 static uint32_t heap_total_size;
-static mon_lock_t heap_lock;
+static mon_mcs_lock_t heap_lock;
 static free_mem_callback_desc_t
 	free_mem_callbacks[HEAP_MAX_NUM_OF_RECORDED_CALLBACKS];
 static uint32_t num_of_registered_callbacks;
@@ -65,8 +75,95 @@ static HEAP_PAGE_INT ex_heap_pages;
 static HEAP_PAGE_INT ex_heap_start_page;
 static HEAP_PAGE_INT max_used_pages;
 
+static HEAP_PAGE_INT heap_free_list[HEAP_FREE_LISTS];
+/* bit N is set when heap_free_list[N] is not empty */
+static uint32_t heap_free_list_bitmap;
+
 extern uint32_t g_heap_pa_num;
 
+static uint32_t heap_free_list_index(HEAP_PAGE_INT number_of_pages)
+{
+	uint32_t index = 0;
+
+	hw_scan_bit_backward(&index, number_of_pages);
+	return index;
+}
+
+static void heap_free_list_insert(HEAP_PAGE_INT first_page,
+				  HEAP_PAGE_INT number_of_pages)
+{
+	uint32_t index = heap_free_list_index(number_of_pages);
+	HEAP_PAGE_INT last_page = first_page + number_of_pages - 1;
+
+	heap_array[first_page].in_use = 0;
+	heap_array[first_page].number_of_pages = number_of_pages;
+	heap_array[last_page].in_use = 0;
+	heap_array[last_page].number_of_pages = number_of_pages;
+
+	heap_array[first_page].prev_free = HEAP_INVALID_PAGE;
+	heap_array[first_page].next_free = heap_free_list[index];
+	if (HEAP_INVALID_PAGE != heap_free_list[index]) {
+		heap_array[heap_free_list[index]].prev_free = first_page;
+	}
+	heap_free_list[index] = first_page;
+	BIT_SET(heap_free_list_bitmap, index);
+}
+
+static void heap_free_list_remove(HEAP_PAGE_INT first_page)
+{
+	uint32_t index =
+		heap_free_list_index(heap_array[first_page].number_of_pages);
+	HEAP_PAGE_INT next = heap_array[first_page].next_free;
+	HEAP_PAGE_INT prev = heap_array[first_page].prev_free;
+
+	if (HEAP_INVALID_PAGE != prev) {
+		heap_array[prev].next_free = next;
+	} else {
+		MON_ASSERT(heap_free_list[index] == first_page);
+		heap_free_list[index] = next;
+		if (HEAP_INVALID_PAGE == next) {
+			BIT_CLR(heap_free_list_bitmap, index);
+		}
+	}
+	if (HEAP_INVALID_PAGE != next) {
+		heap_array[next].prev_free = prev;
+	}
+}
+
+/* returns first page of a free block of at least number_of_pages pages or
+ * HEAP_INVALID_PAGE */
+static HEAP_PAGE_INT heap_free_list_find(HEAP_PAGE_INT number_of_pages)
+{
+	uint32_t index = heap_free_list_index(number_of_pages);
+	uint32_t larger_lists;
+	HEAP_PAGE_INT page;
+
+	/* blocks in the list of the same order may be too small */
+	for (page = heap_free_list[index]; page != HEAP_INVALID_PAGE;
+	     page = heap_array[page].next_free) {
+		if (heap_array[page].number_of_pages >= number_of_pages) {
+			return page;
+		}
+	}
+
+	/* any block of higher order fits */
+	larger_lists = (index + 1 < HEAP_FREE_LISTS) ?
+		       heap_free_list_bitmap & ~((2u << index) - 1) : 0;
+	if (hw_scan_bit_forward(&index, larger_lists)) {
+		return heap_free_list[index];
+	}
+	return HEAP_INVALID_PAGE;
+}
+
+static void heap_free_list_reset(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < HEAP_FREE_LISTS; ++i)
+		heap_free_list[i] = HEAP_INVALID_PAGE;
+	heap_free_list_bitmap = 0;
+}
+
 HEAP_PAGE_INT mon_heap_get_total_pages(void)
 {
 	return heap_total_pages;
@@ -156,12 +253,15 @@ address_t mon_heap_initialize(IN address_t heap_buffer_address,
 
 	for (i = 0; i < heap_total_pages; ++i) {
 		heap_array[i].in_use = 0;
-		heap_array[i].number_of_pages = (heap_total_pages - i);
+		heap_array[i].number_of_pages = 0;
 	}
 
+	heap_free_list_reset();
+	heap_free_list_insert(0, heap_total_pages);
+
 	/* MON_DEBUG_CODE(mon_heap_show()); */
 
-	lock_initialize(&heap_lock);
+	mcs_lock_initialize(&heap_lock);
 
 	return heap_base + (heap_total_pages * PAGE_4KB_SIZE);
 }
@@ -181,7 +281,7 @@ address_t mon_heap_extend(IN address_t ex_heap_buffer_address,
 	size_t heap_buffer_size;
 	HEAP_PAGE_INT i;
 
-	lock_acquire(&heap_lock);
+	mcs_lock_acquire(&heap_lock);
 
 	MON_LOG(mask_anonymous, level_print_always,
 		"HEAP EXT: Max Used Initial Memory %dKB\n",
@@ -219,10 +319,14 @@ address_t mon_heap_extend(IN address_t ex_heap_buffer_address,
 
 	for (i = ex_heap_start_page + 1; i < heap_total_pages; ++i) {
 		heap_array[i].in_use = 0;
-		heap_array[i].number_of_pages = (heap_total_pages - i);
+		heap_array[i].number_of_pages = 0;
 	}
 
-	lock_release(&heap_lock);
+	if (ex_heap_pages > 1) {
+		heap_free_list_insert(ex_heap_start_page + 1, ex_heap_pages - 1);
+	}
+
+	mcs_lock_release(&heap_lock);
 
 	return ex_heap_base + (ex_heap_pages * PAGE_4KB_SIZE);
 }
@@ -243,55 +347,42 @@ static void *page_alloc_unprotected(
 {
 	HEAP_PAGE_INT i;
 	HEAP_PAGE_INT allocated_page_no;
+	HEAP_PAGE_INT free_pages;
 	void *p_buffer = NULL;
 
 	if (number_of_pages == 0) {
 		return NULL;
 	}
 
-	for (i = 0; i < heap_total_pages; ++i) {
-		if ((0 == heap_array[i].in_use) &&
-		    (number_of_pages <= heap_array[i].number_of_pages)) {
-			/* validity check */
-			MON_ASSERT(
-				(i + heap_array[i].number_of_pages) <=
-				heap_total_pages);
-
-			/* found the suitable buffer */
-			allocated_page_no = i;
-			p_buffer = HEAP_PAGE_TO_POINTER(allocated_page_no);
-			heap_array[allocated_page_no].in_use = 1;
-			heap_array[allocated_page_no].number_of_pages =
-				number_of_pages;
+	allocated_page_no = heap_free_list_find(number_of_pages);
+	if (HEAP_INVALID_PAGE != allocated_page_no) {
+		free_pages = heap_array[allocated_page_no].number_of_pages;
+		/* validity check */
+		MON_ASSERT((allocated_page_no + free_pages) <= heap_total_pages);
+
+		heap_free_list_remove(allocated_page_no);
+		/* return the tail to the free lists */
+		if (free_pages > number_of_pages) {
+			heap_free_list_insert(allocated_page_no + number_of_pages,
+				free_pages - number_of_pages);
+		}
+
+		p_buffer = HEAP_PAGE_TO_POINTER(allocated_page_no);
+		heap_array[allocated_page_no].in_use = 1;
+		heap_array[allocated_page_no].number_of_pages = number_of_pages;
 #ifdef DEBUG
-			heap_array[i].file_name = file_name;
-			heap_array[i].line_number = line_number;
+		heap_array[allocated_page_no].file_name = file_name;
+		heap_array[allocated_page_no].line_number = line_number;
 #endif
-			/* MON_LOG(mask_anonymous, level_trace,"HEAP: Successfully
-			 * allocated %d pages at %P\n", number_of_pages, p_buffer);
-			 * MON_LOG(mask_anonymous, level_trace,"HEAP
-			 * page_alloc_unprotected: i=%d, heap_array[i].in_use=%d
-			 * heap_array[i].number_of_pages=%d\n", i, heap_array[i].in_use,
-			 * heap_array[i].number_of_pages); */
-			/* mark next number_of_pages-1 pages as in_use */
-			for (i = allocated_page_no + 1;
-			     i < (allocated_page_no + number_of_pages); ++i) {
-				heap_array[i].in_use = 1;
-				heap_array[i].number_of_pages = 0;
-			}
-
-			if (max_used_pages <
-			    (allocated_page_no + number_of_pages)) {
-				max_used_pages = allocated_page_no +
-						 number_of_pages;
-			}
-			/* MON_LOG(mask_anonymous, level_trace,"HEAP next free: i=%d,
-			 * heap_array[i].in_use=%d heap_array[i].number_of_pages=%d\n", i,
-			 * heap_array[i].in_use, heap_array[i].number_of_pages); */
+		/* mark next number_of_pages-1 pages as in_use */
+		for (i = allocated_page_no + 1;
+		     i < (allocated_page_no + number_of_pages); ++i) {
+			heap_array[i].in_use = 1;
+			heap_array[i].number_of_pages = 0;
+		}
 
-			/* MON_DEBUG_CODE(mon_heap_show()); */
-			/* leave the outer loop */
-			break;
+		if (max_used_pages < (allocated_page_no + number_of_pages)) {
+			max_used_pages = allocated_page_no + number_of_pages;
 		}
 	}
 
@@ -321,13 +412,13 @@ void *mon_page_allocate(
 {
 	void *p_buffer = NULL;
 
-	lock_acquire(&heap_lock);
+	mcs_lock_acquire(&heap_lock);
 	p_buffer = page_alloc_unprotected(
 #ifdef DEBUG
 		file_name, line_number,
 #endif
 		number_of_pages);
-	lock_release(&heap_lock);
+	mcs_lock_release(&heap_lock);
 
 	return p_buffer;
 }
@@ -350,7 +441,7 @@ HEAP_PAGE_INT mon_page_allocate_scattered(
 	HEAP_PAGE_INT i;
 	HEAP_PAGE_INT number_of_allocated_pages;
 
-	lock_acquire(&heap_lock);
+	mcs_lock_acquire(&heap_lock);
 
 	for (i = 0; i < number_of_pages; ++i) {
 		p_page_array[i] = page_alloc_unprotected(
@@ -370,7 +461,7 @@ HEAP_PAGE_INT mon_page_allocate_scattered(
 			break;
 		}
 	}
-	lock_release(&heap_lock);
+	mcs_lock_release(&heap_lock);
 
 	number_of_allocated_pages = i;
 
@@ -381,15 +472,13 @@ HEAP_PAGE_INT mon_page_allocate_scattered(
 }
 
 static void mon_mark_pages_free(HEAP_PAGE_INT page_from,
-				HEAP_PAGE_INT page_to,
-				HEAP_PAGE_INT pages_to_release)
+				HEAP_PAGE_INT page_to)
 {
 	HEAP_PAGE_INT i;
 
 	for (i = page_from; i < page_to; ++i) {
 		heap_array[i].in_use = 0;
-		heap_array[i].number_of_pages = pages_to_release -
-						(i - page_from);
+		heap_array[i].number_of_pages = 0;
 	}
 }
 
@@ -422,7 +511,7 @@ void mon_page_free(IN void *p_buffer)
 		MON_DEADLOOP();
 		return;
 	}
-	lock_acquire(&heap_lock);
+	mcs_lock_acquire(&heap_lock);
 
 	release_from_page_id = HEAP_POINTER_TO_PAGE(p_buffer);
 
@@ -442,12 +531,12 @@ void mon_page_free(IN void *p_buffer)
 	}
 
 	pages_to_release = heap_array[release_from_page_id].number_of_pages;
+	release_to_page_id = release_from_page_id + pages_to_release;
+
+	mon_mark_pages_free(release_from_page_id, release_to_page_id);
 
 	/* check if the next to the last released page is free */
 	/* and if so merge both regions */
-
-	release_to_page_id = release_from_page_id + pages_to_release;
-
 	if (release_to_page_id < heap_total_pages &&
 	    0 == heap_array[release_to_page_id].in_use &&
 	    (release_to_page_id +
@@ -455,21 +544,26 @@ void mon_page_free(IN void *p_buffer)
 	    heap_total_pages) {
 		pages_to_release +=
 			heap_array[release_to_page_id].number_of_pages;
+		heap_free_list_remove(release_to_page_id);
 	}
 
-	/* move backward, to grab all free pages, trying to prevent fragmentation.
-	 * 3rd check is for sanity only */
-	while (release_from_page_id > 0 &&
-	       0 == heap_array[release_from_page_id - 1].in_use &&
-	       0 != heap_array[release_from_page_id - 1].number_of_pages) {
-		release_from_page_id--;
-		pages_to_release++;
+	/* the page before is the last page of the previous block. If the block
+	 * is free, it keeps the block size, merge both regions */
+	if (release_from_page_id > 0 &&
+	    0 == heap_array[release_from_page_id - 1].in_use) {
+		HEAP_PAGE_INT prev_pages =
+			heap_array[release_from_page_id - 1].number_of_pages;
+
+		/* sanity check */
+		MON_ASSERT(prev_pages != 0 && prev_pages <= release_from_page_id);
+		release_from_page_id -= prev_pages;
+		pages_to_release += prev_pages;
+		heap_free_list_remove(release_from_page_id);
 	}
 
-	mon_mark_pages_free(release_from_page_id, release_to_page_id,
-		pages_to_release);
+	heap_free_list_insert(release_from_page_id, pages_to_release);
 
-	lock_release(&heap_lock);
+	mcs_lock_release(&heap_lock);
 }
 
 /*-------------------------------------------------------*
@@ -548,7 +642,7 @@ void *mon_memory_allocate(
 		(HEAP_PAGE_INT)(size / PAGE_4KB_SIZE));
 
 	if (NULL != p_buffer) {
-		mon_memset(p_buffer, 0, size);
+		mon_zero_pages(p_buffer, size / PAGE_4KB_SIZE);
 	}
 
 	return p_buffer;
@@ -171,6 +171,304 @@ void lock_release_writelock(mon_read_write_lock_t *lock)
 	lock_release(&lock->lock);
 }
 
+/*
+ * Contention statistics
+ */
+INLINE void lock_stats_acquired(mon_lock_stats_t *stats, uint64_t spins)
+{
+	stats->acquisitions++;
+	if (spins != 0) {
+		stats->contended++;
+		stats->spins += spins;
+	}
+	stats->acquire_tsc = hw_rdtsc();
+}
+
+INLINE void lock_stats_released(mon_lock_stats_t *stats)
+{
+	uint64_t hold_tsc = hw_rdtsc() - stats->acquire_tsc;
+
+	if (hold_tsc > stats->max_hold_tsc) {
+		stats->max_hold_tsc = hold_tsc;
+	}
+}
+
+/* Wait loop body, returns after one unit of waiting */
+INLINE void lock_wait(boolean_t interruptible)
+{
+	if (!interruptible || !ipc_process_one_ipc()) {
+		hw_pause();
+	}
+}
+
+/*
+ * MCS queued spinlock
+ *
+ * The lock tail holds a 32-bit code of the last queued node, 0 when the
+ * lock is free, so the queue can be appended with a 32-bit exchange.
+ *
+ * Before its per-CPU data is set up, hw_cpu_id() of a CPU cannot index the
+ * node array. Such a CPU only takes a free lock, setting the tail to
+ * MCS_ANONYMOUS_CODE. The first waiter queued behind it has no node to
+ * link to, so it waits for the handoff flag of the lock instead.
+ */
+typedef struct {
+	volatile uint32_t	next;   /* code of the next waiter, 0 if none */
+	volatile uint32_t	locked;
+	uint32_t		padding[14];
+} mon_mcs_node_t;
+
+#define MCS_NODE_MASK                   ((1 << MCS_NODES_PER_CPU) - 1)
+#define MCS_NODE_CODE(__cpu, __index)   \
+	(((uint32_t)(__cpu) + 1) * MCS_NODES_PER_CPU + (__index))
+#define MCS_NODE_FROM_CODE(__code)      \
+	(&mcs_nodes[(__code) / MCS_NODES_PER_CPU - 1] \
+	 [(__code) % MCS_NODES_PER_CPU])
+#define MCS_ANONYMOUS_CODE              ((uint32_t)-1)
+#define MCS_ANONYMOUS_NODE              MCS_NODES_PER_CPU
+
+static ALIGN_N(mon_mcs_node_t, mcs_nodes[MAX_CPUS][MCS_NODES_PER_CPU], 64);
+/* per-CPU mask of the queue nodes in use, touched only by the owning CPU */
+static uint32_t mcs_nodes_in_use[MAX_CPUS];
+
+void mcs_lock_initialize(mon_mcs_lock_t *lock)
+{
+	lock->tail = 0;
+	lock->owner_cpu_id = (cpu_id_t)-1;
+	lock->owner_node = 0;
+	lock->handoff = FALSE;
+	mon_zeromem(&lock->stats, sizeof(lock->stats));
+}
+
+static
+void mcs_lock_acquire_internal(mon_mcs_lock_t *lock, boolean_t interruptible)
+{
+	cpu_id_t this_cpu_id = hw_cpu_id();
+	mon_mcs_node_t *node;
+	uint32_t node_index;
+	uint32_t code;
+	uint32_t prev_code;
+	uint64_t spins = 0;
+
+	MON_ASSERT_NOLOCK(lock->owner_cpu_id != this_cpu_id);
+
+	if (this_cpu_id >= MAX_CPUS) {
+		/* no queue node for this CPU, spin until the lock is free */
+		while ((uint32_t)hw_interlocked_compare_exchange(
+			       (volatile int32_t *)&lock->tail, 0,
+			       (int32_t)MCS_ANONYMOUS_CODE) != 0) {
+			lock_wait(interruptible);
+			spins++;
+		}
+		node_index = MCS_ANONYMOUS_NODE;
+		goto acquired;
+	}
+
+	if (!hw_scan_bit_forward(&node_index,
+		    ~mcs_nodes_in_use[this_cpu_id] & MCS_NODE_MASK)) {
+		/* too many MCS locks held by this CPU */
+		MON_DEADLOOP();
+	}
+	mcs_nodes_in_use[this_cpu_id] |= BIT_VALUE(node_index);
+
+	node = &mcs_nodes[this_cpu_id][node_index];
+	node->next = 0;
+	node->locked = TRUE;
+	code = MCS_NODE_CODE(this_cpu_id, node_index);
+
+	prev_code = (uint32_t)hw_interlocked_assign(
+		(volatile int32_t *)&lock->tail, (int32_t)code);
+	if (prev_code == MCS_ANONYMOUS_CODE) {
+		/* the owner has no node to link to */
+		while (!lock->handoff) {
+			lock_wait(interruptible);
+			spins++;
+		}
+		lock->handoff = FALSE;
+	} else if (prev_code != 0) {
+		/* queue behind the previous waiter and spin locally */
+		MCS_NODE_FROM_CODE(prev_code)->next = code;
+		while (node->locked) {
+			lock_wait(interruptible);
+			spins++;
+		}
+	}
+
+acquired:
+	hw_compiler_barrier();
+
+	lock->owner_cpu_id = this_cpu_id;
+	lock->owner_node = (uint16_t)node_index;
+	lock_stats_acquired(&lock->stats, spins);
+}
+
+void mcs_lock_acquire(mon_mcs_lock_t *lock)
+{
+	mcs_lock_acquire_internal(lock, FALSE);
+}
+
+void interruptible_mcs_lock_acquire(mon_mcs_lock_t *lock)
+{
+	mcs_lock_acquire_internal(lock, TRUE);
+}
+
+void mcs_lock_release(mon_mcs_lock_t *lock)
+{
+	cpu_id_t this_cpu_id = lock->owner_cpu_id;
+	uint32_t node_index = lock->owner_node;
+	mon_mcs_node_t *node;
+	uint32_t code;
+
+	MON_ASSERT_NOLOCK(this_cpu_id == hw_cpu_id());
+
+	lock_stats_released(&lock->stats);
+	lock->owner_cpu_id = (cpu_id_t)-1;
+	hw_compiler_barrier();
+
+	if (node_index == MCS_ANONYMOUS_NODE) {
+		if ((uint32_t)hw_interlocked_compare_exchange(
+			    (volatile int32_t *)&lock->tail,
+			    (int32_t)MCS_ANONYMOUS_CODE, 0) !=
+		    MCS_ANONYMOUS_CODE) {
+			/* a waiter queued behind this owner */
+			lock->handoff = TRUE;
+		}
+		return;
+	}
+
+	node = &mcs_nodes[this_cpu_id][node_index];
+	code = MCS_NODE_CODE(this_cpu_id, node_index);
+
+	if (node->next == 0) {
+		if ((uint32_t)hw_interlocked_compare_exchange(
+			    (volatile int32_t *)&lock->tail, code, 0) == code) {
+			/* no waiters */
+			goto done;
+		}
+		/* a waiter swapped the tail but has not linked itself yet */
+		while (node->next == 0)
+			hw_pause();
+	}
+	MCS_NODE_FROM_CODE(node->next)->locked = FALSE;
+
+done:
+	mcs_nodes_in_use[this_cpu_id] &= ~BIT_VALUE(node_index);
+}
+
+/*
+ * Phase-fair ticket reader/writer lock (Brandenburg, Anderson)
+ *
+ * rin counts entering readers in units of PF_RW_RINC, its low bits tell
+ * whether a writer is present and its phase. Readers that see a writer
+ * wait until the writer bits change.
+ */
+#define PF_RW_RINC      0x100
+#define PF_RW_WBITS     0x3
+#define PF_RW_PRES      0x2
+#define PF_RW_PHID      0x1
+
+void pf_rw_lock_initialize(mon_pf_rw_lock_t *lock)
+{
+	lock->rin = 0;
+	lock->rout = 0;
+	lock->win = 0;
+	lock->wout = 0;
+	lock->writer_cpu_id = (cpu_id_t)-1;
+	mon_zeromem(&lock->stats, sizeof(lock->stats));
+}
+
+static
+void pf_rw_lock_acquire_readlock_internal(mon_pf_rw_lock_t *lock,
+					  boolean_t interruptible)
+{
+	uint32_t writer_bits;
+
+	MON_ASSERT_NOLOCK(lock->writer_cpu_id != hw_cpu_id());
+
+	writer_bits = (uint32_t)hw_interlocked_add(
+		(volatile int32_t *)&lock->rin, PF_RW_RINC) & PF_RW_WBITS;
+	if (writer_bits != 0) {
+		while (writer_bits == (lock->rin & PF_RW_WBITS))
+			lock_wait(interruptible);
+	}
+	hw_compiler_barrier();
+}
+
+void pf_rw_lock_acquire_readlock(mon_pf_rw_lock_t *lock)
+{
+	pf_rw_lock_acquire_readlock_internal(lock, FALSE);
+}
+
+void interruptible_pf_rw_lock_acquire_readlock(mon_pf_rw_lock_t *lock)
+{
+	pf_rw_lock_acquire_readlock_internal(lock, TRUE);
+}
+
+void pf_rw_lock_release_readlock(mon_pf_rw_lock_t *lock)
+{
+	MON_ASSERT_NOLOCK((lock->rin & ~PF_RW_WBITS) != lock->rout);
+	hw_compiler_barrier();
+	hw_interlocked_add((volatile int32_t *)&lock->rout, PF_RW_RINC);
+}
+
+static
+void pf_rw_lock_acquire_writelock_internal(mon_pf_rw_lock_t *lock,
+					   boolean_t interruptible)
+{
+	cpu_id_t this_cpu_id = hw_cpu_id();
+	uint32_t ticket;
+	uint32_t writer_bits;
+	uint32_t readers_ticket;
+	uint64_t spins = 0;
+
+	MON_ASSERT_NOLOCK(lock->writer_cpu_id != this_cpu_id);
+
+	/* hw_interlocked_add() returns the new value */
+	ticket = (uint32_t)hw_interlocked_add(
+		(volatile int32_t *)&lock->win, 1) - 1;
+	while (ticket != lock->wout) {
+		lock_wait(interruptible);
+		spins++;
+	}
+
+	/* block new readers, then wait for the readers already in */
+	writer_bits = PF_RW_PRES | (ticket & PF_RW_PHID);
+	readers_ticket = (uint32_t)hw_interlocked_add(
+		(volatile int32_t *)&lock->rin, (int32_t)writer_bits) -
+			 writer_bits;
+	while (readers_ticket != lock->rout) {
+		lock_wait(interruptible);
+		spins++;
+	}
+	hw_compiler_barrier();
+
+	lock->writer_cpu_id = this_cpu_id;
+	lock_stats_acquired(&lock->stats, spins);
+}
+
+void pf_rw_lock_acquire_writelock(mon_pf_rw_lock_t *lock)
+{
+	pf_rw_lock_acquire_writelock_internal(lock, FALSE);
+}
+
+void interruptible_pf_rw_lock_acquire_writelock(mon_pf_rw_lock_t *lock)
+{
+	pf_rw_lock_acquire_writelock_internal(lock, TRUE);
+}
+
+void pf_rw_lock_release_writelock(mon_pf_rw_lock_t *lock)
+{
+	MON_ASSERT_NOLOCK(lock->writer_cpu_id == hw_cpu_id());
+
+	lock_stats_released(&lock->stats);
+	lock->writer_cpu_id = (cpu_id_t)-1;
+	hw_compiler_barrier();
+
+	/* let the blocked readers in, then pass the lock to the next writer */
+	hw_interlocked_and((volatile int32_t *)&lock->rin, ~PF_RW_WBITS);
+	lock->wout++;
+}
+
 MON_DEBUG_CODE(
 	void lock_print(mon_lock_t *lock)
 	{
@@ -179,3 +477,13 @@ MON_DEBUG_CODE(
 			lock->uint32_lock, lock->owner_cpu_id);
 	}
 	)
+
+#ifdef DEBUG
+void lock_print_stats(const char *name, const mon_lock_stats_t *stats)
+{
+	MON_LOG(mask_anonymous, level_trace,
+		"lock %s: acquisitions=%P contended=%P spins=%P"
+		" max hold=%P ticks\r\n", name, stats->acquisitions,
+		stats->contended, stats->spins, stats->max_hold_tsc);
+}
+#endif
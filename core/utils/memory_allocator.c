@@ -113,16 +113,20 @@ void *mon_mem_allocate_internal(char *file_name,
 	pool_index = buffer_size_to_pool_index(size_to_request);
 	pool_element_size = 1 << pool_index;
 
-	lock_acquire(&lock);
+	/* pools are thread safe, the lock protects pools creation only */
 	pool = pools[pool_index];
 	if (NULL == pool) {
-		pool = pools[pool_index] =
-			       assync_pool_create((uint32_t)pool_element_size);
-		MON_ASSERT(pool);
+		lock_acquire(&lock);
+		pool = pools[pool_index];
+		if (NULL == pool) {
+			pool = pools[pool_index] =
+				       sync_pool_create((uint32_t)pool_element_size);
+			MON_ASSERT(pool);
+		}
+		lock_release(&lock);
 	}
 
 	ptr = pool_allocate(pool);
-	lock_release(&lock);
 	if (NULL == ptr) {
 		return NULL;
 	}
@@ -183,12 +187,10 @@ void mon_mem_free(char *file_name, int32_t line_number, IN void *buff)
 	pool_index = buffer_size_to_pool_index(pool_element_size);
 	allocated_buffer = (void *)((uint64_t)buff - alloc_info->offset);
 
-	lock_acquire(&lock);
 	pool = pools[pool_index];
 	MON_ASSERT(pool != NULL);
 
 	pool_free(pool, allocated_buffer);
-	lock_release(&lock);
 }
 
 void *mon_mem_allocate_aligned(char *file_name,
@@ -43,21 +43,14 @@ typedef struct {
 	vmcall_id_t		vmcall_id;
 } vmcall_entry_t;
 
+/* attached to the guest descriptor as GUEST_VMCALL_CONTROL */
 typedef struct {
 	guest_id_t	guest_id;
 	uint8_t		padding[2];
 	uint32_t	filled_entries_count;
 	vmcall_entry_t	vmcall_table[MAX_ACTIVE_VMCALLS_PER_GUEST];
-	list_element_t	list[1];
 } guest_vmcall_entries_t;
 
-typedef struct {
-	list_element_t guest_vmcall_entries[1];
-} vmcall_global_state_t;
-
-/* for all guests */
-static vmcall_global_state_t vmcall_global_state;
-
 static mon_status_t vmcall_unimplemented(guest_cpu_handle_t gcpu,
 					 address_t *arg1,
 					 address_t *arg2,
@@ -69,18 +62,12 @@ static mon_status_t vmcall_print_string(guest_cpu_handle_t gcpu,
 
 static vmexit_handling_status_t vmcall_common_handler(guest_cpu_handle_t gcpu);
 
-static guest_vmcall_entries_t *vmcall_find_guest_vmcalls(guest_id_t guest_id);
+static guest_vmcall_entries_t *vmcall_find_guest_vmcalls(guest_handle_t guest);
 
-static vmcall_entry_t *vmcall_get_vmcall_entry(guest_id_t guest_id,
+static vmcall_entry_t *vmcall_get_vmcall_entry(guest_handle_t guest,
 					       vmcall_id_t vmcall_id);
 boolean_t handle_int15_vmcall(guest_cpu_handle_t gcpu);
 
-void vmcall_intialize(void)
-{
-	mon_memset(&vmcall_global_state, 0, sizeof(vmcall_global_state));
-	list_init(vmcall_global_state.guest_vmcall_entries);
-}
-
 void vmcall_guest_intialize(guest_id_t guest_id)
 {
 	uint32_t id;
@@ -97,7 +84,8 @@ void vmcall_guest_intialize(guest_id_t guest_id)
 	guest_vmcalls->guest_id = guest_id;
 	guest_vmcalls->filled_entries_count = 0;
 
-	list_add(vmcall_global_state.guest_vmcall_entries, guest_vmcalls->list);
+	guest_set_control(mon_guest_handle(guest_id), GUEST_VMCALL_CONTROL,
+		guest_vmcalls);
 
 	vmexit_install_handler(guest_id,
 		vmcall_common_handler,
@@ -115,12 +103,13 @@ void mon_vmcall_register(guest_id_t guest_id,
 			 vmcall_id_t vmcall_id,
 			 vmcall_handler_t handler, boolean_t special_call)
 {
+	guest_handle_t guest = mon_guest_handle(guest_id);
 	vmcall_entry_t *vmcall_entry;
 
 	MON_ASSERT(NULL != handler);
 
 	/* if already exists, check that all params are the same */
-	vmcall_entry = vmcall_get_vmcall_entry(guest_id, vmcall_id);
+	vmcall_entry = vmcall_get_vmcall_entry(guest, vmcall_id);
 	if (NULL != vmcall_entry) {
 		if ((vmcall_entry->vmcall_id == vmcall_id) &&
 		    (vmcall_entry->vmcall_handler == handler) &&
@@ -135,7 +124,7 @@ void mon_vmcall_register(guest_id_t guest_id,
 		MON_ASSERT(FALSE);
 	}
 
-	vmcall_entry = vmcall_get_vmcall_entry(guest_id, UNALLOCATED_VMCALL);
+	vmcall_entry = vmcall_get_vmcall_entry(guest, UNALLOCATED_VMCALL);
 	MON_ASSERT(vmcall_entry);
 	MON_LOG(mask_mon, level_trace,
 		"vmcall_register: guest %d vmcall_id %d vmcall_entry %p\r\n",
@@ -150,7 +139,6 @@ extern uint32_t g_is_post_launch;
 vmexit_handling_status_t vmcall_common_handler(guest_cpu_handle_t gcpu)
 {
 	guest_handle_t guest = mon_gcpu_guest_handle(gcpu);
-	guest_id_t guest_id = guest_get_id(guest);
 	vmcall_id_t vmcall_id;
 	address_t arg1, arg2, arg3;
 	mon_status_t ret_value;
@@ -171,7 +159,7 @@ vmexit_handling_status_t vmcall_common_handler(guest_cpu_handle_t gcpu)
 
 	if (MON_NATIVE_VMCALL_SIGNATURE ==
 	    gcpu_get_native_gp_reg(gcpu, IA32_REG_RAX)) {
-		vmcall_entry = vmcall_get_vmcall_entry(guest_id, vmcall_id);
+		vmcall_entry = vmcall_get_vmcall_entry(guest, vmcall_id);
 	}
 
 	if (NULL != vmcall_entry) {
@@ -244,18 +232,14 @@ mon_status_t vmcall_unimplemented(guest_cpu_handle_t gcpu USED_IN_DEBUG_ONLY,
 
 
 static
-guest_vmcall_entries_t *vmcall_find_guest_vmcalls(guest_id_t guest_id)
+guest_vmcall_entries_t *vmcall_find_guest_vmcalls(guest_handle_t guest)
 {
-	list_element_t *iter = NULL;
-	guest_vmcall_entries_t *guest_vmcalls = NULL;
-
-	LIST_FOR_EACH(vmcall_global_state.guest_vmcall_entries, iter) {
-		guest_vmcalls = LIST_ENTRY(iter, guest_vmcall_entries_t, list);
-		if (guest_vmcalls->guest_id == guest_id) {
-			return guest_vmcalls;
-		}
+	if (NULL == guest) {
+		return NULL;
 	}
-	return NULL;
+
+	return (guest_vmcall_entries_t *)guest_get_control(guest,
+		GUEST_VMCALL_CONTROL);
 }
 
 static
@@ -274,13 +258,13 @@ vmcall_entry_t *find_guest_vmcall_entry(guest_vmcall_entries_t *guest_vmcalls,
 }
 
 static
-vmcall_entry_t *vmcall_get_vmcall_entry(guest_id_t guest_id,
+vmcall_entry_t *vmcall_get_vmcall_entry(guest_handle_t guest,
 					vmcall_id_t vmcall_id)
 {
 	guest_vmcall_entries_t *guest_vmcalls;
 	vmcall_entry_t *vmcall_entry;
 
-	guest_vmcalls = vmcall_find_guest_vmcalls(guest_id);
+	guest_vmcalls = vmcall_find_guest_vmcalls(guest);
 	if (NULL == guest_vmcalls) {
 		MON_ASSERT(0);
 		return NULL;
@@ -19,6 +19,7 @@
 #define MON_ASSERT(__condition) MON_ASSERT_LOG(VMEXIT_C, __condition)
 #include "mon_defs.h"
 #include "heap.h"
+#include "libc.h"
 #include "scheduler.h"
 #include "vmx_asm.h"
 #include "mon_globals.h"
@@ -44,11 +45,13 @@
 #include "isr.h"
 #include "memory_dump.h"
 #include "vmexit_dtr_tr.h"
+#include "cli.h"
+#include "hw_pcpu.h"
+#include "vmx_trace.h"
+#include "mon_api.h"
 
 boolean_t legacy_scheduling_enabled = TRUE;
 
-extern boolean_t vmcs_sw_shadow_disable[];
-
 extern vmexit_handling_status_t vmexit_cr_access(guest_cpu_handle_t gcpu);
 extern vmexit_handling_status_t vmexit_triple_fault(guest_cpu_handle_t gcpu);
 extern vmexit_handling_status_t vmexit_undefined_opcode(guest_cpu_handle_t gcpu);
@@ -56,6 +59,7 @@ extern vmexit_handling_status_t vmexit_init_event(guest_cpu_handle_t gcpu);
 extern vmexit_handling_status_t vmexit_sipi_event(guest_cpu_handle_t gcpu);
 extern vmexit_handling_status_t vmexit_task_switch(guest_cpu_handle_t gcpu);
 extern vmexit_handling_status_t vmexit_invlpg(guest_cpu_handle_t gcpu);
+extern vmexit_handling_status_t vmexit_invpcid(guest_cpu_handle_t gcpu);
 extern vmexit_handling_status_t vmexit_invd(guest_cpu_handle_t gcpu);
 extern void vmexit_check_keystroke(guest_cpu_handle_t gcpu);
 extern vmexit_handling_status_t vmexit_ept_violation(guest_cpu_handle_t gcpu);
@@ -93,33 +97,79 @@ uint32_t ASM_FUNCTION vmexit_check_ept_violation(void);
 
 extern int CLI_active(void);
 
-static
-void vmexit_bottom_up_common_handler(guest_cpu_handle_t gcpu, uint32_t reason);
+/*
+ * VMEXIT statistics are kept per host CPU. Each host CPU updates only its own
+ * block, so no interlocked operations are done on the VMEXIT path, and every
+ * block starts on its own cache line. The blocks are summed only when the
+ * statistics are requested.
+ */
+#define VMEXIT_STATS_CACHE_LINE_SIZE    64
+#define VMEXIT_STATS_HISTOGRAM_SHIFT    7
 
-static
-void vmexit_bottom_up_all_mons_skip_instruction(guest_cpu_handle_t gcpu,
-						uint32_t reason);
+typedef struct {
+	uint64_t	count;
+	uint64_t	cycles;
+	uint64_t	histogram[MON_VMEXIT_STATS_HISTOGRAM_BUCKETS];
+} vmexit_reason_stats_t;
 
-static
-void vmexit_top_down_common_handler(guest_cpu_handle_t gcpu, uint32_t reason);
+typedef struct {
+	vmexit_reason_stats_t reason[IA32_VMX_EXIT_BASIC_REASON_COUNT];
+} vmexit_cpu_stats_t;
+
+#define VMEXIT_CPU_STATS_SIZE                                          \
+	ALIGN_FORWARD(sizeof(vmexit_cpu_stats_t), VMEXIT_STATS_CACHE_LINE_SIZE)
 
+#define VMEXIT_CPU_STATS(__guest_vmexit_control, __cpu_id)             \
+	((vmexit_cpu_stats_t *)((__guest_vmexit_control)->cpu_stats +   \
+				(__cpu_id) * VMEXIT_CPU_STATS_SIZE))
+
+/* attached to the guest descriptor as GUEST_VMEXIT_CONTROL */
 typedef struct {
 	guest_id_t	 guest_id;
 	char		 padding[6];
 	vmexit_handler_t vmexit_handlers[IA32_VMX_EXIT_BASIC_REASON_COUNT];
-	uint64_t	 vmexit_counter[IA32_VMX_EXIT_BASIC_REASON_COUNT];
-	list_element_t	 list[1];
+	/* g_num_of_cpus blocks of VMEXIT_CPU_STATS_SIZE bytes */
+	uint8_t		 *cpu_stats;
 } guest_vmexit_control_t;
 
-typedef struct {
-	list_element_t guest_vmexit_controls[1];
-} vmexit_global_state_t;
+static
+void vmexit_bottom_up_common_handler(guest_cpu_handle_t gcpu, uint32_t reason,
+				     guest_vmexit_control_t *
+				     guest_vmexit_control);
+
+static
+void vmexit_bottom_up_all_mons_skip_instruction(guest_cpu_handle_t gcpu,
+						uint32_t reason,
+						guest_vmexit_control_t *
+						guest_vmexit_control);
+
+static
+void vmexit_top_down_common_handler(guest_cpu_handle_t gcpu, uint32_t reason,
+				    guest_vmexit_control_t *
+				    guest_vmexit_control);
 
-/* for all guests */
-static vmexit_global_state_t vmexit_global_state;
+static
+void vmexit_level1_simple_bottom_up_handler(guest_cpu_handle_t gcpu,
+					    uint32_t reason,
+					    guest_vmexit_control_t *
+					    guest_vmexit_control);
+
+static
+void vmexit_level1_simple_skip_instruction(guest_cpu_handle_t gcpu,
+					   uint32_t reason,
+					   guest_vmexit_control_t *
+					   guest_vmexit_control);
+
+static
+void vmexit_level1_simple_top_down_handler(guest_cpu_handle_t gcpu,
+					   uint32_t reason,
+					   guest_vmexit_control_t *
+					   guest_vmexit_control);
 
 typedef void (*func_vmexit_classification_t) (guest_cpu_handle_t gcpu,
-					      uint32_t reason);
+					      uint32_t reason,
+					      guest_vmexit_control_t *
+					      guest_vmexit_control);
 
 static func_vmexit_classification_t
 	vmexit_classification_func[IA32_VMX_EXIT_BASIC_REASON_COUNT] = {
@@ -239,20 +289,41 @@ static func_vmexit_classification_t
 	vmexit_top_down_common_handler,
 	/* 57 IA32_VMX_EXIT_BASIC_REASON_PLACE_HOLDER_2 */
 	vmexit_top_down_common_handler,
-	/* 58 IA32_VMX_EXIT_BASIC_REASON_PLACE_HOLDER_3 */
-	vmexit_top_down_common_handler,
+	/* 58 IA32_VMX_EXIT_BASIC_REASON_INVPCID_INSTRUCTION */
+	vmexit_bottom_up_all_mons_skip_instruction,
 	/* 59 IA32_VMX_EXIT_BASIC_REASON_INVALID_VMFUNC */
-	vmexit_top_down_common_handler
+	vmexit_top_down_common_handler,
+	/* 60 IA32_VMX_EXIT_BASIC_REASON_ENCLS_INSTRUCTION */
+	vmexit_top_down_common_handler,
+	/* 61 IA32_VMX_EXIT_BASIC_REASON_RDSEED_INSTRUCTION */
+	vmexit_top_down_common_handler,
+	/* 62 IA32_VMX_EXIT_BASIC_REASON_PML_FULL */
+	vmexit_bottom_up_common_handler
 };
 
+/* Dispatch table used while the gcpu runs in GUEST_LEVEL_1_SIMPLE mode.
+ * Filled in vmexit_initialize() from vmexit_classification_func[], each
+ * layered common handler replaced by its non-layered counterpart. */
+static func_vmexit_classification_t
+	vmexit_level1_simple_classification_func[
+	IA32_VMX_EXIT_BASIC_REASON_COUNT];
+
 /* T.B.D.*/
 #define NMI_DO_PROCESSING()
 extern void vmexit_nmi_exception_handlers_install(guest_id_t guest_id);
 
-static void vmexit_handler_invoke(guest_cpu_handle_t gcpu, uint32_t reason);
+static void vmexit_handler_invoke(guest_cpu_handle_t gcpu, uint32_t reason,
+				  guest_vmexit_control_t *guest_vmexit_control);
+
+static guest_vmexit_control_t *vmexit_find_guest_vmexit_control(guest_handle_t
+								guest);
+
+static mon_status_t vmexit_stats_vmcall_handler(guest_cpu_handle_t gcpu,
+						address_t *arg1,
+						address_t *arg2,
+						address_t *arg3);
 
-static guest_vmexit_control_t *vmexit_find_guest_vmexit_control(guest_id_t
-								guest_id);
+static void vmexit_cli_register(void);
 
 /*----------------------------------Code-----------------------------------*/
 
@@ -267,16 +338,30 @@ void vmexit_initialize(void)
 {
 	guest_handle_t guest;
 	guest_econtext_t guest_ctx;
+	uint32_t i;
 
-	mon_memset(&vmexit_global_state, 0, sizeof(vmexit_global_state));
-
-	list_init(vmexit_global_state.guest_vmexit_controls);
-	io_vmexit_initialize();
-	vmcall_intialize();
+	for (i = 0; i < IA32_VMX_EXIT_BASIC_REASON_COUNT; ++i) {
+		if (vmexit_classification_func[i] ==
+		    vmexit_bottom_up_common_handler) {
+			vmexit_level1_simple_classification_func[i] =
+				vmexit_level1_simple_bottom_up_handler;
+		} else if (vmexit_classification_func[i] ==
+			   vmexit_bottom_up_all_mons_skip_instruction) {
+			vmexit_level1_simple_classification_func[i] =
+				vmexit_level1_simple_skip_instruction;
+		} else {
+			MON_ASSERT(vmexit_classification_func[i] ==
+				vmexit_top_down_common_handler);
+			vmexit_level1_simple_classification_func[i] =
+				vmexit_level1_simple_top_down_handler;
+		}
+	}
 
 	for (guest = guest_first(&guest_ctx);
 	     guest; guest = guest_next(&guest_ctx))
 		vmexit_guest_initialize(guest_get_id(guest));
+
+	vmexit_cli_register();
 }
 
 /*--------------------------------------------------------------------------*
@@ -301,8 +386,15 @@ void vmexit_guest_initialize(guest_id_t guest_id)
 
 	guest_vmexit_control->guest_id = guest_id;
 
-	list_add(vmexit_global_state.guest_vmexit_controls,
-		guest_vmexit_control->list);
+	guest_vmexit_control->cpu_stats =
+		(uint8_t *)mon_page_alloc(PAGE_ROUNDUP(g_num_of_cpus *
+				VMEXIT_CPU_STATS_SIZE));
+	MON_ASSERT(guest_vmexit_control->cpu_stats);
+	mon_memset(guest_vmexit_control->cpu_stats, 0,
+		g_num_of_cpus * VMEXIT_CPU_STATS_SIZE);
+
+	guest_set_control(mon_guest_handle(guest_id), GUEST_VMEXIT_CONTROL,
+		guest_vmexit_control);
 
 	/* install default handlers */
 	for (i = 0; i < IA32_VMX_EXIT_BASIC_REASON_COUNT; ++i)
@@ -371,6 +463,8 @@ void vmexit_guest_initialize(guest_id_t guest_id)
 		= vmexit_invd;
 	guest_vmexit_control->vmexit_handlers
 	[IA32_VMX_EXIT_BASIC_REASON_INVLPG_INSTRUCTION] = vmexit_invlpg;
+	guest_vmexit_control->vmexit_handlers
+	[IA32_VMX_EXIT_BASIC_REASON_INVPCID_INSTRUCTION] = vmexit_invpcid;
 	guest_vmexit_control->vmexit_handlers[
 		IA32_VMX_EXIT_BASIC_REASON_EPT_VIOLATION] =
 		vmexit_ept_violation;
@@ -419,17 +513,19 @@ void vmexit_guest_initialize(guest_id_t guest_id)
 
 	/* install VMCALL services */
 	vmcall_guest_intialize(guest_id);
+	mon_vmcall_register(guest_id, VMCALL_GET_VMEXIT_STATS,
+		vmexit_stats_vmcall_handler, FALSE);
+	mon_trace_guest_initialize(guest_id);
 	MON_LOG(mask_mon, level_trace,
 		"vmexit_guest_initialize end guest_id=#%d\r\n", guest_id);
 }
 
 static
 void vmexit_bottom_up_all_mons_skip_instruction(guest_cpu_handle_t gcpu,
-						uint32_t reason)
+						uint32_t reason,
+						guest_vmexit_control_t *
+						guest_vmexit_control)
 {
-	guest_handle_t guest = mon_gcpu_guest_handle(gcpu);
-	guest_id_t guest_id = guest_get_id(guest);
-	guest_vmexit_control_t *guest_vmexit_control = NULL;
 	vmcs_hierarchy_t *vmcs_hierarchy = gcpu_get_vmcs_hierarchy(gcpu);
 	vmcs_object_t *level0_vmcs =
 		vmcs_hierarchy_get_vmcs(vmcs_hierarchy, VMCS_LEVEL_0);
@@ -438,14 +534,9 @@ void vmexit_bottom_up_all_mons_skip_instruction(guest_cpu_handle_t gcpu,
 	guest_level_t guest_level = gcpu_get_guest_level(gcpu);
 	boolean_t skip_instruction = TRUE;
 
-	guest_vmexit_control = vmexit_find_guest_vmexit_control(guest_id);
-	MON_ASSERT(guest_vmexit_control);
-
 	MON_ASSERT(reason < IA32_VMX_EXIT_BASIC_REASON_COUNT);
 
 	MON_ASSERT(level0_vmcs != NULL);
-	hw_interlocked_increment((int32_t *)&
-		(guest_vmexit_control->vmexit_counter[reason]));
 
 	if ((guest_level == GUEST_LEVEL_1_SIMPLE) ||
 	    (guest_level == GUEST_LEVEL_1_MON) ||
@@ -487,11 +578,10 @@ void vmexit_bottom_up_all_mons_skip_instruction(guest_cpu_handle_t gcpu,
 	}
 }
 
-void vmexit_bottom_up_common_handler(guest_cpu_handle_t gcpu, uint32_t reason)
+void vmexit_bottom_up_common_handler(guest_cpu_handle_t gcpu, uint32_t reason,
+				     guest_vmexit_control_t *
+				     guest_vmexit_control)
 {
-	guest_handle_t guest = mon_gcpu_guest_handle(gcpu);
-	guest_id_t guest_id = guest_get_id(guest);
-	guest_vmexit_control_t *guest_vmexit_control = NULL;
 	vmexit_handling_status_t vmexit_handling_status = VMEXIT_NOT_HANDLED;
 	vmcs_hierarchy_t *vmcs_hierarchy = gcpu_get_vmcs_hierarchy(gcpu);
 	vmcs_object_t *level0_vmcs =
@@ -500,14 +590,9 @@ void vmexit_bottom_up_common_handler(guest_cpu_handle_t gcpu, uint32_t reason)
 		vmcs_hierarchy_get_vmcs(vmcs_hierarchy, VMCS_MERGED);
 	guest_level_t guest_level = gcpu_get_guest_level(gcpu);
 
-	guest_vmexit_control = vmexit_find_guest_vmexit_control(guest_id);
-	MON_ASSERT(guest_vmexit_control);
-
 	MON_ASSERT(reason < IA32_VMX_EXIT_BASIC_REASON_COUNT);
 
 	MON_ASSERT(level0_vmcs != NULL);
-	hw_interlocked_increment((int32_t *)&
-		(guest_vmexit_control->vmexit_counter[reason]));
 
 	if ((guest_level == GUEST_LEVEL_1_SIMPLE) ||    /* non -layered vmexit */
 	    (guest_level == GUEST_LEVEL_1_MON) ||       /* or vmexit from level 1 */
@@ -571,25 +656,18 @@ void vmexit_bottom_up_common_handler(guest_cpu_handle_t gcpu, uint32_t reason)
 	}
 }
 
-void vmexit_top_down_common_handler(guest_cpu_handle_t gcpu, uint32_t reason)
+void vmexit_top_down_common_handler(guest_cpu_handle_t gcpu, uint32_t reason,
+				    guest_vmexit_control_t *
+				    guest_vmexit_control)
 {
-	guest_handle_t guest = mon_gcpu_guest_handle(gcpu);
-	guest_id_t guest_id = guest_get_id(guest);
-	guest_vmexit_control_t *guest_vmexit_control = NULL;
 	vmexit_handling_status_t vmexit_handling_status = VMEXIT_NOT_HANDLED;
 	vmcs_hierarchy_t *vmcs_hierarchy = gcpu_get_vmcs_hierarchy(gcpu);
 	vmcs_object_t *merged_vmcs =
 		vmcs_hierarchy_get_vmcs(vmcs_hierarchy, VMCS_MERGED);
 	guest_level_t guest_level = gcpu_get_guest_level(gcpu);
 
-	guest_vmexit_control = vmexit_find_guest_vmexit_control(guest_id);
-	MON_ASSERT(guest_vmexit_control);
-
 	MON_ASSERT(reason < IA32_VMX_EXIT_BASIC_REASON_COUNT);
 
-	hw_interlocked_increment((int32_t *)&
-		(guest_vmexit_control->vmexit_counter[reason]));
-
 	if (guest_level == GUEST_LEVEL_2 && gcpu_is_native_execution(gcpu)) {
 		vmcs_object_t *level1_vmcs =
 			vmcs_hierarchy_get_vmcs(vmcs_hierarchy, VMCS_LEVEL_1);
@@ -623,17 +701,92 @@ void vmexit_top_down_common_handler(guest_cpu_handle_t gcpu, uint32_t reason)
 	}
 }
 
-void vmexit_handler_invoke(guest_cpu_handle_t gcpu, uint32_t reason)
+/*
+ * Non-layered counterparts of the common handlers above. In
+ * GUEST_LEVEL_1_SIMPLE mode only level-0 may request and handle VMEXITs, so
+ * the reason handler is called directly, without the VMCS hierarchy
+ * analysis, and the VMEXIT reason is re-read only when the handler fails.
+ */
+static
+void vmexit_level1_simple_bottom_up_handler(guest_cpu_handle_t gcpu,
+					    uint32_t reason,
+					    guest_vmexit_control_t *
+					    guest_vmexit_control)
 {
-	guest_handle_t guest = mon_gcpu_guest_handle(gcpu);
-	guest_id_t guest_id = guest_get_id(guest);
-	guest_vmexit_control_t *guest_vmexit_control = NULL;
+	ia32_vmx_exit_reason_t exit_reason;
 
-	guest_vmexit_control = vmexit_find_guest_vmexit_control(guest_id);
-	MON_ASSERT(guest_vmexit_control);
+	if (guest_vmexit_control->vmexit_handlers[reason] (gcpu) ==
+	    VMEXIT_HANDLED) {
+		return;
+	}
+
+	/* reason can be changed after the attempt to handle */
+	exit_reason.uint32 =
+		(uint32_t)mon_vmcs_read(mon_gcpu_get_vmcs(gcpu),
+			VMCS_EXIT_INFO_REASON);
+	reason = exit_reason.bits.basic_reason;
+
+	/* Currently it can happen only for exception */
+	if (reason !=
+	    IA32_VMX_EXIT_BASIC_REASON_SOFTWARE_INTERRUPT_EXCEPTION_NMI) {
+		MON_LOG(mask_mon, level_trace, "%s: reason = %d\n",
+			__FUNCTION__, reason);
+	}
+	MON_ASSERT(reason ==
+		IA32_VMX_EXIT_BASIC_REASON_SOFTWARE_INTERRUPT_EXCEPTION_NMI);
+	gcpu_vmexit_exception_reflect(gcpu);
+}
+
+static
+void vmexit_level1_simple_skip_instruction(guest_cpu_handle_t gcpu,
+					   uint32_t reason,
+					   guest_vmexit_control_t *
+					   guest_vmexit_control)
+{
+	/* return value is not important */
+	guest_vmexit_control->vmexit_handlers[reason] (gcpu);
+	gcpu_skip_guest_instruction(gcpu);
+}
+
+static
+void vmexit_level1_simple_top_down_handler(guest_cpu_handle_t gcpu,
+					   uint32_t reason,
+					   guest_vmexit_control_t *
+					   guest_vmexit_control)
+{
+	vmexit_handling_status_t vmexit_handling_status;
+
+	vmexit_handling_status =
+		guest_vmexit_control->vmexit_handlers[reason] (gcpu);
+
+	if (vmexit_handling_status == VMEXIT_HANDLED) {
+		return;
+	}
+
+	if (vmexit_handling_status == VMEXIT_HANDLED_RESUME_LEVEL2) {
+		gcpu_set_next_guest_level(gcpu, GUEST_LEVEL_2);
+	} else {
+		MON_LOG(mask_mon, level_trace,
+			"%s: Top-Down VMExit (%d) which wasn't handled",
+			__FUNCTION__, reason);
+		/* Should not get here */
+		MON_DEADLOOP();
+	}
+}
+
+void vmexit_handler_invoke(guest_cpu_handle_t gcpu, uint32_t reason,
+			   guest_vmexit_control_t *guest_vmexit_control)
+{
 	if (reason < IA32_VMX_EXIT_BASIC_REASON_COUNT) {
-		/* Call top-down or bottom-up common handler; */
-		vmexit_classification_func[reason] (gcpu, reason);
+		/* Call top-down or bottom-up common handler, layered only if
+		 * the gcpu runs in layered mode */
+		if (gcpu_get_guest_level(gcpu) == GUEST_LEVEL_1_SIMPLE) {
+			vmexit_level1_simple_classification_func[reason] (gcpu,
+				reason, guest_vmexit_control);
+		} else {
+			vmexit_classification_func[reason] (gcpu, reason,
+				guest_vmexit_control);
+		}
 	} else {
 		MON_LOG(mask_mon,
 			level_trace,
@@ -892,7 +1045,8 @@ mon_status_t vmexit_install_handler(guest_id_t guest_id,
 	mon_status_t status = MON_OK;
 	guest_vmexit_control_t *guest_vmexit_control = NULL;
 
-	guest_vmexit_control = vmexit_find_guest_vmexit_control(guest_id);
+	guest_vmexit_control =
+		vmexit_find_guest_vmexit_control(mon_guest_handle(guest_id));
 	MON_ASSERT(guest_vmexit_control);
 
 	if (reason < IA32_VMX_EXIT_BASIC_REASON_COUNT) {
@@ -910,6 +1064,178 @@ mon_status_t vmexit_install_handler(guest_id_t guest_id,
 	return status;
 }
 
+/*--------------------------------------------------------------------------*
+*  FUNCTION : vmexit_stats_account()
+*  PURPOSE  : Account one VMEXIT in the statistics of the current host CPU
+*  ARGUMENTS: guest_vmexit_control_t *guest_vmexit_control - of the guest
+*             which caused the VMEXIT
+*           : uint32_t reason
+*           : uint64_t cycles - TSC cycles spent from VMEXIT to VMRESUME
+*  RETURNS  : void
+*--------------------------------------------------------------------------*/
+static
+void vmexit_stats_account(guest_vmexit_control_t *guest_vmexit_control,
+			  uint32_t reason, uint64_t cycles)
+{
+	vmexit_reason_stats_t *stats;
+	uint32_t bucket = 0;
+
+	if (reason >= IA32_VMX_EXIT_BASIC_REASON_COUNT) {
+		return;
+	}
+
+	stats = &VMEXIT_CPU_STATS(guest_vmexit_control,
+		hw_cpu_id())->reason[reason];
+
+	stats->count++;
+	stats->cycles += cycles;
+
+	if (hw_scan_bit_backward64(&bucket,
+		    cycles >> VMEXIT_STATS_HISTOGRAM_SHIFT)) {
+		bucket++;
+		if (bucket >= MON_VMEXIT_STATS_HISTOGRAM_BUCKETS) {
+			bucket = MON_VMEXIT_STATS_HISTOGRAM_BUCKETS - 1;
+		}
+	}
+	stats->histogram[bucket]++;
+}
+
+/*--------------------------------------------------------------------------*
+*  FUNCTION : vmexit_stats_collect()
+*  PURPOSE  : Sum statistics of given VMEXIT reason over all host CPUs
+*  ARGUMENTS: guest_vmexit_control_t *guest_vmexit_control
+*           : uint32_t reason
+*           : OUT uint64_t *count
+*           : OUT uint64_t *cycles
+*           : OUT uint64_t histogram[MON_VMEXIT_STATS_HISTOGRAM_BUCKETS]
+*  RETURNS  : void
+*  NOTES    : Host CPUs keep on updating their blocks, so the result is a
+*           : snapshot which is not necessarily consistent across reasons
+*--------------------------------------------------------------------------*/
+static
+void vmexit_stats_collect(guest_vmexit_control_t *guest_vmexit_control,
+			  uint32_t reason, uint64_t *count, uint64_t *cycles,
+			  uint64_t histogram[])
+{
+	vmexit_reason_stats_t *stats;
+	cpu_id_t cpu_id;
+	uint32_t bucket;
+
+	*count = 0;
+	*cycles = 0;
+	for (bucket = 0; bucket < MON_VMEXIT_STATS_HISTOGRAM_BUCKETS; ++bucket)
+		histogram[bucket] = 0;
+
+	for (cpu_id = 0; cpu_id < g_num_of_cpus; ++cpu_id) {
+		stats = &VMEXIT_CPU_STATS(guest_vmexit_control,
+			cpu_id)->reason[reason];
+		*count += stats->count;
+		*cycles += stats->cycles;
+		for (bucket = 0; bucket < MON_VMEXIT_STATS_HISTOGRAM_BUCKETS;
+		     ++bucket)
+			histogram[bucket] += stats->histogram[bucket];
+	}
+}
+
+/*--------------------------------------------------------------------------*
+*  FUNCTION : vmexit_stats_vmcall_handler()
+*  PURPOSE  : VMCALL_GET_VMEXIT_STATS service. Returns statistics of the
+*           : calling guest
+*  ARGUMENTS: arg1 - guest virtual address of mon_vmexit_stats_params_t
+*  RETURNS  : mon_status_t
+*--------------------------------------------------------------------------*/
+static
+mon_status_t vmexit_stats_vmcall_handler(guest_cpu_handle_t gcpu,
+					 address_t *arg1,
+					 address_t *arg2 UNUSED,
+					 address_t *arg3 UNUSED)
+{
+	mon_vmexit_stats_params_t params;
+	guest_vmexit_control_t *guest_vmexit_control;
+
+	if (copy_from_gva(gcpu, (uint64_t)*arg1, sizeof(params),
+		    (uint64_t)&params) != 0) {
+		mon_gcpu_inject_gp0(gcpu);
+		return MON_ERROR;
+	}
+
+	guest_vmexit_control =
+		vmexit_find_guest_vmexit_control(mon_gcpu_guest_handle(gcpu));
+	MON_ASSERT(guest_vmexit_control);
+
+	if ((params.vmcall_id != VMCALL_GET_VMEXIT_STATS) ||
+	    (params.reason >= IA32_VMX_EXIT_BASIC_REASON_COUNT)) {
+		params.status = MON_ERROR;
+	} else {
+		vmexit_stats_collect(guest_vmexit_control, params.reason,
+			&params.count, &params.cycles, params.histogram);
+		params.status = MON_OK;
+	}
+
+	if (copy_to_gva(gcpu, (uint64_t)*arg1, sizeof(params),
+		    (uint64_t)&params) != 0) {
+		mon_gcpu_inject_gp0(gcpu);
+		return MON_ERROR;
+	}
+
+	return MON_OK;
+}
+
+#ifdef CLI_INCLUDE
+static int cli_vmexit_stats(unsigned argc, char *argv[])
+{
+	guest_handle_t guest;
+	guest_vmexit_control_t *guest_vmexit_control;
+	uint64_t count, cycles;
+	uint64_t histogram[MON_VMEXIT_STATS_HISTOGRAM_BUCKETS];
+	uint32_t reason, bucket;
+
+	if (argc < 2) {
+		return -1;
+	}
+
+	guest = mon_guest_handle((guest_id_t)CLI_ATOL(argv[1]));
+	if (NULL == guest) {
+		CLI_PRINT("Guest %s does not exist\n", argv[1]);
+		return -1;
+	}
+	guest_vmexit_control = vmexit_find_guest_vmexit_control(guest);
+	MON_ASSERT(guest_vmexit_control);
+
+	CLI_PRINT("Reason            Count       Avg cycles  Histogram\n");
+	for (reason = 0; reason < IA32_VMX_EXIT_BASIC_REASON_COUNT; ++reason) {
+		vmexit_stats_collect(guest_vmexit_control, reason, &count,
+			&cycles, histogram);
+		if (0 == count) {
+			continue;
+		}
+		CLI_PRINT("%6d %16lld %16lld ", reason, count, cycles / count);
+		for (bucket = 0; bucket < MON_VMEXIT_STATS_HISTOGRAM_BUCKETS;
+		     ++bucket)
+			CLI_PRINT(" %lld", histogram[bucket]);
+		CLI_PRINT("\n");
+	}
+
+	return 0;
+}
+
+static
+void vmexit_cli_register(void)
+{
+	cli_add_command(cli_vmexit_stats, "vmexit stats",
+		"Print per-reason VMEXIT counters and cycle histograms"
+		" for given guest",
+		"<guest id>", CLI_ACCESS_LEVEL_USER);
+}
+#else
+
+static
+void vmexit_cli_register(void)
+{
+}
+
+#endif
+
 extern uint32_t vmexit_reason(void);
 uint64_t gcpu_read_guestrip(void);
 
@@ -926,6 +1252,9 @@ void vmexit_common_handler(void)
 	vmcs_object_t *vmcs;
 	ia32_vmx_exit_reason_t reason;
 	report_initial_vmexit_check_data_t initial_vmexit_check_data;
+	guest_vmexit_control_t *guest_vmexit_control;
+	uint64_t vmexit_tsc = hw_rdtsc();
+	hw_pcpu_t *pcpu = hw_pcpu();
 
 	gcpu = mon_scheduler_current_gcpu();
 	MON_ASSERT(gcpu);
@@ -933,7 +1262,7 @@ void vmexit_common_handler(void)
 	/* Disable the VMCS Software Shadow/Cache
 	 * This is required since GCPU and VMCS cache has not yet been flushed and
 	 * might have stale values from previous VMExit */
-	vmcs_sw_shadow_disable[hw_cpu_id()] = TRUE;
+	pcpu->vmcs_sw_shadow_disable = TRUE;
 
 	if (gcpu->trigger_log_event
 	    && (vmexit_reason() ==
@@ -960,7 +1289,16 @@ void vmexit_common_handler(void)
 			fvs_save_resumed_eptp(gcpu);
 		}
 
+		/* resumed without going through the handlers, still counted */
+		reason.uint32 = initial_vmexit_check_data.vmexit_reason;
+		guest_vmexit_control = vmexit_find_guest_vmexit_control(
+			mon_gcpu_guest_handle(gcpu));
+		MON_ASSERT(guest_vmexit_control);
+		vmexit_stats_account(guest_vmexit_control,
+			reason.bits.basic_reason, hw_rdtsc() - vmexit_tsc);
+
 		nmi_window_update_before_vmresume(mon_gcpu_get_vmcs(gcpu));
+		gcpu_restore_ext_state(gcpu);
 		vmentry_func(FALSE);
 	}
 
@@ -974,13 +1312,13 @@ void vmexit_common_handler(void)
 
 	/* OPTIMIZATION: For EPT violation, do not enable the software VMCS cache */
 	if ((vmexit_check_ept_violation() & 7) == 0) {
-		vmcs_sw_shadow_disable[hw_cpu_id()] = FALSE;
+		pcpu->vmcs_sw_shadow_disable = FALSE;
 	}
 
 	/* clear guest cpu cache data. in fact it clears all VMCS caches too. */
 	gcpu_vmexit_start(gcpu);
 
-	host_cpu_store_vmexit_gcpu(hw_cpu_id(), gcpu);
+	host_cpu_store_vmexit_gcpu(gcpu);
 
 	if (CLI_active()) {
 		/* Check keystroke */
@@ -1012,11 +1350,17 @@ void vmexit_common_handler(void)
 	 * if legacy_scheduling_enabled == FALSE, scheduling must be done in
 	 * gcpu_resume() */
 
+	/* the only lookup of the guest VMEXIT control on this VMEXIT */
+	guest_vmexit_control =
+		vmexit_find_guest_vmexit_control(mon_gcpu_guest_handle(gcpu));
+	MON_ASSERT(guest_vmexit_control);
+
 	next_gcpu = gcpu_call_vmexit_function(gcpu, reason.bits.basic_reason);
 
 	if (NULL == next_gcpu) {
 		/* call reason-specific VMEXIT handler */
-		vmexit_handler_invoke(gcpu, reason.bits.basic_reason);
+		vmexit_handler_invoke(gcpu, reason.bits.basic_reason,
+			guest_vmexit_control);
 		if (legacy_scheduling_enabled) {
 			/* select guest for execution */
 			next_gcpu = scheduler_select_next_gcpu();
@@ -1033,25 +1377,27 @@ void vmexit_common_handler(void)
 	/* finally process NMI injection */
 	NMI_DO_PROCESSING();
 
+	vmexit_stats_account(guest_vmexit_control, reason.bits.basic_reason,
+		hw_rdtsc() - vmexit_tsc);
+
+	/* write the asynchronous log to the debug port, only as much as the
+	 * UART takes without waiting */
+	if (hw_cpu_id() == MON_IO_DRAIN_CPU) {
+		mon_io_drain(FALSE);
+	}
+
 	gcpu_resume(next_gcpu);
 }
 
 static
-guest_vmexit_control_t *vmexit_find_guest_vmexit_control(guest_id_t guest_id)
+guest_vmexit_control_t *vmexit_find_guest_vmexit_control(guest_handle_t guest)
 {
-	list_element_t *iter = NULL;
-	guest_vmexit_control_t *guest_vmexit_control = NULL;
-
-	LIST_FOR_EACH(vmexit_global_state.guest_vmexit_controls, iter) {
-		guest_vmexit_control = LIST_ENTRY(iter,
-			guest_vmexit_control_t,
-			list);
-		if (guest_vmexit_control->guest_id == guest_id) {
-			return guest_vmexit_control;
-		}
+	if (NULL == guest) {
+		return NULL;
 	}
 
-	return NULL;
+	return (guest_vmexit_control_t *)guest_get_control(guest,
+		GUEST_VMEXIT_CONTROL);
 }
 
 #define vmexit_hardware_interrupt           vmexit_handler_default
@@ -769,7 +769,14 @@ func_vmexit_is_control_requested_t
 	/* 54 IA32_VMX_EXIT_BASIC_REASON_INVALID_VMEXIT_REASON_54 */
 	vmexit_analysis_false_func,
 	/* 55 IA32_VMX_EXIT_BASIC_REASON_XSETBV_INSTRUCTION */
-	vmexit_analysis_true_func
+	vmexit_analysis_true_func,
+	/* 56 IA32_VMX_EXIT_BASIC_REASON_PLACE_HOLDER_1 */
+	vmexit_analysis_false_func,
+	/* 57 IA32_VMX_EXIT_BASIC_REASON_PLACE_HOLDER_2 */
+	vmexit_analysis_false_func,
+	/* 58 IA32_VMX_EXIT_BASIC_REASON_INVPCID_INSTRUCTION, exits together
+	 * with INVLPG */
+	vmexit_analysis_invlpg_inst_exiting
 };
 
 boolean_t vmexit_analysis_was_control_requested(guest_cpu_handle_t gcpu,
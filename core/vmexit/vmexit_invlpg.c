@@ -32,6 +32,8 @@ vmexit_handling_status_t vmexit_invlpg(guest_cpu_handle_t gcpu)
 		mon_vmcs_read(vmcs, VMCS_EXIT_INFO_QUALIFICATION);
 	data.invlpg_addr = qualification.invlpg_instruction.address;
 
+	gcpu_gva_cache_invalidate_page(gcpu, data.invlpg_addr);
+
 	/* Return value of raising event is not important */
 	event_raise(EVENT_GCPU_INVALIDATE_PAGE, gcpu, &data);
 
@@ -40,3 +42,13 @@ vmexit_handling_status_t vmexit_invlpg(guest_cpu_handle_t gcpu)
 
 	return VMEXIT_HANDLED;
 }
+
+/* INVPCID causes VMEXIT when INVLPG exiting is on. Its operand is not
+ * decoded, all cached GVA translations are dropped */
+vmexit_handling_status_t vmexit_invpcid(guest_cpu_handle_t gcpu)
+{
+	gcpu_gva_cache_flush(gcpu);
+
+	/* Instruction will be skipped in upper "bottom-up" handler */
+	return VMEXIT_HANDLED;
+}
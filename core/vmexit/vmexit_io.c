@@ -48,31 +48,24 @@ typedef struct {
 	void			*io_handler_context;
 } io_vmexit_descriptor_t;
 
+/* attached to the guest descriptor as GUEST_IO_VMEXIT_CONTROL */
 typedef struct {
 	guest_id_t		guest_id;
 	char			padding[6];
 	uint8_t			*io_bitmap;
 	io_vmexit_descriptor_t	io_descriptors[IO_VMEXIT_MAX_COUNT];
-	list_element_t		list[1];
 } guest_io_vmexit_control_t;
 
-typedef struct {
-	list_element_t guest_io_vmexit_controls[1];
-} io_vmexit_global_state_t;
-
-/*-----------------Local Variables----------------*/
-
-static io_vmexit_global_state_t io_vmexit_global_state;
-
 /*-----------------Forward Declarations for Local Functions----------------*/
 
 static
 vmexit_handling_status_t io_vmexit_handler(guest_cpu_handle_t gcpu);
 static
-io_vmexit_descriptor_t *io_port_lookup(guest_id_t guest_id,
+io_vmexit_descriptor_t *io_port_lookup(guest_io_vmexit_control_t *io_ctrl,
 				       io_port_id_t port_id);
 static
-io_vmexit_descriptor_t *io_free_port_lookup(guest_id_t guest_id);
+io_vmexit_descriptor_t *io_free_port_lookup(guest_io_vmexit_control_t *
+					    io_ctrl);
 static
 void io_blocking_read_handler(guest_cpu_handle_t gcpu,
 			      io_port_id_t port_id,
@@ -102,22 +95,8 @@ void io_transparent_write_handler(guest_cpu_handle_t gcpu,
 				  unsigned port_size, /* 1, 2, 4 */
 				  void *p_value);
 static
-guest_io_vmexit_control_t *io_vmexit_find_guest_io_control(guest_id_t
-							   guest_id);
-
-/*----------------------------------------------------------------------------*
-*  FUNCTION : io_vmexit_setup()
-*  PURPOSE  : Allocate and initialize IO VMEXITs related data structures,
-*           : common for all guests
-*  ARGUMENTS: guest_id_t    num_of_guests
-*  RETURNS  : void
-*----------------------------------------------------------------------------*/
-void io_vmexit_initialize(void)
-{
-	mon_memset(&io_vmexit_global_state, 0, sizeof(io_vmexit_global_state));
-
-	list_init(io_vmexit_global_state.guest_io_vmexit_controls);
-}
+guest_io_vmexit_control_t *io_vmexit_find_guest_io_control(guest_handle_t
+							   guest);
 
 /*----------------------------------------------------------------------------*
 *  FUNCTION : io_vmexit_guest_setup()
@@ -143,8 +122,8 @@ void io_vmexit_guest_initialize(guest_id_t guest_id)
 
 	MON_ASSERT(io_ctrl->io_bitmap);
 
-	list_add(io_vmexit_global_state.guest_io_vmexit_controls,
-		io_ctrl->list);
+	guest_set_control(mon_guest_handle(guest_id), GUEST_IO_VMEXIT_CONTROL,
+		io_ctrl);
 
 	MON_LOG(mask_anonymous,
 		level_trace,
@@ -174,7 +153,7 @@ void io_vmexit_activate(guest_cpu_handle_t gcpu)
 	vmexit_control_t vmexit_request;
 
 	MON_LOG(mask_anonymous, level_trace, "io_vmexit_activate start\r\n");
-	io_ctrl = io_vmexit_find_guest_io_control(guest_id);
+	io_ctrl = io_vmexit_find_guest_io_control(guest);
 
 	MON_ASSERT(io_ctrl);
 
@@ -219,18 +198,15 @@ void io_vmexit_activate(guest_cpu_handle_t gcpu)
 /*----------------------------------------------------------------------------*
 *  FUNCTION : io_port_lookup()
 *  PURPOSE  : Look for descriptor for specified port
-*  ARGUMENTS: guest_id_t    guest_id
+*  ARGUMENTS: guest_io_vmexit_control_t *io_ctrl
 *           : uint16_t      port_id
 *  RETURNS  : Pointer to the descriptor, NULL if not found
 *----------------------------------------------------------------------------*/
-io_vmexit_descriptor_t *io_port_lookup(guest_id_t guest_id,
+io_vmexit_descriptor_t *io_port_lookup(guest_io_vmexit_control_t *io_ctrl,
 				       io_port_id_t port_id)
 {
-	guest_io_vmexit_control_t *io_ctrl = NULL;
 	unsigned i;
 
-	io_ctrl = io_vmexit_find_guest_io_control(guest_id);
-
 	if (NULL == io_ctrl) {
 		return NULL;
 	}
@@ -247,16 +223,13 @@ io_vmexit_descriptor_t *io_port_lookup(guest_id_t guest_id,
 /*----------------------------------------------------------------------------*
 *  FUNCTION : io_free_port_lookup()
 *  PURPOSE  : Look for unallocated descriptor
-*  ARGUMENTS: guest_id_t    guest_id
+*  ARGUMENTS: guest_io_vmexit_control_t *io_ctrl
 *  RETURNS  : Pointer to the descriptor, NULL if not found
 *----------------------------------------------------------------------------*/
-io_vmexit_descriptor_t *io_free_port_lookup(guest_id_t guest_id)
+io_vmexit_descriptor_t *io_free_port_lookup(guest_io_vmexit_control_t *io_ctrl)
 {
-	guest_io_vmexit_control_t *io_ctrl = NULL;
 	unsigned i;
 
-	io_ctrl = io_vmexit_find_guest_io_control(guest_id);
-
 	if (NULL == io_ctrl) {
 		return NULL;
 	}
@@ -422,11 +395,10 @@ mon_status_t mon_io_vmexit_handler_register(guest_id_t guest_id,
 					    io_access_handler_t handler,
 					    void *context)
 {
-	io_vmexit_descriptor_t *p_desc = io_port_lookup(guest_id, port_id);
+	guest_io_vmexit_control_t *io_ctrl =
+		io_vmexit_find_guest_io_control(mon_guest_handle(guest_id));
+	io_vmexit_descriptor_t *p_desc = io_port_lookup(io_ctrl, port_id);
 	mon_status_t status;
-	guest_io_vmexit_control_t *io_ctrl = NULL;
-
-	io_ctrl = io_vmexit_find_guest_io_control(guest_id);
 
 	MON_ASSERT(io_ctrl);
 	MON_ASSERT(handler);
@@ -438,7 +410,7 @@ mon_status_t mon_io_vmexit_handler_register(guest_id_t guest_id,
 			guest_id,
 			port_id);
 	} else {
-		p_desc = io_free_port_lookup(guest_id);
+		p_desc = io_free_port_lookup(io_ctrl);
 	}
 
 	if (NULL != p_desc) {
@@ -468,11 +440,10 @@ mon_status_t mon_io_vmexit_handler_register(guest_id_t guest_id,
 mon_status_t mon_io_vmexit_handler_unregister(guest_id_t guest_id,
 					      io_port_id_t port_id)
 {
-	io_vmexit_descriptor_t *p_desc = io_port_lookup(guest_id, port_id);
+	guest_io_vmexit_control_t *io_ctrl =
+		io_vmexit_find_guest_io_control(mon_guest_handle(guest_id));
+	io_vmexit_descriptor_t *p_desc = io_port_lookup(io_ctrl, port_id);
 	mon_status_t status;
-	guest_io_vmexit_control_t *io_ctrl = NULL;
-
-	io_ctrl = io_vmexit_find_guest_io_control(guest_id);
 
 	MON_ASSERT(io_ctrl);
 
@@ -696,7 +667,9 @@ vmexit_handling_status_t io_vmexit_handler(guest_cpu_handle_t gcpu)
 			IA32_REG_RDX)
 		: (uint16_t)p_qualification->io_instruction.
 		port_number;
-	io_vmexit_descriptor_t *p_desc = io_port_lookup(guest_id, port_id);
+	io_vmexit_descriptor_t *p_desc =
+		io_port_lookup(io_vmexit_find_guest_io_control(guest_handle),
+			port_id);
 	unsigned port_size = (unsigned)p_qualification->io_instruction.size + 1;
 	rw_access_t access =
 		p_qualification->io_instruction.direction ? READ_ACCESS :
@@ -819,7 +792,7 @@ void io_vmexit_block_port(guest_id_t guest_id,
 	unsigned i;
 	guest_io_vmexit_control_t *io_ctrl = NULL;
 
-	io_ctrl = io_vmexit_find_guest_io_control(guest_id);
+	io_ctrl = io_vmexit_find_guest_io_control(mon_guest_handle(guest_id));
 
 	MON_ASSERT(io_ctrl);
 
@@ -831,17 +804,12 @@ void io_vmexit_block_port(guest_id_t guest_id,
 }
 
 static
-guest_io_vmexit_control_t *io_vmexit_find_guest_io_control(guest_id_t guest_id)
+guest_io_vmexit_control_t *io_vmexit_find_guest_io_control(guest_handle_t guest)
 {
-	list_element_t *iter = NULL;
-	guest_io_vmexit_control_t *io_ctrl = NULL;
-
-	LIST_FOR_EACH(io_vmexit_global_state.guest_io_vmexit_controls, iter) {
-		io_ctrl = LIST_ENTRY(iter, guest_io_vmexit_control_t, list);
-		if (io_ctrl->guest_id == guest_id) {
-			return io_ctrl;
-		}
+	if (NULL == guest) {
+		return NULL;
 	}
 
-	return NULL;
+	return (guest_io_vmexit_control_t *)guest_get_control(guest,
+		GUEST_IO_VMEXIT_CONTROL);
 }
@@ -69,7 +69,7 @@ vmexit_handling_status_t vmexit_sipi_event(guest_cpu_handle_t gcpu)
 			"CPU-%d Leave SIPI State: Guest Core count is %d.\n",
 			hw_cpu_id(), g_guest_num_of_cpus);
 
-		MON_DEBUG_CODE(mon_trace(gcpu, "[sipi] Leave SIPI State\n"));
+		mon_trace_event(gcpu, MON_TRACE_EVENT_SIPI_LEAVE, 0, 0, 0, 0);
 
 		/* emulator configures guest with host state, and setup emulator
 		 * context to real mode, thus we have to configure the guest with the
@@ -20,6 +20,7 @@
 #include "vmx_vmcs.h"
 #include "guest_cpu_vmenter_event.h"
 #include "host_memory_manager_api.h"
+#include "mon_api.h"
 
 /* This is 32-bit TSS. */
 
@@ -252,7 +253,6 @@ int copy_from_gva(guest_cpu_handle_t gcpu,
 	return 0;
 }
 
-static
 int copy_to_gva(guest_cpu_handle_t gcpu,
 		uint64_t gva,
 		uint32_t size,
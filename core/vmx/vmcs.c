@@ -30,6 +30,7 @@
 #include "isr.h"
 #include "ept.h"
 #include "memory_dump.h"
+#include "hw_pcpu.h"
 #include "file_codes.h"
 
 #define MON_DEADLOOP()          MON_DEADLOOP_LOG(VMCS_C)
@@ -403,6 +404,13 @@ static vmcs_encoding_t g_field_data[] = {
 	{ VM_X_VE_INFO_ADDRESS,			 NO_EXIST,
 	  SUPP_HIGH_ENC, { 0 },
 	  "VMCS_VE_INFO_ADDRESS" },
+
+	{ VM_X_PML_ADDRESS,			 NO_EXIST,
+	  SUPP_HIGH_ENC, { 0 },
+	  "VMCS_PML_ADDRESS" },
+	{ VM_X_GUEST_PML_INDEX,			 NO_EXIST,
+	  FULL_ENC_ONLY, { 0 },
+	  "VMCS_GUEST_PML_INDEX" },
 	{ VMCS_NO_COMPONENT,			 NO_EXIST,
 	  FULL_ENC_ONLY, { 0 },					 "VMCS_FIELD_COUNT"	  }
 };
@@ -621,6 +629,41 @@ boolean_t vmcs_field_is_supported(vmcs_field_t field_id)
 	       g_field_data[field_id].access != NO_EXIST;
 }
 
+/*--------------------------------------------------------------------------*
+*  FUNCTION : vmcs_is_group_dirty()
+*  PURPOSE  : Check whether any field of the group was modified since the
+*           : dirty bits were last cleared
+*  ARGUMENTS: vmcs
+*           : group
+*  RETURNS  : TRUE if at least one field of the group is dirty
+*--------------------------------------------------------------------------*/
+boolean_t vmcs_is_group_dirty(const vmcs_object_t *vmcs,
+			      vmcs_field_group_t group)
+{
+	MON_ASSERT(vmcs);
+
+	switch (group) {
+	case VMCS_GROUP_GUEST_STATE:
+		/* PML index is guest state updated by hardware on each logged
+		 * write; it is enumerated last, after the controls */
+		return vmcs->vmcs_is_dirty_range(vmcs, VMCS_GUEST_CR0,
+			VMCS_GUEST_PDPTR3) ||
+		       vmcs->vmcs_is_dirty_range(vmcs, VMCS_GUEST_PML_INDEX,
+			VMCS_GUEST_PML_INDEX);
+	case VMCS_GROUP_HOST_STATE:
+		return vmcs->vmcs_is_dirty_range(vmcs, VMCS_HOST_CR0,
+			VMCS_HOST_IA32_PERF_GLOBAL_CTRL);
+	case VMCS_GROUP_CONTROLS:
+		return vmcs->vmcs_is_dirty_range(vmcs, VMCS_VPID,
+			VMCS_PREEMPTION_TIMER) ||
+		       vmcs->vmcs_is_dirty_range(vmcs, VMCS_CR3_TARGET_VALUE_0,
+			VMCS_PML_ADDRESS);
+	default:
+		MON_ASSERT(0);
+		return TRUE;
+	}
+}
+
 void vmcs_write_nocheck(vmcs_object_t *vmcs,
 			vmcs_field_t field_id, uint64_t value)
 {
@@ -761,6 +804,11 @@ void enable_vmcs_2_0_fields(const vmcs_hw_constraints_t *constraints)
 		g_field_data[VMCS_EPTP_INDEX].access = WRITABLE;
 		g_field_data[VMCS_VE_INFO_ADDRESS].access = WRITABLE;
 	}
+
+	if (constraints->may1_processor_based_exec_ctrl2.bits.enable_pml) {
+		g_field_data[VMCS_PML_ADDRESS].access = WRITABLE;
+		g_field_data[VMCS_GUEST_PML_INDEX].access = WRITABLE;
+	}
 }
 
 static
@@ -1534,7 +1582,7 @@ void vmcs_restore_initial(guest_cpu_handle_t gcpu)
 	initial_vmcs = (uint64_t *)g_initial_vmcs[cpu_id];
 
 	/* write vmcs directly to HW */
-	vmcs_sw_shadow_disable[cpu_id] = TRUE;
+	hw_pcpu()->vmcs_sw_shadow_disable = TRUE;
 
 	j = 0;
 	/* restore control fields */
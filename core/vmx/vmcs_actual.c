@@ -33,6 +33,7 @@
 #include "vmcs_actual.h"
 #include "vmcs_internal.h"
 #include "vmx_nmi.h"
+#include "hw_pcpu.h"
 
 #define UPDATE_SUCCEEDED    0
 #define UPDATE_FINISHED     1
@@ -126,6 +127,10 @@ void vmcs_act_flush_to_memory(vmcs_object_t *vmcs);
 static
 boolean_t vmcs_act_is_dirty(const vmcs_object_t *vmcs);
 static
+boolean_t vmcs_act_is_dirty_range(const vmcs_object_t *vmcs,
+				  vmcs_field_t first_field,
+				  vmcs_field_t last_field);
+static
 guest_cpu_handle_t vmcs_act_get_owner(const vmcs_object_t *vmcs);
 static
 void vmcs_act_destroy(vmcs_object_t *vmcs);
@@ -187,15 +192,11 @@ void error_processing(uint64_t vmcs,
 		      const char *operation,
 		      vmcs_field_t field);
 
-/* stores NMI Windows which should be injected per CPU */
-static
-boolean_t nmi_window[MON_MAX_CPU_SUPPORTED];
-
 /*----------------------------------------------------------------------------*
 *                              NMI Handling
 *  When NMI occured:
 *    FS := non zero value        ; mark that NMI occured during VMEXIT
-*    nmi_window[cpu-no] := TRUE  ; mark that NMI Window should be injected on
+*    pcpu->nmi_window := TRUE    ; mark that NMI Window should be injected on
 *                                ; next VMENTER
 *    spoil transaction status (see below).
 *
@@ -214,16 +215,19 @@ INLINE boolean_t nmi_is_nmi_occured(void)
 	return 0 != hw_read_fs();
 }
 
+/* NMI Window which should be injected is stored per host CPU */
 INLINE void nmi_window_set(void)
 {
-	nmi_window[hw_cpu_id()] = TRUE;
+	hw_pcpu()->nmi_window = TRUE;
 }
 
 INLINE void nmi_window_clear(void)
 {
-	nmi_window[hw_cpu_id()] = FALSE;
+	hw_pcpu_t *pcpu = hw_pcpu();
+
+	pcpu->nmi_window = FALSE;
 	if (nmi_is_nmi_occured()) {
-		nmi_window[hw_cpu_id()] = TRUE;
+		pcpu->nmi_window = TRUE;
 	}
 }
 
@@ -235,7 +239,7 @@ INLINE void nmi_remember_occured_nmi(void)
 
 INLINE boolean_t nmi_window_is_requested(void)
 {
-	return nmi_is_nmi_occured() || nmi_window[hw_cpu_id()];
+	return nmi_is_nmi_occured() || hw_pcpu()->nmi_window;
 }
 
 void vmcs_nmi_handler(vmcs_object_t *vmcs)
@@ -333,6 +337,7 @@ vmcs_object_t *vmcs_act_create(guest_cpu_handle_t gcpu)
 	p_vmcs->vmcs_base->vmcs_flush_to_cpu = vmcs_act_flush_to_cpu;
 	p_vmcs->vmcs_base->vmcs_flush_to_memory = vmcs_act_flush_to_memory;
 	p_vmcs->vmcs_base->vmcs_is_dirty = vmcs_act_is_dirty;
+	p_vmcs->vmcs_base->vmcs_is_dirty_range = vmcs_act_is_dirty_range;
 	p_vmcs->vmcs_base->vmcs_get_owner = vmcs_act_get_owner;
 	p_vmcs->vmcs_base->vmcs_destroy = vmcs_act_destroy;
 	p_vmcs->vmcs_base->vmcs_add_msr_to_vmexit_store_list =
@@ -370,6 +375,17 @@ boolean_t vmcs_act_is_dirty(const vmcs_object_t *vmcs)
 	return cache64_is_dirty(p_vmcs->cache);
 }
 
+boolean_t vmcs_act_is_dirty_range(const vmcs_object_t *vmcs,
+				  vmcs_field_t first_field,
+				  vmcs_field_t last_field)
+{
+	vmcs_actual_object_t *p_vmcs = (vmcs_actual_object_t *)vmcs;
+
+	MON_ASSERT(p_vmcs);
+	return cache64_is_dirty_range(p_vmcs->cache, (uint32_t)first_field,
+		(uint32_t)last_field);
+}
+
 guest_cpu_handle_t vmcs_act_get_owner(const vmcs_object_t *vmcs)
 {
 	vmcs_actual_object_t *p_vmcs = (vmcs_actual_object_t *)vmcs;
@@ -378,14 +394,15 @@ guest_cpu_handle_t vmcs_act_get_owner(const vmcs_object_t *vmcs)
 	return p_vmcs->gcpu_owner;
 }
 
-extern boolean_t vmcs_sw_shadow_disable[];
 void vmcs_act_write(vmcs_object_t *vmcs, vmcs_field_t field_id,
 		    uint64_t value)
 {
 	vmcs_actual_object_t *p_vmcs = (vmcs_actual_object_t *)vmcs;
 
 	MON_ASSERT(p_vmcs);
-	if (!vmcs_sw_shadow_disable[hw_cpu_id()]) {
+	/* A VMCS may be accessed only on its owning CPU, so the flag of the
+	 * current host CPU applies. */
+	if (!hw_pcpu()->vmcs_sw_shadow_disable) {
 		cache64_write(p_vmcs->cache, value, (uint32_t)field_id);
 	} else {
 		vmcs_act_write_to_hardware(p_vmcs, field_id, value);
@@ -400,6 +417,13 @@ uint64_t vmcs_act_read(const vmcs_object_t *vmcs, vmcs_field_t field_id)
 	MON_ASSERT(p_vmcs);
 	MON_ASSERT(field_id < VMCS_FIELD_COUNT);
 
+	if (hw_pcpu()->vmcs_sw_shadow_disable) {
+		if (GET_NEVER_ACTIVATED_FLAG(p_vmcs)) {
+			return 0;
+		}
+		return vmcs_act_read_from_hardware(p_vmcs, field_id);
+	}
+
 	if (TRUE != cache64_read(p_vmcs->cache, &value, (uint32_t)field_id)) {
 		/* special case - if hw VMCS was never filled, there is nothing to read
 		 * from HW */
@@ -410,12 +434,55 @@ uint64_t vmcs_act_read(const vmcs_object_t *vmcs, vmcs_field_t field_id)
 		}
 
 		value = vmcs_act_read_from_hardware(p_vmcs, field_id);
-		/* update cache */
-		cache64_write(p_vmcs->cache, value, (uint32_t)field_id);
+		/* update cache, the value is in sync with hardware */
+		cache64_fill(p_vmcs->cache, value, (uint32_t)field_id);
 	}
 	return value;
 }
 
+/* Fields read by almost every VMEXIT handler; fetched in one burst right
+ * after VMEXIT, while the VMCS is current and no VMPTRLD is required */
+static const vmcs_field_t vmcs_act_exit_prefetch_fields[] = {
+	VMCS_EXIT_INFO_REASON,
+	VMCS_EXIT_INFO_QUALIFICATION,
+	VMCS_EXIT_INFO_INSTRUCTION_LENGTH,
+	VMCS_GUEST_RIP,
+	VMCS_GUEST_RFLAGS
+};
+
+/*--------------------------------------------------------------------------*
+*  FUNCTION : vmcs_act_prefetch_exit_info()
+*  PURPOSE  : Fill the VMCS cache with VMEXIT information fields
+*  ARGUMENTS: vmcs - active VMCS of the current CPU, cache just invalidated
+*  RETURNS  : void
+*--------------------------------------------------------------------------*/
+void vmcs_act_prefetch_exit_info(vmcs_object_t *vmcs)
+{
+	vmcs_actual_object_t *p_vmcs = (vmcs_actual_object_t *)vmcs;
+	hw_vmx_ret_value_t ret_val;
+	uint64_t value;
+	uint32_t i;
+
+	MON_ASSERT(p_vmcs);
+	MON_ASSERT(GET_ACTIVATED_FLAG(p_vmcs));
+
+	for (i = 0; i < (uint32_t)NELEMENTS(vmcs_act_exit_prefetch_fields);
+	     ++i) {
+		ret_val = hw_vmx_read_current_vmcs(
+			vmcs_get_field_encoding(
+				vmcs_act_exit_prefetch_fields[i], NULL),
+			&value);
+		if (ret_val != HW_VMX_SUCCESS) {
+			error_processing(p_vmcs->hpa, ret_val,
+				"hw_vmx_read_current_vmcs",
+				vmcs_act_exit_prefetch_fields[i]);
+			continue;
+		}
+		cache64_fill(p_vmcs->cache, value,
+			(uint32_t)vmcs_act_exit_prefetch_fields[i]);
+	}
+}
+
 uint64_t vmcs_act_read_from_hardware(vmcs_actual_object_t *p_vmcs,
 				     vmcs_field_t field_id)
 {
@@ -948,10 +948,9 @@ void ms_perform_cr_split(IN guest_cpu_handle_t gcpu,
 	gcpu_set_control_reg_layered(gcpu, reg, level1_reg, VMCS_LEVEL_1);
 }
 
-void ms_merge_to_level2(IN guest_cpu_handle_t gcpu,
-			IN boolean_t merge_only_dirty)
+static
+void ms_merge_controls_to_level2(IN guest_cpu_handle_t gcpu)
 {
-	/* TODO: merge only dirty */
 	vmcs_hierarchy_t *hierarchy = gcpu_get_vmcs_hierarchy(gcpu);
 	vmcs_object_t *level0_vmcs = vmcs_hierarchy_get_vmcs(hierarchy,
 		VMCS_LEVEL_0);
@@ -966,17 +965,6 @@ void ms_merge_to_level2(IN guest_cpu_handle_t gcpu,
 	processor_based_vm_execution_controls_t merged_controls;
 	processor_based_vm_execution_controls2_t merged_controls_2;
 
-	MON_ASSERT(level0_vmcs && level1_vmcs);
-
-	if ((merge_only_dirty) &&
-	    (!vmcs_is_dirty(level0_vmcs)) && (!vmcs_is_dirty(level1_vmcs))) {
-		return;
-	}
-
-	/* -----------------GUEST_STATE------------------- */
-	/* Copy guest state from level-1 vmcs */
-	ms_copy_guest_state_flom_level1(gcpu, TRUE /* copy CRs */);
-
 	/* -------------------CONTROLS-------------------- */
 	/* Merging controls */
 
@@ -1568,11 +1556,58 @@ void ms_merge_to_level2(IN guest_cpu_handle_t gcpu,
 			VMCS_ENTER_MSR_LOAD_ADDRESS,
 			VMCS_ENTER_MSR_LOAD_COUNT);
 	}
+}
+
+void ms_merge_to_level2(IN guest_cpu_handle_t gcpu,
+			IN boolean_t merge_only_dirty)
+{
+	vmcs_hierarchy_t *hierarchy = gcpu_get_vmcs_hierarchy(gcpu);
+	vmcs_object_t *level0_vmcs = vmcs_hierarchy_get_vmcs(hierarchy,
+		VMCS_LEVEL_0);
+	vmcs_object_t *level1_vmcs = vmcs_hierarchy_get_vmcs(hierarchy,
+		VMCS_LEVEL_1);
+	vmcs_object_t *merged_vmcs = vmcs_hierarchy_get_vmcs(hierarchy,
+		VMCS_MERGED);
+	boolean_t merge_guest_state = TRUE;
+	boolean_t merge_controls = TRUE;
+	boolean_t merge_host_state = TRUE;
+
+	MON_ASSERT(level0_vmcs && level1_vmcs);
+
+	if (merge_only_dirty) {
+		if ((!vmcs_is_dirty(level0_vmcs)) &&
+		    (!vmcs_is_dirty(level1_vmcs))) {
+			return;
+		}
+
+		/* Guest state is taken from level-1 only. Merged controls also
+		 * depend on level-1 guest CRs (CR shadows) and entry controls */
+		merge_guest_state =
+			vmcs_is_group_dirty(level1_vmcs, VMCS_GROUP_GUEST_STATE);
+		merge_controls = merge_guest_state ||
+			vmcs_is_group_dirty(level0_vmcs, VMCS_GROUP_CONTROLS) ||
+			vmcs_is_group_dirty(level1_vmcs, VMCS_GROUP_CONTROLS);
+		merge_host_state =
+			vmcs_is_group_dirty(level0_vmcs, VMCS_GROUP_HOST_STATE);
+	}
+
+	/* -----------------GUEST_STATE------------------- */
+	/* Copy guest state from level-1 vmcs */
+	if (merge_guest_state) {
+		ms_copy_guest_state_flom_level1(gcpu, TRUE /* copy CRs */);
+	}
+
+	/* -------------------CONTROLS-------------------- */
+	if (merge_controls) {
+		ms_merge_controls_to_level2(gcpu);
+	}
 
 	/* ------------------HOST_STATE------------------ */
 
 	/* Copy host state from level-0 vmcs */
-	ms_copy_host_state(merged_vmcs, level0_vmcs);
+	if (merge_host_state) {
+		ms_copy_host_state(merged_vmcs, level0_vmcs);
+	}
 }
 
 void ms_split_from_level2(IN guest_cpu_handle_t gcpu)
@@ -1628,9 +1663,8 @@ void ms_split_from_level2(IN guest_cpu_handle_t gcpu)
 
 void ms_merge_to_level1(IN guest_cpu_handle_t gcpu,
 			IN boolean_t was_vmexit_from_level1,
-			IN boolean_t merge_only_dirty UNUSED)
+			IN boolean_t merge_only_dirty)
 {
-	/* TODO: merge only dirty */
 	vmcs_hierarchy_t *hierarchy = gcpu_get_vmcs_hierarchy(gcpu);
 	vmcs_object_t *level0_vmcs = vmcs_hierarchy_get_vmcs(hierarchy,
 		VMCS_LEVEL_0);
@@ -1638,6 +1672,18 @@ void ms_merge_to_level1(IN guest_cpu_handle_t gcpu,
 		VMCS_LEVEL_1);
 	vmcs_object_t *merged_vmcs = vmcs_hierarchy_get_vmcs(hierarchy,
 		VMCS_MERGED);
+	boolean_t merge_host_state = TRUE;
+
+	/* (level-1) --> (level-1): guest state is not merged, so only modified
+	 * controls and level-0 host state require an update */
+	if (merge_only_dirty && was_vmexit_from_level1) {
+		if ((!vmcs_is_dirty(level0_vmcs)) &&
+		    (!vmcs_is_dirty(level1_vmcs))) {
+			return;
+		}
+		merge_host_state =
+			vmcs_is_group_dirty(level0_vmcs, VMCS_GROUP_HOST_STATE);
+	}
 
 	/* -----------------GUEST_STATE------------------- */
 
@@ -2359,7 +2405,9 @@ void ms_merge_to_level1(IN guest_cpu_handle_t gcpu,
 	/* ------------------HOST_STATE------------------ */
 
 	/* Copy host state from level-0 vmcs */
-	ms_copy_host_state(merged_vmcs, level0_vmcs);
+	if (merge_host_state) {
+		ms_copy_host_state(merged_vmcs, level0_vmcs);
+	}
 }
 
 /*
@@ -47,6 +47,10 @@ void vmcs_sw_flush_to_cpu(const vmcs_object_t *vmcs);
 static
 boolean_t vmcs_sw_is_dirty(const vmcs_object_t *vmcs);
 static
+boolean_t vmcs_sw_is_dirty_range(const vmcs_object_t *vmcs,
+				 vmcs_field_t first_field,
+				 vmcs_field_t last_field);
+static
 guest_cpu_handle_t vmcs_sw_get_owner(const vmcs_object_t *vmcs);
 
 static
@@ -209,6 +213,7 @@ vmcs_object_t *vmcs_0_create(vmcs_object_t *vmcs_origin)
 	vmcs_clone->vmcs_base->vmcs_write = vmcs_sw_write;
 	vmcs_clone->vmcs_base->vmcs_flush_to_cpu = vmcs_sw_flush_to_cpu;
 	vmcs_clone->vmcs_base->vmcs_is_dirty = vmcs_sw_is_dirty;
+	vmcs_clone->vmcs_base->vmcs_is_dirty_range = vmcs_sw_is_dirty_range;
 	vmcs_clone->vmcs_base->vmcs_get_owner = vmcs_sw_get_owner;
 	vmcs_clone->vmcs_base->vmcs_flush_to_memory = vmcs_0_flush_to_memory;
 	vmcs_clone->vmcs_base->vmcs_destroy = vmcs_0_destroy;
@@ -394,6 +399,17 @@ boolean_t vmcs_sw_is_dirty(const vmcs_object_t *vmcs)
 	return cache64_is_dirty(p_vmcs->cache);
 }
 
+boolean_t vmcs_sw_is_dirty_range(const vmcs_object_t *vmcs,
+				 vmcs_field_t first_field,
+				 vmcs_field_t last_field)
+{
+	vmcs_software_object_t *p_vmcs = (vmcs_software_object_t *)vmcs;
+
+	MON_ASSERT(p_vmcs);
+	return cache64_is_dirty_range(p_vmcs->cache, (uint32_t)first_field,
+		(uint32_t)last_field);
+}
+
 guest_cpu_handle_t vmcs_sw_get_owner(const vmcs_object_t *vmcs)
 {
 	vmcs_software_object_t *p_vmcs = (vmcs_software_object_t *)vmcs;
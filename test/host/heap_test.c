@@ -0,0 +1,361 @@
+/*******************************************************************************
+* Copyright (c) 2015 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+/*
+ * Randomized differential test of the page heap.
+ *
+ * The heap is initialized over a host buffer, random allocations and frees
+ * of all sizes are mirrored in a flat page ownership array. Allocations
+ * must not overlap, must keep their contents, and may fail only when the
+ * model has no free run long enough: freed blocks are coalesced and every
+ * free block of sufficient size is found.
+ *
+ * heap_test [number of operations] [seed] [number of rounds]
+ */
+
+#include <mon_defs.h>
+#include <common_libc.h>
+#include <heap.h>
+#include "host_test.h"
+
+#define HEAP_TEST_DEFAULT_OPS           2000
+#define HEAP_TEST_DEFAULT_SEED          0x2545F4914F6CDD1DULL
+#define HEAP_TEST_DEFAULT_ROUNDS        4
+#define HEAP_TEST_VERIFY_INTERVAL       50
+
+#define HEAP_TEST_BUFFER_SIZE           (8 * 1024 * 1024)
+#define HEAP_TEST_MAX_BUFFERS           1024
+#define HEAP_TEST_MAX_SCATTERED         16
+#define HEAP_TEST_FILLER                0xA5A5A5A5A5A5A5A5ULL
+
+typedef struct {
+	uint64_t	*p_buffer;
+	HEAP_PAGE_INT	first_page;
+	HEAP_PAGE_INT	number_of_pages;
+	uint64_t	tag;
+} heap_test_buffer_t;
+
+typedef struct {
+	address_t		heap_base;
+	HEAP_PAGE_INT		total_pages;
+	/* index + 1 of the buffer owning each page, 0 when free */
+	uint32_t		*owner;
+	heap_test_buffer_t	buffers[HEAP_TEST_MAX_BUFFERS];
+	uint64_t		seed;
+	uint64_t		tag;
+} heap_test_t;
+
+static heap_test_t heap_test;
+
+static
+HEAP_PAGE_INT heap_test_longest_free_run(void)
+{
+	HEAP_PAGE_INT longest = 0;
+	HEAP_PAGE_INT run = 0;
+	HEAP_PAGE_INT i;
+
+	for (i = 0; i < heap_test.total_pages; i++) {
+		run = heap_test.owner[i] ? 0 : run + 1;
+		longest = MAX(longest, run);
+	}
+	return longest;
+}
+
+static
+void heap_test_fill(IN heap_test_buffer_t *buffer, IN uint64_t value)
+{
+	uint64_t words = (uint64_t)buffer->number_of_pages * PAGE_4KB_SIZE /
+			 sizeof(uint64_t);
+	uint64_t i;
+
+	for (i = 0; i < words; i++) {
+		buffer->p_buffer[i] = value;
+	}
+}
+
+static
+boolean_t heap_test_check_contents(IN heap_test_buffer_t *buffer)
+{
+	uint64_t words = (uint64_t)buffer->number_of_pages * PAGE_4KB_SIZE /
+			 sizeof(uint64_t);
+	uint64_t i;
+
+	for (i = 0; i < words; i++) {
+		HOST_TEST_CHECK(buffer->p_buffer[i] == buffer->tag,
+			"buffer %p of %u pages changed while allocated",
+			buffer->p_buffer, buffer->number_of_pages);
+	}
+	return TRUE;
+}
+
+/* record a buffer returned by the heap in the model */
+static
+boolean_t heap_test_add(IN uint32_t index,
+			IN void *p_buffer,
+			IN HEAP_PAGE_INT number_of_pages,
+			IN boolean_t zeroed)
+{
+	heap_test_buffer_t *buffer = &heap_test.buffers[index];
+	address_t address = (address_t)p_buffer;
+	HEAP_PAGE_INT i;
+
+	HOST_TEST_CHECK(((address & PAGE_4KB_MASK) == 0) &&
+		(address >= heap_test.heap_base) &&
+		(address + (uint64_t)number_of_pages * PAGE_4KB_SIZE <=
+		 heap_test.heap_base +
+		 (uint64_t)heap_test.total_pages * PAGE_4KB_SIZE),
+		"buffer %p of %u pages is outside the heap", p_buffer,
+		number_of_pages);
+
+	buffer->p_buffer = (uint64_t *)p_buffer;
+	buffer->first_page = (HEAP_PAGE_INT)((address - heap_test.heap_base) /
+					     PAGE_4KB_SIZE);
+	buffer->number_of_pages = number_of_pages;
+	buffer->tag = ++heap_test.tag;
+
+	for (i = 0; i < number_of_pages; i++) {
+		HOST_TEST_CHECK(heap_test.owner[buffer->first_page + i] == 0,
+			"buffer %p of %u pages overlaps buffer %p", p_buffer,
+			number_of_pages,
+			heap_test.buffers[heap_test.owner[buffer->first_page +
+							  i] - 1].p_buffer);
+		heap_test.owner[buffer->first_page + i] = index + 1;
+	}
+
+	HOST_TEST_CHECK(mon_page_buff_size(p_buffer) == number_of_pages,
+		"buffer %p has %u pages, expected %u", p_buffer,
+		mon_page_buff_size(p_buffer), number_of_pages);
+
+	if (zeroed) {
+		buffer->tag = 0;
+		if (!heap_test_check_contents(buffer)) {
+			return FALSE;
+		}
+		buffer->tag = heap_test.tag;
+	}
+	heap_test_fill(buffer, buffer->tag);
+	return TRUE;
+}
+
+static
+boolean_t heap_test_free(IN uint32_t index)
+{
+	heap_test_buffer_t *buffer = &heap_test.buffers[index];
+	HEAP_PAGE_INT i;
+
+	if (!heap_test_check_contents(buffer)) {
+		return FALSE;
+	}
+	/* leave garbage behind for mon_memory_alloc() to clear */
+	heap_test_fill(buffer, HEAP_TEST_FILLER);
+	mon_page_free(buffer->p_buffer);
+
+	for (i = 0; i < buffer->number_of_pages; i++) {
+		heap_test.owner[buffer->first_page + i] = 0;
+	}
+	buffer->p_buffer = NULL;
+	return TRUE;
+}
+
+static
+HEAP_PAGE_INT heap_test_rand_size(void)
+{
+	switch (host_test_rand_range(&heap_test.seed, 16)) {
+	case 0:
+		/* large, may not fit */
+		return (HEAP_PAGE_INT)host_test_rand_range(&heap_test.seed,
+			heap_test.total_pages / 2) + 1;
+	case 1:
+	case 2:
+		return (HEAP_PAGE_INT)host_test_rand_range(&heap_test.seed,
+			64) + 1;
+	default:
+		return (HEAP_PAGE_INT)host_test_rand_range(&heap_test.seed,
+			4) + 1;
+	}
+}
+
+static
+boolean_t heap_test_alloc(IN uint32_t index)
+{
+	HEAP_PAGE_INT number_of_pages = heap_test_rand_size();
+	boolean_t zeroed = (host_test_rand_range(&heap_test.seed, 4) == 0);
+	void *p_buffer;
+
+	if (zeroed) {
+		p_buffer = mon_memory_alloc(number_of_pages * PAGE_4KB_SIZE -
+			(uint32_t)host_test_rand_range(&heap_test.seed,
+				PAGE_4KB_SIZE));
+	} else {
+		p_buffer = mon_page_alloc(number_of_pages);
+	}
+
+	if (p_buffer == NULL) {
+		HOST_TEST_CHECK(heap_test_longest_free_run() < number_of_pages,
+			"allocation of %u pages failed, %u free pages in a row",
+			number_of_pages, heap_test_longest_free_run());
+		return TRUE;
+	}
+	return heap_test_add(index, p_buffer, number_of_pages, zeroed);
+}
+
+static
+boolean_t heap_test_alloc_scattered(void)
+{
+	void *pages[HEAP_TEST_MAX_SCATTERED];
+	HEAP_PAGE_INT number_of_pages = (HEAP_PAGE_INT)host_test_rand_range(
+		&heap_test.seed, HEAP_TEST_MAX_SCATTERED) + 1;
+	HEAP_PAGE_INT free_pages = 0;
+	HEAP_PAGE_INT allocated, i;
+	uint32_t index = 0;
+
+	for (i = 0; i < heap_test.total_pages; i++) {
+		free_pages += (heap_test.owner[i] == 0);
+	}
+
+	allocated = mon_page_alloc_scattered(number_of_pages, pages);
+	HOST_TEST_CHECK(allocated == MIN(number_of_pages, free_pages),
+		"%u of %u scattered pages allocated, %u pages free",
+		allocated, number_of_pages, free_pages);
+
+	for (i = 0; i < allocated; i++) {
+		while (heap_test.buffers[index].p_buffer != NULL) {
+			index++;
+			if (index == HEAP_TEST_MAX_BUFFERS) {
+				/* no room in the model, give the rest back */
+				for (; i < allocated; i++) {
+					mon_page_free(pages[i]);
+				}
+				return TRUE;
+			}
+		}
+		if (!heap_test_add(index, pages[i], 1, FALSE)) {
+			return FALSE;
+		}
+	}
+	for (; i < number_of_pages; i++) {
+		HOST_TEST_CHECK(pages[i] == NULL,
+			"scattered page %u not allocated but set", i);
+	}
+	return TRUE;
+}
+
+static
+boolean_t heap_test_verify(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < HEAP_TEST_MAX_BUFFERS; i++) {
+		if ((heap_test.buffers[i].p_buffer != NULL) &&
+		    !heap_test_check_contents(&heap_test.buffers[i])) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+static
+boolean_t heap_test_run(IN uint32_t num_of_ops)
+{
+	void *p_buffer;
+	uint32_t op, i;
+
+	for (op = 0; op < num_of_ops; op++) {
+		uint32_t index = (uint32_t)host_test_rand_range(&heap_test.seed,
+			HEAP_TEST_MAX_BUFFERS);
+		boolean_t res;
+
+		if (host_test_rand_range(&heap_test.seed, 32) == 0) {
+			res = heap_test_alloc_scattered();
+		} else if (heap_test.buffers[index].p_buffer != NULL) {
+			res = heap_test_free(index);
+		} else {
+			res = heap_test_alloc(index);
+		}
+		HOST_TEST_CHECK(res, "heap operation %u failed", op);
+
+		if (((op + 1) % HEAP_TEST_VERIFY_INTERVAL) == 0) {
+			if (!heap_test_verify()) {
+				return FALSE;
+			}
+		}
+	}
+
+	for (i = 0; i < HEAP_TEST_MAX_BUFFERS; i++) {
+		if ((heap_test.buffers[i].p_buffer != NULL) &&
+		    !heap_test_free(i)) {
+			return FALSE;
+		}
+	}
+
+	/* everything was merged back into a single block */
+	p_buffer = mon_page_alloc(heap_test.total_pages);
+	HOST_TEST_CHECK(p_buffer == (void *)heap_test.heap_base,
+		"whole heap can't be allocated after freeing everything");
+	mon_page_free(p_buffer);
+	return TRUE;
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t num_of_ops = (uint32_t)host_test_arg(argc, argv, 1,
+		HEAP_TEST_DEFAULT_OPS);
+	uint64_t seed = host_test_arg(argc, argv, 2, HEAP_TEST_DEFAULT_SEED);
+	uint32_t num_of_rounds = (uint32_t)host_test_arg(argc, argv, 3,
+		HEAP_TEST_DEFAULT_ROUNDS);
+	void *heap_buffer;
+	address_t heap_end;
+	uint32_t round;
+
+	if (seed == 0) {
+		seed = 1;
+	}
+	printf("heap_test: %u rounds of %u operations, seed 0x%llx\n",
+		num_of_rounds, num_of_ops, seed);
+
+	if (posix_memalign(&heap_buffer, PAGE_4KB_SIZE,
+		    HEAP_TEST_BUFFER_SIZE) != 0) {
+		printf("heap_test: out of memory\n");
+		return 1;
+	}
+	heap_end = mon_heap_initialize((address_t)heap_buffer,
+		HEAP_TEST_BUFFER_SIZE);
+	heap_test.total_pages = mon_heap_get_total_pages();
+	heap_test.heap_base = heap_end -
+			      (address_t)heap_test.total_pages * PAGE_4KB_SIZE;
+
+	/* the model lives in the heap, in the pages behind the tested part */
+	heap_test.owner = (uint32_t *)mon_memory_alloc(
+		heap_test.total_pages * sizeof(uint32_t));
+	if ((address_t)heap_test.owner != heap_test.heap_base) {
+		printf("heap_test: model not placed at the heap start\n");
+		return 1;
+	}
+	heap_test.heap_base += ALIGN_FORWARD(heap_test.total_pages *
+		sizeof(uint32_t), PAGE_4KB_SIZE);
+	heap_test.total_pages -= mon_page_buff_size(heap_test.owner);
+
+	for (round = 0; round < num_of_rounds; round++) {
+		heap_test.seed = host_test_rand(&seed);
+		if (!heap_test_run(num_of_ops)) {
+			printf("heap_test: FAILED in round %u\n", round);
+			return 1;
+		}
+	}
+
+	printf("heap_test: PASSED\n");
+	return 0;
+}
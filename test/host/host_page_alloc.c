@@ -0,0 +1,243 @@
+/*******************************************************************************
+* Copyright (c) 2015 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+/*
+ * Page allocator stub replacing heap.c for the tests of the code above it.
+ *
+ * MAM keeps table addresses in 40 bits, like the physical addresses they
+ * are in the monitor, while the C library allocates far above 1T. Pages
+ * are therefore carved from an arena reserved low in the address space:
+ * fresh pages from its end, freed buffers are reused for requests of the
+ * same size. The size of each buffer is kept beside the arena, so
+ * mon_page_buff_size() works and leaks can be counted.
+ *
+ * mon_page_allocate() fills the pages with garbage, the monitor heap does
+ * not zero them either.
+ */
+
+#include <mon_defs.h>
+#include <heap.h>
+#include "host_test.h"
+
+/* Linux x86-64 */
+extern void *mmap(void *addr, size_t length, int prot, int flags, int fd,
+		  int64_t offset);
+#define HOST_PROT_READ_WRITE    0x3
+#define HOST_MAP_ANONYMOUS      0x22            /* private, anonymous */
+#define HOST_MAP_NORESERVE      0x4000
+#define HOST_MAP_FAILED         ((void *)-1)
+
+#define HOST_PAGE_ALLOC_BASE    0x1000000000ULL /* 64G */
+#define HOST_PAGE_ALLOC_PAGES   (4 * 1024 * 1024)       /* 16G */
+#define HOST_PAGE_ALLOC_LIMIT   0x10000000000ULL        /* 1T */
+/* Free buffers of up to this many pages have their own list */
+#define HOST_PAGE_ALLOC_LISTS   64
+#define HOST_PAGE_ALLOC_FILLER  0xA5
+
+typedef struct host_page_alloc_free_t {
+	struct host_page_alloc_free_t	*next;
+	HEAP_PAGE_INT			number_of_pages;
+	uint32_t			padding;
+} host_page_alloc_free_t;
+
+static char *host_page_alloc_arena;
+static HEAP_PAGE_INT host_page_alloc_next_page;
+/* number of pages of the buffer starting at each arena page, 0 if none */
+static HEAP_PAGE_INT host_page_alloc_sizes[HOST_PAGE_ALLOC_PAGES];
+/* last list holds the larger buffers */
+static host_page_alloc_free_t *host_page_alloc_free[HOST_PAGE_ALLOC_LISTS + 1];
+static uint64_t host_page_alloc_used_pages;
+
+static
+void host_page_alloc_init(void)
+{
+	void *p = mmap((void *)HOST_PAGE_ALLOC_BASE,
+		(size_t)HOST_PAGE_ALLOC_PAGES * PAGE_4KB_SIZE,
+		HOST_PROT_READ_WRITE, HOST_MAP_ANONYMOUS | HOST_MAP_NORESERVE,
+		-1, 0);
+
+	if ((p == HOST_MAP_FAILED) ||
+	    ((uint64_t)p + (uint64_t)HOST_PAGE_ALLOC_PAGES * PAGE_4KB_SIZE >
+	     HOST_PAGE_ALLOC_LIMIT)) {
+		printf("page allocator: can't reserve the arena below 1T\n");
+		abort();
+	}
+	host_page_alloc_arena = (char *)p;
+}
+
+static
+HEAP_PAGE_INT host_page_alloc_get_index(IN void *p_buffer)
+{
+	uint64_t offset = (uint64_t)((char *)p_buffer - host_page_alloc_arena);
+	HEAP_PAGE_INT index = (HEAP_PAGE_INT)(offset / PAGE_4KB_SIZE);
+
+	if ((host_page_alloc_arena == NULL) ||
+	    ((char *)p_buffer < host_page_alloc_arena) ||
+	    ((offset & PAGE_4KB_MASK) != 0) ||
+	    (index >= host_page_alloc_next_page) ||
+	    (host_page_alloc_sizes[index] == 0)) {
+		printf("page allocator: %p was not allocated here\n", p_buffer);
+		abort();
+	}
+	return index;
+}
+
+static
+host_page_alloc_free_t **host_page_alloc_get_list(
+	IN HEAP_PAGE_INT number_of_pages)
+{
+	return &host_page_alloc_free[MIN(number_of_pages,
+					 HOST_PAGE_ALLOC_LISTS + 1) - 1];
+}
+
+static
+void *host_page_alloc(IN HEAP_PAGE_INT number_of_pages)
+{
+	host_page_alloc_free_t **list;
+	char *p = NULL;
+
+	if (number_of_pages == 0) {
+		return NULL;
+	}
+	if (host_page_alloc_arena == NULL) {
+		host_page_alloc_init();
+	}
+
+	list = host_page_alloc_get_list(number_of_pages);
+	while (*list != NULL) {
+		if ((*list)->number_of_pages == number_of_pages) {
+			p = (char *)*list;
+			*list = (*list)->next;
+			break;
+		}
+		list = &(*list)->next;
+	}
+
+	if (p == NULL) {
+		if (number_of_pages >
+		    HOST_PAGE_ALLOC_PAGES - host_page_alloc_next_page) {
+			return NULL;
+		}
+		p = host_page_alloc_arena +
+		    (uint64_t)host_page_alloc_next_page * PAGE_4KB_SIZE;
+		host_page_alloc_next_page += number_of_pages;
+	}
+
+	host_page_alloc_sizes[(p - host_page_alloc_arena) / PAGE_4KB_SIZE] =
+		number_of_pages;
+	host_page_alloc_used_pages += number_of_pages;
+	return p;
+}
+
+uint64_t host_page_alloc_get_used_pages(void)
+{
+	return host_page_alloc_used_pages;
+}
+
+void *mon_page_allocate(
+#ifdef DEBUG
+	char *file_name, int32_t line_number,
+#endif
+	HEAP_PAGE_INT number_of_pages)
+{
+	void *p = host_page_alloc(number_of_pages);
+
+	if (p != NULL) {
+		memset(p, HOST_PAGE_ALLOC_FILLER,
+			(size_t)number_of_pages * PAGE_4KB_SIZE);
+	}
+	return p;
+}
+
+HEAP_PAGE_INT mon_page_allocate_scattered(
+#ifdef DEBUG
+	char *file_name, int32_t line_number,
+#endif
+	IN HEAP_PAGE_INT number_of_pages, OUT void *p_page_array[])
+{
+	HEAP_PAGE_INT i;
+
+	for (i = 0; i < number_of_pages; i++) {
+		p_page_array[i] = mon_page_allocate(
+#ifdef DEBUG
+			file_name, line_number,
+#endif
+			1);
+		if (p_page_array[i] == NULL) {
+			break;
+		}
+	}
+	return i;
+}
+
+void mon_page_free(IN void *p_buffer)
+{
+	HEAP_PAGE_INT index = host_page_alloc_get_index(p_buffer);
+	HEAP_PAGE_INT number_of_pages = host_page_alloc_sizes[index];
+	host_page_alloc_free_t *buffer = (host_page_alloc_free_t *)p_buffer;
+	host_page_alloc_free_t **list =
+		host_page_alloc_get_list(number_of_pages);
+
+	host_page_alloc_sizes[index] = 0;
+	host_page_alloc_used_pages -= number_of_pages;
+
+	memset(p_buffer, HOST_PAGE_ALLOC_FILLER,
+		(size_t)number_of_pages * PAGE_4KB_SIZE);
+	buffer->number_of_pages = number_of_pages;
+	buffer->next = *list;
+	*list = buffer;
+}
+
+uint32_t mon_page_buff_size(IN void *p_buffer)
+{
+	return host_page_alloc_sizes[host_page_alloc_get_index(p_buffer)];
+}
+
+void *mon_memory_allocate(
+#ifdef DEBUG
+	char *file_name, int32_t line_number,
+#endif
+	IN uint32_t size)
+{
+	HEAP_PAGE_INT number_of_pages =
+		(HEAP_PAGE_INT)((size + PAGE_4KB_SIZE - 1) / PAGE_4KB_SIZE);
+	void *p = host_page_alloc(number_of_pages);
+
+	if (p != NULL) {
+		memset(p, 0, (size_t)number_of_pages * PAGE_4KB_SIZE);
+	}
+	return p;
+}
+
+/* Nothing can be reclaimed on the host, this is plain allocation */
+void *mon_memory_allocate_must_succeed(
+#ifdef DEBUG
+	char *file_name, int32_t line_number,
+#endif
+	heap_alloc_handle_t handle, uint32_t size)
+{
+	void *p = mon_memory_allocate(
+#ifdef DEBUG
+		file_name, line_number,
+#endif
+		size);
+
+	if (p == NULL) {
+		printf("page allocator: out of memory\n");
+		abort();
+	}
+	return p;
+}
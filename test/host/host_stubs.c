@@ -0,0 +1,156 @@
+/*******************************************************************************
+* Copyright (c) 2015 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+/*
+ * Monitor services used by libmon_host.a, implemented for a single
+ * threaded user space process: one CPU, identity HVA <-> HPA, printing
+ * through the C library and asserts that abort the process.
+ */
+
+#include <mon_defs.h>
+#include <common_libc.h>
+#include <mon_dbg.h>
+#include <mon_globals.h>
+#include <hw_utils.h>
+#include <ipc.h>
+#include <host_memory_manager_api.h>
+#include <e820_abstraction.h>
+#include "host_test.h"
+
+cpu_id_t g_num_of_cpus = 1;
+
+/* heap.c: no extra physical address ranges behind the heap */
+uint32_t g_heap_pa_num;
+
+/* MON_LOG reads the debug mask from here, zero keeps the logs quiet */
+mon_startup_struct_t mon_startup_data;
+
+int CDECL mon_printf(const char *format, ...)
+{
+	va_list args;
+	int ret;
+
+	va_start(args, format);
+	ret = vprintf(format, args);
+	va_end(args);
+	return ret;
+}
+
+boolean_t deadloop_helper(const char *assert_condition,
+			  const char *func_name,
+			  const char *file_name,
+			  uint32_t line_num,
+			  uint32_t access_level)
+{
+	printf("%s:%u: %s: assertion \"%s\" failed\n",
+		file_name, line_num, func_name,
+		assert_condition ? assert_condition : "");
+	abort();
+	return FALSE;
+}
+
+void mon_deadloop_dump(uint32_t file_code, uint32_t line_num)
+{
+	printf("deadloop in file code %u line %u\n", file_code, line_num);
+	abort();
+}
+
+void *CDECL mon_memset(void *dest, int filler, size_t count)
+{
+	return memset(dest, filler, count);
+}
+
+void CDECL mon_memset64(void *dest, uint64_t value, size_t count)
+{
+	uint64_t *p = (uint64_t *)dest;
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		p[i] = value;
+	}
+}
+
+cpu_id_t ASM_FUNCTION hw_cpu_id(void)
+{
+	return 0;
+}
+
+/* Nobody else waits for us, there is nothing to process while spinning */
+boolean_t ipc_process_one_ipc(void)
+{
+	return FALSE;
+}
+
+boolean_t mon_hmm_hva_to_hpa(IN hva_t hva, OUT hpa_t *hpa)
+{
+	*hpa = (hpa_t)hva;
+	return TRUE;
+}
+
+boolean_t mon_hmm_hpa_to_hva(IN hpa_t hpa, OUT hva_t *hva)
+{
+	*hva = (hva_t)hpa;
+	return TRUE;
+}
+
+/*
+ * gpm_create_e820_map() is the only user of these, and the tests don't
+ * build guest E820 maps.
+ */
+boolean_t e820_abstraction_create_new_map(OUT e820_handle_t *handle)
+{
+	return FALSE;
+}
+
+void e820_abstraction_destroy_map(IN e820_handle_t handle)
+{
+}
+
+boolean_t e820_abstraction_add_new_range(IN e820_handle_t handle,
+					 IN uint64_t base_address,
+					 IN uint64_t length,
+					 IN int15_e820_range_type_t
+					 address_range_type,
+					 IN int15_e820_memory_map_ext_attributes_t
+					 extended_attributes)
+{
+	return FALSE;
+}
+
+e820_abstraction_range_iterator_t
+e820_abstraction_iterator_get_first(e820_handle_t e820_handle)
+{
+	return NULL;
+}
+
+e820_abstraction_range_iterator_t
+e820_abstraction_iterator_get_next(e820_handle_t e820_handle,
+				   e820_abstraction_range_iterator_t iter)
+{
+	return NULL;
+}
+
+const int15_e820_memory_map_entry_ext_t *
+e820_abstraction_iterator_get_range_details(IN
+					    e820_abstraction_range_iterator_t
+					    iter)
+{
+	return NULL;
+}
+
+void e820_abstraction_print_memory_map(IN e820_handle_t handle)
+{
+}
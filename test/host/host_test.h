@@ -0,0 +1,77 @@
+/*******************************************************************************
+* Copyright (c) 2015 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef _HOST_TEST_H_
+#define _HOST_TEST_H_
+
+/*
+ * Common definitions of the user space memory manager tests.
+ *
+ * The programs are built with the monitor headers only (-nostdinc), so the
+ * few C library functions they use are declared here.
+ */
+
+#include <mon_defs.h>
+
+extern int printf(const char *format, ...);
+extern int vprintf(const char *format, va_list args);
+extern int posix_memalign(void **ptr, size_t alignment, size_t size);
+extern void free(void *ptr);
+extern void abort(void);
+extern void *memset(void *dest, int filler, size_t count);
+extern unsigned long long strtoull(const char *str, char **end, int base);
+
+/* Fail the current test function with a message */
+#define HOST_TEST_CHECK(__condition, ...)                                      \
+	do {                                                                   \
+		if (!(__condition)) {                                          \
+			printf("%s:%d: ", __FILE__, __LINE__);                 \
+			printf(__VA_ARGS__);                                   \
+			printf("\n");                                          \
+			return FALSE;                                          \
+		}                                                              \
+	} while (0)
+
+/* xorshift64, never returns 0 for a non zero seed */
+INLINE uint64_t host_test_rand(IN OUT uint64_t *seed)
+{
+	uint64_t x = *seed;
+
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	*seed = x;
+	return x;
+}
+
+INLINE uint64_t host_test_rand_range(IN OUT uint64_t *seed, IN uint64_t limit)
+{
+	return host_test_rand(seed) % limit;
+}
+
+/* argv[index] as number, or the default */
+INLINE uint64_t host_test_arg(IN int argc,
+			      IN char *argv[],
+			      IN int index,
+			      IN uint64_t default_value)
+{
+	return (argc > index) ? strtoull(argv[index], NULL, 0) : default_value;
+}
+
+/* Pages currently handed out by the stubbed allocator (host_page_alloc.c) */
+uint64_t host_page_alloc_get_used_pages(void);
+
+#endif /* _HOST_TEST_H_ */
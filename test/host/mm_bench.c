@@ -0,0 +1,288 @@
+/*******************************************************************************
+* Copyright (c) 2015 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+/*
+ * Micro benchmark of the Memory Address Mapper over E820 shaped guest
+ * maps. Reports TSC cycles of insertion (one by one and batched), lookup,
+ * permission changes, removal and conversion to EPT.
+ *
+ * mm_bench [number of ranges] [guest size in GB] [seed]
+ *
+ * Without arguments a small, a typical and a large guest are measured.
+ */
+
+#include <mon_defs.h>
+#include <common_libc.h>
+#include <memory_address_mapper_api.h>
+#include <gpm_api.h>
+#include <heap.h>
+#include <hw_utils.h>
+#include <mon_phys_mem_types.h>
+#include "host_test.h"
+
+#define MM_BENCH_DEFAULT_SEED           0x2545F4914F6CDD1DULL
+#define MM_BENCH_LOOKUPS                (1024 * 1024)
+#define MM_BENCH_UPDATES                16384
+#define MM_BENCH_NOT_MAPPED             ((mam_mapping_result_t)0x10)
+
+static const struct {
+	uint32_t	num_of_ranges;
+	uint32_t	size_in_gb;
+} mm_bench_configs[] = {
+	{ 16,   4 },
+	{ 256,  64 },
+	{ 1024, 512 },
+};
+
+/*
+ * Fill "ranges" with a sorted, E820 shaped guest map: low memory below
+ * 640K, RAM up to 3G with a PCI hole up to 4G and the rest above 4G.
+ * RAM is cut into "count" ranges by small holes and short uncached slices,
+ * the way GPM ranges x MTRR slices look for real guests.
+ */
+static
+uint32_t mm_bench_build_map(IN OUT uint64_t *seed,
+			    OUT mam_range_desc_t *ranges,
+			    IN uint32_t count,
+			    IN uint64_t total_size)
+{
+	uint64_t addr = 0x100000;
+	uint64_t chunk = MAX(total_size / count, PAGE_4KB_SIZE) &
+			 ~((uint64_t)PAGE_4KB_SIZE - 1);
+	uint32_t i = 0;
+
+	ranges[i].src_addr = 0;
+	ranges[i].tgt_addr = 0;
+	ranges[i].size = 0x9f000;
+	ranges[i].attrs = mam_rwx_attrs;
+	ranges[i].attrs.ept_attr.emt = MON_PHYS_MEM_WRITE_BACK;
+	ranges[i].padding = 0;
+	i++;
+
+	while ((i < count) && (addr < total_size)) {
+		uint64_t size = chunk - host_test_rand_range(seed,
+			chunk / (4 * PAGE_4KB_SIZE) + 1) * PAGE_4KB_SIZE;
+
+		if ((addr < 0x100000000ULL) && (addr + size > 0xC0000000ULL)) {
+			/* PCI hole */
+			if (addr < 0xC0000000ULL) {
+				size = 0xC0000000ULL - addr;
+			} else {
+				addr = 0x100000000ULL;
+				continue;
+			}
+		}
+
+		ranges[i].src_addr = addr;
+		ranges[i].tgt_addr = addr;
+		ranges[i].size = size;
+		ranges[i].attrs = mam_rwx_attrs;
+		ranges[i].attrs.ept_attr.emt =
+			host_test_rand_range(seed, 16) ?
+			MON_PHYS_MEM_WRITE_BACK : MON_PHYS_MEM_UNCACHED;
+		ranges[i].padding = 0;
+		i++;
+
+		addr += size;
+		if (host_test_rand_range(seed, 2) == 0) {
+			addr += (host_test_rand_range(seed, 512) + 1) *
+				PAGE_4KB_SIZE;
+		}
+	}
+
+	return i;
+}
+
+static
+void mm_bench_report(IN const char *name,
+		     IN uint64_t cycles,
+		     IN uint32_t num_of_ops)
+{
+	printf("  %-24s %12llu cycles %10llu per op\n", name, cycles,
+		cycles / MAX(num_of_ops, 1));
+}
+
+/* random page of the map, mapped or not */
+static
+uint64_t mm_bench_rand_page(IN OUT uint64_t *seed, IN uint64_t highest_addr)
+{
+	return ALIGN_BACKWARD(host_test_rand_range(seed, highest_addr),
+		PAGE_4KB_SIZE);
+}
+
+static
+boolean_t mm_bench_run(IN uint32_t requested,
+		       IN uint64_t total_size,
+		       IN uint64_t seed)
+{
+	uint64_t used_pages = host_page_alloc_get_used_pages();
+	uint64_t highest_addr;
+	uint64_t start, tgt_addr, ept_root_hpa;
+	mam_range_desc_t *ranges;
+	mam_handle_t single = MAM_INVALID_HANDLE;
+	mam_handle_t batched = MAM_INVALID_HANDLE;
+	gpm_handle_t gpm;
+	mam_attributes_t attrs, write;
+	hpa_t hpa;
+	uint32_t count, i;
+	boolean_t res = FALSE;
+
+	ranges = (mam_range_desc_t *)mon_memory_alloc(requested *
+		sizeof(mam_range_desc_t));
+	if (ranges == NULL) {
+		printf("mm_bench: out of memory\n");
+		return FALSE;
+	}
+	count = mm_bench_build_map(&seed, ranges, requested, total_size);
+	highest_addr = ranges[count - 1].src_addr + ranges[count - 1].size;
+	printf("mm_bench: %u ranges up to 0x%llx\n", count, highest_addr);
+
+	single = mam_create_mapping(mam_rwx_attrs);
+	batched = mam_create_mapping(mam_rwx_attrs);
+	if ((single == MAM_INVALID_HANDLE) || (batched == MAM_INVALID_HANDLE)) {
+		goto out;
+	}
+
+	start = hw_rdtsc();
+	for (i = 0; i < count; i++) {
+		if (!mam_insert_range(single, ranges[i].src_addr,
+			    ranges[i].tgt_addr, ranges[i].size,
+			    ranges[i].attrs)) {
+			goto out;
+		}
+	}
+	mm_bench_report("mam_insert_range", hw_rdtsc() - start, count);
+
+	start = hw_rdtsc();
+	if (!mam_insert_ranges(batched, ranges, count)) {
+		goto out;
+	}
+	mm_bench_report("mam_insert_ranges", hw_rdtsc() - start, count);
+
+	start = hw_rdtsc();
+	for (i = 0; i < MM_BENCH_LOOKUPS; i++) {
+		mam_get_mapping(batched,
+			host_test_rand_range(&seed, highest_addr),
+			&tgt_addr, &attrs);
+	}
+	mm_bench_report("mam_get_mapping", hw_rdtsc() - start,
+		MM_BENCH_LOOKUPS);
+
+	write.uint32 = 0;
+	write.ept_attr.writable = 1;
+	start = hw_rdtsc();
+	for (i = 0; i < MM_BENCH_UPDATES; i++) {
+		uint64_t addr = mm_bench_rand_page(&seed, highest_addr);
+
+		if (!mam_remove_permissions_from_existing_mapping(batched,
+			    addr, PAGE_4KB_SIZE, write) ||
+		    !mam_add_permissions_to_existing_mapping(batched,
+			    addr, PAGE_4KB_SIZE, write)) {
+			goto out;
+		}
+	}
+	mm_bench_report("4K permission flip", hw_rdtsc() - start,
+		MM_BENCH_UPDATES);
+
+	start = hw_rdtsc();
+	for (i = 0; i < MM_BENCH_UPDATES; i++) {
+		uint64_t addr = mm_bench_rand_page(&seed, highest_addr);
+
+		if (!mam_insert_not_existing_range(batched, addr,
+			    PAGE_4KB_SIZE, MM_BENCH_NOT_MAPPED) ||
+		    !mam_insert_range(batched, addr, addr, PAGE_4KB_SIZE,
+			    mam_rwx_attrs)) {
+			goto out;
+		}
+	}
+	mm_bench_report("4K remove + insert", hw_rdtsc() - start,
+		MM_BENCH_UPDATES);
+
+	start = hw_rdtsc();
+	if (!mon_mam_convert_to_ept(single,
+		    MAM_EPT_SUPPORT_2MB_PAGE | MAM_EPT_SUPPORT_1GB_PAGE,
+		    MAM_EPT_48_BITS_GAW, FALSE, &ept_root_hpa)) {
+		goto out;
+	}
+	mm_bench_report("mon_mam_convert_to_ept", hw_rdtsc() - start, 1);
+
+	start = hw_rdtsc();
+	for (i = 0; i < MM_BENCH_LOOKUPS; i++) {
+		mam_get_mapping(single,
+			host_test_rand_range(&seed, highest_addr),
+			&tgt_addr, &attrs);
+	}
+	mm_bench_report("mam_get_mapping (ept)", hw_rdtsc() - start,
+		MM_BENCH_LOOKUPS);
+
+	/* GPM keeps the map in a MAM of its own */
+	gpm = mon_gpm_create_mapping();
+	if (gpm == GPM_INVALID_HANDLE) {
+		goto out;
+	}
+	for (i = 0; i < count; i++) {
+		if (!mon_gpm_add_mapping(gpm, ranges[i].src_addr,
+			    ranges[i].tgt_addr, ranges[i].size,
+			    ranges[i].attrs)) {
+			goto out;
+		}
+	}
+	start = hw_rdtsc();
+	for (i = 0; i < MM_BENCH_LOOKUPS; i++) {
+		mon_gpm_gpa_to_hpa(gpm, host_test_rand_range(&seed,
+				highest_addr), &hpa, &attrs);
+	}
+	mm_bench_report("mon_gpm_gpa_to_hpa", hw_rdtsc() - start,
+		MM_BENCH_LOOKUPS);
+
+	res = TRUE;
+
+out:
+	if (!res) {
+		printf("mm_bench: operation failed (out of memory?)\n");
+	}
+	if (single != MAM_INVALID_HANDLE) {
+		mon_mam_destroy_mapping(single);
+	}
+	if (batched != MAM_INVALID_HANDLE) {
+		mon_mam_destroy_mapping(batched);
+	}
+	mon_memory_free(ranges);
+	printf("  %llu pages of tables in use\n",
+		host_page_alloc_get_used_pages() - used_pages);
+	return res;
+}
+
+int main(int argc, char *argv[])
+{
+	uint64_t seed = host_test_arg(argc, argv, 3, MM_BENCH_DEFAULT_SEED);
+	uint32_t i;
+
+	if (argc > 1) {
+		return mm_bench_run(MAX((uint32_t)host_test_arg(argc, argv, 1,
+					0), 2),
+			host_test_arg(argc, argv, 2, 64) << 30, seed) ? 0 : 1;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(mm_bench_configs); i++) {
+		if (!mm_bench_run(mm_bench_configs[i].num_of_ranges,
+			    (uint64_t)mm_bench_configs[i].size_in_gb << 30,
+			    seed)) {
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,1147 @@
+/*******************************************************************************
+* Copyright (c) 2015 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+/*
+ * Randomized differential test of MAM, GPM, hash64 and pool.
+ *
+ * Each test runs random operations through the public API and checks the
+ * results against a flat reference model: a per-page array for the
+ * mappers, a key array for hash64 and the written contents of the live
+ * elements for the pool. MAM is checked on the internal representation
+ * and again after conversion to EPT.
+ *
+ * mm_test [number of operations] [seed] [number of rounds]
+ */
+
+#include <mon_defs.h>
+#include <common_libc.h>
+#include <memory_address_mapper_api.h>
+#include <gpm_api.h>
+#include <hash64_api.h>
+#include <pool_api.h>
+#include <heap.h>
+#include <mon_phys_mem_types.h>
+#include "host_test.h"
+
+#define MM_TEST_DEFAULT_OPS             2000
+#define MM_TEST_DEFAULT_SEED            0x2545F4914F6CDD1DULL
+#define MM_TEST_DEFAULT_ROUNDS          4
+#define MM_TEST_VERIFY_INTERVAL         50
+
+/* Window checked page by page by the mapper tests (16M) */
+#define MM_TEST_WINDOW_PAGES            4096
+#define MM_TEST_LARGE_PAGES             512
+#define MM_TEST_MAX_BATCH               8
+/* Targets are placed above 4G and below 1T */
+#define MM_TEST_TGT_BASE                0x100000000ULL
+#define MM_TEST_TGT_PAGES               (1 << 26)
+
+/* Values returned for ranges inserted by mam_insert_not_existing_range */
+#define MM_TEST_REASON_BASE             ((mam_mapping_result_t)0x10)
+#define MM_TEST_REASON_COUNT            3
+/* Model value of EPT pages whose permissions were all removed. MAM reports
+ * them as not mapped, with the high part of the leaf as the reason */
+#define MM_TEST_NO_ACCESS               ((mam_mapping_result_t)0x0f)
+
+#define MM_TEST_HASH_KEYS               1024
+#define MM_TEST_POOL_LIVE               2048
+
+typedef boolean_t (*mm_test_func_t) (IN uint64_t seed, IN uint32_t num_of_ops);
+
+/*---------------------------------------------------------------------------
+ * Random ranges inside the window
+ *---------------------------------------------------------------------------*/
+
+static
+mam_attributes_t mm_test_rand_attrs(IN OUT uint64_t *seed)
+{
+	mam_attributes_t attrs;
+
+	attrs.uint32 = 0;
+	/* keep readable set: EPT entries without any permission are not
+	 * present and can't be told apart from unmapped ones */
+	attrs.ept_attr.readable = 1;
+	attrs.ept_attr.writable = (uint32_t)host_test_rand_range(seed, 2);
+	attrs.ept_attr.executable = (uint32_t)host_test_rand_range(seed, 2);
+	attrs.ept_attr.emt = host_test_rand_range(seed, 4) ?
+			     MON_PHYS_MEM_WRITE_BACK : MON_PHYS_MEM_UNCACHED;
+	return attrs;
+}
+
+static
+void mm_test_rand_range_in_window(IN OUT uint64_t *seed,
+				  OUT uint32_t *first_page,
+				  OUT uint32_t *num_of_pages)
+{
+	uint32_t first, count;
+
+	if (host_test_rand_range(seed, 3) == 0) {
+		/* 2M aligned range, candidate for large leaves */
+		first = (uint32_t)host_test_rand_range(seed,
+			MM_TEST_WINDOW_PAGES / MM_TEST_LARGE_PAGES);
+		count = (uint32_t)host_test_rand_range(seed, 2) + 1;
+		first *= MM_TEST_LARGE_PAGES;
+		count *= MM_TEST_LARGE_PAGES;
+	} else {
+		first = (uint32_t)host_test_rand_range(seed,
+			MM_TEST_WINDOW_PAGES);
+		count = (uint32_t)host_test_rand_range(seed,
+			host_test_rand_range(seed, 4) ? 16 : 1024) + 1;
+	}
+
+	*first_page = first;
+	*num_of_pages = MIN(count, MM_TEST_WINDOW_PAGES - first);
+}
+
+static
+uint64_t mm_test_rand_tgt(IN OUT uint64_t *seed, IN uint32_t first_page)
+{
+	uint64_t tgt_page = host_test_rand_range(seed, MM_TEST_TGT_PAGES);
+
+	if ((first_page % MM_TEST_LARGE_PAGES) == 0) {
+		/* Keep the same 2M offset so large leaves are possible */
+		tgt_page &= ~((uint64_t)MM_TEST_LARGE_PAGES - 1);
+	}
+	return MM_TEST_TGT_BASE + tgt_page * PAGE_4KB_SIZE;
+}
+
+/*---------------------------------------------------------------------------
+ * MAM
+ *---------------------------------------------------------------------------*/
+
+typedef struct {
+	uint64_t		tgt_addr;
+	mam_attributes_t	attrs;
+	mam_mapping_result_t	result;
+	/* written since the dirty flags were last cleared (EPT only) */
+	boolean_t		dirty;
+	uint32_t		padding;
+} mm_test_mam_page_t;
+
+typedef struct {
+	mam_handle_t		mam;
+	mm_test_mam_page_t	*model;
+	uint64_t		seed;
+	boolean_t		is_ept;
+	uint32_t		padding;
+} mm_test_mam_t;
+
+static
+void mm_test_mam_model_map(IN mm_test_mam_t *test,
+			   IN uint32_t first_page,
+			   IN uint32_t num_of_pages,
+			   IN uint64_t tgt_addr,
+			   IN mam_attributes_t attrs)
+{
+	uint32_t i;
+
+	for (i = 0; i < num_of_pages; i++) {
+		mm_test_mam_page_t *page = &test->model[first_page + i];
+
+		page->tgt_addr = tgt_addr + (uint64_t)i * PAGE_4KB_SIZE;
+		page->attrs = attrs;
+		page->result = MAM_MAPPING_SUCCESSFUL;
+		page->dirty = TRUE;
+	}
+}
+
+static
+boolean_t mm_test_mam_insert(IN mm_test_mam_t *test)
+{
+	uint32_t first_page, num_of_pages;
+	uint64_t tgt_addr;
+	mam_attributes_t attrs;
+
+	mm_test_rand_range_in_window(&test->seed, &first_page, &num_of_pages);
+	tgt_addr = mm_test_rand_tgt(&test->seed, first_page);
+	attrs = mm_test_rand_attrs(&test->seed);
+
+	mm_test_mam_model_map(test, first_page, num_of_pages, tgt_addr, attrs);
+	return mam_insert_range(test->mam,
+		(uint64_t)first_page * PAGE_4KB_SIZE,
+		tgt_addr, (uint64_t)num_of_pages * PAGE_4KB_SIZE, attrs);
+}
+
+static
+boolean_t mm_test_mam_insert_batch(IN mm_test_mam_t *test)
+{
+	mam_range_desc_t ranges[MM_TEST_MAX_BATCH];
+	uint32_t count = 0;
+	uint32_t first_page, num_of_pages;
+	uint64_t tgt_addr;
+	mam_attributes_t attrs;
+	uint32_t max_count = (uint32_t)host_test_rand_range(&test->seed,
+		MM_TEST_MAX_BATCH) + 1;
+
+	mm_test_rand_range_in_window(&test->seed, &first_page, &num_of_pages);
+	tgt_addr = mm_test_rand_tgt(&test->seed, first_page);
+	attrs = mm_test_rand_attrs(&test->seed);
+
+	/* Sorted vector; neighbours are often contiguous with equal
+	 * attributes to exercise coalescing */
+	while ((count < max_count) && (first_page < MM_TEST_WINDOW_PAGES)) {
+		num_of_pages = MIN(num_of_pages,
+			MM_TEST_WINDOW_PAGES - first_page);
+
+		ranges[count].src_addr = (uint64_t)first_page * PAGE_4KB_SIZE;
+		ranges[count].tgt_addr = tgt_addr;
+		ranges[count].size = (uint64_t)num_of_pages * PAGE_4KB_SIZE;
+		ranges[count].attrs = attrs;
+		ranges[count].padding = 0;
+		mm_test_mam_model_map(test, first_page, num_of_pages,
+			tgt_addr, attrs);
+		count++;
+
+		tgt_addr += ranges[count - 1].size;
+		first_page += num_of_pages;
+		if (host_test_rand_range(&test->seed, 4) == 0) {
+			/* hole */
+			first_page += (uint32_t)host_test_rand_range(
+				&test->seed, 8) + 1;
+		}
+		if (host_test_rand_range(&test->seed, 4) == 0) {
+			tgt_addr = mm_test_rand_tgt(&test->seed, first_page);
+		}
+		if (host_test_rand_range(&test->seed, 4) == 0) {
+			attrs = mm_test_rand_attrs(&test->seed);
+		}
+		num_of_pages = (uint32_t)host_test_rand_range(&test->seed,
+			64) + 1;
+	}
+
+	return mam_insert_ranges(test->mam, ranges, count);
+}
+
+static
+boolean_t mm_test_mam_insert_not_existing(IN mm_test_mam_t *test)
+{
+	uint32_t first_page, num_of_pages, i;
+	mam_mapping_result_t reason = MM_TEST_REASON_BASE +
+				      (mam_mapping_result_t)
+				      host_test_rand_range(&test->seed,
+		MM_TEST_REASON_COUNT);
+
+	mm_test_rand_range_in_window(&test->seed, &first_page, &num_of_pages);
+
+	for (i = 0; i < num_of_pages; i++) {
+		test->model[first_page + i].result = reason;
+	}
+	return mam_insert_not_existing_range(test->mam,
+		(uint64_t)first_page * PAGE_4KB_SIZE,
+		(uint64_t)num_of_pages * PAGE_4KB_SIZE, reason);
+}
+
+static
+boolean_t mm_test_mam_change_permissions(IN mm_test_mam_t *test,
+					 IN boolean_t add)
+{
+	uint32_t first_page, num_of_pages, i;
+	mam_attributes_t attrs;
+
+	mm_test_rand_range_in_window(&test->seed, &first_page, &num_of_pages);
+
+	attrs.uint32 = 0;
+	attrs.ept_attr.writable = (uint32_t)host_test_rand_range(
+		&test->seed, 2);
+	attrs.ept_attr.executable = !attrs.ept_attr.writable;
+
+	for (i = 0; i < num_of_pages; i++) {
+		mm_test_mam_page_t *page = &test->model[first_page + i];
+
+		if (page->result != MAM_MAPPING_SUCCESSFUL) {
+			continue;
+		}
+		if (add) {
+			page->attrs.uint32 |= attrs.uint32;
+		} else {
+			page->attrs.uint32 &= ~attrs.uint32;
+		}
+	}
+
+	if (add) {
+		return mam_add_permissions_to_existing_mapping(test->mam,
+			(uint64_t)first_page * PAGE_4KB_SIZE,
+			(uint64_t)num_of_pages * PAGE_4KB_SIZE, attrs);
+	}
+	return mam_remove_permissions_from_existing_mapping(test->mam,
+		(uint64_t)first_page * PAGE_4KB_SIZE,
+		(uint64_t)num_of_pages * PAGE_4KB_SIZE, attrs);
+}
+
+static
+boolean_t mm_test_mam_change_permissions_in_place(IN mm_test_mam_t *test)
+{
+	uint32_t first_page, num_of_pages, i;
+	mam_attributes_t attrs_to_set;
+	mam_attributes_t attrs_to_clear;
+
+	mm_test_rand_range_in_window(&test->seed, &first_page, &num_of_pages);
+
+	attrs_to_set.uint32 = 0;
+	attrs_to_clear.uint32 = 0;
+	if (host_test_rand_range(&test->seed, 2)) {
+		attrs_to_set.ept_attr.writable = 1;
+		attrs_to_clear.ept_attr.executable =
+			(uint32_t)host_test_rand_range(&test->seed, 2);
+	} else {
+		attrs_to_clear.ept_attr.writable = 1;
+		attrs_to_set.ept_attr.executable =
+			(uint32_t)host_test_rand_range(&test->seed, 2);
+	}
+
+	if (!mam_update_permissions_in_place(test->mam,
+		    (uint64_t)first_page * PAGE_4KB_SIZE,
+		    (uint64_t)num_of_pages * PAGE_4KB_SIZE,
+		    attrs_to_set, attrs_to_clear)) {
+		/* a large leaf is partly covered, nothing may change */
+		return TRUE;
+	}
+
+	for (i = 0; i < num_of_pages; i++) {
+		mm_test_mam_page_t *page = &test->model[first_page + i];
+
+		if (page->result != MAM_MAPPING_SUCCESSFUL) {
+			continue;
+		}
+		page->attrs.uint32 |= attrs_to_set.uint32;
+		page->attrs.uint32 &= ~attrs_to_clear.uint32;
+	}
+	return TRUE;
+}
+
+/*
+ * Remove all the permissions from the start of a clean 2M region. The
+ * first entry of a table decides how the whole table is read, so the
+ * other pages only keep verifying while the emptied leaf is still typed
+ * as EPT entry.
+ */
+static
+boolean_t mm_test_mam_clear_all_permissions(IN mm_test_mam_t *test)
+{
+	uint32_t first_page, num_of_pages, i;
+	mam_attributes_t attrs;
+	boolean_t res;
+
+	first_page = (uint32_t)host_test_rand_range(&test->seed,
+		MM_TEST_WINDOW_PAGES / MM_TEST_LARGE_PAGES) *
+		     MM_TEST_LARGE_PAGES;
+	num_of_pages = (uint32_t)host_test_rand_range(&test->seed,
+		MM_TEST_LARGE_PAGES - 1) + 1;
+
+	/* clean every leaf of the region, large ones included */
+	if (!mam_get_ept_dirty_pages(test->mam,
+		    (uint64_t)first_page * PAGE_4KB_SIZE,
+		    (uint64_t)MM_TEST_LARGE_PAGES * PAGE_4KB_SIZE, NULL,
+		    TRUE)) {
+		return FALSE;
+	}
+	for (i = 0; i < MM_TEST_LARGE_PAGES; i++) {
+		test->model[first_page + i].dirty = FALSE;
+	}
+
+	attrs.uint32 = 0;
+	attrs.ept_attr.readable = 1;
+	attrs.ept_attr.writable = 1;
+	attrs.ept_attr.executable = 1;
+
+	if (host_test_rand_range(&test->seed, 2)) {
+		res = mam_remove_permissions_from_existing_mapping(test->mam,
+			(uint64_t)first_page * PAGE_4KB_SIZE,
+			(uint64_t)num_of_pages * PAGE_4KB_SIZE, attrs);
+	} else {
+		mam_attributes_t no_attrs;
+
+		no_attrs.uint32 = 0;
+		if (!mam_update_permissions_in_place(test->mam,
+			    (uint64_t)first_page * PAGE_4KB_SIZE,
+			    (uint64_t)num_of_pages * PAGE_4KB_SIZE,
+			    no_attrs, attrs)) {
+			/* a large leaf is partly covered, nothing may change */
+			return TRUE;
+		}
+		res = TRUE;
+	}
+
+	for (i = 0; i < num_of_pages; i++) {
+		mm_test_mam_page_t *page = &test->model[first_page + i];
+
+		if (page->result == MAM_MAPPING_SUCCESSFUL) {
+			page->result = MM_TEST_NO_ACCESS;
+		}
+	}
+	return res;
+}
+
+/* whether every leaf which may map the page lies inside the range */
+static
+boolean_t mm_test_mam_leaves_inside(IN uint32_t first_page,
+				    IN uint32_t num_of_pages,
+				    IN uint32_t page)
+{
+	uint32_t pages_per_leaf[] = { PAGE_2MB_SIZE / PAGE_4KB_SIZE,
+				      PAGE_1GB_SIZE / PAGE_4KB_SIZE };
+	uint32_t i, leaf_first_page;
+
+	for (i = 0; i < ARRAY_SIZE(pages_per_leaf); i++) {
+		leaf_first_page = ALIGN_BACKWARD(page, pages_per_leaf[i]);
+		if ((leaf_first_page < first_page) ||
+		    (leaf_first_page + pages_per_leaf[i] >
+		     first_page + num_of_pages)) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/*
+ * Clear the EPT dirty flags of a random range. Every page mapped since the
+ * previous clearing must be reported (more may be, e.g. after a split) and
+ * right after the clearing only pages of large leaves sticking out of the
+ * range, which are not cleared, may be.
+ */
+static
+boolean_t mm_test_mam_clear_dirty(IN mm_test_mam_t *test)
+{
+	uint64_t bitmap[MM_TEST_WINDOW_PAGES / 64];
+	uint32_t first_page, num_of_pages, i;
+
+	mm_test_rand_range_in_window(&test->seed, &first_page, &num_of_pages);
+
+	mon_zeromem(bitmap, sizeof(bitmap));
+	HOST_TEST_CHECK(mam_get_ept_dirty_pages(test->mam,
+			(uint64_t)first_page * PAGE_4KB_SIZE,
+			(uint64_t)num_of_pages * PAGE_4KB_SIZE, bitmap, TRUE),
+		"mam_get_ept_dirty_pages failed");
+	for (i = 0; i < num_of_pages; i++) {
+		mm_test_mam_page_t *page = &test->model[first_page + i];
+
+		HOST_TEST_CHECK((page->result != MAM_MAPPING_SUCCESSFUL) ||
+			!page->dirty || BITMAP_ARRAY64_GET(bitmap, i),
+			"dirty page 0x%llx not reported",
+			(uint64_t)(first_page + i) * PAGE_4KB_SIZE);
+		page->dirty = FALSE;
+	}
+
+	mon_zeromem(bitmap, sizeof(bitmap));
+	HOST_TEST_CHECK(mam_get_ept_dirty_pages(test->mam,
+			(uint64_t)first_page * PAGE_4KB_SIZE,
+			(uint64_t)num_of_pages * PAGE_4KB_SIZE, bitmap, FALSE),
+		"mam_get_ept_dirty_pages failed");
+	for (i = 0; i < num_of_pages; i++) {
+		if (BITMAP_ARRAY64_GET(bitmap, i)) {
+			HOST_TEST_CHECK(!mm_test_mam_leaves_inside(first_page,
+					num_of_pages, first_page + i),
+				"page 0x%llx dirty after clearing",
+				(uint64_t)(first_page + i) * PAGE_4KB_SIZE);
+			test->model[first_page + i].dirty = TRUE;
+		}
+	}
+	return TRUE;
+}
+
+static
+boolean_t mm_test_mam_verify(IN mm_test_mam_t *test, IN uint32_t op)
+{
+	uint32_t i;
+
+	for (i = 0; i < MM_TEST_WINDOW_PAGES; i++) {
+		mm_test_mam_page_t *page = &test->model[i];
+		uint64_t tgt_addr = 0;
+		mam_attributes_t attrs;
+		mam_mapping_result_t result;
+
+		attrs.uint32 = 0;
+		result = mam_get_mapping(test->mam,
+			(uint64_t)i * PAGE_4KB_SIZE, &tgt_addr, &attrs);
+
+		if ((page->result == MM_TEST_NO_ACCESS) ?
+		    (result == MAM_MAPPING_SUCCESSFUL) :
+		    ((result != page->result) ||
+		     ((result == MAM_MAPPING_SUCCESSFUL) &&
+		      ((tgt_addr != page->tgt_addr) ||
+		       (attrs.uint32 != page->attrs.uint32))))) {
+			printf("mam (%s) failed after op %u at 0x%llx:\n",
+				test->is_ept ? "ept" : "internal", op,
+				(uint64_t)i * PAGE_4KB_SIZE);
+			printf("  expected result 0x%x tgt 0x%llx attrs 0x%x\n",
+				page->result, page->tgt_addr,
+				page->attrs.uint32);
+			printf("  actual   result 0x%x tgt 0x%llx attrs 0x%x\n",
+				result, tgt_addr, attrs.uint32);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+static
+boolean_t mm_test_mam_run_ops(IN mm_test_mam_t *test,
+			      IN uint32_t num_of_ops)
+{
+	uint32_t op;
+	boolean_t res = TRUE;
+
+	for (op = 0; op < num_of_ops; op++) {
+		switch (host_test_rand_range(&test->seed,
+				test->is_ept ? 9 : 7)) {
+		case 0:
+		case 1:
+			res = mm_test_mam_insert(test);
+			break;
+		case 2:
+			res = mm_test_mam_insert_batch(test);
+			break;
+		case 3:
+			res = mm_test_mam_insert_not_existing(test);
+			break;
+		case 4:
+			res = mm_test_mam_change_permissions(test, FALSE);
+			break;
+		case 5:
+			res = mm_test_mam_change_permissions_in_place(test);
+			break;
+		case 7:
+			/* EPT only */
+			res = mm_test_mam_clear_dirty(test);
+			break;
+		case 8:
+			/* EPT only */
+			res = mm_test_mam_clear_all_permissions(test);
+			break;
+		default:
+			res = mm_test_mam_change_permissions(test, TRUE);
+			break;
+		}
+
+		HOST_TEST_CHECK(res, "mam operation %u failed", op);
+
+		if (((op + 1) % MM_TEST_VERIFY_INTERVAL) == 0) {
+			if (!mm_test_mam_verify(test, op)) {
+				return FALSE;
+			}
+		}
+	}
+
+	return mm_test_mam_verify(test, op);
+}
+
+static
+boolean_t mm_test_mam(IN uint64_t seed, IN uint32_t num_of_ops)
+{
+	mm_test_mam_t test;
+	uint64_t used_pages = host_page_alloc_get_used_pages();
+	uint64_t ept_root_hpa;
+	uint32_t i;
+	boolean_t res;
+
+	test.seed = seed;
+	test.model = (mm_test_mam_page_t *)mon_memory_alloc(
+		MM_TEST_WINDOW_PAGES * sizeof(mm_test_mam_page_t));
+	HOST_TEST_CHECK(test.model != NULL, "out of memory");
+	for (i = 0; i < MM_TEST_WINDOW_PAGES; i++) {
+		test.model[i].result = MAM_UNKNOWN_MAPPING;
+	}
+
+	test.mam = mam_create_mapping(mam_rwx_attrs);
+	HOST_TEST_CHECK(test.mam != MAM_INVALID_HANDLE, "out of memory");
+
+	test.is_ept = FALSE;
+	res = mm_test_mam_run_ops(&test, num_of_ops);
+
+	if (res) {
+		res = mon_mam_convert_to_ept(test.mam,
+			MAM_EPT_SUPPORT_2MB_PAGE | MAM_EPT_SUPPORT_1GB_PAGE,
+			MAM_EPT_48_BITS_GAW, FALSE, &ept_root_hpa);
+		test.is_ept = TRUE;
+		res = res && mm_test_mam_verify(&test, num_of_ops);
+		res = res && mm_test_mam_run_ops(&test, num_of_ops);
+	}
+
+	mon_mam_destroy_mapping(test.mam);
+	mon_memory_free(test.model);
+
+	HOST_TEST_CHECK(!res ||
+		(host_page_alloc_get_used_pages() == used_pages),
+		"mam leaked %lld pages",
+		host_page_alloc_get_used_pages() - used_pages);
+	return res;
+}
+
+/*---------------------------------------------------------------------------
+ * GPM
+ *---------------------------------------------------------------------------*/
+
+typedef enum {
+	MM_TEST_GPM_UNMAPPED,
+	MM_TEST_GPM_MAPPED,
+	MM_TEST_GPM_MMIO
+} mm_test_gpm_state_t;
+
+typedef struct {
+	hpa_t			hpa;
+	mam_attributes_t	attrs;
+	mm_test_gpm_state_t	state;
+} mm_test_gpm_page_t;
+
+static
+boolean_t mm_test_gpm_verify(IN gpm_handle_t gpm,
+			     IN mm_test_gpm_page_t *model,
+			     IN uint32_t op)
+{
+	uint32_t i;
+
+	for (i = 0; i < MM_TEST_WINDOW_PAGES; i++) {
+		gpa_t gpa = (gpa_t)i * PAGE_4KB_SIZE;
+		hpa_t hpa = 0;
+		hva_t hva = 0;
+		mam_attributes_t attrs;
+		boolean_t mapped;
+
+		attrs.uint32 = 0;
+		mapped = mon_gpm_gpa_to_hpa(gpm, gpa, &hpa, &attrs);
+		HOST_TEST_CHECK(mapped == (model[i].state ==
+					   MM_TEST_GPM_MAPPED),
+			"gpm op %u: gpa 0x%llx is %smapped", op, gpa,
+			mapped ? "" : "not ");
+		HOST_TEST_CHECK(mon_gpm_is_mmio_address(gpm, gpa) ==
+			(model[i].state == MM_TEST_GPM_MMIO),
+			"gpm op %u: wrong MMIO state of gpa 0x%llx", op, gpa);
+		if (!mapped) {
+			HOST_TEST_CHECK(!gpm_gpa_to_hva(gpm, gpa, &hva),
+				"gpm op %u: gpa 0x%llx has a hva", op, gpa);
+			continue;
+		}
+		HOST_TEST_CHECK((hpa == model[i].hpa) &&
+			(attrs.uint32 == model[i].attrs.uint32),
+			"gpm op %u: gpa 0x%llx -> 0x%llx/0x%x, expected "
+			"0x%llx/0x%x", op, gpa, hpa, attrs.uint32,
+			model[i].hpa, model[i].attrs.uint32);
+		HOST_TEST_CHECK(gpm_gpa_to_hva(gpm, gpa, &hva) &&
+			(hva == (hva_t)hpa),
+			"gpm op %u: wrong hva of gpa 0x%llx", op, gpa);
+	}
+	return TRUE;
+}
+
+/*
+ * The ranges iterator must return each mapped or MMIO page exactly once,
+ * in ranges of one kind with contiguous HPAs and equal attributes.
+ */
+static
+boolean_t mm_test_gpm_verify_iterator(IN gpm_handle_t gpm,
+				      IN mm_test_gpm_page_t *model)
+{
+	gpm_ranges_iterator_t iter = gpm_get_ranges_iterator(gpm);
+	uint32_t next_page = 0;
+	uint32_t i;
+
+	while (iter != GPM_INVALID_RANGES_ITERATOR) {
+		gpa_t gpa;
+		uint64_t size;
+		uint32_t first, count;
+
+		iter = gpm_get_range_details_from_iterator(gpm, iter, &gpa,
+			&size);
+		HOST_TEST_CHECK((size != 0) && ((gpa & PAGE_4KB_MASK) == 0) &&
+			((size & PAGE_4KB_MASK) == 0),
+			"gpm iterator: bad range 0x%llx size 0x%llx", gpa,
+			size);
+		/* outside the window everything is unmapped */
+		HOST_TEST_CHECK(gpa < (gpa_t)MM_TEST_WINDOW_PAGES *
+			PAGE_4KB_SIZE,
+			"gpm iterator: range 0x%llx outside the map", gpa);
+
+		first = (uint32_t)(gpa / PAGE_4KB_SIZE);
+		count = (uint32_t)MIN(size / PAGE_4KB_SIZE,
+			MM_TEST_WINDOW_PAGES - first);
+		HOST_TEST_CHECK(first >= next_page,
+			"gpm iterator: range 0x%llx overlaps the previous one",
+			gpa);
+		for (i = next_page; i < first; i++) {
+			HOST_TEST_CHECK(model[i].state == MM_TEST_GPM_UNMAPPED,
+				"gpm iterator: skipped page 0x%llx",
+				(uint64_t)i * PAGE_4KB_SIZE);
+		}
+		HOST_TEST_CHECK(model[first].state != MM_TEST_GPM_UNMAPPED,
+			"gpm iterator: range 0x%llx is not mapped", gpa);
+		for (i = first; i < first + count; i++) {
+			HOST_TEST_CHECK((model[i].state == model[first].state) &&
+				((model[i].state != MM_TEST_GPM_MAPPED) ||
+				 ((model[i].hpa == model[first].hpa +
+				   (uint64_t)(i - first) * PAGE_4KB_SIZE) &&
+				  (model[i].attrs.uint32 ==
+				   model[first].attrs.uint32))),
+				"gpm iterator: range 0x%llx size 0x%llx is not "
+				"uniform at 0x%llx", gpa, size,
+				(uint64_t)i * PAGE_4KB_SIZE);
+		}
+		next_page = first + count;
+	}
+
+	for (i = next_page; i < MM_TEST_WINDOW_PAGES; i++) {
+		HOST_TEST_CHECK(model[i].state == MM_TEST_GPM_UNMAPPED,
+			"gpm iterator: skipped page 0x%llx",
+			(uint64_t)i * PAGE_4KB_SIZE);
+	}
+	return TRUE;
+}
+
+static
+boolean_t mm_test_gpm(IN uint64_t seed, IN uint32_t num_of_ops)
+{
+	mm_test_gpm_page_t *model;
+	gpm_handle_t gpm, copy;
+	uint32_t generation;
+	uint32_t op, i;
+
+	model = (mm_test_gpm_page_t *)mon_memory_alloc(
+		MM_TEST_WINDOW_PAGES * sizeof(mm_test_gpm_page_t));
+	HOST_TEST_CHECK(model != NULL, "out of memory");
+
+	gpm = mon_gpm_create_mapping();
+	HOST_TEST_CHECK(gpm != GPM_INVALID_HANDLE, "out of memory");
+
+	for (op = 0; op < num_of_ops; op++) {
+		uint32_t first_page, num_of_pages;
+		mm_test_gpm_page_t page;
+		gpa_t gpa;
+		uint64_t size;
+		boolean_t res;
+
+		mm_test_rand_range_in_window(&seed, &first_page,
+			&num_of_pages);
+		gpa = (gpa_t)first_page * PAGE_4KB_SIZE;
+		size = (uint64_t)num_of_pages * PAGE_4KB_SIZE;
+		page.hpa = 0;
+		page.attrs.uint32 = 0;
+		generation = gpm_get_generation(gpm);
+
+		switch (host_test_rand_range(&seed, 4)) {
+		case 0:
+			page.state = MM_TEST_GPM_UNMAPPED;
+			res = mon_gpm_remove_mapping(gpm, gpa, size);
+			break;
+		case 1:
+			page.state = MM_TEST_GPM_MMIO;
+			res = gpm_add_mmio_range(gpm, gpa, size);
+			break;
+		default:
+			page.state = MM_TEST_GPM_MAPPED;
+			page.hpa = mm_test_rand_tgt(&seed, first_page);
+			page.attrs = mm_test_rand_attrs(&seed);
+			res = mon_gpm_add_mapping(gpm, gpa, page.hpa, size,
+				page.attrs);
+			break;
+		}
+		HOST_TEST_CHECK(res, "gpm operation %u failed", op);
+		HOST_TEST_CHECK(gpm_get_generation(gpm) != generation,
+			"gpm generation not changed by operation %u", op);
+
+		for (i = 0; i < num_of_pages; i++) {
+			model[first_page + i] = page;
+			if (page.state == MM_TEST_GPM_MAPPED) {
+				model[first_page + i].hpa +=
+					(uint64_t)i * PAGE_4KB_SIZE;
+			}
+		}
+
+		if (((op + 1) % MM_TEST_VERIFY_INTERVAL) == 0) {
+			if (!mm_test_gpm_verify(gpm, model, op) ||
+			    !mm_test_gpm_verify_iterator(gpm, model)) {
+				return FALSE;
+			}
+		}
+	}
+
+	if (!mm_test_gpm_verify(gpm, model, op) ||
+	    !mm_test_gpm_verify_iterator(gpm, model)) {
+		return FALSE;
+	}
+
+	/* mon_gpm_copy() is built on the iterator */
+	copy = mon_gpm_create_mapping();
+	HOST_TEST_CHECK(copy != GPM_INVALID_HANDLE, "out of memory");
+	HOST_TEST_CHECK(mon_gpm_copy(gpm, copy, FALSE, mam_no_attributes),
+		"mon_gpm_copy failed");
+	if (!mm_test_gpm_verify(copy, model, op)) {
+		return FALSE;
+	}
+
+	mon_memory_free(model);
+	return TRUE;
+}
+
+/*---------------------------------------------------------------------------
+ * hash64
+ *---------------------------------------------------------------------------*/
+
+typedef struct {
+	uint64_t	key;
+	uint64_t	value;
+	boolean_t	present;
+	uint32_t	padding;
+} mm_test_hash_key_t;
+
+static
+uint32_t mm_test_hash_func(uint64_t key, uint32_t size)
+{
+	return (uint32_t)(key % size);
+}
+
+static
+void *mm_test_hash_mem_alloc(uint32_t size)
+{
+	return mon_memory_alloc(size);
+}
+
+static
+void mm_test_hash_mem_free(void *data)
+{
+	mon_memory_free(data);
+}
+
+static
+void *mm_test_hash_node_alloc(void *context)
+{
+	return mon_memory_alloc(hash64_get_node_size());
+}
+
+static
+void mm_test_hash_node_free(void *context, void *data)
+{
+	mon_memory_free(data);
+}
+
+static
+boolean_t mm_test_hash_verify(IN hash64_handle_t hash,
+			      IN mm_test_hash_key_t *keys,
+			      IN uint32_t num_of_present,
+			      IN const char *name)
+{
+	uint32_t i;
+
+	HOST_TEST_CHECK(hash64_get_num_of_elements(hash) == num_of_present,
+		"%s hash has %u elements, expected %u", name,
+		hash64_get_num_of_elements(hash), num_of_present);
+	HOST_TEST_CHECK(hash64_is_empty(hash) == (num_of_present == 0),
+		"%s hash emptiness is wrong", name);
+
+	for (i = 0; i < MM_TEST_HASH_KEYS; i++) {
+		uint64_t value = 0;
+		boolean_t found = hash64_lookup(hash, keys[i].key, &value);
+
+		HOST_TEST_CHECK(found == keys[i].present,
+			"%s hash: key 0x%llx is %sfound", name, keys[i].key,
+			found ? "" : "not ");
+		HOST_TEST_CHECK(!found || (value == keys[i].value),
+			"%s hash: key 0x%llx has value 0x%llx, expected 0x%llx",
+			name, keys[i].key, value, keys[i].value);
+	}
+	return TRUE;
+}
+
+static
+boolean_t mm_test_hash_run(IN hash64_handle_t hash,
+			   IN boolean_t is_open,
+			   IN uint64_t seed,
+			   IN uint32_t num_of_ops)
+{
+	const char *name = is_open ? "open" : "chained";
+	mm_test_hash_key_t *keys;
+	uint32_t num_of_present = 0;
+	uint32_t op, i;
+
+	keys = (mm_test_hash_key_t *)mon_memory_alloc(
+		MM_TEST_HASH_KEYS * sizeof(mm_test_hash_key_t));
+	HOST_TEST_CHECK(keys != NULL, "out of memory");
+
+	/* small numbers, page addresses (pool), wide and random keys */
+	for (i = 0; i < MM_TEST_HASH_KEYS; i++) {
+		switch (i % 4) {
+		case 0:
+			keys[i].key = i;
+			break;
+		case 1:
+			keys[i].key = (uint64_t)i * PAGE_4KB_SIZE;
+			break;
+		case 2:
+			keys[i].key = (uint64_t)i << 32;
+			break;
+		default:
+			keys[i].key = host_test_rand(&seed) | 1;
+			break;
+		}
+	}
+
+	for (op = 0; op < num_of_ops * 4; op++) {
+		mm_test_hash_key_t *key =
+			&keys[host_test_rand_range(&seed, MM_TEST_HASH_KEYS)];
+		uint64_t value = host_test_rand(&seed);
+
+		switch (host_test_rand_range(&seed, 8)) {
+		case 0:
+		case 1:
+		case 2:
+			/* insert if missing, update otherwise */
+			if (key->present) {
+				HOST_TEST_CHECK(hash64_update(hash, key->key,
+						value), "%s hash update failed",
+					name);
+			} else {
+				HOST_TEST_CHECK(hash64_insert(hash, key->key,
+						value), "%s hash insert failed",
+					name);
+				key->present = TRUE;
+				num_of_present++;
+			}
+			key->value = value;
+			break;
+		case 3:
+			/* update inserts missing keys */
+			HOST_TEST_CHECK(hash64_update(hash, key->key, value),
+				"%s hash update failed", name);
+			if (!key->present) {
+				key->present = TRUE;
+				num_of_present++;
+			}
+			key->value = value;
+			break;
+		case 4:
+		case 5:
+			if (key->present) {
+				HOST_TEST_CHECK(hash64_remove(hash, key->key),
+					"%s hash remove failed", name);
+				key->present = FALSE;
+				num_of_present--;
+			} else if (is_open) {
+				/* the chained hash asserts on missing keys */
+				HOST_TEST_CHECK(!hash64_remove(hash, key->key),
+					"%s hash removed a missing key", name);
+			}
+			break;
+		case 6:
+			if (host_test_rand_range(&seed, 16) == 0) {
+				HOST_TEST_CHECK(hash64_change_size_and_rehash(
+						hash, (uint32_t)
+						host_test_rand_range(&seed,
+							2 * MM_TEST_HASH_KEYS) +
+						1), "%s hash resize failed",
+					name);
+			}
+			break;
+		default:
+			break;
+		}
+
+		if (((op + 1) % MM_TEST_VERIFY_INTERVAL) == 0) {
+			if (!mm_test_hash_verify(hash, keys, num_of_present,
+				    name)) {
+				return FALSE;
+			}
+		}
+	}
+
+	if (!mm_test_hash_verify(hash, keys, num_of_present, name)) {
+		return FALSE;
+	}
+
+	for (i = 0; i < MM_TEST_HASH_KEYS; i++) {
+		if (keys[i].present) {
+			HOST_TEST_CHECK(hash64_remove(hash, keys[i].key),
+				"%s hash remove failed", name);
+			keys[i].present = FALSE;
+		}
+	}
+	if (!mm_test_hash_verify(hash, keys, 0, name)) {
+		return FALSE;
+	}
+
+	mon_memory_free(keys);
+	return TRUE;
+}
+
+static
+boolean_t mm_test_hash(IN uint64_t seed, IN uint32_t num_of_ops)
+{
+	uint64_t used_pages = host_page_alloc_get_used_pages();
+	hash64_handle_t hash;
+	boolean_t res;
+
+	hash = hash64_create_open_hash((uint32_t)host_test_rand_range(&seed,
+		64) + 1);
+	HOST_TEST_CHECK(hash != HASH64_INVALID_HANDLE, "out of memory");
+	res = mm_test_hash_run(hash, TRUE, seed, num_of_ops);
+	hash64_destroy_hash(hash);
+	if (!res) {
+		return FALSE;
+	}
+
+	hash = hash64_create_hash(mm_test_hash_func, mm_test_hash_mem_alloc,
+		mm_test_hash_mem_free, mm_test_hash_node_alloc,
+		mm_test_hash_node_free, NULL,
+		(uint32_t)host_test_rand_range(&seed, 256) + 1);
+	HOST_TEST_CHECK(hash != HASH64_INVALID_HANDLE, "out of memory");
+	res = mm_test_hash_run(hash, FALSE, seed, num_of_ops);
+	hash64_destroy_hash(hash);
+	if (!res) {
+		return FALSE;
+	}
+
+	HOST_TEST_CHECK(host_page_alloc_get_used_pages() == used_pages,
+		"hash64 leaked %lld pages",
+		host_page_alloc_get_used_pages() - used_pages);
+	return TRUE;
+}
+
+/*---------------------------------------------------------------------------
+ * pool
+ *---------------------------------------------------------------------------*/
+
+typedef struct {
+	uint64_t	*element;
+	uint64_t	tag;
+} mm_test_pool_element_t;
+
+/* Each live element is filled with its tag, so elements handed out twice
+ * or overlapping each other show up as changed contents */
+static
+boolean_t mm_test_pool_check_element(IN mm_test_pool_element_t *live,
+				     IN uint32_t element_size)
+{
+	uint32_t i;
+
+	for (i = 0; i < element_size / sizeof(uint64_t); i++) {
+		HOST_TEST_CHECK(live->element[i] == live->tag,
+			"pool element %p changed while allocated",
+			live->element);
+	}
+	return TRUE;
+}
+
+static
+boolean_t mm_test_pool_run(IN pool_handle_t pool,
+			   IN uint32_t element_size,
+			   IN uint64_t seed,
+			   IN uint32_t num_of_ops)
+{
+	mm_test_pool_element_t *live;
+	uint64_t tag = 0;
+	uint32_t op, i;
+
+	live = (mm_test_pool_element_t *)mon_memory_alloc(
+		MM_TEST_POOL_LIVE * sizeof(mm_test_pool_element_t));
+	HOST_TEST_CHECK(live != NULL, "out of memory");
+
+	for (op = 0; op < num_of_ops * 4; op++) {
+		mm_test_pool_element_t *slot =
+			&live[host_test_rand_range(&seed, MM_TEST_POOL_LIVE)];
+
+		if (slot->element != NULL) {
+			if (!mm_test_pool_check_element(slot, element_size)) {
+				return FALSE;
+			}
+			pool_free(pool, slot->element);
+			slot->element = NULL;
+			continue;
+		}
+
+		slot->element = (uint64_t *)pool_allocate(pool);
+		HOST_TEST_CHECK(slot->element != NULL,
+			"pool allocation %u failed", op);
+		HOST_TEST_CHECK((((address_t)slot->element & PAGE_4KB_MASK) +
+				 element_size) <= PAGE_4KB_SIZE,
+			"pool element %p crosses a page", slot->element);
+		slot->tag = ++tag;
+		for (i = 0; i < element_size / sizeof(uint64_t); i++) {
+			slot->element[i] = slot->tag;
+		}
+	}
+
+	for (i = 0; i < MM_TEST_POOL_LIVE; i++) {
+		if (live[i].element != NULL) {
+			if (!mm_test_pool_check_element(&live[i],
+				    element_size)) {
+				return FALSE;
+			}
+			pool_free(pool, live[i].element);
+		}
+	}
+
+	mon_memory_free(live);
+	return TRUE;
+}
+
+static
+boolean_t mm_test_pool(IN uint64_t seed, IN uint32_t num_of_ops)
+{
+	static const uint32_t element_sizes[] = { 8, 24, 64, 200, 1000, 2048 };
+	uint32_t i;
+
+	for (i = 0; i < ARRAY_SIZE(element_sizes); i++) {
+		pool_handle_t pool = (i % 2) ?
+				     assync_pool_create(element_sizes[i]) :
+				     sync_pool_create(element_sizes[i]);
+
+		HOST_TEST_CHECK(pool != POOL_INVALID_HANDLE, "out of memory");
+		if (!mm_test_pool_run(pool, element_sizes[i], seed + i,
+			    num_of_ops)) {
+			printf("pool of %u byte elements failed\n",
+				element_sizes[i]);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+
+int main(int argc, char *argv[])
+{
+	static const struct {
+		const char	*name;
+		mm_test_func_t	func;
+	} tests[] = {
+		{ "mam",    mm_test_mam },
+		{ "gpm",    mm_test_gpm },
+		{ "hash64", mm_test_hash },
+		{ "pool",   mm_test_pool },
+	};
+	uint32_t num_of_ops = (uint32_t)host_test_arg(argc, argv, 1,
+		MM_TEST_DEFAULT_OPS);
+	uint64_t seed = host_test_arg(argc, argv, 2, MM_TEST_DEFAULT_SEED);
+	uint32_t num_of_rounds = (uint32_t)host_test_arg(argc, argv, 3,
+		MM_TEST_DEFAULT_ROUNDS);
+	uint32_t round, i;
+
+	if (seed == 0) {
+		seed = 1;
+	}
+	printf("mm_test: %u rounds of %u operations, seed 0x%llx\n",
+		num_of_rounds, num_of_ops, seed);
+
+	for (round = 0; round < num_of_rounds; round++) {
+		for (i = 0; i < ARRAY_SIZE(tests); i++) {
+			if (!tests[i].func(host_test_rand(&seed), num_of_ops)) {
+				printf("mm_test: %s FAILED in round %u\n",
+					tests[i].name, round);
+				return 1;
+			}
+		}
+	}
+
+	printf("mm_test: PASSED\n");
+	return 0;
+}